@@ -66,6 +66,15 @@ extern "C" {
 #define MFU_CHUNK_SIZE_STR "4MB"
 #define MFU_CHUNK_SIZE (4*1024*1024)
 
+/* when picking chunk sizes adaptively, target number of chunks
+ * per process, smallest alignment of a chunk, largest chunk, and
+ * weight added to each chunk to account for the cost of opening
+ * its file */
+#define MFU_CHUNKS_PER_RANK (8)
+#define MFU_CHUNK_ALIGN (1024*1024)
+#define MFU_CHUNK_SIZE_MAX (1024ULL*1024*1024)
+#define MFU_CHUNK_WEIGHT_OVERHEAD (64*1024)
+
 /* default buffer size to read/write data to file system */
 #define MFU_BUFFER_SIZE_STR "4MB"
 #define MFU_BUFFER_SIZE (4*1024*1024)
@@ -208,6 +217,30 @@ int mfu_flist_walk_param_paths(
     mfu_file_t* mfu_file          /* IN  - I/O filesystem functions to use during the walk */
 );
 
+/* create file list by walking list of directories, using a list from
+ * a previous walk of the same paths to skip reading directories whose
+ * mtime and ctime are unchanged, entries of those directories are
+ * taken from prev and stat'ed again, requires stat in walk_opts */
+int mfu_flist_walk_paths_incremental(
+    uint64_t num_paths,         /* IN  - number of paths in array */
+    const char** paths,         /* IN  - array of paths to be walkted */
+    mfu_walk_opts_t* walk_opts, /* IN  - functions to perform during the walk */
+    mfu_flist prev,             /* IN  - list from previous walk of paths */
+    mfu_flist flist,            /* OUT - flist to insert walked items into */
+    mfu_file_t* mfu_file        /* IN  - I/O filesystem functions to use during the walk */
+);
+
+/* given a list of param_paths, walk each one and add to flist,
+ * skipping directories that are unchanged in prev */
+int mfu_flist_walk_param_paths_incremental(
+    uint64_t num,                 /* IN  - number of paths in array */
+    const mfu_param_path* params, /* IN  - array of paths to be walkted */
+    mfu_walk_opts_t* walk_opts,   /* IN  - functions to perform during the walk */
+    mfu_flist prev,               /* IN  - list from previous walk of paths */
+    mfu_flist flist,              /* OUT - flist to insert walked items into */
+    mfu_file_t* mfu_file          /* IN  - I/O filesystem functions to use during the walk */
+);
+
 /* skip function pointer: given a path input, along with user-provided
  * arguments, compute whether to enqueue this file in output list of
  * mfu_flist_stat, return 1 if file should be skipped, 0 if not. */
@@ -279,12 +312,52 @@ void mfu_flist_read_cache(
     mfu_flist flist
 );
 
+/* read file list from file, may drop items that can't satisfy pred
+ * while reading, caller must still apply pred to the list */
+void mfu_flist_read_cache_pred(
+    const char* name,
+    mfu_flist flist,
+    const mfu_pred* pred
+);
+
+/* read list of paths from a text file holding one path per line,
+ * items have no stat data, empty lines are ignored, relative paths
+ * are taken relative to the current working directory, and paths
+ * are reduced as by mfu_path_reduce, aborts if the file can't be read */
+void mfu_flist_read_paths(
+    const char* name,
+    mfu_flist flist
+);
+
 /* write file list to file */
 void mfu_flist_write_cache(
     const char* name,
     mfu_flist flist
 );
 
+/* options to configure how a list is written to a cache file */
+typedef struct {
+    int version;           /* cache format version to write for lists with stat data, 4 (default) or 5 */
+    bool compress;         /* whether to compress blocks of a version 5 cache, implies version 5 */
+    int shards;            /* number of version 5 shard files to write, 1 for a single file, >1 implies version 5 */
+    bool stripe;           /* whether to set lustre striping on shard files */
+    uint64_t stripe_size;  /* size of a single stripe in bytes */
+    int stripe_count;      /* number of stripes, -1 for all devices */
+} mfu_cache_opts_t;
+
+/* return a newly allocated cache opts structure */
+mfu_cache_opts_t* mfu_cache_opts_new(void);
+
+/* free cache options allocated from mfu_cache_opts_new */
+void mfu_cache_opts_delete(mfu_cache_opts_t** popts);
+
+/* write file list to file using given options */
+void mfu_flist_write_cache_opts(
+    const char* name,
+    mfu_flist flist,
+    const mfu_cache_opts_t* opts
+);
+
 /* write file list to text file */
 void mfu_flist_write_text(
     const char* name,
@@ -445,6 +518,14 @@ mfu_flist mfu_flist_remap(mfu_flist list, mfu_flist_map_fn map, const void* args
  * and then returns the newly created list to the caller */
 mfu_flist mfu_flist_spread(mfu_flist flist);
 
+/* merge changes in delta into base by path and return a new list,
+ * items in delta insert or replace items in base with the same path,
+ * paths in removed (may be MFU_FLIST_NULL) are dropped along with the
+ * base items under them, but items in delta are always kept,
+ * lists are sorted together by path so output is in path order,
+ * with the items under each directory directly after it */
+mfu_flist mfu_flist_merge(mfu_flist base, mfu_flist delta, mfu_flist removed);
+
 /* sort flist by specified fields, given as common-delimitted list
  * returns a newly allocated sorted list
  * precede field name with '-' character to reverse sort order:
@@ -453,6 +534,12 @@ mfu_flist mfu_flist_spread(mfu_flist flist);
  *   char fields[] = "size,-name"; */
 mfu_flist mfu_flist_sort(const char* fields, mfu_flist flist);
 
+/* sort flist like mfu_flist_sort, but spill sorted runs to files in dir,
+ * which should be node-local scratch space, and merge them back, so that
+ * sort buffers on each process stay within about bufsize bytes,
+ * returns a newly allocated sorted list */
+mfu_flist mfu_flist_sort_external(const char* fields, mfu_flist flist, const char* dir, size_t bufsize);
+
 /****************************************
  * Functions to create / remove data on file system based on input list
  ****************************************/
@@ -601,6 +688,14 @@ typedef struct mfu_file_chunk_struct {
  * is responsbile for */
 mfu_file_chunk* mfu_file_chunk_list_alloc(mfu_flist list, uint64_t chunk_size);
 
+/* like mfu_file_chunk_list_alloc, but picks a chunk size for each file,
+ * chunk_size is used unless it would give each process many more chunks
+ * than needed to balance load, or leave some processes without a chunk,
+ * each file is then split into equal chunks aligned to its stripe size
+ * when available, and chunks are spread to processes by size rather
+ * than by count */
+mfu_file_chunk* mfu_file_chunk_list_alloc_adaptive(mfu_flist list, uint64_t chunk_size);
+
 /* free the linked list allocated with mfu_file_chunk_list_alloc */
 void mfu_file_chunk_list_free(mfu_file_chunk** phead);
 
@@ -618,6 +713,53 @@ void mfu_file_chunk_list_lor(
     int* results                /* OUT - array of output, storing logical OR across all chunks for each item in flist */
 );
 
+/* name of extended attribute used to store a file digest */
+#define MFU_DIGEST_XATTR "user.mfu.digest"
+
+/* number of uint64_t values in a digest, a SHA-256 hash stored
+ * as big-endian words */
+#define MFU_DIGEST_WORDS (4)
+
+/* flags for mfu_flist_digest */
+#define MFU_DIGEST_LOAD  (1 << 0) /* reuse digests stored on files if still valid */
+#define MFU_DIGEST_STORE (1 << 1) /* store newly computed digests on files */
+
+/* compute a SHA-256 content digest for each regular file in list,
+ * files are split at copy_opts->chunk_size boundaries and chunks
+ * are hashed in parallel, then combined per file on the owner rank,
+ * digests only match between files hashed with the same chunk size,
+ * with MFU_DIGEST_LOAD, a digest stored in MFU_DIGEST_XATTR is used
+ * instead of reading the file if it was recorded for the same size,
+ * mtime, and chunk size as listed in the flist, and for the same
+ * device and inode, so copies of the xattr are not trusted,
+ * returns 0 on success and -1 if any file could not be read */
+int mfu_flist_digest(
+    mfu_flist list,              /* IN  - input flist */
+    int flags,                   /* IN  - MFU_DIGEST_* flags */
+    mfu_copy_opts_t* copy_opts,  /* IN  - chunk size, buffer size, O_DIRECT, O_NOATIME */
+    uint64_t* digests,           /* OUT - MFU_DIGEST_WORDS values for each item in list */
+    int* valid,                  /* OUT - 1 if digest was computed for item, 0 if not a file or error */
+    uint64_t* bytes_read,        /* OUT - number of bytes this process read */
+    mfu_file_t* mfu_file         /* IN  - I/O filesystem functions to use */
+);
+
+/* compute a digest for each item in list as with mfu_flist_digest,
+ * where the digest of a symlink covers its target and the digest of
+ * a directory covers the name, type, size, mtime, and digest of each
+ * item below it, directories are reduced level by level from the
+ * deepest up, so two directories have the same digest only if the
+ * trees below them match, the list must contain all items in the tree,
+ * returns 0 on success and -1 if any item could not be read */
+int mfu_flist_tree_digest(
+    mfu_flist list,              /* IN  - input flist */
+    int flags,                   /* IN  - MFU_DIGEST_* flags */
+    mfu_copy_opts_t* copy_opts,  /* IN  - chunk size, buffer size, O_DIRECT, O_NOATIME */
+    uint64_t* digests,           /* OUT - MFU_DIGEST_WORDS values for each item in list */
+    int* valid,                  /* OUT - 1 if digest was computed for item and all items below it */
+    uint64_t* bytes_read,        /* OUT - number of bytes this process read */
+    mfu_file_t* mfu_file         /* IN  - I/O filesystem functions to use */
+);
+
 /****************************************
  * Functions to read/write list to file or print to screen
  ****************************************/
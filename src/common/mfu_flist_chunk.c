@@ -32,18 +32,48 @@ static int map_chunk_to_rank(uint64_t offset, uint64_t cutoff, uint64_t chunks_p
     return rank;
 }
 
+/* given the weight of all chunks before a chunk, and the weight
+ * each rank should hold, compute and return the rank of the chunk */
+static int map_weight_to_rank(uint64_t offset, uint64_t weight_per_rank, int ranks)
+{
+    uint64_t rank = offset / weight_per_rank;
+    if (rank >= (uint64_t) ranks) {
+        rank = (uint64_t) (ranks - 1);
+    }
+    return (int) rank;
+}
+
+/* weight of a chunk when spreading chunks of different sizes,
+ * the constant term accounts for the per-chunk cost of opening
+ * files, so that many small files are not all sent to one rank */
+static uint64_t chunk_weight(uint64_t chunk_id, uint64_t chunk_size, uint64_t file_size)
+{
+    uint64_t length = chunk_size;
+    uint64_t start = chunk_id * chunk_size;
+    if (start + length > file_size) {
+        length = (start < file_size) ? file_size - start : 0;
+    }
+    return length + MFU_CHUNK_WEIGHT_OVERHEAD;
+}
+
 /* This is a long routine, but the idea is simple.  All tasks sum up
  * the number of file chunks they have, and those are then evenly
- * distributed amongst the processes.  */
-mfu_file_chunk* mfu_file_chunk_list_alloc(mfu_flist list, uint64_t chunk_size)
+ * distributed amongst the processes.  If chunk_sizes is not NULL,
+ * it specifies the chunk size for each item in the list, and chunks
+ * are distributed by their weight rather than by their count. */
+static mfu_file_chunk* file_chunk_list_alloc(mfu_flist list, uint64_t default_chunk_size, const uint64_t* chunk_sizes)
 {
     /* get our rank and number of ranks */
     int rank, ranks;
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &ranks);
 
+    /* spread chunks by weight if chunks may have different sizes */
+    int weighted = (chunk_sizes != NULL);
+
     /* total up number of file chunks for all files in our list */
     uint64_t count = 0;
+    uint64_t weight = 0;
     uint64_t idx;
     uint64_t size = mfu_flist_size(list);
     for (idx = 0; idx < size; idx++) {
@@ -55,6 +85,9 @@ mfu_file_chunk* mfu_file_chunk_list_alloc(mfu_flist list, uint64_t chunk_size)
             /* get size of file */
             uint64_t file_size = mfu_flist_file_get_size(list, idx);
 
+            /* get chunk size for this file */
+            uint64_t chunk_size = weighted ? chunk_sizes[idx] : default_chunk_size;
+
             /* compute number of chunks to copy for this file */
             uint64_t chunks = file_size / chunk_size;
             if (chunks * chunk_size < file_size || file_size == 0) {
@@ -65,20 +98,37 @@ mfu_file_chunk* mfu_file_chunk_list_alloc(mfu_flist list, uint64_t chunk_size)
 
             /* include these chunks in our total */
             count += chunks;
+
+            /* add up weight of our chunks, all chunks are full
+             * except possibly the last one */
+            if (weighted) {
+                weight += (chunks - 1) * (chunk_size + MFU_CHUNK_WEIGHT_OVERHEAD);
+                weight += chunk_weight(chunks - 1, chunk_size, file_size);
+            }
         }
     }
 
+    /* when spreading by weight, we track offsets in units of
+     * weight rather than in units of chunks */
+    uint64_t units = weighted ? weight : count;
+
     /* compute total number of chunks across procs */
     uint64_t total;
-    MPI_Allreduce(&count, &total, 1, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(&units, &total, 1, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
 
     /* get global offset of our first chunk */
     uint64_t offset;
-    MPI_Exscan(&count, &offset, 1, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Exscan(&units, &offset, 1, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
     if (rank == 0) {
         offset = 0;
     }
 
+    /* weight to be assigned to each rank */
+    uint64_t weight_per_rank = (total + (uint64_t) ranks - 1) / (uint64_t) ranks;
+    if (weight_per_rank == 0) {
+        weight_per_rank = 1;
+    }
+
     /* compute number of chunks per task, ranks below cutoff will
      * be responsible for (chunks_per_rank+1) and ranks at cutoff
      * and above are responsible for chunks_per_rank */
@@ -107,12 +157,16 @@ mfu_file_chunk* mfu_file_chunk_list_alloc(mfu_flist list, uint64_t chunk_size)
     int send_ranks = 0;
     int first_send_rank, last_send_rank;
     if (count > 0) {
-        /* compute first rank we'll send data to */
-        first_send_rank = map_chunk_to_rank(offset, cutoff, chunks_per_rank);
-
-        /* compute last rank we'll send to */
-        uint64_t last_offset = offset + count - 1;
-        last_send_rank  = map_chunk_to_rank(last_offset, cutoff, chunks_per_rank);
+        /* compute first and last rank we'll send data to, when spreading
+         * by weight this may include trailing ranks that get no chunks */
+        uint64_t last_offset = offset + units - 1;
+        if (weighted) {
+            first_send_rank = map_weight_to_rank(offset, weight_per_rank, ranks);
+            last_send_rank  = map_weight_to_rank(last_offset, weight_per_rank, ranks);
+        } else {
+            first_send_rank = map_chunk_to_rank(offset, cutoff, chunks_per_rank);
+            last_send_rank  = map_chunk_to_rank(last_offset, cutoff, chunks_per_rank);
+        }
 
         /* set flag for each process we'll send data to */
         for (i = first_send_rank; i <= last_send_rank; i++) {
@@ -152,6 +206,9 @@ mfu_file_chunk* mfu_file_chunk_list_alloc(mfu_flist list, uint64_t chunk_size)
             /* get size of file */
             uint64_t file_size = mfu_flist_file_get_size(list, idx);
 
+            /* get chunk size for this file */
+            uint64_t chunk_size = weighted ? chunk_sizes[idx] : default_chunk_size;
+
             /* compute number of chunks to copy for this file */
             uint64_t chunks = file_size / chunk_size;
             if (chunks * chunk_size < file_size || file_size == 0) {
@@ -164,7 +221,12 @@ mfu_file_chunk* mfu_file_chunk_list_alloc(mfu_flist list, uint64_t chunk_size)
             uint64_t chunk_id;
             for (chunk_id = 0; chunk_id < chunks; chunk_id++) {
                 /* determine which rank we should map this chunk to */
-                int current_rank = map_chunk_to_rank(current_offset, cutoff, chunks_per_rank);
+                int current_rank;
+                if (weighted) {
+                    current_rank = map_weight_to_rank(current_offset, weight_per_rank, ranks);
+                } else {
+                    current_rank = map_chunk_to_rank(current_offset, cutoff, chunks_per_rank);
+                }
 
                 /* compute index into our send_ranks arrays */
                 int rank_index = current_rank - first_send_rank;
@@ -224,7 +286,11 @@ mfu_file_chunk* mfu_file_chunk_list_alloc(mfu_flist list, uint64_t chunk_size)
                 }
 
                 /* go on to our next chunk */
-                current_offset++;
+                if (weighted) {
+                    current_offset += chunk_weight(chunk_id, chunk_size, file_size);
+                } else {
+                    current_offset++;
+                }
             }
         }
     }
@@ -434,6 +500,107 @@ mfu_file_chunk* mfu_file_chunk_list_alloc(mfu_flist list, uint64_t chunk_size)
     return head;
 }
 
+mfu_file_chunk* mfu_file_chunk_list_alloc(mfu_flist list, uint64_t chunk_size)
+{
+    return file_chunk_list_alloc(list, chunk_size, NULL);
+}
+
+mfu_file_chunk* mfu_file_chunk_list_alloc_adaptive(mfu_flist list, uint64_t chunk_size)
+{
+    /* get number of ranks */
+    int ranks;
+    MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+
+    /* total up bytes in regular files across all procs */
+    uint64_t idx;
+    uint64_t size = mfu_flist_size(list);
+    uint64_t bytes = 0;
+    for (idx = 0; idx < size; idx++) {
+        mfu_filetype type = mfu_flist_file_get_type(list, idx);
+        if (type == MFU_TYPE_FILE) {
+            bytes += mfu_flist_file_get_size(list, idx);
+        }
+    }
+    uint64_t total_bytes;
+    MPI_Allreduce(&bytes, &total_bytes, 1, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+
+    /* the chunk size that would give each rank a handful of chunks */
+    uint64_t share = total_bytes / ((uint64_t) ranks * MFU_CHUNKS_PER_RANK);
+
+    /* don't split chunks finer than the alignment, which keeps
+     * offsets friendly to O_DIRECT, unless the user asked for
+     * chunks smaller than that */
+    uint64_t align = MFU_CHUNK_ALIGN;
+    if (chunk_size < align) {
+        align = chunk_size;
+    }
+
+    /* don't grow chunks past the cap, so dynamic rebalancing stays
+     * fine grained near the end of a huge copy, unless the user
+     * asked for chunks larger than that */
+    uint64_t cap = MFU_CHUNK_SIZE_MAX;
+    if (chunk_size > cap) {
+        cap = chunk_size;
+    }
+
+    /* start from the chunk size the user asked for, grow it if each
+     * rank would get more chunks than it needs to balance load,
+     * and shrink it if some ranks would get no chunk at all */
+    uint64_t base = chunk_size;
+    if (share > chunk_size || total_bytes / chunk_size < (uint64_t) ranks) {
+        base = share;
+    }
+    if (base < align) {
+        base = align;
+    }
+    if (base > cap) {
+        base = cap;
+    }
+    base -= base % align;
+
+    /* compute chunk size for each file */
+    uint64_t* chunk_sizes = (uint64_t*) MFU_MALLOC(size * sizeof(uint64_t));
+    for (idx = 0; idx < size; idx++) {
+        /* use the base chunk size by default */
+        chunk_sizes[idx] = base;
+
+        /* only bother with files that we'll split */
+        mfu_filetype type = mfu_flist_file_get_type(list, idx);
+        if (type != MFU_TYPE_FILE) {
+            continue;
+        }
+        uint64_t file_size = mfu_flist_file_get_size(list, idx);
+        if (file_size <= base) {
+            continue;
+        }
+
+        /* split the file into as many chunks as the base size needs,
+         * but make them equal in size, so the file doesn't end in a
+         * small chunk that costs as much to schedule as a full one */
+        uint64_t pieces = (file_size + base - 1) / base;
+        uint64_t file_chunk = (file_size + pieces - 1) / pieces;
+
+        /* round chunk size up to a multiple of the stripe size,
+         * so each chunk starts on a stripe boundary,
+         * or else to a multiple of the alignment */
+        uint64_t unit = align;
+        uint64_t stripe_size  = 0;
+        uint64_t stripe_count = 0;
+        const char* name = mfu_flist_file_get_name(list, idx);
+        if (mfu_stripe_get(name, &stripe_size, &stripe_count) == 0 && stripe_size > 0) {
+            unit = stripe_size;
+        }
+        chunk_sizes[idx] = (file_chunk + unit - 1) / unit * unit;
+    }
+
+    /* split files and spread chunks by weight */
+    mfu_file_chunk* head = file_chunk_list_alloc(list, base, chunk_sizes);
+
+    mfu_free(&chunk_sizes);
+
+    return head;
+}
+
 /* free the linked list of structs (copy elem's) */
 void mfu_file_chunk_list_free(mfu_file_chunk** phead)
 {
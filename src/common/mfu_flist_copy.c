@@ -88,6 +88,9 @@ typedef struct {
     double   wtime_ended;        /* time when dcp command ended */
 } mfu_copy_stats_t;
 
+/* number of open files to keep in each file cache */
+#define MFU_COPY_FILE_CACHE_SIZE (16)
+
 /* cache open file descriptor to avoid
  * opening / closing the same file */
 typedef struct {
@@ -97,6 +100,14 @@ typedef struct {
 #ifdef DAOS_SUPPORT
     dfs_obj_t* obj; /* open object */
 #endif
+    uint64_t used; /* value of cache clock when entry was last used */
+} mfu_copy_file_cache_entry_t;
+
+/* small set of open files, when full, the least recently
+ * used file is closed to make room for a new one */
+typedef struct {
+    mfu_copy_file_cache_entry_t entries[MFU_COPY_FILE_CACHE_SIZE];
+    uint64_t clock; /* incremented each time an entry is used */
 } mfu_copy_file_cache_t;
 
 /****************************************
@@ -146,10 +157,58 @@ static void mkdir_progress_fn(const uint64_t* vals, int count, int complete, int
     }
 }
 
-/** Cache most recent open file descriptor to avoid opening / closing the same file */
+/** Cache recently opened file descriptors to avoid opening / closing the same file */
 static mfu_copy_file_cache_t mfu_copy_src_cache;
 static mfu_copy_file_cache_t mfu_copy_dst_cache;
 
+/* mark all entries in file cache as empty */
+static void mfu_copy_file_cache_init(mfu_copy_file_cache_t* cache)
+{
+    int i;
+    for (i = 0; i < MFU_COPY_FILE_CACHE_SIZE; i++) {
+        cache->entries[i].name = NULL;
+        cache->entries[i].used = 0;
+    }
+    cache->clock = 0;
+}
+
+/* point mfu_file at the file held in the given cache entry */
+static void mfu_copy_file_cache_select(
+    mfu_copy_file_cache_entry_t* entry,
+    mfu_file_t* mfu_file)
+{
+    if (mfu_file->type == POSIX) {
+        mfu_file->fd = entry->fd;
+    }
+#ifdef DAOS_SUPPORT
+    if (mfu_file->type == DFS) {
+        mfu_file->obj = entry->obj;
+    }
+#endif
+}
+
+/* close file held in cache entry, files open for write are not
+ * synced here, data is flushed for all files at once by mfu_sync_all */
+static int mfu_copy_file_cache_evict(
+    mfu_copy_file_cache_entry_t* entry,
+    mfu_file_t* mfu_file)
+{
+    int rc = 0;
+
+    /* close file if we have one */
+    char* name = entry->name;
+    if (name != NULL) {
+        /* point mfu_file at this entry so we close the right file */
+        mfu_copy_file_cache_select(entry, mfu_file);
+
+        /* close the file and delete the name string */
+        rc = mfu_file_close(name, mfu_file);
+        mfu_free(&entry->name);
+    }
+
+    return rc;
+}
+
 /* open and cache a file.
  * Returns 0 on success; -1 otherwise */
 static int mfu_copy_open_file(
@@ -159,22 +218,38 @@ static int mfu_copy_open_file(
     mfu_copy_opts_t* copy_opts,   /* options configuring the copy operation */
     mfu_file_t* mfu_file)         /* whether the file is in POSIX/DAOS */
 {
-    /* see if we have a cached file descriptor */
-    char* name = cache->name;
-    if (name != NULL) {
-        /* we have a cached file descriptor */
-        if (strcmp(name, file) == 0 && cache->read == read_flag) {
+    /* see if we have a cached file descriptor, while we look,
+     * track an empty slot or the least recently used one */
+    int i;
+    mfu_copy_file_cache_entry_t* victim = NULL;
+    cache->clock++;
+    for (i = 0; i < MFU_COPY_FILE_CACHE_SIZE; i++) {
+        mfu_copy_file_cache_entry_t* entry = &cache->entries[i];
+        if (entry->name != NULL &&
+            strcmp(entry->name, file) == 0 &&
+            entry->read == read_flag)
+        {
             /* the file we're trying to open matches name and read/write mode,
              * so just return the cached descriptor */
+            entry->used = cache->clock;
+            mfu_copy_file_cache_select(entry, mfu_file);
             return 0;
-        } else {
-            /* the file we're trying to open is different,
-             * close the old file and delete the name */
-            mfu_file_close(name, mfu_file);
-            mfu_free(&cache->name);
+        }
+
+        /* prefer empty slots, then the oldest entry */
+        if (victim == NULL ||
+            (victim->name != NULL && (entry->name == NULL || entry->used < victim->used)))
+        {
+            victim = entry;
         }
     }
 
+    /* the file we're trying to open is not cached,
+     * close the victim file if needed to make room */
+    mfu_copy_file_cache_evict(victim, mfu_file);
+    mfu_copy_file_cache_entry_t* cache_entry = victim;
+    cache_entry->used = cache->clock;
+
     /* open the new file, this sets mfu_file->fd/obj */
     if (read_flag) {
         int flags = O_RDONLY;
@@ -199,9 +274,9 @@ static int mfu_copy_open_file(
             return -1;
         }
 
-        cache->name = MFU_STRDUP(file);
-        cache->fd   = mfu_file->fd;
-        cache->read = read_flag;
+        cache_entry->name = MFU_STRDUP(file);
+        cache_entry->fd   = mfu_file->fd;
+        cache_entry->read = read_flag;
 
 #ifdef LUSTRE_SUPPORT
         /* Zero is an invalid ID for grouplock. */
@@ -227,35 +302,29 @@ static int mfu_copy_open_file(
             return -1;
         }
         
-        cache->name = MFU_STRDUP(file);
-        cache->read = read_flag;
-        cache->obj  = mfu_file->obj;
+        cache_entry->name = MFU_STRDUP(file);
+        cache_entry->read = read_flag;
+        cache_entry->obj  = mfu_file->obj;
     }
 #endif
 
     return 0;
 }
 
-/* close a file that opened with mfu_copy_open_file */
+/* close all files that were opened with mfu_copy_open_file */
 static int mfu_copy_close_file(
     mfu_copy_file_cache_t* cache,
     mfu_file_t* mfu_file)
 {
     int rc = 0;
 
-    /* close file if we have one */
-    char* name = cache->name;
-    if (name != NULL) {
-        int fd = cache->fd;
-        /* if open for write, fsync */
-        int read_flag = cache->read;
-        if (! read_flag && mfu_file->type == POSIX) {
-            rc = mfu_fsync(name, fd);
+    /* close each file we have */
+    int i;
+    for (i = 0; i < MFU_COPY_FILE_CACHE_SIZE; i++) {
+        int tmp_rc = mfu_copy_file_cache_evict(&cache->entries[i], mfu_file);
+        if (tmp_rc != 0) {
+            rc = tmp_rc;
         }
-
-        /* close the file and delete the name string */
-        rc = mfu_file_close(name, mfu_file);
-        mfu_free(&cache->name);
     }
 
     return rc;
@@ -346,7 +415,10 @@ static int mfu_copy_xattrs(
             int got_val = 0;
 
             copy_xattr = 1; /* copy unless indicated below not to */
-            if (copy_opts->copy_xattrs == XATTR_USE_LIBATTR) {
+            if (strcmp(name, MFU_DIGEST_XATTR) == 0) {
+                /* a stored digest describes the source file only */
+                copy_xattr = 0;
+            } else if (copy_opts->copy_xattrs == XATTR_USE_LIBATTR) {
 #ifdef HAVE_LIBATTR
                 if (attr_copy_action(name, NULL) == ATTR_ACTION_SKIP) {
                     copy_xattr = 0;
@@ -2007,11 +2079,18 @@ static struct mfu_extent_list * mfu_fiemap_get_extents(
         }
     }
 
+    /* unwritten extents are allocated but read back as zeros,
+     * so treat them as holes */
+    __u32 mapped = 0;
     for (ssize_t idx = 0; idx < fiemap->fm_mapped_extents; idx++) {
-        extent_list->mel_extents[idx].me_logical = fiemap->fm_extents[idx].fe_logical;
-        extent_list->mel_extents[idx].me_length = fiemap->fm_extents[idx].fe_length;
+        if (fiemap->fm_extents[idx].fe_flags & FIEMAP_EXTENT_UNWRITTEN) {
+            continue;
+        }
+        extent_list->mel_extents[mapped].me_logical = fiemap->fm_extents[idx].fe_logical;
+        extent_list->mel_extents[mapped].me_length = fiemap->fm_extents[idx].fe_length;
+        mapped++;
     }
-    extent_list->mel_mapped_extents = fiemap->fm_mapped_extents;
+    extent_list->mel_mapped_extents = mapped;
 
     free(fiemap);
 
@@ -2052,7 +2131,7 @@ static struct mfu_extent_list * mfu_lseek_get_extents(
 
     /* Verify that SEEK_HOLE and SEEK_DATA are supported */
     if ((mfu_file_lseek(src, mfu_src_file, offset, SEEK_HOLE) == (off_t)-1) ||
-        (mfu_file_lseek(src, mfu_src_file, offset, SEEK_DATA) == (off_t)-1)) {
+        (mfu_file_lseek(src, mfu_src_file, offset, SEEK_DATA) == (off_t)-1 && errno != ENXIO)) {
         goto fail_no_extent_list;
     }
 
@@ -2073,6 +2152,11 @@ static struct mfu_extent_list * mfu_lseek_get_extents(
     while (offset < last_byte) {
         offset = mfu_file_lseek(src, mfu_src_file, offset, op);
 
+        /* no more data between offset and end of file */
+        if (offset == -1 && op == SEEK_DATA && errno == ENXIO) {
+            break;
+        }
+
 	if (offset == -1) {
             MFU_LOG(MFU_LOG_ERR, "Couldn't seek in src path `%s' (errno=%d %s)",
                 src, errno, strerror(errno));
@@ -2093,8 +2177,8 @@ static struct mfu_extent_list * mfu_lseek_get_extents(
             extent_list->mel_mapped_extents++;
             MFU_LOG(MFU_LOG_DBG, "src %s extent %d logical %llu length %llu:",
                 src, extent_list->mel_mapped_extents-1,
-                extent_list->mel_extents[idx].me_logical,
-                extent_list->mel_extents[idx++].me_length);
+                extent_list->mel_extents[idx-1].me_logical,
+                extent_list->mel_extents[idx-1].me_length);
         }
 
         if (idx >= extent_list->mel_extent_count) {
@@ -2132,43 +2216,68 @@ fail_no_extent_list:
     return NULL;
 }
 
-static int mfu_copy_file_extents(
+/* extents of the source file this process most recently copied
+ * from, a process often copies a run of adjacent chunks of the same
+ * file, so we map the range covered by that run once and reuse that
+ * map for each chunk in it */
+typedef struct {
+    char* name;                          /* name of source file (NULL if none) */
+    uint64_t start;                      /* first byte of mapped range */
+    uint64_t end;                        /* one past last byte of mapped range */
+    bool normal_copy_required;           /* true if extents could not be mapped */
+    struct mfu_extent_list* extent_list; /* data extents within mapped range */
+} mfu_copy_extent_cache_t;
+
+static mfu_copy_extent_cache_t mfu_copy_extent_cache;
+
+/* forget any cached extents */
+static void mfu_copy_extent_cache_free(void)
+{
+    mfu_free(&mfu_copy_extent_cache.name);
+    mfu_free(&mfu_copy_extent_cache.extent_list);
+    mfu_copy_extent_cache.start = 0;
+    mfu_copy_extent_cache.end   = 0;
+    mfu_copy_extent_cache.normal_copy_required = true;
+}
+
+/* return list of data extents of src covering [offset, offset+length),
+ * src must be open in mfu_src_file, if the cache does not cover that
+ * range, the range [offset, offset+map_length) is mapped and cached,
+ * sets normal_copy_required if the file system cannot tell us where
+ * the data is */
+static const struct mfu_extent_list* mfu_copy_extent_cache_get(
     const char* src,
     const char* dest,
     uint64_t offset,
     uint64_t length,
+    uint64_t map_length,
     uint64_t file_size,
     bool* normal_copy_required,
     mfu_copy_opts_t* copy_opts,
     mfu_file_t* mfu_src_file,
     mfu_file_t* mfu_dst_file)
 {
-    size_t last_ext_start = offset;
-    size_t last_ext_len = 0;
-    uint64_t last_byte = offset + length;
-    struct mfu_extent_list* extent_list;
-
-    *normal_copy_required = true;
-    if (copy_opts->direct) {
-        goto fail_normal_copy;
+    /* return cached extents if they cover this range of this file */
+    mfu_copy_extent_cache_t* cache = &mfu_copy_extent_cache;
+    if (cache->name != NULL && strcmp(cache->name, src) == 0 &&
+        cache->start <= offset && offset + length <= cache->end)
+    {
+        *normal_copy_required = cache->normal_copy_required;
+        return cache->extent_list;
     }
 
-    struct stat sb;
-    if (fstat(mfu_src_file->fd, &sb) < 0) {
-        goto fail_normal_copy;
-    }
+    /* otherwise drop the extents we have */
+    mfu_copy_extent_cache_free();
 
-#ifdef DAOS_SUPPORT
-    /* Not yet supported */
-    if (mfu_src_file->type == DFS) {
-        goto fail_normal_copy;
+    /* map at least the requested range */
+    if (map_length < length) {
+        map_length = length;
     }
-#endif
 
     /* get extents using SEEK_DATA and SEEK_HOLE */
-    extent_list = mfu_lseek_get_extents( src, dest, offset, length,
-        file_size, normal_copy_required, copy_opts, mfu_src_file,
-        mfu_dst_file);
+    struct mfu_extent_list* extent_list = mfu_lseek_get_extents(src, dest,
+        offset, map_length, file_size, normal_copy_required, copy_opts,
+        mfu_src_file, mfu_dst_file);
 
     if (!extent_list || *normal_copy_required == true) {
         if (extent_list) {
@@ -2176,77 +2285,138 @@ static int mfu_copy_file_extents(
         }
 
         /* extents acquired by fiemap ioctl */
-        extent_list = mfu_fiemap_get_extents( src, dest,
-            offset, length, file_size, normal_copy_required, copy_opts,
+        extent_list = mfu_fiemap_get_extents(src, dest,
+            offset, map_length, file_size, normal_copy_required, copy_opts,
             mfu_src_file, mfu_dst_file);
 
         if (!extent_list || *normal_copy_required == true) {
-            goto fail_fiemap;
+            if (extent_list) {
+                free(extent_list);
+            }
+            extent_list = NULL;
+            *normal_copy_required = true;
         }
     }
 
-    /* seek to offset in source file */
-    if (mfu_file_lseek(src, mfu_src_file, (off_t)last_ext_start, SEEK_SET) < 0) {
-        MFU_LOG(MFU_LOG_ERR, "Couldn't seek in source path `%s' (errno=%d %s)",
-            src, errno, strerror(errno));
-        goto fail_fiemap;
+    /* remember result, including failure, so that we don't
+     * try to map the same range again for its next chunk */
+    cache->name                 = MFU_STRDUP(src);
+    cache->start                = offset;
+    cache->end                  = offset + map_length;
+    cache->normal_copy_required = *normal_copy_required;
+    cache->extent_list          = extent_list;
+
+    return extent_list;
+}
+
+static int mfu_copy_file_extents(
+    const char* src,
+    const char* dest,
+    uint64_t offset,
+    uint64_t length,
+    uint64_t map_length,
+    uint64_t file_size,
+    bool* normal_copy_required,
+    mfu_copy_opts_t* copy_opts,
+    mfu_file_t* mfu_src_file,
+    mfu_file_t* mfu_dst_file)
+{
+    uint64_t last_byte = offset + length;
+
+    *normal_copy_required = true;
+    if (copy_opts->direct) {
+        return -1;
     }
 
-    /* seek to offset in destination file */
-    if (mfu_file_lseek(dest, mfu_dst_file, (off_t)last_ext_start, SEEK_SET) < 0) {
-        MFU_LOG(MFU_LOG_ERR, "Couldn't seek in destination path `%s' (errno=%d %s)",
-            dest, errno, strerror(errno));
-        goto fail_fiemap;
+#ifdef DAOS_SUPPORT
+    /* Not yet supported */
+    if (mfu_src_file->type == DFS) {
+        return -1;
     }
+#endif
 
-    unsigned int i;
-    for (i = 0; i < extent_list->mel_mapped_extents; i++) {
-        size_t ext_start;
-        size_t ext_len;
-        size_t ext_hole_size;
+    /* get extents covering our chunk, mapped once per run of chunks */
+    const struct mfu_extent_list* extent_list = mfu_copy_extent_cache_get(
+        src, dest, offset, length, map_length, file_size,
+        normal_copy_required, copy_opts, mfu_src_file, mfu_dst_file);
+    if (extent_list == NULL || *normal_copy_required == true) {
+        return -1;
+    }
+
+    /* we know where the data is, so from here on errors are
+     * reported to the caller rather than retried with a normal copy */
+    *normal_copy_required = false;
 
-        size_t buf_size = copy_opts->buf_size;
-        void* buf = copy_opts->block_buf1;
+    /* extents are sorted by offset, binary search for the
+     * first extent that ends after the start of our chunk */
+    uint32_t count = extent_list->mel_mapped_extents;
+    uint32_t low = 0;
+    uint32_t high = count;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        const struct mfu_extent* ext = &extent_list->mel_extents[mid];
+        if (ext->me_logical + ext->me_length <= offset) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
 
-        ext_start = extent_list->mel_extents[i].me_logical;
-        ext_len = extent_list->mel_extents[i].me_length;
-        ext_hole_size = ext_start - (last_ext_start + last_ext_len);
+    size_t buf_size = copy_opts->buf_size;
+    void* buf = copy_opts->block_buf1;
 
-        if (ext_hole_size) {
-            if (mfu_file_lseek(src, mfu_src_file, (off_t)ext_start, SEEK_SET) < 0) {
-                MFU_LOG(MFU_LOG_ERR, "Couldn't seek in source path `%s' (errno=%d %s)",
-                    src, errno, strerror(errno));
-                goto fail_fiemap;
-            }
-            if (mfu_file_lseek(dest, mfu_dst_file, (off_t)ext_hole_size, SEEK_CUR) < 0) {
-                MFU_LOG(MFU_LOG_ERR, "Couldn't seek in destination path `%s' (errno=%d %s)",
-                    dest, errno, strerror(errno));
-                goto fail_fiemap;
-            }
+    /* copy data in each extent that overlaps our chunk,
+     * holes are skipped entirely and left as holes in the
+     * destination, which is truncated to its full size below */
+    uint32_t i;
+    for (i = low; i < count; i++) {
+        const struct mfu_extent* ext = &extent_list->mel_extents[i];
+
+        /* stop once we pass the end of our chunk */
+        uint64_t ext_start = ext->me_logical;
+        if (ext_start >= last_byte) {
+            break;
         }
 
-        last_ext_start = ext_start;
-        last_ext_len = ext_len;
+        /* clip extent to our chunk */
+        uint64_t ext_end = ext_start + ext->me_length;
+        if (ext_start < offset) {
+            ext_start = offset;
+        }
+        if (ext_end > last_byte) {
+            ext_end = last_byte;
+        }
 
-        while (ext_len) {
-            ssize_t num_read = mfu_file_read(src, buf, MIN(ext_len, buf_size), mfu_src_file);
+        uint64_t off = ext_start;
+        while (off < ext_end) {
+            size_t left = (size_t) MIN(ext_end - off, (uint64_t) buf_size);
+            ssize_t num_read = mfu_file_pread(src, buf, left, (off_t) off, mfu_src_file);
+            if (num_read < 0) {
+                MFU_LOG(MFU_LOG_ERR, "Read error when copying from `%s' to `%s' (errno=%d %s)",
+                    src, dest, errno, strerror(errno));
+                return -1;
+            }
 
-            if (!num_read)
-                break;
-            ssize_t num_written = mfu_file_write(dest, buf, (size_t)num_read, mfu_dst_file);
+            /* file shrank since we mapped it */
+            if (num_read == 0) {
+                MFU_LOG(MFU_LOG_ERR, "Source file `%s' shorter than expected size of %llu bytes",
+                    src, (unsigned long long) file_size);
+                return -1;
+            }
 
+            ssize_t num_written = mfu_file_pwrite(dest, buf, (size_t)num_read, (off_t) off, mfu_dst_file);
             if (num_written < 0) {
                 MFU_LOG(MFU_LOG_ERR, "Write error when copying from `%s' to `%s' (errno=%d %s)",
-                          src, dest, errno, strerror(errno));
-                goto fail_fiemap;
+                    src, dest, errno, strerror(errno));
+                return -1;
             }
             if (num_written != num_read) {
                 MFU_LOG(MFU_LOG_ERR, "Write error when copying from `%s' to `%s'",
                     src, dest);
-                goto fail_fiemap;
+                return -1;
             }
 
-            ext_len -= (size_t)num_written;
+            off += (uint64_t) num_written;
             mfu_copy_stats.total_bytes_copied += (int64_t) num_written;
         }
     }
@@ -2260,32 +2430,32 @@ static int mfu_copy_file_extents(
         if (mfu_file_ftruncate(mfu_dst_file, file_size_offt) < 0) {
             MFU_LOG(MFU_LOG_ERR, "Failed to truncate destination file: %s (errno=%d %s)",
                 dest, errno, strerror(errno));
-            goto fail_fiemap;
+            return -1;
        }
     }
 
     if (last_written >= file_size_offt) {
         mfu_copy_stats.total_size += (int64_t) (file_size_offt - (off_t) offset);
     } else {
-        mfu_copy_stats.total_size += (int64_t) last_byte;
+        mfu_copy_stats.total_size += (int64_t) length;
     }
 
-    free( extent_list );
+    /* count holes as copied for progress messages */
+    copy_count += length;
+    mfu_progress_update(&copy_count, copy_prog);
 
     return 0;
-
-fail_fiemap:
-    free( extent_list );
-
-fail_normal_copy:
-    return -1;
 }
 
+/* copy [offset, offset+length) of src to dest, with sparse copies
+ * the extents of [offset, offset+map_length) are mapped, so a caller
+ * that copies a run of adjacent chunks can have them mapped at once */
 static int mfu_copy_file(
     const char* src,
     const char* dest,
     uint64_t offset,
     uint64_t length,
+    uint64_t map_length,
     uint64_t file_size,
     mfu_copy_opts_t* copy_opts,
     mfu_file_t* mfu_src_file,
@@ -2313,7 +2483,7 @@ static int mfu_copy_file(
 
     if (copy_opts->sparse) {
         bool normal_copy_required;
-        ret = mfu_copy_file_extents(src, dest, offset, length, file_size,
+        ret = mfu_copy_file_extents(src, dest, offset, length, map_length, file_size,
                                &normal_copy_required, copy_opts,
                                mfu_src_file, mfu_dst_file);
         if (!ret || !normal_copy_required) {
@@ -2327,6 +2497,290 @@ static int mfu_copy_file(
     return ret;
 }
 
+/* copies data for each chunk in the list assigned to this process,
+ * sets vals[i] to 1 for any chunk i that failed to copy */
+static void mfu_copy_files_static(
+    const mfu_file_chunk* head,
+    uint64_t list_count,
+    int* vals,
+    int numpaths,
+    const mfu_param_path* paths,
+    const mfu_param_path* destpath,
+    mfu_copy_opts_t* copy_opts,
+    mfu_file_t* mfu_src_file,
+    mfu_file_t* mfu_dst_file,
+    uint64_t* total_count)
+{
+    /* loop over and copy data for each file section we're responsible for,
+     * chunks before run_last are adjacent chunks of one file ending at map_end */
+    uint64_t i;
+    uint64_t run_last = 0;
+    uint64_t map_end  = 0;
+    const mfu_file_chunk* p = head;
+    for (i = 0; i < list_count; i++) {
+        /* get name of destination file */
+        char* dest = mfu_param_path_copy_dest(p->name, numpaths,
+                paths, destpath, copy_opts, mfu_src_file, mfu_dst_file);
+        if (dest == NULL) {
+            /* No need to copy it */
+            p = p->next;
+            continue;
+        }
+
+        /* add bytes to our running total */
+        *total_count += (uint64_t)p->length;
+
+        /* find the end of the run of adjacent chunks of this file
+         * that we copy, so extents are mapped once for all of them */
+        if (i >= run_last) {
+            map_end = (uint64_t)p->offset + (uint64_t)p->length;
+            run_last = i + 1;
+            const mfu_file_chunk* q = p->next;
+            while (run_last < list_count &&
+                   (uint64_t)q->offset == map_end &&
+                   strcmp(q->name, p->name) == 0)
+            {
+                map_end += (uint64_t)q->length;
+                run_last++;
+                q = q->next;
+            }
+        }
+
+        /* copy portion of file corresponding to this chunk,
+         * and record whether copy operation succeeded */
+        int copy_rc = mfu_copy_file(p->name, dest, (uint64_t)p->offset,
+                (uint64_t)p->length, map_end - (uint64_t)p->offset,
+                (uint64_t)p->file_size, copy_opts,
+                mfu_src_file, mfu_dst_file);
+        if (copy_rc < 0) {
+            /* error copying file */
+            vals[i] = 1;
+        }
+
+        /* free the dest name */
+        mfu_free(&dest);
+
+        /* update pointer to next element */
+        p = p->next;
+    }
+}
+
+/* describes one unit of work in the dynamic copy queue,
+ * records are exposed through an MPI window so that
+ * other processes can fetch them, all fields are uint64_t
+ * so the record can be read as a plain array of bytes */
+typedef struct {
+    uint64_t index;     /* index of owning element in local chunk list */
+    uint64_t offset;    /* starting offset of piece within file */
+    uint64_t length;    /* number of bytes in piece */
+    uint64_t file_size; /* total size of file */
+    uint64_t name_off;  /* offset of file name within name buffer */
+    uint64_t name_len;  /* length of file name including terminating NUL */
+} mfu_copy_piece_t;
+
+/* copy a single piece of a file and record failure by
+ * setting the flag for its chunk on the owning process */
+static void mfu_copy_files_dynamic_piece(
+    const char* name,
+    const mfu_copy_piece_t* piece,
+    int owner,
+    MPI_Win win_vals,
+    int numpaths,
+    const mfu_param_path* paths,
+    const mfu_param_path* destpath,
+    mfu_copy_opts_t* copy_opts,
+    mfu_file_t* mfu_src_file,
+    mfu_file_t* mfu_dst_file,
+    uint64_t* total_count)
+{
+    /* get name of destination file */
+    char* dest = mfu_param_path_copy_dest(name, numpaths,
+            paths, destpath, copy_opts, mfu_src_file, mfu_dst_file);
+    if (dest == NULL) {
+        /* No need to copy it */
+        return;
+    }
+
+    /* add bytes to our running total */
+    *total_count += piece->length;
+
+    /* copy portion of file corresponding to this piece */
+    int copy_rc = mfu_copy_file(name, dest, piece->offset,
+            piece->length, piece->length, piece->file_size, copy_opts,
+            mfu_src_file, mfu_dst_file);
+    if (copy_rc < 0) {
+        /* error copying file, flag the chunk on its owner,
+         * we use an accumulate so that concurrent updates from
+         * several processes to the same chunk are well defined */
+        int one = 1;
+        MPI_Aint disp = (MPI_Aint) piece->index;
+        MPI_Accumulate(&one, 1, MPI_INT, owner, disp, 1, MPI_INT, MPI_MAX, win_vals);
+        MPI_Win_flush(owner, win_vals);
+    }
+
+    /* free the dest name */
+    mfu_free(&dest);
+}
+
+/* copies data for chunks in the list by handing out one piece per
+ * chunk on demand, each piece covers its chunk's own range so the
+ * sizes chosen when the chunk list was built are kept, each process
+ * first drains pieces from its own queue and then steals pieces
+ * from the queues of other processes until all queues are empty,
+ * sets vals[i] to 1 for any local chunk i that failed to copy */
+static void mfu_copy_files_dynamic(
+    const mfu_file_chunk* head,
+    uint64_t list_count,
+    int* vals,
+    int numpaths,
+    const mfu_param_path* paths,
+    const mfu_param_path* destpath,
+    mfu_copy_opts_t* copy_opts,
+    mfu_file_t* mfu_src_file,
+    mfu_file_t* mfu_dst_file,
+    uint64_t* total_count)
+{
+    /* get our rank and number of ranks */
+    int rank, ranks;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+
+    /* count bytes for file names, there is one piece per chunk,
+     * a zero-length chunk still needs its piece, since copy
+     * handles truncating empty files */
+    uint64_t i;
+    uint64_t num_pieces = list_count;
+    uint64_t name_bytes = 0;
+    const mfu_file_chunk* p = head;
+    for (i = 0; i < list_count; i++) {
+        name_bytes += strlen(p->name) + 1;
+        p = p->next;
+    }
+
+    /* allocate our queue of pieces along with a buffer of names */
+    mfu_copy_piece_t* pieces = (mfu_copy_piece_t*) MFU_MALLOC(num_pieces * sizeof(mfu_copy_piece_t));
+    char* names = (char*) MFU_MALLOC(name_bytes);
+
+    /* record a piece for each chunk, chunks for the same file are
+     * contiguous in the list, so pieces of a file stay together */
+    uint64_t name_off = 0;
+    p = head;
+    for (i = 0; i < list_count; i++) {
+        size_t len = strlen(p->name) + 1;
+        memcpy(names + name_off, p->name, len);
+
+        mfu_copy_piece_t* piece = &pieces[i];
+        piece->index     = i;
+        piece->offset    = (uint64_t) p->offset;
+        piece->length    = (uint64_t) p->length;
+        piece->file_size = (uint64_t) p->file_size;
+        piece->name_off  = name_off;
+        piece->name_len  = (uint64_t) len;
+
+        name_off += (uint64_t) len;
+        p = p->next;
+    }
+
+    /* gather number of pieces on each process */
+    uint64_t* counts = (uint64_t*) MFU_MALLOC(ranks * sizeof(uint64_t));
+    MPI_Allgather(&num_pieces, 1, MPI_UINT64_T, counts, 1, MPI_UINT64_T, MPI_COMM_WORLD);
+
+    /* expose the next piece to be handed out from our queue,
+     * along with piece records, names, and per-chunk flags */
+    uint64_t* next;
+    MPI_Win win_next, win_pieces, win_names, win_vals;
+    MPI_Win_allocate((MPI_Aint) sizeof(uint64_t), (int) sizeof(uint64_t),
+        MPI_INFO_NULL, MPI_COMM_WORLD, &next, &win_next);
+    MPI_Win_create(pieces, (MPI_Aint) (num_pieces * sizeof(mfu_copy_piece_t)), 1,
+        MPI_INFO_NULL, MPI_COMM_WORLD, &win_pieces);
+    MPI_Win_create(names, (MPI_Aint) name_bytes, 1,
+        MPI_INFO_NULL, MPI_COMM_WORLD, &win_names);
+    MPI_Win_create(vals, (MPI_Aint) (list_count * sizeof(int)), (int) sizeof(int),
+        MPI_INFO_NULL, MPI_COMM_WORLD, &win_vals);
+
+    /* initialize our counter before anyone can access it */
+    *next = 0;
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    MPI_Win_lock_all(0, win_next);
+    MPI_Win_lock_all(0, win_pieces);
+    MPI_Win_lock_all(0, win_names);
+    MPI_Win_lock_all(0, win_vals);
+
+    /* buffer to hold names of files fetched from other processes */
+    size_t name_bufsize = 0;
+    char* name_buf = NULL;
+
+    /* work through our own queue first, then visit the queues
+     * of other processes in ring order starting with our right
+     * neighbor so that thieves spread out over different victims */
+    int step;
+    for (step = 0; step < ranks; step++) {
+        int target = (rank + step) % ranks;
+        uint64_t target_count = counts[target];
+
+        while (1) {
+            /* claim the next piece from the target queue */
+            uint64_t one = 1;
+            uint64_t idx;
+            MPI_Fetch_and_op(&one, &idx, MPI_UINT64_T, target, 0, MPI_SUM, win_next);
+            MPI_Win_flush(target, win_next);
+            if (idx >= target_count) {
+                /* the target has no more work for us */
+                break;
+            }
+
+            /* pieces in our own queue can be read directly */
+            if (target == rank) {
+                mfu_copy_piece_t* piece = &pieces[idx];
+                mfu_copy_files_dynamic_piece(names + piece->name_off, piece,
+                    rank, win_vals, numpaths, paths, destpath, copy_opts,
+                    mfu_src_file, mfu_dst_file, total_count);
+                continue;
+            }
+
+            /* fetch the piece record from the target */
+            mfu_copy_piece_t piece;
+            MPI_Aint disp = (MPI_Aint) (idx * sizeof(mfu_copy_piece_t));
+            MPI_Get(&piece, (int) sizeof(piece), MPI_BYTE, target,
+                disp, (int) sizeof(piece), MPI_BYTE, win_pieces);
+            MPI_Win_flush(target, win_pieces);
+
+            /* fetch the file name from the target */
+            if (piece.name_len > name_bufsize) {
+                mfu_free(&name_buf);
+                name_bufsize = (size_t) piece.name_len;
+                name_buf = (char*) MFU_MALLOC(name_bufsize);
+            }
+            MPI_Get(name_buf, (int) piece.name_len, MPI_CHAR, target,
+                (MPI_Aint) piece.name_off, (int) piece.name_len, MPI_CHAR, win_names);
+            MPI_Win_flush(target, win_names);
+
+            mfu_copy_files_dynamic_piece(name_buf, &piece,
+                target, win_vals, numpaths, paths, destpath, copy_opts,
+                mfu_src_file, mfu_dst_file, total_count);
+        }
+    }
+
+    mfu_free(&name_buf);
+
+    MPI_Win_unlock_all(win_vals);
+    MPI_Win_unlock_all(win_names);
+    MPI_Win_unlock_all(win_pieces);
+    MPI_Win_unlock_all(win_next);
+
+    /* freeing the windows waits for all processes to finish,
+     * after which vals holds the final state of each chunk */
+    MPI_Win_free(&win_vals);
+    MPI_Win_free(&win_names);
+    MPI_Win_free(&win_pieces);
+    MPI_Win_free(&win_next);
+
+    mfu_free(&counts);
+    mfu_free(&names);
+    mfu_free(&pieces);
+}
+
 /* slices files in list at boundaries of chunk size, evenly distributes
  * chunks, and copies data from source to destination file,
  * returns 0 on success and -1 on error */
@@ -2384,7 +2838,12 @@ static int mfu_copy_files(
 
     /* split file list into a linked list of file sections,
      * this evenly spreads the file sections across processes */
-    mfu_file_chunk* head = mfu_file_chunk_list_alloc(list, copy_opts->chunk_size);
+    mfu_file_chunk* head;
+    if (copy_opts->adaptive) {
+        head = mfu_file_chunk_list_alloc_adaptive(list, copy_opts->chunk_size);
+    } else {
+        head = mfu_file_chunk_list_alloc(list, copy_opts->chunk_size);
+    }
 
     /* get a count of how many items are the chunk list */
     uint64_t list_count = mfu_file_chunk_list_size(head);
@@ -2394,46 +2853,29 @@ static int mfu_copy_files(
      * to be used as input to logical OR to determine state of entire file */
     int* vals = (int*) MFU_MALLOC(list_count * sizeof(int));
 
-    /* loop over and copy data for each file section we're responsible for */
+    /* assume we'll succeed in copying each chunk */
     uint64_t i;
-    const mfu_file_chunk* p = head;
     for (i = 0; i < list_count; i++) {
-         /* assume we'll succeed in copying this chunk */
-         vals[i] = 0;
-
-        /* get name of destination file */
-        char* dest = mfu_param_path_copy_dest(p->name, numpaths,
-                paths, destpath, copy_opts, mfu_src_file, mfu_dst_file);
-        if (dest == NULL) {
-            /* No need to copy it */
-            p = p->next;
-            continue;
-        }
-
-        /* add bytes to our running total */
-        total_count += (uint64_t)p->length;
-
-        /* copy portion of file corresponding to this chunk,
-         * and record whether copy operation succeeded */
-        int copy_rc = mfu_copy_file(p->name, dest, (uint64_t)p->offset,
-                (uint64_t)p->length, (uint64_t)p->file_size, copy_opts,
-                mfu_src_file, mfu_dst_file);
-        if (copy_rc < 0) {
-            /* error copying file */
-            vals[i] = 1;
-        }
-
-        /* free the dest name */
-        mfu_free(&dest);
+        vals[i] = 0;
+    }
 
-        /* update pointer to next element */
-        p = p->next;
+    /* copy data for each file section we're responsible for,
+     * in dynamic mode sections are handed out on demand instead */
+    if (copy_opts->dynamic) {
+        mfu_copy_files_dynamic(head, list_count, vals, numpaths, paths,
+            destpath, copy_opts, mfu_src_file, mfu_dst_file, &total_count);
+    } else {
+        mfu_copy_files_static(head, list_count, vals, numpaths, paths,
+            destpath, copy_opts, mfu_src_file, mfu_dst_file, &total_count);
     }
 
     /* close files */
     mfu_copy_close_file(&mfu_copy_src_cache, mfu_src_file);
     mfu_copy_close_file(&mfu_copy_dst_cache, mfu_dst_file);
 
+    /* drop extents of the last file we copied from */
+    mfu_copy_extent_cache_free();
+
     /* barrier to ensure all files are closed,
      * may try to unlink bad destination files below */
     MPI_Barrier(MPI_COMM_WORLD);
@@ -2530,25 +2972,74 @@ static int mfu_copy_files(
     return rc;
 }
 
-static void mfu_sync_all(const char* msg)
+/* flush data on the file system holding path, or on all
+ * file systems if path is NULL, returns 0 on success */
+static int mfu_sync_fs(const char* path)
+{
+#ifdef HAVE_SYNCFS
+    if (path != NULL) {
+        int fd = open(path, O_RDONLY);
+        if (fd >= 0) {
+            int rc = syncfs(fd);
+            if (rc != 0) {
+                MFU_LOG(MFU_LOG_ERR, "Failed to sync file system of `%s' (errno=%d %s)",
+                    path, errno, strerror(errno));
+            }
+            close(fd);
+            return rc;
+        }
+    }
+#endif
+
+    /* fall back to syncing everything */
+    sync();
+    return 0;
+}
+
+/* force data written by all procs to disk, since procs on a node
+ * share a page cache, only one proc per node needs to sync,
+ * if path is not NULL, only the file system holding path is synced,
+ * returns 0 on all procs if every node synced, -1 otherwise */
+static int mfu_sync_all(const char* msg, const char* path)
 {
     int rank;
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 
-    MPI_Barrier(MPI_COMM_WORLD);
-    double start = MPI_Wtime();
+    /* split procs into groups that share a node */
+    MPI_Comm node_comm;
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &node_comm);
+    int node_rank;
+    MPI_Comm_rank(node_comm, &node_rank);
 
     if (rank == 0) {
         MFU_LOG(MFU_LOG_INFO, "%s", msg);
     }
-    sync();
 
-    MPI_Barrier(MPI_COMM_WORLD);
+    /* wait for procs on our node to finish writing */
+    MPI_Barrier(node_comm);
+    double start = MPI_Wtime();
+
+    /* one proc per node flushes the file system */
+    int rc = 0;
+    if (node_rank == 0) {
+        rc = mfu_sync_fs(path);
+    }
+
+    /* wait for all nodes to complete, and check whether any failed */
+    int any_rc;
+    MPI_Allreduce(&rc, &any_rc, 1, MPI_INT, MPI_LOR, MPI_COMM_WORLD);
     double end = MPI_Wtime();
 
+    MPI_Comm_free(&node_comm);
+
     if (rank == 0) {
+        if (any_rc) {
+            MFU_LOG(MFU_LOG_ERR, "Sync failed on one or more nodes.");
+        }
         MFU_LOG(MFU_LOG_INFO, "Sync completed in %.3lf seconds.", (end - start));
     }
+
+    return any_rc ? -1 : 0;
 }
 
 static void print_summary(mfu_flist flist)
@@ -2677,6 +3168,12 @@ int mfu_flist_copy(
     /* copy the destination path to user opts structure */
     copy_opts->dest_path = MFU_STRDUP((*destpath).path);
 
+    /* only the destination file system needs to be synced */
+    const char* sync_path = NULL;
+    if (mfu_dst_file->type == POSIX) {
+        sync_path = destpath->path;
+    }
+
     /* print note about what we're doing and the amount of files/data to be moved */
     if (rank == 0) {
         MFU_LOG(MFU_LOG_INFO, "Copying to %s", copy_opts->dest_path);
@@ -2703,8 +3200,8 @@ int mfu_flist_copy(
     mfu_copy_stats.total_bytes_copied = 0;
 
     /* Initialize file cache */
-    mfu_copy_src_cache.name = NULL;
-    mfu_copy_dst_cache.name = NULL;
+    mfu_copy_file_cache_init(&mfu_copy_src_cache);
+    mfu_copy_file_cache_init(&mfu_copy_dst_cache);
 
     /* split items in file list into sublists depending on their
      * directory depth */
@@ -2793,7 +3290,9 @@ int mfu_flist_copy(
 
                 /* force data to backend to avoid the following metadata
                  * setting mismatch, which may happen on lustre */
-                mfu_sync_all("Syncing data to disk.");
+                if (mfu_sync_all("Syncing data to disk.", sync_path) != 0) {
+                    rc = -1;
+                }
 
                 /* set permissions, ownership, and timestamps if needed */
                 mfu_copy_set_metadata(levels2, minlevel2, lists2, numpaths,
@@ -2806,7 +3305,9 @@ int mfu_flist_copy(
                 mfu_flist_free(&spreadlist);
 
                 /* force updates to disk */
-                mfu_sync_all("Syncing updates to disk.");
+                if (mfu_sync_all("Syncing updates to disk.", sync_path) != 0) {
+                    rc = -1;
+                }
             }
 
             /* done with our batch list */
@@ -2887,7 +3388,9 @@ int mfu_flist_copy(
                 paths, destpath, copy_opts, mfu_src_file, mfu_dst_file);
 
         /* force updates to disk */
-        mfu_sync_all("Syncing directory updates to disk.");
+        if (mfu_sync_all("Syncing directory updates to disk.", sync_path) != 0) {
+            rc = -1;
+        }
     } else {
         /* user does not want to batch files, so copy the whole list */
 
@@ -2907,14 +3410,18 @@ int mfu_flist_copy(
 
         /* force data to backend to avoid the following metadata
          * setting mismatch, which may happen on lustre */
-        mfu_sync_all("Syncing data to disk.");
+        if (mfu_sync_all("Syncing data to disk.", sync_path) != 0) {
+            rc = -1;
+        }
 
         /* set permissions, ownership, and timestamps if needed */
         mfu_copy_set_metadata(levels, minlevel, lists, numpaths,
                 paths, destpath, copy_opts, mfu_src_file, mfu_dst_file);
 
         /* force updates to disk */
-        mfu_sync_all("Syncing directory updates to disk.");
+        if (mfu_sync_all("Syncing directory updates to disk.", sync_path) != 0) {
+            rc = -1;
+        }
     }
 
     /* free our lists of levels */
@@ -3311,7 +3818,9 @@ int mfu_flist_fill(mfu_flist list, mfu_copy_opts_t* copy_opts, mfu_file_t* mfu_f
 
     /* force data to backend to avoid the following metadata
      * setting mismatch, which may happen on lustre */
-     mfu_sync_all("Syncing data to disk.");
+    if (mfu_sync_all("Syncing data to disk.", NULL) != 0) {
+        rc = -1;
+    }
 
     /* determine whether any process reported an error,
      * inputs should are either 0 or -1, so min will be -1 on any -1 */
@@ -3339,6 +3848,12 @@ int mfu_flist_hardlink(
     /* copy the destination path to user opts structure */
     copy_opts->dest_path = MFU_STRDUP((*destpath).path);
 
+    /* only the destination file system needs to be synced */
+    const char* sync_path = NULL;
+    if (mfu_dst_file->type == POSIX) {
+        sync_path = destpath->path;
+    }
+
     /* print note about what we're doing and the amount of files/data to be moved */
     if (rank == 0) {
         MFU_LOG(MFU_LOG_INFO, "Linking to %s", copy_opts->dest_path);
@@ -3357,8 +3872,8 @@ int mfu_flist_hardlink(
     mfu_copy_stats.total_bytes_copied = 0;
 
     /* Initialize file cache */
-    mfu_copy_src_cache.name = NULL;
-    mfu_copy_dst_cache.name = NULL;
+    mfu_copy_file_cache_init(&mfu_copy_src_cache);
+    mfu_copy_file_cache_init(&mfu_copy_dst_cache);
 
     /* split items in file list into sublists depending on their
      * directory depth */
@@ -3392,7 +3907,9 @@ int mfu_flist_hardlink(
             srcpath, destpath, copy_opts, mfu_src_file, mfu_dst_file);
 
     /* force updates to disk */
-    mfu_sync_all("Syncing directory updates to disk.");
+    if (mfu_sync_all("Syncing directory updates to disk.", sync_path) != 0) {
+        rc = -1;
+    }
 
     /* free our lists of levels */
     mfu_flist_array_free(levels, &lists);
@@ -3588,6 +4105,12 @@ mfu_copy_opts_t* mfu_copy_opts_new(void)
     /* By default, do not limit the batch size */
     opts->batch_files = 0;
 
+    /* By default, copy the statically assigned list of chunks */
+    opts->dynamic = false;
+
+    /* By default, split all files using chunk_size */
+    opts->adaptive = false;
+
     return opts;
 }
 
@@ -0,0 +1,863 @@
+/* for O_DIRECT and O_NOATIME */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+
+#include <openssl/evp.h>
+
+#include "mpi.h"
+#include "mfu.h"
+
+/****************************************
+ * Functions to compute per-file content digests
+ ***************************************/
+
+/* version tag written at the front of the stored xattr value,
+ * bump this if the way digests are computed ever changes */
+#define DIGEST_XATTR_VERSION "mfu3"
+
+/* start a new SHA-256 hash, which is MFU_DIGEST_WORDS * 8 bytes long */
+static void digest_init(EVP_MD_CTX* ctx)
+{
+    if (EVP_DigestInit_ex(ctx, EVP_sha256(), NULL) != 1) {
+        MFU_ABORT(1, "Failed to initialize SHA-256 digest");
+    }
+}
+
+/* continue a hash over the given bytes */
+static void digest_update(EVP_MD_CTX* ctx, const void* buf, size_t len)
+{
+    EVP_DigestUpdate(ctx, buf, len);
+}
+
+/* continue a hash over a 64-bit value in a byte order
+ * that does not depend on the host */
+static void digest_update_uint64(EVP_MD_CTX* ctx, uint64_t value)
+{
+    unsigned char buf[8];
+    int i;
+    for (i = 0; i < 8; i++) {
+        buf[i] = (unsigned char) (value >> (56 - 8 * i));
+    }
+    EVP_DigestUpdate(ctx, buf, sizeof(buf));
+}
+
+/* continue a hash over a digest */
+static void digest_update_digest(EVP_MD_CTX* ctx, const uint64_t* digest)
+{
+    int i;
+    for (i = 0; i < MFU_DIGEST_WORDS; i++) {
+        digest_update_uint64(ctx, digest[i]);
+    }
+}
+
+/* finish a hash, the digest is stored as big-endian words so that
+ * printing the words in order gives the usual SHA-256 hex string */
+static void digest_final(EVP_MD_CTX* ctx, uint64_t* digest)
+{
+    unsigned char md[EVP_MAX_MD_SIZE];
+    EVP_DigestFinal_ex(ctx, md, NULL);
+    int i, j;
+    for (i = 0; i < MFU_DIGEST_WORDS; i++) {
+        uint64_t word = 0;
+        for (j = 0; j < 8; j++) {
+            word = (word << 8) | (uint64_t) md[i * 8 + j];
+        }
+        digest[i] = word;
+    }
+}
+
+/* create a hash context, aborts if out of memory */
+static EVP_MD_CTX* digest_ctx_new(void)
+{
+    EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+    if (ctx == NULL) {
+        MFU_ABORT(1, "Failed to allocate digest context");
+    }
+    return ctx;
+}
+
+/* look for a digest stored on the file that is still valid for the
+ * size and mtime recorded in the list, returns 1 and sets digest if
+ * found, 0 otherwise */
+static int digest_load(mfu_flist list, uint64_t idx, uint64_t chunk_size,
+                       uint64_t* digest, mfu_file_t* mfu_file)
+{
+    const char* name = mfu_flist_file_get_name(list, idx);
+
+    /* the record is tied to the device and inode it was stored on,
+     * so a copy that carries the xattr along is hashed again */
+    struct stat st;
+    if (mfu_file_lstat(name, &st, mfu_file) != 0) {
+        return 0;
+    }
+
+    char value[256];
+    ssize_t len = mfu_file_lgetxattr(name, MFU_DIGEST_XATTR, value, sizeof(value) - 1, mfu_file);
+    if (len <= 0) {
+        /* no stored digest, or xattrs are not supported */
+        return 0;
+    }
+    value[len] = '\0';
+
+    char version[8];
+    uint64_t stored_chunk, stored_size, stored_mtime, stored_mtime_nsec;
+    uint64_t stored_dev, stored_ino, stored_digest[MFU_DIGEST_WORDS];
+    int n = sscanf(value, "%7s %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64
+        " %16" SCNx64 "%16" SCNx64 "%16" SCNx64 "%16" SCNx64,
+        version, &stored_chunk, &stored_size, &stored_mtime, &stored_mtime_nsec,
+        &stored_dev, &stored_ino,
+        &stored_digest[0], &stored_digest[1], &stored_digest[2], &stored_digest[3]);
+    if (n != 7 + MFU_DIGEST_WORDS || strcmp(version, DIGEST_XATTR_VERSION) != 0) {
+        MFU_LOG(MFU_LOG_DBG, "Ignoring malformed digest on `%s'", name);
+        return 0;
+    }
+
+    /* the digest only applies to the data of this file as it was
+     * when it was computed, and only at the same chunk size */
+    if (stored_dev        != (uint64_t) st.st_dev ||
+        stored_ino        != (uint64_t) st.st_ino ||
+        stored_chunk      != chunk_size ||
+        stored_size       != mfu_flist_file_get_size(list, idx) ||
+        stored_mtime      != mfu_flist_file_get_mtime(list, idx) ||
+        stored_mtime_nsec != mfu_flist_file_get_mtime_nsec(list, idx))
+    {
+        return 0;
+    }
+
+    memcpy(digest, stored_digest, sizeof(stored_digest));
+    return 1;
+}
+
+/* record digest on the file along with the size, mtime, device, and
+ * inode it applies to, failures are only reported in debug output
+ * since storing is best effort */
+static void digest_store(mfu_flist list, uint64_t idx, uint64_t chunk_size,
+                         const uint64_t* digest, mfu_file_t* mfu_file)
+{
+    const char* name = mfu_flist_file_get_name(list, idx);
+
+    struct stat st;
+    if (mfu_file_lstat(name, &st, mfu_file) != 0) {
+        MFU_LOG(MFU_LOG_DBG, "Failed to stat `%s' to store digest (errno=%d %s)",
+            name, errno, strerror(errno));
+        return;
+    }
+
+    char value[256];
+    int len = snprintf(value, sizeof(value), "%s %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64
+        " %016" PRIx64 "%016" PRIx64 "%016" PRIx64 "%016" PRIx64,
+        DIGEST_XATTR_VERSION, chunk_size,
+        mfu_flist_file_get_size(list, idx),
+        mfu_flist_file_get_mtime(list, idx),
+        mfu_flist_file_get_mtime_nsec(list, idx),
+        (uint64_t) st.st_dev,
+        (uint64_t) st.st_ino,
+        digest[0], digest[1], digest[2], digest[3]);
+
+    int rc = mfu_file_lsetxattr(name, MFU_DIGEST_XATTR, value, (size_t) len, 0, mfu_file);
+    if (rc != 0) {
+        MFU_LOG(MFU_LOG_DBG, "Failed to store digest on `%s' (errno=%d %s)",
+            name, errno, strerror(errno));
+    }
+}
+
+/* hash bytes [offset, offset+length) of an open file into one
+ * digest per chunk_size block, returns 0 on success, -1 on error */
+static int digest_chunks(const char* name, uint64_t offset, uint64_t length, uint64_t file_size,
+                         uint64_t chunk_size, int direct, void* buf, size_t buf_size, EVP_MD_CTX* ctx,
+                         uint64_t* hashes, uint64_t* bytes_read, mfu_file_t* mfu_file)
+{
+    uint64_t end = offset + length;
+    uint64_t chunk_start = offset;
+    uint64_t count = 0;
+    do {
+        /* hash one chunk, an empty file still has a single chunk */
+        uint64_t chunk_end = chunk_start + chunk_size;
+        if (chunk_end > end) {
+            chunk_end = end;
+        }
+
+        digest_init(ctx);
+        uint64_t off = chunk_start;
+        while (off < chunk_end) {
+            size_t left_to_read = buf_size;
+            if (chunk_end - off < (uint64_t) left_to_read) {
+                left_to_read = (size_t) (chunk_end - off);
+            }
+
+            ssize_t nread = mfu_file_pread(name, buf, left_to_read, (off_t) off, mfu_file);
+
+            /* with O_DIRECT, retry short reads with the same buffer and offset */
+            while (direct &&
+                   nread > 0 &&
+                   (size_t)nread < left_to_read &&
+                   (off + (uint64_t)nread) < file_size)
+            {
+                nread = mfu_file_pread(name, buf, left_to_read, (off_t) off, mfu_file);
+            }
+
+            if (nread < 0) {
+                MFU_LOG(MFU_LOG_ERR, "Failed to read `%s' at offset %llx (errno=%d %s)",
+                    name, (unsigned long long) off, errno, strerror(errno));
+                return -1;
+            }
+            if (nread == 0) {
+                MFU_LOG(MFU_LOG_ERR, "Unexpected EOF reading `%s' at offset %llx",
+                    name, (unsigned long long) off);
+                return -1;
+            }
+
+            /* with O_DIRECT we may read past the region we asked for */
+            size_t nhash = (size_t) nread;
+            if (nhash > left_to_read) {
+                nhash = left_to_read;
+            }
+
+            digest_update(ctx, buf, nhash);
+            off += (uint64_t) nhash;
+            *bytes_read += (uint64_t) nhash;
+        }
+
+        digest_final(ctx, &hashes[count * MFU_DIGEST_WORDS]);
+        count++;
+
+        chunk_start = chunk_end;
+    } while (chunk_start < end);
+
+    return 0;
+}
+
+int mfu_flist_digest(
+    mfu_flist list,
+    int flags,
+    mfu_copy_opts_t* copy_opts,
+    uint64_t* digests,
+    int* valid,
+    uint64_t* bytes_read,
+    mfu_file_t* mfu_file)
+{
+    /* assume we'll succeed */
+    int rc = 0;
+
+    uint64_t chunk_size = copy_opts->chunk_size;
+    size_t buf_size     = copy_opts->buf_size;
+    int direct          = copy_opts->direct;
+
+    int ranks;
+    MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+
+    *bytes_read = 0;
+
+    /* fill in digests we already have, and build a list of
+     * regular files we still need to read */
+    mfu_flist todo = mfu_flist_subset(list);
+    uint64_t size = mfu_flist_size(list);
+    uint64_t* todo_index = (uint64_t*) MFU_MALLOC(size * sizeof(uint64_t));
+    uint64_t todo_count = 0;
+    uint64_t loaded = 0;
+    uint64_t idx;
+    for (idx = 0; idx < size; idx++) {
+        memset(&digests[idx * MFU_DIGEST_WORDS], 0, MFU_DIGEST_WORDS * sizeof(uint64_t));
+        valid[idx] = 0;
+
+        mfu_filetype type = mfu_flist_file_get_type(list, idx);
+        if (type != MFU_TYPE_FILE) {
+            continue;
+        }
+
+        if ((flags & MFU_DIGEST_LOAD) &&
+            digest_load(list, idx, chunk_size, &digests[idx * MFU_DIGEST_WORDS], mfu_file))
+        {
+            valid[idx] = 1;
+            loaded++;
+            continue;
+        }
+
+        mfu_flist_file_copy(list, idx, todo);
+        todo_index[todo_count] = idx;
+        todo_count++;
+    }
+    mfu_flist_summarize(todo);
+
+    /* report how many digests were reused */
+    uint64_t all_loaded;
+    MPI_Allreduce(&loaded, &all_loaded, 1, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+    uint64_t all_todo = mfu_flist_global_size(todo);
+    if (mfu_debug_level >= MFU_LOG_VERBOSE && mfu_rank == 0) {
+        MFU_LOG(MFU_LOG_INFO, "Using %llu stored digests, computing %llu",
+            (unsigned long long) all_loaded, (unsigned long long) all_todo);
+    }
+
+    /* split remaining files into chunks and spread them over ranks,
+     * each rank hashes its chunks independently */
+    mfu_file_chunk* head = mfu_file_chunk_list_alloc(todo, chunk_size);
+
+    /* count the number of chunk hashes we'll compute,
+     * an element may cover several consecutive chunks */
+    uint64_t nhashes = 0;
+    const mfu_file_chunk* p;
+    for (p = head; p != NULL; p = p->next) {
+        uint64_t n = (p->length + chunk_size - 1) / chunk_size;
+        nhashes += (n > 0) ? n : 1;
+    }
+
+    /* each chunk digest is sent to the owner of the file as a tuple
+     * of (file index, chunk id, error, digest) */
+    int width = 3 + MFU_DIGEST_WORDS;
+    int* sendcounts = (int*) MFU_MALLOC((size_t)ranks * sizeof(int));
+    int* senddisps  = (int*) MFU_MALLOC((size_t)ranks * sizeof(int));
+    int* recvcounts = (int*) MFU_MALLOC((size_t)ranks * sizeof(int));
+    int* recvdisps  = (int*) MFU_MALLOC((size_t)ranks * sizeof(int));
+    uint64_t* sendbuf = (uint64_t*) MFU_MALLOC(nhashes * (size_t)width * sizeof(uint64_t));
+    uint64_t* hashes  = (uint64_t*) MFU_MALLOC(nhashes * MFU_DIGEST_WORDS * sizeof(uint64_t));
+    EVP_MD_CTX* ctx = digest_ctx_new();
+
+    /* allocate buffer to read files, aligned for O_DIRECT */
+    size_t alignment = 1024*1024;
+    void* buf = MFU_MEMALIGN(buf_size, alignment);
+
+    int i;
+    for (i = 0; i < ranks; i++) {
+        sendcounts[i] = 0;
+    }
+
+    /* read and hash our chunks, the list is ordered by destination rank
+     * so tuples for the same rank end up next to each other */
+    uint64_t* sendptr = sendbuf;
+    for (p = head; p != NULL; p = p->next) {
+        uint64_t n = (p->length + chunk_size - 1) / chunk_size;
+        if (n == 0) {
+            n = 1;
+        }
+
+        int err = 0;
+
+        int open_flags = O_RDONLY;
+        if (copy_opts->open_noatime) {
+            open_flags |= O_NOATIME;
+        }
+        if (direct) {
+            open_flags |= O_DIRECT;
+        }
+
+        if (mfu_file_open(p->name, open_flags, mfu_file) != 0) {
+            MFU_LOG(MFU_LOG_ERR, "Failed to open `%s' (errno=%d %s)",
+                p->name, errno, strerror(errno));
+            err = 1;
+        } else {
+            if (digest_chunks(p->name, p->offset, p->length, p->file_size, chunk_size,
+                              direct, buf, buf_size, ctx, hashes, bytes_read, mfu_file) != 0)
+            {
+                err = 1;
+            }
+            mfu_file_close(p->name, mfu_file);
+        }
+
+        uint64_t first = p->offset / chunk_size;
+        uint64_t j;
+        for (j = 0; j < n; j++) {
+            sendptr[0] = p->index_of_owner;
+            sendptr[1] = first + j;
+            sendptr[2] = (uint64_t) err;
+            if (err) {
+                memset(&sendptr[3], 0, MFU_DIGEST_WORDS * sizeof(uint64_t));
+            } else {
+                memcpy(&sendptr[3], &hashes[j * MFU_DIGEST_WORDS], MFU_DIGEST_WORDS * sizeof(uint64_t));
+            }
+            sendptr += width;
+        }
+        sendcounts[p->rank_of_owner] += (int) n * width;
+
+        if (err) {
+            rc = -1;
+        }
+    }
+
+    mfu_free(&buf);
+    mfu_free(&hashes);
+
+    /* exchange chunk hashes so the owner of each file gets all of them */
+    senddisps[0] = 0;
+    for (i = 1; i < ranks; i++) {
+        senddisps[i] = senddisps[i - 1] + sendcounts[i - 1];
+    }
+
+    MPI_Alltoall(sendcounts, 1, MPI_INT, recvcounts, 1, MPI_INT, MPI_COMM_WORLD);
+
+    int recv_total = recvcounts[0];
+    recvdisps[0] = 0;
+    for (i = 1; i < ranks; i++) {
+        recv_total += recvcounts[i];
+        recvdisps[i] = recvdisps[i - 1] + recvcounts[i - 1];
+    }
+
+    uint64_t* recvbuf = (uint64_t*) MFU_MALLOC((size_t)recv_total * sizeof(uint64_t));
+    MPI_Alltoallv(
+        sendbuf, sendcounts, senddisps, MPI_UINT64_T,
+        recvbuf, recvcounts, recvdisps, MPI_UINT64_T, MPI_COMM_WORLD
+    );
+
+    /* compute where the chunk hashes of each of our files start */
+    uint64_t* starts = (uint64_t*) MFU_MALLOC((todo_count + 1) * sizeof(uint64_t));
+    starts[0] = 0;
+    for (idx = 0; idx < todo_count; idx++) {
+        uint64_t file_size = mfu_flist_file_get_size(todo, idx);
+        uint64_t n = (file_size + chunk_size - 1) / chunk_size;
+        starts[idx + 1] = starts[idx] + ((n > 0) ? n : 1);
+    }
+
+    uint64_t* chunks = (uint64_t*) MFU_MALLOC(starts[todo_count] * MFU_DIGEST_WORDS * sizeof(uint64_t));
+    int* errors = (int*) MFU_MALLOC(todo_count * sizeof(int));
+    for (idx = 0; idx < todo_count; idx++) {
+        errors[idx] = 0;
+    }
+
+    int disp;
+    for (disp = 0; disp < recv_total; disp += width) {
+        uint64_t file_index = recvbuf[disp];
+        uint64_t chunk_id   = recvbuf[disp + 1];
+        if (recvbuf[disp + 2]) {
+            errors[file_index] = 1;
+        }
+        memcpy(&chunks[(starts[file_index] + chunk_id) * MFU_DIGEST_WORDS], &recvbuf[disp + 3],
+            MFU_DIGEST_WORDS * sizeof(uint64_t));
+    }
+
+    /* combine chunk digests into a single digest per file,
+     * the file size is mixed in so that the digest also covers the length */
+    for (idx = 0; idx < todo_count; idx++) {
+        if (errors[idx]) {
+            continue;
+        }
+
+        uint64_t file_size = mfu_flist_file_get_size(todo, idx);
+        digest_init(ctx);
+        digest_update_uint64(ctx, file_size);
+        uint64_t c;
+        for (c = starts[idx]; c < starts[idx + 1]; c++) {
+            digest_update_digest(ctx, &chunks[c * MFU_DIGEST_WORDS]);
+        }
+
+        uint64_t orig = todo_index[idx];
+        digest_final(ctx, &digests[orig * MFU_DIGEST_WORDS]);
+        valid[orig] = 1;
+
+        if (flags & MFU_DIGEST_STORE) {
+            digest_store(list, orig, chunk_size, &digests[orig * MFU_DIGEST_WORDS], mfu_file);
+        }
+    }
+
+    EVP_MD_CTX_free(ctx);
+
+    mfu_free(&errors);
+    mfu_free(&chunks);
+    mfu_free(&starts);
+    mfu_free(&recvbuf);
+    mfu_free(&sendbuf);
+    mfu_free(&recvdisps);
+    mfu_free(&recvcounts);
+    mfu_free(&senddisps);
+    mfu_free(&sendcounts);
+    mfu_file_chunk_list_free(&head);
+    mfu_free(&todo_index);
+    mfu_flist_free(&todo);
+
+    /* determine whether any process hit an error */
+    int all_rc;
+    MPI_Allreduce(&rc, &all_rc, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+    return all_rc;
+}
+
+/****************************************
+ * Functions to compute hierarchical directory digests
+ ***************************************/
+
+/* a set of tuples of uint64_t values exchanged between ranks,
+ * sendcounts and recvcounts are kept so replies can be sent
+ * back along the same path */
+typedef struct {
+    int width;           /* number of uint64_t values per tuple */
+    int* sendcounts;     /* number of uint64_t values sent to each rank */
+    int* senddisps;
+    int* recvcounts;     /* number of uint64_t values received from each rank */
+    int* recvdisps;
+    uint64_t* order;     /* original index of each tuple in send order */
+    uint64_t* recvbuf;   /* received tuples */
+    uint64_t recv_count; /* number of received tuples */
+} digest_xchg;
+
+/* send count tuples of the given width to dests[i], on return
+ * x->recvbuf holds the tuples sent to this rank */
+static void digest_xchg_send(digest_xchg* x, int width, const uint64_t* tuples,
+                             const int* dests, uint64_t count)
+{
+    int ranks;
+    MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+
+    x->width      = width;
+    x->sendcounts = (int*) MFU_MALLOC((size_t)ranks * sizeof(int));
+    x->senddisps  = (int*) MFU_MALLOC((size_t)ranks * sizeof(int));
+    x->recvcounts = (int*) MFU_MALLOC((size_t)ranks * sizeof(int));
+    x->recvdisps  = (int*) MFU_MALLOC((size_t)ranks * sizeof(int));
+    x->order      = (uint64_t*) MFU_MALLOC(count * sizeof(uint64_t));
+
+    int i;
+    for (i = 0; i < ranks; i++) {
+        x->sendcounts[i] = 0;
+    }
+    uint64_t idx;
+    for (idx = 0; idx < count; idx++) {
+        x->sendcounts[dests[idx]] += width;
+    }
+    x->senddisps[0] = 0;
+    for (i = 1; i < ranks; i++) {
+        x->senddisps[i] = x->senddisps[i - 1] + x->sendcounts[i - 1];
+    }
+
+    /* pack tuples in rank order, remembering where each came from */
+    int* offsets = (int*) MFU_MALLOC((size_t)ranks * sizeof(int));
+    for (i = 0; i < ranks; i++) {
+        offsets[i] = x->senddisps[i];
+    }
+    uint64_t* sendbuf = (uint64_t*) MFU_MALLOC(count * (size_t)width * sizeof(uint64_t));
+    for (idx = 0; idx < count; idx++) {
+        int dest = dests[idx];
+        memcpy(&sendbuf[offsets[dest]], &tuples[idx * width], (size_t)width * sizeof(uint64_t));
+        x->order[offsets[dest] / width] = idx;
+        offsets[dest] += width;
+    }
+    mfu_free(&offsets);
+
+    MPI_Alltoall(x->sendcounts, 1, MPI_INT, x->recvcounts, 1, MPI_INT, MPI_COMM_WORLD);
+
+    int recv_total = x->recvcounts[0];
+    x->recvdisps[0] = 0;
+    for (i = 1; i < ranks; i++) {
+        recv_total += x->recvcounts[i];
+        x->recvdisps[i] = x->recvdisps[i - 1] + x->recvcounts[i - 1];
+    }
+
+    x->recvbuf = (uint64_t*) MFU_MALLOC((size_t)recv_total * sizeof(uint64_t));
+    MPI_Alltoallv(
+        sendbuf, x->sendcounts, x->senddisps, MPI_UINT64_T,
+        x->recvbuf, x->recvcounts, x->recvdisps, MPI_UINT64_T, MPI_COMM_WORLD
+    );
+    x->recv_count = (uint64_t)recv_total / (uint64_t)width;
+
+    mfu_free(&sendbuf);
+}
+
+/* send one reply tuple of the given width back for each received tuple,
+ * fills replies in the original order of the tuples passed to send */
+static void digest_xchg_reply(digest_xchg* x, int width, const uint64_t* answers, uint64_t* replies)
+{
+    int ranks;
+    MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+
+    /* scale counts from request width to reply width */
+    int* scounts = (int*) MFU_MALLOC((size_t)ranks * sizeof(int));
+    int* sdisps  = (int*) MFU_MALLOC((size_t)ranks * sizeof(int));
+    int* rcounts = (int*) MFU_MALLOC((size_t)ranks * sizeof(int));
+    int* rdisps  = (int*) MFU_MALLOC((size_t)ranks * sizeof(int));
+    int i;
+    for (i = 0; i < ranks; i++) {
+        scounts[i] = x->recvcounts[i] / x->width * width;
+        sdisps[i]  = x->recvdisps[i]  / x->width * width;
+        rcounts[i] = x->sendcounts[i] / x->width * width;
+        rdisps[i]  = x->senddisps[i]  / x->width * width;
+    }
+
+    uint64_t count = 0;
+    for (i = 0; i < ranks; i++) {
+        count += (uint64_t) (x->sendcounts[i] / x->width);
+    }
+    uint64_t* recvbuf = (uint64_t*) MFU_MALLOC(count * (size_t)width * sizeof(uint64_t));
+
+    MPI_Alltoallv(
+        (void*)answers, scounts, sdisps, MPI_UINT64_T,
+        recvbuf, rcounts, rdisps, MPI_UINT64_T, MPI_COMM_WORLD
+    );
+
+    /* put replies back in the order of the original tuples */
+    uint64_t idx;
+    for (idx = 0; idx < count; idx++) {
+        memcpy(&replies[x->order[idx] * width], &recvbuf[idx * width], (size_t)width * sizeof(uint64_t));
+    }
+
+    mfu_free(&recvbuf);
+    mfu_free(&rdisps);
+    mfu_free(&rcounts);
+    mfu_free(&sdisps);
+    mfu_free(&scounts);
+}
+
+static void digest_xchg_free(digest_xchg* x)
+{
+    mfu_free(&x->recvbuf);
+    mfu_free(&x->order);
+    mfu_free(&x->recvdisps);
+    mfu_free(&x->recvcounts);
+    mfu_free(&x->senddisps);
+    mfu_free(&x->sendcounts);
+}
+
+/* sort received tuples by their first value, the path hash */
+static int digest_tuple_cmp(const void* a, const void* b)
+{
+    uint64_t ka = ((const uint64_t*) a)[0];
+    uint64_t kb = ((const uint64_t*) b)[0];
+    if (ka != kb) {
+        return (ka < kb) ? -1 : 1;
+    }
+    return 0;
+}
+
+/* rank responsible for collecting the entries of a directory */
+static int digest_path_rank(uint64_t hash, int ranks)
+{
+    return (int) (hash % (uint64_t) ranks);
+}
+
+/* digest of a symlink is a hash of its target */
+static int digest_symlink(const char* name, EVP_MD_CTX* ctx, uint64_t* digest, mfu_file_t* mfu_file)
+{
+    char target[PATH_MAX + 1];
+    ssize_t len = mfu_file_readlink(name, target, sizeof(target) - 1, mfu_file);
+    if (len < 0) {
+        MFU_LOG(MFU_LOG_ERR, "Failed to read link `%s' readlink() (errno=%d %s)",
+            name, errno, strerror(errno));
+        return -1;
+    }
+    digest_init(ctx);
+    digest_update(ctx, target, (size_t) len);
+    digest_final(ctx, digest);
+    return 0;
+}
+
+/* hash an item as seen by its parent directory, covering its name,
+ * type, size (except for directories), mtime, and digest */
+static void digest_entry(mfu_flist list, uint64_t idx, const uint64_t* digest,
+                         EVP_MD_CTX* ctx, uint64_t* entry)
+{
+    const char* name = mfu_flist_file_get_name(list, idx);
+    const char* base = strrchr(name, '/');
+    base = (base != NULL) ? base + 1 : name;
+
+    mfu_filetype type = mfu_flist_file_get_type(list, idx);
+
+    digest_init(ctx);
+    digest_update(ctx, base, strlen(base) + 1);
+    digest_update_uint64(ctx, (uint64_t) type);
+    if (type != MFU_TYPE_DIR) {
+        digest_update_uint64(ctx, mfu_flist_file_get_size(list, idx));
+    }
+    digest_update_uint64(ctx, mfu_flist_file_get_mtime(list, idx));
+    digest_update_uint64(ctx, mfu_flist_file_get_mtime_nsec(list, idx));
+    digest_update_digest(ctx, digest);
+    digest_final(ctx, entry);
+}
+
+int mfu_flist_tree_digest(
+    mfu_flist list,
+    int flags,
+    mfu_copy_opts_t* copy_opts,
+    uint64_t* digests,
+    int* valid,
+    uint64_t* bytes_read,
+    mfu_file_t* mfu_file)
+{
+    int ranks;
+    MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+
+    /* start with content digests of regular files */
+    int rc = mfu_flist_digest(list, flags, copy_opts, digests, valid, bytes_read, mfu_file);
+
+    /* add symlink targets, other items have no content of their own */
+    EVP_MD_CTX* ctx = digest_ctx_new();
+    uint64_t size = mfu_flist_size(list);
+    uint64_t idx;
+    for (idx = 0; idx < size; idx++) {
+        mfu_filetype type = mfu_flist_file_get_type(list, idx);
+        if (type == MFU_TYPE_LINK) {
+            const char* name = mfu_flist_file_get_name(list, idx);
+            if (digest_symlink(name, ctx, &digests[idx * MFU_DIGEST_WORDS], mfu_file) == 0) {
+                valid[idx] = 1;
+            } else {
+                rc = -1;
+            }
+        } else if (type != MFU_TYPE_FILE) {
+            valid[idx] = 1;
+        }
+    }
+
+    /* split items by depth, items keep their relative order so we
+     * can map them back to their index in the original list */
+    int levels, minlevel;
+    mfu_flist* lists;
+    mfu_flist_array_by_depth(list, &levels, &minlevel, &lists);
+
+    uint64_t** level_index = (uint64_t**) MFU_MALLOC((size_t)levels * sizeof(uint64_t*));
+    uint64_t* level_count  = (uint64_t*)  MFU_MALLOC((size_t)levels * sizeof(uint64_t));
+    int level;
+    for (level = 0; level < levels; level++) {
+        level_index[level] = (uint64_t*) MFU_MALLOC(mfu_flist_size(lists[level]) * sizeof(uint64_t));
+        level_count[level] = 0;
+    }
+    for (idx = 0; idx < size; idx++) {
+        level = mfu_flist_file_get_depth(list, idx) - minlevel;
+        level_index[level][level_count[level]] = idx;
+        level_count[level]++;
+    }
+
+    /* entries collected for directories of the current level on this rank,
+     * as (path hash, number of entries, error, sum of entry digests)
+     * sorted by hash, where each word of the entry digests is summed
+     * on its own, an answer to a query drops the path hash */
+    int dir_width    = 3 + MFU_DIGEST_WORDS;
+    int answer_width = 2 + MFU_DIGEST_WORDS;
+    int entry_width  = 2 + MFU_DIGEST_WORDS;
+    uint64_t* dirs = NULL;
+    uint64_t dir_count = 0;
+
+    /* work from the deepest level up, each level needs the
+     * digests of all directories below it */
+    for (level = levels - 1; level >= 0; level--) {
+        uint64_t count = level_count[level];
+        const uint64_t* index = level_index[level];
+
+        /* look up the entries collected for each directory on this level */
+        uint64_t* queries = (uint64_t*) MFU_MALLOC(count * sizeof(uint64_t));
+        int* dests        = (int*) MFU_MALLOC(count * sizeof(int));
+        uint64_t* qpos    = (uint64_t*) MFU_MALLOC(count * sizeof(uint64_t));
+        uint64_t nqueries = 0;
+        uint64_t i;
+        for (i = 0; i < count; i++) {
+            idx = index[i];
+            if (mfu_flist_file_get_type(list, idx) != MFU_TYPE_DIR) {
+                continue;
+            }
+            const char* name = mfu_flist_file_get_name(list, idx);
+            uint64_t hash = mfu_hash_fnv1a64(name, strlen(name));
+            queries[nqueries] = hash;
+            dests[nqueries]   = digest_path_rank(hash, ranks);
+            qpos[nqueries]    = idx;
+            nqueries++;
+        }
+
+        digest_xchg qx;
+        digest_xchg_send(&qx, 1, queries, dests, nqueries);
+
+        /* answer with (count, error, sum) for each directory asked about,
+         * a directory with no entries has a zero sum and count */
+        uint64_t* answers = (uint64_t*) MFU_MALLOC(qx.recv_count * (size_t)answer_width * sizeof(uint64_t));
+        for (i = 0; i < qx.recv_count; i++) {
+            uint64_t key = qx.recvbuf[i];
+            uint64_t* found = NULL;
+            if (dir_count > 0) {
+                found = (uint64_t*) bsearch(&key, dirs, dir_count, (size_t)dir_width * sizeof(uint64_t), digest_tuple_cmp);
+            }
+            uint64_t* answer = &answers[i * (uint64_t)answer_width];
+            if (found != NULL) {
+                memcpy(answer, &found[1], (size_t)answer_width * sizeof(uint64_t));
+            } else {
+                memset(answer, 0, (size_t)answer_width * sizeof(uint64_t));
+            }
+        }
+
+        uint64_t* replies = (uint64_t*) MFU_MALLOC(nqueries * (size_t)answer_width * sizeof(uint64_t));
+        digest_xchg_reply(&qx, answer_width, answers, replies);
+        digest_xchg_free(&qx);
+        mfu_free(&answers);
+        mfu_free(&dirs);
+        dir_count = 0;
+
+        /* the digest of a directory combines the entries below it,
+         * entries are summed so the order they arrive in does not matter */
+        for (i = 0; i < nqueries; i++) {
+            const uint64_t* reply = &replies[i * (uint64_t)answer_width];
+            digest_init(ctx);
+            digest_update_uint64(ctx, reply[0]);
+            digest_update_digest(ctx, &reply[2]);
+            digest_final(ctx, &digests[qpos[i] * MFU_DIGEST_WORDS]);
+            valid[qpos[i]] = (reply[1] == 0);
+        }
+
+        mfu_free(&replies);
+        mfu_free(&qpos);
+        mfu_free(&dests);
+        mfu_free(&queries);
+
+        /* items at the top level have no parent in the list */
+        if (level == 0) {
+            break;
+        }
+
+        /* send the entry of each item on this level to the rank
+         * collecting entries for its parent directory */
+        uint64_t* entries = (uint64_t*) MFU_MALLOC(count * (size_t)entry_width * sizeof(uint64_t));
+        int* edests       = (int*) MFU_MALLOC(count * sizeof(int));
+        for (i = 0; i < count; i++) {
+            idx = index[i];
+            const char* name = mfu_flist_file_get_name(list, idx);
+            const char* slash = strrchr(name, '/');
+            size_t parent_len = (slash != NULL) ? (size_t)(slash - name) : 0;
+            uint64_t parent = mfu_hash_fnv1a64(name, parent_len);
+
+            uint64_t* entry = &entries[i * (uint64_t)entry_width];
+            entry[0] = parent;
+            entry[1] = valid[idx] ? 0 : 1;
+            digest_entry(list, idx, &digests[idx * MFU_DIGEST_WORDS], ctx, &entry[2]);
+            edests[i] = digest_path_rank(parent, ranks);
+        }
+
+        digest_xchg ex;
+        digest_xchg_send(&ex, entry_width, entries, edests, count);
+        mfu_free(&edests);
+        mfu_free(&entries);
+
+        /* sort entries by parent and sum them up per directory */
+        qsort(ex.recvbuf, ex.recv_count, (size_t)entry_width * sizeof(uint64_t), digest_tuple_cmp);
+        dirs = (uint64_t*) MFU_MALLOC(ex.recv_count * (size_t)dir_width * sizeof(uint64_t));
+        for (i = 0; i < ex.recv_count; i++) {
+            const uint64_t* e = &ex.recvbuf[i * (uint64_t)entry_width];
+            if (dir_count == 0 || dirs[(dir_count - 1) * (uint64_t)dir_width] != e[0]) {
+                uint64_t* d = &dirs[dir_count * (uint64_t)dir_width];
+                memset(d, 0, (size_t)dir_width * sizeof(uint64_t));
+                d[0] = e[0];
+                dir_count++;
+            }
+            uint64_t* d = &dirs[(dir_count - 1) * (uint64_t)dir_width];
+            d[1]++;
+            d[2] |= e[1];
+            int w;
+            for (w = 0; w < MFU_DIGEST_WORDS; w++) {
+                d[3 + w] += e[2 + w];
+            }
+        }
+        digest_xchg_free(&ex);
+    }
+
+    EVP_MD_CTX_free(ctx);
+
+    mfu_free(&dirs);
+    for (level = 0; level < levels; level++) {
+        mfu_free(&level_index[level]);
+    }
+    mfu_free(&level_index);
+    mfu_free(&level_count);
+    mfu_flist_array_free(levels, &lists);
+
+    /* determine whether any process hit an error */
+    int all_rc;
+    MPI_Allreduce(&rc, &all_rc, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+    return all_rc;
+}
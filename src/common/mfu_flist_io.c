@@ -21,6 +21,8 @@
 #include <grp.h> /* for getgrent */
 #include <errno.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <bzlib.h>
 
 #include "dtcmp.h"
 #include "mfu.h"
@@ -35,6 +37,41 @@ static char mpierrstr[MPI_MAX_ERROR_STRING];
 static char datarep_ext32[]  = "external32";
 static char datarep_native[] = "native";
 
+/* v5 caches hold items in blocks of this many entries */
+#define CACHE_V5_BLOCK (64 * 1024)
+
+/* number of uint64_t fields in the v5 header, including the version */
+#define CACHE_V5_HEADER (10)
+
+/* number of uint64_t stat columns in a v5 block */
+#define CACHE_V5_COLUMNS (10)
+
+/* number of uint64_t fields in a v5 block index entry */
+#define CACHE_V5_INDEX (13)
+
+/* v5 header flag set when blocks may be compressed */
+#define CACHE_V5_BZ2 (1)
+
+/* v5 header flag set when the file is an index of shard files */
+#define CACHE_V5_SHARDS (2)
+
+/* describes a block of items in a v5 cache */
+typedef struct {
+    uint64_t count;     /* number of items in block */
+    uint64_t offset;    /* byte offset of block in file */
+    uint64_t stored;    /* number of bytes stored in file */
+    uint64_t raw;       /* number of bytes after decompression */
+    uint64_t types;     /* bit mask of item types in block */
+    uint64_t min_size;  /* smallest file size in block */
+    uint64_t max_size;  /* largest file size in block */
+    uint64_t min_mtime; /* oldest mtime in block */
+    uint64_t max_mtime; /* newest mtime in block */
+    uint64_t min_uid;   /* smallest uid in block */
+    uint64_t max_uid;   /* largest uid in block */
+    uint64_t min_gid;   /* smallest gid in block */
+    uint64_t max_gid;   /* largest gid in block */
+} cache_v5_block_t;
+
 static void mfu_pack_io_uint32(char** pptr, uint32_t value)
 {
     /* convert from host to network order */
@@ -343,6 +380,26 @@ static size_t list_insert_ptr(flist_t* flist, char* ptr, int detail, uint64_t ch
     return bytes;
 }
 
+/* returns 1 if a packed record with stat data is within bounds,
+ * reads fields in place so that records outside the bounds can be
+ * skipped without allocating an element */
+static int list_elem_packed_match(const char* buf, uint64_t chars, const mfu_pred_bounds* bounds)
+{
+    const char* ptr = buf + chars;
+    uint64_t mode, uid, gid, atime, atime_nsec, mtime, mtime_nsec, ctime, ctime_nsec, size;
+    mfu_unpack_io_uint64(&ptr, &mode);
+    mfu_unpack_io_uint64(&ptr, &uid);
+    mfu_unpack_io_uint64(&ptr, &gid);
+    mfu_unpack_io_uint64(&ptr, &atime);
+    mfu_unpack_io_uint64(&ptr, &atime_nsec);
+    mfu_unpack_io_uint64(&ptr, &mtime);
+    mfu_unpack_io_uint64(&ptr, &mtime_nsec);
+    mfu_unpack_io_uint64(&ptr, &ctime);
+    mfu_unpack_io_uint64(&ptr, &ctime_nsec);
+    mfu_unpack_io_uint64(&ptr, &size);
+    return mfu_pred_bounds_check(bounds, buf, mode, uid, gid, mtime, size);
+}
+
 /****************************************
  * Read file list from file
  ***************************************/
@@ -846,6 +903,7 @@ static void read_cache_v4(
     MPI_Offset* outdisp,
     MPI_File fh,
     const char* datarep,
+    const mfu_pred_bounds* bounds,
     flist_t* flist)
 {
     MPI_Status status;
@@ -1058,8 +1116,11 @@ static void read_cache_v4(
             char* ptr = (char*) buf;
             uint64_t packcount = 0;
             while (packcount < (uint64_t) read_count) {
-                /* unpack item from buffer and advance pointer */
-                list_insert_ptr(flist, ptr, 1, chars);
+                /* unpack item from buffer and advance pointer,
+                 * skipping items that can't satisfy the caller's tests */
+                if (bounds == NULL || list_elem_packed_match(ptr, chars, bounds)) {
+                    list_insert_ptr(flist, ptr, 1, chars);
+                }
                 ptr += elem_size;
                 packcount++;
             }
@@ -1080,9 +1141,540 @@ static void read_cache_v4(
     return;
 }
 
-void mfu_flist_read_cache(
+/* read a list of users or groups written with write_cache_buft,
+ * returns number of bytes consumed from file */
+static MPI_Offset read_cache_buft(
     const char* name,
-    mfu_flist bflist)
+    MPI_File fh,
+    const char* datarep,
+    MPI_Offset disp,
+    buf_t* items)
+{
+    if (items->count == 0 || items->chars == 0) {
+        return 0;
+    }
+
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    /* create type and allocate memory to hold data */
+    mfu_flist_usrgrp_create_stridtype((int)items->chars, &(items->dt));
+    MPI_Aint lb, extent;
+    MPI_Type_get_extent(items->dt, &lb, &extent);
+    items->bufsize = items->count * (size_t)extent;
+    items->buf = (void*) MFU_MALLOC(items->bufsize);
+
+    /* set view to read data */
+    int mpirc = MPI_File_set_view(fh, disp, MPI_BYTE, MPI_BYTE, datarep, MPI_INFO_NULL);
+    if (mpirc != MPI_SUCCESS) {
+        MPI_Error_string(mpirc, mpierrstr, &mpierrlen);
+        MFU_ABORT(1, "Failed to set view on file: `%s' rc=%d %s", name, mpirc, mpierrstr);
+    }
+
+    /* rank 0 reads data and broadcasts */
+    int bufsize = (int) buft_pack_size(items);
+    if (rank == 0) {
+        MPI_Status status;
+        char* buf = (char*) MFU_MALLOC(bufsize);
+        mpirc = MPI_File_read_at(fh, 0, buf, bufsize, MPI_BYTE, &status);
+        if (mpirc != MPI_SUCCESS) {
+            MPI_Error_string(mpirc, mpierrstr, &mpierrlen);
+            MFU_ABORT(1, "Failed to read file: `%s' rc=%d %s", name, mpirc, mpierrstr);
+        }
+        buft_unpack(buf, items);
+        mfu_free(&buf);
+    }
+    MPI_Bcast(items->buf, (int)items->count, items->dt, 0, MPI_COMM_WORLD);
+
+    return (MPI_Offset) bufsize;
+}
+
+/* round up to a multiple of 8 bytes, so every integer in a
+ * memory mapped v5 cache is naturally aligned */
+static uint64_t cache_v5_pad8(uint64_t bytes)
+{
+    return (bytes + 7) & ~((uint64_t)7);
+}
+
+/* number of bytes in a decompressed v5 block with count items
+ * and heap bytes of file names */
+static uint64_t cache_v5_block_raw(uint64_t count, uint64_t heap)
+{
+    return (CACHE_V5_COLUMNS * count + count + 1) * 8 + cache_v5_pad8(heap);
+}
+
+static void cache_v5_block_pack(char** pptr, const cache_v5_block_t* b)
+{
+    mfu_pack_io_uint64(pptr, b->count);
+    mfu_pack_io_uint64(pptr, b->offset);
+    mfu_pack_io_uint64(pptr, b->stored);
+    mfu_pack_io_uint64(pptr, b->raw);
+    mfu_pack_io_uint64(pptr, b->types);
+    mfu_pack_io_uint64(pptr, b->min_size);
+    mfu_pack_io_uint64(pptr, b->max_size);
+    mfu_pack_io_uint64(pptr, b->min_mtime);
+    mfu_pack_io_uint64(pptr, b->max_mtime);
+    mfu_pack_io_uint64(pptr, b->min_uid);
+    mfu_pack_io_uint64(pptr, b->max_uid);
+    mfu_pack_io_uint64(pptr, b->min_gid);
+    mfu_pack_io_uint64(pptr, b->max_gid);
+}
+
+static void cache_v5_block_unpack(const char** pptr, cache_v5_block_t* b)
+{
+    mfu_unpack_io_uint64(pptr, &b->count);
+    mfu_unpack_io_uint64(pptr, &b->offset);
+    mfu_unpack_io_uint64(pptr, &b->stored);
+    mfu_unpack_io_uint64(pptr, &b->raw);
+    mfu_unpack_io_uint64(pptr, &b->types);
+    mfu_unpack_io_uint64(pptr, &b->min_size);
+    mfu_unpack_io_uint64(pptr, &b->max_size);
+    mfu_unpack_io_uint64(pptr, &b->min_mtime);
+    mfu_unpack_io_uint64(pptr, &b->max_mtime);
+    mfu_unpack_io_uint64(pptr, &b->min_uid);
+    mfu_unpack_io_uint64(pptr, &b->max_uid);
+    mfu_unpack_io_uint64(pptr, &b->min_gid);
+    mfu_unpack_io_uint64(pptr, &b->max_gid);
+}
+
+/* returns 1 if any item in block may be within bounds */
+static int cache_v5_block_match(const cache_v5_block_t* block, const mfu_pred_bounds* bounds)
+{
+    if (! (block->types & bounds->types)) {
+        return 0;
+    }
+    if (block->max_size < bounds->min_size || block->min_size > bounds->max_size) {
+        return 0;
+    }
+    if (block->max_mtime < bounds->min_mtime || block->min_mtime > bounds->max_mtime) {
+        return 0;
+    }
+    if (block->max_uid < bounds->min_uid || block->min_uid > bounds->max_uid) {
+        return 0;
+    }
+    if (block->max_gid < bounds->min_gid || block->min_gid > bounds->max_gid) {
+        return 0;
+    }
+    return 1;
+}
+
+/* decode items from a decompressed v5 block and append them to flist,
+ * items outside bounds (if given) are skipped before allocating them */
+static void cache_v5_block_decode(const char* buf, uint64_t count, const mfu_pred_bounds* bounds, flist_t* flist)
+{
+    /* get pointers to each column */
+    const char* cols[CACHE_V5_COLUMNS];
+    int c;
+    for (c = 0; c < CACHE_V5_COLUMNS; c++) {
+        cols[c] = buf + (uint64_t)c * count * 8;
+    }
+    const char* name_offs = buf + CACHE_V5_COLUMNS * count * 8;
+    const char* heap = name_offs + (count + 1) * 8;
+
+    uint64_t i;
+    for (i = 0; i < count; i++) {
+        /* read fields in place */
+        uint64_t name_off;
+        uint64_t vals[CACHE_V5_COLUMNS];
+        mfu_unpack_io_uint64(&name_offs, &name_off);
+        for (c = 0; c < CACHE_V5_COLUMNS; c++) {
+            mfu_unpack_io_uint64(&cols[c], &vals[c]);
+        }
+        const char* file = heap + name_off;
+
+        /* skip items that can't satisfy the caller's tests */
+        if (bounds != NULL &&
+            ! mfu_pred_bounds_check(bounds, file, vals[0], vals[1], vals[2], vals[5], vals[9]))
+        {
+            continue;
+        }
+
+        /* create new element to record file path, file type, and stat info */
+        elem_t* elem = (elem_t*) MFU_MALLOC(sizeof(elem_t));
+        elem->file       = MFU_STRDUP(file);
+        elem->depth      = mfu_flist_compute_depth(file);
+        elem->detail     = 1;
+        elem->mode       = vals[0];
+        elem->uid        = vals[1];
+        elem->gid        = vals[2];
+        elem->atime      = vals[3];
+        elem->atime_nsec = vals[4];
+        elem->mtime      = vals[5];
+        elem->mtime_nsec = vals[6];
+        elem->ctime      = vals[7];
+        elem->ctime_nsec = vals[8];
+        elem->size       = vals[9];
+
+        /* use mode to set file type */
+        elem->type = mfu_flist_mode_to_filetype((mode_t)elem->mode);
+
+        /* append element to tail of linked list */
+        mfu_flist_insert_elem(flist, elem);
+    }
+}
+
+/* read header and block index of a v5 file with POSIX calls,
+ * returns packed index entries, which caller must free */
+static char* cache_v5_read_index(const char* name, uint64_t* nblocks)
+{
+    int fd = mfu_open(name, O_RDONLY);
+    if (fd < 0) {
+        MFU_ABORT(1, "Failed to open file: `%s' errno=%d %s", name, errno, strerror(errno));
+    }
+
+    uint64_t header_packed[CACHE_V5_HEADER];
+    ssize_t nread = mfu_pread(name, fd, header_packed, sizeof(header_packed), 0);
+    if (nread != (ssize_t) sizeof(header_packed)) {
+        MFU_ABORT(1, "Failed to read file: `%s' errno=%d %s", name, errno, strerror(errno));
+    }
+    uint64_t header[CACHE_V5_HEADER];
+    const char* ptr = (const char*) header_packed;
+    int i;
+    for (i = 0; i < CACHE_V5_HEADER; i++) {
+        mfu_unpack_io_uint64(&ptr, &header[i]);
+    }
+    if (header[0] != 5 || (header[1] & CACHE_V5_SHARDS)) {
+        MFU_ABORT(1, "Not a version 5 cache file: `%s'", name);
+    }
+
+    size_t index_size = (size_t)header[7] * CACHE_V5_INDEX * 8;
+    char* index_buf = (char*) MFU_MALLOC(index_size);
+    if (index_size > 0) {
+        nread = mfu_pread(name, fd, index_buf, index_size, (off_t)header[9]);
+        if (nread != (ssize_t) index_size) {
+            MFU_ABORT(1, "Failed to read file: `%s' errno=%d %s", name, errno, strerror(errno));
+        }
+    }
+    mfu_close(name, fd);
+
+    *nblocks = header[7];
+    return index_buf;
+}
+
+/* file format:
+ * all integer values stored in network byte order
+ *
+ *   uint64_t file version
+ *   uint64_t flags
+ *   uint64_t total number of users
+ *   uint64_t max username length
+ *   uint64_t total number of groups
+ *   uint64_t max groupname length
+ *   uint64_t total number of files
+ *   uint64_t number of blocks
+ *   uint64_t byte offset of first block
+ *   uint64_t byte offset of block index
+ *   list of <username(str), userid(uint64_t)>
+ *   list of <groupname(str), groupid(uint64_t)>
+ *   list of blocks, each padded to 8 bytes
+ *   list of <block index entry>
+ *
+ * each block holds up to CACHE_V5_BLOCK items in columns:
+ *   mode, uid, gid, atime, atime_nsec, mtime, mtime_nsec,
+ *   ctime, ctime_nsec, size (count uint64_t values each)
+ *   count+1 uint64_t offsets of file names in heap
+ *   heap of NUL-terminated file names, padded to 8 bytes
+ * if the CACHE_V5_BZ2 flag is set, a block whose stored size is
+ * less than its raw size is compressed with bzip2
+ *
+ * a block index entry records the count, offset, stored size, and
+ * raw size of the block, a mask of item types, and the min/max
+ * of size, mtime, uid, and gid over its items, so blocks can be
+ * skipped without reading them
+ *
+ * if the CACHE_V5_SHARDS flag is set, the file holds no blocks,
+ * the number of blocks is instead the number of shard files, and
+ * the data between the first block and block index offsets is a
+ * table of shards, each entry is
+ *   uint64_t number of items in shard
+ *   uint64_t length of shard name (padded to 8 bytes)
+ *   shard file name, relative to the directory of the index file
+ * each shard is a complete v5 file that can also be read alone
+ *   */
+static void read_cache_v5(
+    const char* name,
+    MPI_Offset* outdisp,
+    MPI_File fh,
+    const char* datarep,
+    const mfu_pred_bounds* bounds,
+    flist_t* flist)
+{
+    MPI_Status status;
+
+    MPI_Offset disp = *outdisp;
+
+    /* indicate that we have stat data */
+    flist->detail = 1;
+
+    /* get our rank */
+    int rank, ranks;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+
+    /* rank 0 reads and broadcasts header */
+    uint64_t header[CACHE_V5_HEADER - 1];
+    int header_size = (CACHE_V5_HEADER - 1) * 8;
+    int mpirc = MPI_File_set_view(fh, 0, MPI_BYTE, MPI_BYTE, datarep, MPI_INFO_NULL);
+    if (mpirc != MPI_SUCCESS) {
+        MPI_Error_string(mpirc, mpierrstr, &mpierrlen);
+        MFU_ABORT(1, "Failed to set view on file: `%s' rc=%d %s", name, mpirc, mpierrstr);
+    }
+    if (rank == 0) {
+        uint64_t header_packed[CACHE_V5_HEADER - 1];
+        mpirc = MPI_File_read_at(fh, disp, header_packed, header_size, MPI_BYTE, &status);
+        if (mpirc != MPI_SUCCESS) {
+            MPI_Error_string(mpirc, mpierrstr, &mpierrlen);
+            MFU_ABORT(1, "Failed to read file: `%s' rc=%d %s", name, mpirc, mpierrstr);
+        }
+
+        const char* ptr = (const char*) header_packed;
+        int i;
+        for (i = 0; i < CACHE_V5_HEADER - 1; i++) {
+            mfu_unpack_io_uint64(&ptr, &header[i]);
+        }
+    }
+    MPI_Bcast(header, CACHE_V5_HEADER - 1, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+    disp += header_size;
+
+    flist->users.count  = header[1];
+    flist->users.chars  = header[2];
+    flist->groups.count = header[3];
+    flist->groups.chars = header[4];
+
+    /* read users and groups */
+    disp += read_cache_buft(name, fh, datarep, disp, &flist->users);
+    disp += read_cache_buft(name, fh, datarep, disp, &flist->groups);
+
+    /* rank 0 reads the block index of each file holding blocks,
+     * this is either the file itself, or the shards listed in it */
+    uint64_t flags = header[0];
+    uint64_t counts[3] = {0, 0, 0}; /* files, bytes of names, blocks */
+    char* names = NULL;
+    char* index_buf = NULL;
+    uint64_t* block_files = NULL;
+    if (rank == 0) {
+        if (! (flags & CACHE_V5_SHARDS)) {
+            /* blocks are in this file */
+            uint64_t nblocks = header[6];
+            size_t index_size = (size_t)nblocks * CACHE_V5_INDEX * 8;
+            index_buf = (char*) MFU_MALLOC(index_size);
+            if (index_size > 0) {
+                mpirc = MPI_File_read_at(fh, (MPI_Offset)header[8], index_buf, (int)index_size, MPI_BYTE, &status);
+                if (mpirc != MPI_SUCCESS) {
+                    MPI_Error_string(mpirc, mpierrstr, &mpierrlen);
+                    MFU_ABORT(1, "Failed to read file: `%s' rc=%d %s", name, mpirc, mpierrstr);
+                }
+            }
+
+            names = MFU_STRDUP(name);
+            block_files = (uint64_t*) calloc(nblocks + 1, sizeof(uint64_t));
+            counts[0] = 1;
+            counts[1] = strlen(name) + 1;
+            counts[2] = nblocks;
+        } else {
+            /* read table of shards, which runs up to the index offset */
+            uint64_t nfiles = header[6];
+            size_t table_size = (size_t)(header[8] - header[7]);
+            char* table = (char*) MFU_MALLOC(table_size);
+            mpirc = MPI_File_read_at(fh, (MPI_Offset)header[7], table, (int)table_size, MPI_BYTE, &status);
+            if (mpirc != MPI_SUCCESS) {
+                MPI_Error_string(mpirc, mpierrstr, &mpierrlen);
+                MFU_ABORT(1, "Failed to read file: `%s' rc=%d %s", name, mpirc, mpierrstr);
+            }
+
+            /* shard names are relative to the directory holding the index */
+            mfu_path* dir = mfu_path_from_str(name);
+            mfu_path_dirname(dir);
+
+            const char* ptr = table;
+            uint64_t f;
+            for (f = 0; f < nfiles; f++) {
+                uint64_t shard_count, len;
+                mfu_unpack_io_uint64(&ptr, &shard_count);
+                mfu_unpack_io_uint64(&ptr, &len);
+                mfu_path* shard_path = mfu_path_dup(dir);
+                mfu_path_append_str(shard_path, ptr);
+                char* shard = mfu_path_strdup(shard_path);
+                mfu_path_delete(&shard_path);
+                ptr += len;
+
+                /* each shard is a complete v5 file, get its block index */
+                uint64_t shard_blocks;
+                char* shard_index = cache_v5_read_index(shard, &shard_blocks);
+
+                /* append name and blocks of this shard */
+                size_t shard_len = strlen(shard) + 1;
+                size_t index_size = (size_t)shard_blocks * CACHE_V5_INDEX * 8;
+                size_t index_offset = (size_t)counts[2] * CACHE_V5_INDEX * 8;
+                names = (char*) realloc(names, (size_t)counts[1] + shard_len);
+                index_buf = (char*) realloc(index_buf, index_offset + index_size + 1);
+                block_files = (uint64_t*) realloc(block_files, (size_t)(counts[2] + shard_blocks + 1) * sizeof(uint64_t));
+                memcpy(names + counts[1], shard, shard_len);
+                memcpy(index_buf + index_offset, shard_index, index_size);
+                uint64_t i;
+                for (i = 0; i < shard_blocks; i++) {
+                    block_files[counts[2] + i] = f;
+                }
+                counts[0]++;
+                counts[1] += shard_len;
+                counts[2] += shard_blocks;
+
+                mfu_free(&shard_index);
+                mfu_free(&shard);
+            }
+
+            mfu_path_delete(&dir);
+            mfu_free(&table);
+        }
+    }
+
+    /* broadcast file names and block index */
+    MPI_Bcast(counts, 3, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+    uint64_t nfiles  = counts[0];
+    uint64_t nblocks = counts[2];
+    size_t index_size = (size_t)nblocks * CACHE_V5_INDEX * 8;
+    if (rank != 0) {
+        names       = (char*) MFU_MALLOC((size_t)counts[1]);
+        index_buf   = (char*) MFU_MALLOC(index_size);
+        block_files = (uint64_t*) MFU_MALLOC((size_t)nblocks * sizeof(uint64_t));
+    }
+    MPI_Bcast(names, (int)counts[1], MPI_CHAR, 0, MPI_COMM_WORLD);
+    MPI_Bcast(index_buf, (int)index_size, MPI_BYTE, 0, MPI_COMM_WORLD);
+    MPI_Bcast(block_files, (int)nblocks, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+
+    /* get pointer to name of each file */
+    const char** files = (const char**) MFU_MALLOC((size_t)nfiles * sizeof(char*));
+    const char* name_ptr = names;
+    uint64_t f;
+    for (f = 0; f < nfiles; f++) {
+        files[f] = name_ptr;
+        name_ptr += strlen(name_ptr) + 1;
+    }
+
+    cache_v5_block_t* blocks = (cache_v5_block_t*) MFU_MALLOC(nblocks * sizeof(cache_v5_block_t));
+    const char* ptr = index_buf;
+    uint64_t b;
+    for (b = 0; b < nblocks; b++) {
+        cache_v5_block_unpack(&ptr, &blocks[b]);
+    }
+    mfu_free(&index_buf);
+
+    /* assign contiguous blocks to each rank, balanced by item count,
+     * a block goes to the rank that would own its first item */
+    uint64_t all_count = header[5];
+    uint64_t first = nblocks;
+    uint64_t last  = nblocks;
+    uint64_t start = 0;
+    for (b = 0; b < nblocks; b++) {
+        uint64_t owner = (all_count > 0) ? start * (uint64_t)ranks / all_count : 0;
+        if (owner == (uint64_t)rank) {
+            if (first == nblocks) {
+                first = b;
+            }
+            last = b + 1;
+        }
+        start += blocks[b].count;
+    }
+
+    /* drop blocks whose items all fall outside the bounds */
+    uint64_t skipped = 0;
+    int* keep = (int*) MFU_MALLOC((size_t)nblocks * sizeof(int));
+    for (b = first; b < last; b++) {
+        keep[b] = (bounds == NULL || cache_v5_block_match(&blocks[b], bounds));
+        if (! keep[b]) {
+            skipped++;
+        }
+    }
+    if (bounds != NULL) {
+        uint64_t all_skipped;
+        MPI_Reduce(&skipped, &all_skipped, 1, MPI_UINT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0) {
+            MFU_LOG(MFU_LOG_VERBOSE, "Skipped %llu of %llu blocks",
+                (unsigned long long)all_skipped, (unsigned long long)nblocks);
+        }
+    }
+
+    /* process our blocks in runs that come from the same file */
+    char* raw = NULL;
+    b = first;
+    while (b < last) {
+        /* skip blocks we don't need */
+        if (! keep[b]) {
+            b++;
+            continue;
+        }
+
+        /* find end of run of needed blocks in this file */
+        uint64_t run_end = b + 1;
+        while (run_end < last && block_files[run_end] == block_files[b]) {
+            run_end++;
+        }
+        while (! keep[run_end - 1]) {
+            run_end--;
+        }
+        const char* file = files[block_files[b]];
+
+        /* map the part of the file holding these blocks, the page cache
+         * does the reading and we only touch the bytes we decode */
+        int fd = mfu_open(file, O_RDONLY);
+        if (fd < 0) {
+            MFU_ABORT(1, "Failed to open file: `%s' errno=%d %s", file, errno, strerror(errno));
+        }
+        uint64_t pagesize = (uint64_t) sysconf(_SC_PAGESIZE);
+        uint64_t map_start = blocks[b].offset - (blocks[b].offset % pagesize);
+        uint64_t map_end   = blocks[run_end - 1].offset + blocks[run_end - 1].stored;
+        size_t map_size = (size_t)(map_end - map_start);
+        char* map = (char*) mmap(NULL, map_size, PROT_READ, MAP_SHARED, fd, (off_t)map_start);
+        if (map == MAP_FAILED) {
+            MFU_ABORT(1, "Failed to map file: `%s' errno=%d %s", file, errno, strerror(errno));
+        }
+        madvise(map, map_size, MADV_SEQUENTIAL);
+
+        for (; b < run_end; b++) {
+            cache_v5_block_t* block = &blocks[b];
+            if (! keep[b]) {
+                continue;
+            }
+            const char* data = map + (block->offset - map_start);
+
+            /* decompress block if needed */
+            if (block->stored < block->raw) {
+                mfu_free(&raw);
+                raw = (char*) MFU_MALLOC(block->raw);
+                unsigned int raw_size = (unsigned int) block->raw;
+                int ret = BZ2_bzBuffToBuffDecompress(raw, &raw_size, (char*)data, (unsigned int)block->stored, 0, 0);
+                if (ret != BZ_OK || raw_size != (unsigned int) block->raw) {
+                    MFU_ABORT(1, "Failed to decompress block in file: `%s' rc=%d", file, ret);
+                }
+                data = raw;
+            }
+
+            cache_v5_block_decode(data, block->count, bounds, flist);
+        }
+
+        munmap(map, map_size);
+        mfu_close(file, fd);
+    }
+    mfu_free(&raw);
+
+    mfu_free(&keep);
+    mfu_free(&blocks);
+    mfu_free(&files);
+    mfu_free(&block_files);
+    mfu_free(&names);
+
+    /* create maps of users and groups */
+    mfu_flist_usrgrp_create_map(&flist->users, flist->user_id2name);
+    mfu_flist_usrgrp_create_map(&flist->groups, flist->group_id2name);
+
+    *outdisp = disp;
+    return;
+}
+
+static void read_cache(
+    const char* name,
+    mfu_flist bflist,
+    const mfu_pred_bounds* bounds)
 {
     /* convert handle to flist_t */
     flist_t* flist = (flist_t*) bflist;
@@ -1139,8 +1731,10 @@ void mfu_flist_read_cache(
     disp += 1 * 8; /* 9 consecutive uint64_t types in external32 */
 
     /* read data from file */
-    if (version == 4) {
-        read_cache_v4(name, &disp, fh, datarep, flist);
+    if (version == 5) {
+        read_cache_v5(name, &disp, fh, datarep, bounds, flist);
+    } else if (version == 4) {
+        read_cache_v4(name, &disp, fh, datarep, bounds, flist);
     } else if (version == 3) {
         /* need a couple of dummy params to record walk start and end times */
         uint64_t outstart = 0;
@@ -1184,6 +1778,169 @@ void mfu_flist_read_cache(
     return;
 }
 
+void mfu_flist_read_cache(
+    const char* name,
+    mfu_flist bflist)
+{
+    read_cache(name, bflist, NULL);
+}
+
+void mfu_flist_read_cache_pred(
+    const char* name,
+    mfu_flist bflist,
+    const mfu_pred* pred)
+{
+    /* compute bounds on items that may satisfy pred */
+    mfu_pred_bounds bounds;
+    mfu_pred_bounds_init(&bounds, pred);
+    read_cache(name, bflist, &bounds);
+    mfu_pred_bounds_free(&bounds);
+}
+
+/* append path to list as an item without stat data */
+static void read_paths_add(mfu_flist flist, const char* path)
+{
+    /* store paths in the same form a walk records them, absolute
+     * and reduced, so they compare equal to names in other lists */
+    char* name = mfu_path_strdup_abs_reduce_str(path);
+    uint64_t idx = mfu_flist_file_create(flist);
+    mfu_flist_file_set_name(flist, idx, name);
+    mfu_flist_file_set_type(flist, idx, MFU_TYPE_UNKNOWN);
+    mfu_free(&name);
+}
+
+void mfu_flist_read_paths(
+    const char* name,
+    mfu_flist bflist)
+{
+    /* start timer */
+    double start_read = MPI_Wtime();
+
+    /* get our rank and number of ranks */
+    int rank, ranks;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+
+    /* rank 0 looks up the file size, a list that silently came back
+     * empty would be taken as having no paths, so fail loudly */
+    uint64_t size = 0;
+    if (rank == 0) {
+        struct stat st;
+        if (mfu_lstat(name, &st) != 0) {
+            MFU_ABORT(1, "Failed to stat file: `%s' (errno=%d %s)",
+                name, errno, strerror(errno));
+        }
+        size = (uint64_t) st.st_size;
+    }
+    MPI_Bcast(&size, 1, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+
+    int fd = mfu_open(name, O_RDONLY);
+    if (fd < 0) {
+        MFU_ABORT(1, "Failed to open file for reading: `%s' (errno=%d %s)",
+            name, errno, strerror(errno));
+    }
+
+    /* each rank reads an even range of bytes, a line belongs to the
+     * rank whose range holds its first byte, so ranks past the start
+     * of the file read the byte before their range to find out whether
+     * their first byte starts a line, and they read past the end of
+     * their range to finish their last line */
+    uint64_t start = size * (uint64_t)rank / (uint64_t)ranks;
+    uint64_t end   = size * (uint64_t)(rank + 1) / (uint64_t)ranks;
+    uint64_t pos   = (start > 0) ? start - 1 : 0;
+    int skip = (start > 0);
+
+    size_t bufsize = 1024 * 1024;
+    char* buf = (char*) MFU_MALLOC(bufsize);
+
+    size_t linesize = 4096;
+    size_t linelen  = 0;
+    char* line = (char*) MFU_MALLOC(linesize);
+
+    int done = 0;
+    while (! done) {
+        ssize_t nread = mfu_pread(name, fd, buf, bufsize, (off_t)pos);
+        if (nread < 0) {
+            MFU_ABORT(1, "Failed to read file: `%s' (errno=%d %s)",
+                name, errno, strerror(errno));
+        }
+        if (nread == 0) {
+            break;
+        }
+
+        ssize_t i;
+        for (i = 0; i < nread; i++) {
+            char c = buf[i];
+
+            /* skip the tail of a line owned by the previous rank */
+            if (skip) {
+                if (c == '\n') {
+                    skip = 0;
+                }
+                continue;
+            }
+
+            /* stop at the first line that starts past our range */
+            if (linelen == 0 && pos + (uint64_t)i >= end) {
+                done = 1;
+                break;
+            }
+
+            if (c == '\n') {
+                line[linelen] = '\0';
+                if (linelen > 0) {
+                    read_paths_add(bflist, line);
+                }
+                linelen = 0;
+                continue;
+            }
+
+            /* grow line buffer, leaving room for terminating NUL */
+            if (linelen + 1 >= linesize) {
+                linesize *= 2;
+                line = (char*) realloc(line, linesize);
+                if (line == NULL) {
+                    MFU_ABORT(1, "Failed to allocate %lu bytes for path", (unsigned long)linesize);
+                }
+            }
+            line[linelen++] = c;
+        }
+
+        pos += (uint64_t)nread;
+    }
+
+    /* add last path if file does not end with a newline */
+    if (linelen > 0) {
+        line[linelen] = '\0';
+        read_paths_add(bflist, line);
+    }
+
+    mfu_free(&line);
+    mfu_free(&buf);
+    mfu_close(name, fd);
+
+    /* compute global summary */
+    mfu_flist_summarize(bflist);
+
+    /* end timer */
+    double end_read = MPI_Wtime();
+
+    /* report read count, time, and rate */
+    if (rank == 0) {
+        uint64_t all_count = mfu_flist_global_size(bflist);
+        double time_diff = end_read - start_read;
+        double rate = 0.0;
+        if (time_diff > 0.0) {
+            rate = ((double)all_count) / time_diff;
+        }
+        MFU_LOG(MFU_LOG_INFO, "Read %lu paths in %.3lf seconds (%.3lf paths/sec)",
+               all_count, time_diff, rate
+              );
+    }
+
+    return;
+}
+
 /****************************************
  * Write file list to file
  ***************************************/
@@ -1543,9 +2300,543 @@ static void write_cache_stat_v4(
     return;
 }
 
+/* write a list of users or groups from rank 0 at disp,
+ * returns number of bytes written */
+static MPI_Offset write_cache_buft(
+    const char* name,
+    MPI_File fh,
+    const char* datarep,
+    MPI_Offset disp,
+    const buf_t* items,
+    MPI_Comm comm)
+{
+    if (items->dt == MPI_DATATYPE_NULL) {
+        return 0;
+    }
+
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    /* set view to write out items */
+    int mpirc = MPI_File_set_view(fh, disp, MPI_BYTE, MPI_BYTE, datarep, MPI_INFO_NULL);
+    if (mpirc != MPI_SUCCESS) {
+        MPI_Error_string(mpirc, mpierrstr, &mpierrlen);
+        MFU_ABORT(1, "Failed to set view on file: `%s' rc=%d %s", name, mpirc, mpierrstr);
+    }
+
+    /* write out items */
+    int bufsize = (int) buft_pack_size(items);
+    if (rank == 0) {
+        MPI_Status status;
+        char* buf = (char*) MFU_MALLOC(bufsize);
+        buft_pack(buf, items);
+        mpirc = MPI_File_write_at(fh, 0, buf, bufsize, MPI_BYTE, &status);
+        if (mpirc != MPI_SUCCESS) {
+            MPI_Error_string(mpirc, mpierrstr, &mpierrlen);
+            MFU_ABORT(1, "Failed to write to file: `%s' rc=%d %s", name, mpirc, mpierrstr);
+        }
+        mfu_free(&buf);
+    }
+
+    return (MPI_Offset) bufsize;
+}
+
+/* encode count items starting at elem as a v5 block into buf,
+ * buf must hold cache_v5_block_raw bytes */
+static void cache_v5_block_encode(char* buf, const elem_t* elem, uint64_t count, uint64_t raw)
+{
+    char* cols[CACHE_V5_COLUMNS];
+    int c;
+    for (c = 0; c < CACHE_V5_COLUMNS; c++) {
+        cols[c] = buf + (uint64_t)c * count * 8;
+    }
+    char* name_offs = buf + CACHE_V5_COLUMNS * count * 8;
+    char* heap = name_offs + (count + 1) * 8;
+    char* heap_start = heap;
+
+    uint64_t i;
+    for (i = 0; i < count; i++) {
+        mfu_pack_io_uint64(&cols[0], elem->mode);
+        mfu_pack_io_uint64(&cols[1], elem->uid);
+        mfu_pack_io_uint64(&cols[2], elem->gid);
+        mfu_pack_io_uint64(&cols[3], elem->atime);
+        mfu_pack_io_uint64(&cols[4], elem->atime_nsec);
+        mfu_pack_io_uint64(&cols[5], elem->mtime);
+        mfu_pack_io_uint64(&cols[6], elem->mtime_nsec);
+        mfu_pack_io_uint64(&cols[7], elem->ctime);
+        mfu_pack_io_uint64(&cols[8], elem->ctime_nsec);
+        mfu_pack_io_uint64(&cols[9], elem->size);
+
+        /* append name to heap */
+        mfu_pack_io_uint64(&name_offs, (uint64_t)(heap - heap_start));
+        size_t len = strlen(elem->file) + 1;
+        memcpy(heap, elem->file, len);
+        heap += len;
+
+        elem = elem->next;
+    }
+
+    /* record end of heap, and zero the padding */
+    mfu_pack_io_uint64(&name_offs, (uint64_t)(heap - heap_start));
+    memset(heap, 0, (size_t)((buf + raw) - heap));
+}
+
+/* write list in v5 format, items are written in blocks of columns
+ * with a separate heap for names, so a long name no longer pads
+ * every record, each rank writes its own blocks with independent
+ * writes and rank 0 writes the header and block index at the end,
+ * all procs in comm write to the file */
+static void write_cache_stat_v5(
+    const char* name,
+    flist_t* flist,
+    int compress,
+    MPI_Comm comm)
+{
+    buf_t* users  = &flist->users;
+    buf_t* groups = &flist->groups;
+
+    /* get our rank in job & number of ranks */
+    int rank, ranks;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &ranks);
+
+    /* use mpi io hints to stripe across OSTs */
+    MPI_Info info;
+    MPI_Info_create(&info);
+
+    /* get number of items in our list and total file count */
+    uint64_t count = flist->list_count;
+    uint64_t all_count;
+    MPI_Allreduce(&count, &all_count, 1, MPI_UINT64_T, MPI_SUM, comm);
+
+    /* describe our blocks */
+    uint64_t nblocks = (count + CACHE_V5_BLOCK - 1) / CACHE_V5_BLOCK;
+    cache_v5_block_t* blocks = (cache_v5_block_t*) MFU_MALLOC(nblocks * sizeof(cache_v5_block_t));
+    char** zbufs = (char**) MFU_MALLOC(nblocks * sizeof(char*));
+    uint64_t bytes = 0;
+    const elem_t* current = flist->list_head;
+    uint64_t b;
+    for (b = 0; b < nblocks; b++) {
+        cache_v5_block_t* block = &blocks[b];
+        const elem_t* head = current;
+
+        /* compute block size and zone map over its items */
+        uint64_t n = count - b * CACHE_V5_BLOCK;
+        if (n > CACHE_V5_BLOCK) {
+            n = CACHE_V5_BLOCK;
+        }
+        uint64_t heap = 0;
+        block->count     = n;
+        block->types     = 0;
+        block->min_size  = UINT64_MAX;
+        block->max_size  = 0;
+        block->min_mtime = UINT64_MAX;
+        block->max_mtime = 0;
+        block->min_uid   = UINT64_MAX;
+        block->max_uid   = 0;
+        block->min_gid   = UINT64_MAX;
+        block->max_gid   = 0;
+        uint64_t i;
+        for (i = 0; i < n; i++) {
+            heap += strlen(current->file) + 1;
+            block->types |= ((uint64_t)1 << current->type);
+            if (current->size  < block->min_size)  { block->min_size  = current->size;  }
+            if (current->size  > block->max_size)  { block->max_size  = current->size;  }
+            if (current->mtime < block->min_mtime) { block->min_mtime = current->mtime; }
+            if (current->mtime > block->max_mtime) { block->max_mtime = current->mtime; }
+            if (current->uid   < block->min_uid)   { block->min_uid   = current->uid;   }
+            if (current->uid   > block->max_uid)   { block->max_uid   = current->uid;   }
+            if (current->gid   < block->min_gid)   { block->min_gid   = current->gid;   }
+            if (current->gid   > block->max_gid)   { block->max_gid   = current->gid;   }
+            current = current->next;
+        }
+        block->raw    = cache_v5_block_raw(n, heap);
+        block->stored = block->raw;
+        zbufs[b] = NULL;
+
+        /* compress the block now to learn its size,
+         * keep it raw if compression does not help */
+        if (compress) {
+            char* rawbuf = (char*) MFU_MALLOC(block->raw);
+            cache_v5_block_encode(rawbuf, head, n, block->raw);
+
+            unsigned int zsize = (unsigned int) block->raw;
+            char* zbuf = (char*) MFU_MALLOC(zsize);
+            int ret = BZ2_bzBuffToBuffCompress(zbuf, &zsize, rawbuf, (unsigned int)block->raw, 9, 0, 30);
+            if (ret == BZ_OK && (uint64_t)zsize < block->raw) {
+                block->stored = (uint64_t) zsize;
+                zbufs[b] = zbuf;
+            } else {
+                mfu_free(&zbuf);
+            }
+            mfu_free(&rawbuf);
+        }
+
+        block->offset = bytes;
+        bytes += cache_v5_pad8(block->stored);
+    }
+
+    /* header, users, and groups come first */
+    MPI_Offset data_disp = (MPI_Offset) cache_v5_pad8(
+        CACHE_V5_HEADER * 8 +
+        ((users->dt  != MPI_DATATYPE_NULL) ? buft_pack_size(users)  : 0) +
+        ((groups->dt != MPI_DATATYPE_NULL) ? buft_pack_size(groups) : 0)
+    );
+
+    /* compute offset of our blocks in file */
+    uint64_t offset;
+    MPI_Exscan(&bytes, &offset, 1, MPI_UINT64_T, MPI_SUM, comm);
+    if (rank == 0) {
+        offset = 0;
+    }
+    uint64_t all_bytes;
+    MPI_Allreduce(&bytes, &all_bytes, 1, MPI_UINT64_T, MPI_SUM, comm);
+    for (b = 0; b < nblocks; b++) {
+        blocks[b].offset += (uint64_t)data_disp + offset;
+    }
+
+    /* open file */
+    MPI_Status status;
+    MPI_File fh;
+    const char* datarep = datarep_native;
+    int amode = MPI_MODE_WRONLY | MPI_MODE_CREATE;
+
+    /* change number of ranks to string to pass to MPI_Info */
+    char str_buf[12];
+    sprintf(str_buf, "%d", ranks);
+
+    /* no. of I/O devices for lustre striping is number of ranks */
+    MPI_Info_set(info, "striping_factor", str_buf);
+
+    int mpirc = MPI_File_open(comm, (char*)name, amode, info, &fh);
+    if (mpirc != MPI_SUCCESS) {
+        MPI_Error_string(mpirc, mpierrstr, &mpierrlen);
+        MFU_ABORT(1, "Failed to open file for writing: `%s' rc=%d %s", name, mpirc, mpierrstr);
+    }
+
+    /* truncate file to 0 bytes */
+    mpirc = MPI_File_set_size(fh, 0);
+    if (mpirc != MPI_SUCCESS) {
+        MPI_Error_string(mpirc, mpierrstr, &mpierrlen);
+        MFU_ABORT(1, "Failed to truncate file: `%s' rc=%d %s", name, mpirc, mpierrstr);
+    }
+
+    /* write users and groups after the header */
+    MPI_Offset disp = CACHE_V5_HEADER * 8;
+    disp += write_cache_buft(name, fh, datarep, disp, users, comm);
+    disp += write_cache_buft(name, fh, datarep, disp, groups, comm);
+
+    /* write our blocks */
+    mpirc = MPI_File_set_view(fh, 0, MPI_BYTE, MPI_BYTE, datarep, MPI_INFO_NULL);
+    if (mpirc != MPI_SUCCESS) {
+        MPI_Error_string(mpirc, mpierrstr, &mpierrlen);
+        MFU_ABORT(1, "Failed to set view on file: `%s' rc=%d %s", name, mpirc, mpierrstr);
+    }
+    current = flist->list_head;
+    for (b = 0; b < nblocks; b++) {
+        cache_v5_block_t* block = &blocks[b];
+        char* buf = zbufs[b];
+        if (buf == NULL) {
+            buf = (char*) MFU_MALLOC(block->raw);
+            cache_v5_block_encode(buf, current, block->count, block->raw);
+        }
+
+        mpirc = MPI_File_write_at(fh, (MPI_Offset)block->offset, buf, (int)block->stored, MPI_BYTE, &status);
+        if (mpirc != MPI_SUCCESS) {
+            MPI_Error_string(mpirc, mpierrstr, &mpierrlen);
+            MFU_ABORT(1, "Failed to write to file: `%s' rc=%d %s", name, mpirc, mpierrstr);
+        }
+        mfu_free(&buf);
+
+        /* advance to first item of next block */
+        uint64_t i;
+        for (i = 0; i < block->count; i++) {
+            current = current->next;
+        }
+    }
+    mfu_free(&zbufs);
+
+    /* gather block index to rank 0 */
+    int index_bytes = (int)(nblocks * CACHE_V5_INDEX * 8);
+    char* index_buf = (char*) MFU_MALLOC((size_t)index_bytes);
+    char* ptr = index_buf;
+    for (b = 0; b < nblocks; b++) {
+        cache_v5_block_pack(&ptr, &blocks[b]);
+    }
+    mfu_free(&blocks);
+
+    int* counts = NULL;
+    int* displs = NULL;
+    char* all_index = NULL;
+    int all_index_bytes = 0;
+    if (rank == 0) {
+        counts = (int*) MFU_MALLOC((size_t)ranks * sizeof(int));
+        displs = (int*) MFU_MALLOC((size_t)ranks * sizeof(int));
+    }
+    MPI_Gather(&index_bytes, 1, MPI_INT, counts, 1, MPI_INT, 0, comm);
+    if (rank == 0) {
+        int i;
+        for (i = 0; i < ranks; i++) {
+            displs[i] = all_index_bytes;
+            all_index_bytes += counts[i];
+        }
+        all_index = (char*) MFU_MALLOC((size_t)all_index_bytes);
+    }
+    MPI_Gatherv(index_buf, index_bytes, MPI_BYTE, all_index, counts, displs, MPI_BYTE, 0, comm);
+    mfu_free(&index_buf);
+
+    /* rank 0 writes the block index and then the header */
+    if (rank == 0) {
+        uint64_t index_disp = (uint64_t)data_disp + all_bytes;
+        mpirc = MPI_File_write_at(fh, (MPI_Offset)index_disp, all_index, all_index_bytes, MPI_BYTE, &status);
+        if (mpirc != MPI_SUCCESS) {
+            MPI_Error_string(mpirc, mpierrstr, &mpierrlen);
+            MFU_ABORT(1, "Failed to write to file: `%s' rc=%d %s", name, mpirc, mpierrstr);
+        }
+
+        uint64_t header[CACHE_V5_HEADER];
+        ptr = (char*) header;
+        mfu_pack_io_uint64(&ptr, 5);                          /* file version */
+        mfu_pack_io_uint64(&ptr, compress ? CACHE_V5_BZ2 : 0); /* flags */
+        mfu_pack_io_uint64(&ptr, users->count);               /* number of user records */
+        mfu_pack_io_uint64(&ptr, users->chars);               /* number of chars in user name */
+        mfu_pack_io_uint64(&ptr, groups->count);              /* number of group records */
+        mfu_pack_io_uint64(&ptr, groups->chars);              /* number of chars in group name */
+        mfu_pack_io_uint64(&ptr, all_count);                  /* total number of stat entries */
+        mfu_pack_io_uint64(&ptr, (uint64_t)all_index_bytes / (CACHE_V5_INDEX * 8)); /* number of blocks */
+        mfu_pack_io_uint64(&ptr, (uint64_t)data_disp);        /* offset of first block */
+        mfu_pack_io_uint64(&ptr, index_disp);                 /* offset of block index */
+        mpirc = MPI_File_write_at(fh, 0, header, CACHE_V5_HEADER * 8, MPI_BYTE, &status);
+        if (mpirc != MPI_SUCCESS) {
+            MPI_Error_string(mpirc, mpierrstr, &mpierrlen);
+            MFU_ABORT(1, "Failed to write to file: `%s' rc=%d %s", name, mpirc, mpierrstr);
+        }
+    }
+    mfu_free(&all_index);
+    mfu_free(&displs);
+    mfu_free(&counts);
+
+    /* close file */
+    mpirc = MPI_File_close(&fh);
+    if (mpirc != MPI_SUCCESS) {
+        MPI_Error_string(mpirc, mpierrstr, &mpierrlen);
+        MFU_ABORT(1, "Failed to close file: `%s' rc=%d %s", name, mpirc, mpierrstr);
+    }
+
+    /* free mpi info */
+    MPI_Info_free(&info);
+
+    return;
+}
+
+/* write list as a set of v5 shard files, each written by its own
+ * contiguous range of ranks, plus a small index file at name
+ * listing the shards, so no single file limits write bandwidth */
+static void write_cache_stat_v5_shards(
+    const char* name,
+    flist_t* flist,
+    const mfu_cache_opts_t* opts)
+{
+    buf_t* users  = &flist->users;
+    buf_t* groups = &flist->groups;
+
+    /* get our rank in job & number of ranks */
+    int rank, ranks;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+
+    /* assign ranks to shards in contiguous ranges */
+    int shards = opts->shards;
+    if (shards > ranks) {
+        shards = ranks;
+    }
+    int shard = (int)((uint64_t)rank * (uint64_t)shards / (uint64_t)ranks);
+
+    /* shards are named after the index file, with a numeric suffix */
+    size_t shard_name_size = strlen(name) + 16;
+    char* shard_name = (char*) MFU_MALLOC(shard_name_size);
+    snprintf(shard_name, shard_name_size, "%s.%d", name, shard);
+
+    MPI_Comm shard_comm;
+    MPI_Comm_split(MPI_COMM_WORLD, shard, rank, &shard_comm);
+    int shard_rank;
+    MPI_Comm_rank(shard_comm, &shard_rank);
+
+    /* create the shard with requested striping before opening it */
+    if (opts->stripe && shard_rank == 0) {
+        mfu_unlink(shard_name);
+        mfu_stripe_set(shard_name, opts->stripe_size, opts->stripe_count);
+    }
+    MPI_Barrier(shard_comm);
+
+    /* each group of ranks writes its shard independently */
+    write_cache_stat_v5(shard_name, flist, opts->compress, shard_comm);
+    MPI_Comm_free(&shard_comm);
+    mfu_free(&shard_name);
+
+    /* count items in each shard */
+    uint64_t* counts     = (uint64_t*) MFU_MALLOC((size_t)shards * sizeof(uint64_t));
+    uint64_t* all_counts = (uint64_t*) MFU_MALLOC((size_t)shards * sizeof(uint64_t));
+    int i;
+    for (i = 0; i < shards; i++) {
+        counts[i] = 0;
+    }
+    counts[shard] = flist->list_count;
+    MPI_Reduce(counts, all_counts, shards, MPI_UINT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+
+    /* write the index file, it holds users and groups so that
+     * readers get them without opening a shard */
+    MPI_Status status;
+    MPI_File fh;
+    const char* datarep = datarep_native;
+    int amode = MPI_MODE_WRONLY | MPI_MODE_CREATE;
+    int mpirc = MPI_File_open(MPI_COMM_WORLD, (char*)name, amode, MPI_INFO_NULL, &fh);
+    if (mpirc != MPI_SUCCESS) {
+        MPI_Error_string(mpirc, mpierrstr, &mpierrlen);
+        MFU_ABORT(1, "Failed to open file for writing: `%s' rc=%d %s", name, mpirc, mpierrstr);
+    }
+
+    /* truncate file to 0 bytes */
+    mpirc = MPI_File_set_size(fh, 0);
+    if (mpirc != MPI_SUCCESS) {
+        MPI_Error_string(mpirc, mpierrstr, &mpierrlen);
+        MFU_ABORT(1, "Failed to truncate file: `%s' rc=%d %s", name, mpirc, mpierrstr);
+    }
+
+    MPI_Offset disp = CACHE_V5_HEADER * 8;
+    disp += write_cache_buft(name, fh, datarep, disp, users, MPI_COMM_WORLD);
+    disp += write_cache_buft(name, fh, datarep, disp, groups, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        mpirc = MPI_File_set_view(fh, 0, MPI_BYTE, MPI_BYTE, datarep, MPI_INFO_NULL);
+        if (mpirc != MPI_SUCCESS) {
+            MPI_Error_string(mpirc, mpierrstr, &mpierrlen);
+            MFU_ABORT(1, "Failed to set view on file: `%s' rc=%d %s", name, mpirc, mpierrstr);
+        }
+
+        /* get name of index file without its directory */
+        mfu_path* base_path = mfu_path_from_str(name);
+        mfu_path_basename(base_path);
+        char* base = mfu_path_strdup(base_path);
+        mfu_path_delete(&base_path);
+
+        /* build table of shards */
+        size_t name_size = cache_v5_pad8(strlen(base) + 16);
+        size_t table_size = (size_t)shards * (16 + name_size);
+        char* table = (char*) MFU_MALLOC(table_size);
+        char* ptr = table;
+        uint64_t all_count = 0;
+        for (i = 0; i < shards; i++) {
+            mfu_pack_io_uint64(&ptr, all_counts[i]);
+            mfu_pack_io_uint64(&ptr, (uint64_t)name_size);
+            memset(ptr, 0, name_size);
+            snprintf(ptr, name_size, "%s.%d", base, i);
+            ptr += name_size;
+            all_count += all_counts[i];
+        }
+        mfu_free(&base);
+
+        MPI_Offset table_disp = (MPI_Offset) cache_v5_pad8((uint64_t)disp);
+        mpirc = MPI_File_write_at(fh, table_disp, table, (int)table_size, MPI_BYTE, &status);
+        if (mpirc != MPI_SUCCESS) {
+            MPI_Error_string(mpirc, mpierrstr, &mpierrlen);
+            MFU_ABORT(1, "Failed to write to file: `%s' rc=%d %s", name, mpirc, mpierrstr);
+        }
+        mfu_free(&table);
+
+        uint64_t flags = CACHE_V5_SHARDS | (opts->compress ? CACHE_V5_BZ2 : 0);
+        uint64_t header[CACHE_V5_HEADER];
+        ptr = (char*) header;
+        mfu_pack_io_uint64(&ptr, 5);                      /* file version */
+        mfu_pack_io_uint64(&ptr, flags);                  /* flags */
+        mfu_pack_io_uint64(&ptr, users->count);           /* number of user records */
+        mfu_pack_io_uint64(&ptr, users->chars);           /* number of chars in user name */
+        mfu_pack_io_uint64(&ptr, groups->count);          /* number of group records */
+        mfu_pack_io_uint64(&ptr, groups->chars);          /* number of chars in group name */
+        mfu_pack_io_uint64(&ptr, all_count);              /* total number of stat entries */
+        mfu_pack_io_uint64(&ptr, (uint64_t)shards);       /* number of shards */
+        mfu_pack_io_uint64(&ptr, (uint64_t)table_disp);   /* offset of shard table */
+        mfu_pack_io_uint64(&ptr, (uint64_t)table_disp + table_size); /* end of shard table */
+        mpirc = MPI_File_write_at(fh, 0, header, CACHE_V5_HEADER * 8, MPI_BYTE, &status);
+        if (mpirc != MPI_SUCCESS) {
+            MPI_Error_string(mpirc, mpierrstr, &mpierrlen);
+            MFU_ABORT(1, "Failed to write to file: `%s' rc=%d %s", name, mpirc, mpierrstr);
+        }
+    }
+
+    /* close file */
+    mpirc = MPI_File_close(&fh);
+    if (mpirc != MPI_SUCCESS) {
+        MPI_Error_string(mpirc, mpierrstr, &mpierrlen);
+        MFU_ABORT(1, "Failed to close file: `%s' rc=%d %s", name, mpirc, mpierrstr);
+    }
+
+    /* an earlier run with more shards may have left files past
+     * the ones we wrote, remove them so they are not mistaken
+     * for part of this list, stopping at the first missing one */
+    if (rank == 0) {
+        for (i = shards; ; i++) {
+            char* old_name = (char*) MFU_MALLOC(shard_name_size);
+            snprintf(old_name, shard_name_size, "%s.%d", name, i);
+            int unlink_rc = mfu_unlink(old_name);
+            mfu_free(&old_name);
+            if (unlink_rc != 0) {
+                break;
+            }
+        }
+    }
+
+    mfu_free(&all_counts);
+    mfu_free(&counts);
+
+    return;
+}
+
+mfu_cache_opts_t* mfu_cache_opts_new(void)
+{
+    mfu_cache_opts_t* opts = (mfu_cache_opts_t*) MFU_MALLOC(sizeof(mfu_cache_opts_t));
+
+    /* write the format that older releases can read by default,
+     * version 5 is used if set here or if compress or shards ask for it */
+    opts->version = 4;
+
+    /* don't compress by default */
+    opts->compress = false;
+
+    /* write a single file by default */
+    opts->shards = 1;
+
+    /* leave striping of shard files to the file system by default,
+     * if enabled, stripe shards over all devices in 1MB units */
+    opts->stripe       = false;
+    opts->stripe_size  = 1024 * 1024;
+    opts->stripe_count = -1;
+
+    return opts;
+}
+
+void mfu_cache_opts_delete(mfu_cache_opts_t** popts)
+{
+    if (popts != NULL) {
+        mfu_cache_opts_t* opts = *popts;
+        mfu_free(&opts);
+        *popts = NULL;
+    }
+}
+
 void mfu_flist_write_cache(
     const char* name,
     mfu_flist bflist)
+{
+    mfu_cache_opts_t* opts = mfu_cache_opts_new();
+    mfu_flist_write_cache_opts(name, bflist, opts);
+    mfu_cache_opts_delete(&opts);
+}
+
+void mfu_flist_write_cache_opts(
+    const char* name,
+    mfu_flist bflist,
+    const mfu_cache_opts_t* opts)
 {
     /* convert handle to flist_t */
     flist_t* flist = (flist_t*) bflist;
@@ -1562,7 +2853,15 @@ void mfu_flist_write_cache(
     }
 
     if (all_count > 0) {
-        if (flist->detail) {
+        /* compression and shards only exist in version 5 */
+        int v5 = (opts->version == 5 || opts->compress || opts->shards > 1);
+        if (flist->detail && v5 && opts->shards > 1) {
+            write_cache_stat_v5_shards(name, flist, opts);
+        }
+        else if (flist->detail && v5) {
+            write_cache_stat_v5(name, flist, opts->compress, MPI_COMM_WORLD);
+        }
+        else if (flist->detail) {
             write_cache_stat_v4(name, flist);
         }
         else {
@@ -0,0 +1,324 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dtcmp.h"
+#include "mfu.h"
+
+/* source of an item in a merge, when several sources hold the same
+ * path, the item from the source with the highest value wins */
+#define MERGE_BASE    (0)
+#define MERGE_REMOVED (1)
+#define MERGE_DELTA   (2)
+
+/* routine for sorting paths in ascending order, '/' sorts before
+ * any other character so that the items under a directory directly
+ * follow the directory itself */
+static int merge_path_cmp(const void* a, const void* b)
+{
+    const unsigned char* p = (const unsigned char*) a;
+    const unsigned char* q = (const unsigned char*) b;
+    while (*p != '\0' && *p == *q) {
+        p++;
+        q++;
+    }
+    if (*p == *q) {
+        return 0;
+    }
+    if (*p == '\0' || (*p == '/' && *q != '\0')) {
+        return -1;
+    }
+    if (*q == '\0' || *q == '/') {
+        return 1;
+    }
+    return (*p < *q) ? -1 : 1;
+}
+
+/* return 1 if path is dir or lies under dir, 0 otherwise */
+static int merge_path_under(const char* dir, const char* path)
+{
+    size_t len = strlen(dir);
+    if (strncmp(dir, path, len) != 0) {
+        return 0;
+    }
+    if (path[len] == '\0' || path[len] == '/') {
+        return 1;
+    }
+    return (len > 0 && dir[len - 1] == '/');
+}
+
+/* each element of the exscan below is a flag byte and a path for the
+ * last item held by a range of ranks, followed by a flag byte and a
+ * path for the removed directory that is still open at its end */
+
+/* reduction op used in an exscan to find the last path held by any
+ * lower rank and the removed directory open at that point,
+ * the last path from the higher rank wins if its flag is set,
+ * the removed directory from the lower rank wins if it holds the
+ * last path of the higher rank, since it then covers all its items */
+static void merge_last_path(void* invec, void* inoutvec, int* len, MPI_Datatype* dt)
+{
+    int size;
+    MPI_Type_size(*dt, &size);
+    int half = size / 2;
+
+    char* in    = (char*) invec;
+    char* inout = (char*) inoutvec;
+    int i;
+    for (i = 0; i < *len; i++) {
+        char* in_root    = in + half;
+        char* inout_root = inout + half;
+        if (in_root[0] != 0 &&
+            (inout[0] == 0 || merge_path_under(in_root + 1, inout + 1)))
+        {
+            memcpy(inout_root, in_root, (size_t)half);
+        }
+        if (inout[0] == 0) {
+            memcpy(inout, in, (size_t)half);
+        }
+        in    += size;
+        inout += size;
+    }
+}
+
+/* copy items of list into sort buffer as (path, source) keys,
+ * each followed by the packed item */
+static char* merge_pack(
+    char* ptr,
+    mfu_flist flist,
+    uint64_t chars,
+    size_t sat_size,
+    uint32_t source)
+{
+    uint64_t idx;
+    uint64_t size = mfu_flist_size(flist);
+    for (idx = 0; idx < size; idx++) {
+        const char* name = mfu_flist_file_get_name(flist, idx);
+        memset(ptr, 0, chars);
+        strcpy(ptr, name);
+        memcpy(ptr + chars, &source, sizeof(uint32_t));
+        mfu_flist_file_pack(ptr + chars + sizeof(uint32_t), flist, idx);
+        ptr += chars + sizeof(uint32_t) + sat_size;
+    }
+    return ptr;
+}
+
+mfu_flist mfu_flist_merge(mfu_flist base, mfu_flist delta, mfu_flist removed)
+{
+    /* start timer */
+    double start_merge = MPI_Wtime();
+
+    /* get our rank */
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    /* items of the delta must carry the same detail as the base */
+    if (mfu_flist_global_size(delta) > 0 &&
+        mfu_flist_have_detail(delta) != mfu_flist_have_detail(base))
+    {
+        MFU_ABORT(1, "Base and delta lists must both have stat data or both lack it");
+    }
+
+    /* create a new list as subset of base list */
+    mfu_flist flist = mfu_flist_subset(base);
+
+    /* get max path length and packed item size over all lists */
+    uint64_t chars = mfu_flist_file_max_name(base);
+    size_t sat_size = mfu_flist_file_pack_size(base);
+    uint64_t delta_chars = mfu_flist_file_max_name(delta);
+    size_t delta_size = mfu_flist_file_pack_size(delta);
+    if (delta_chars > chars) {
+        chars = delta_chars;
+    }
+    if (delta_size > sat_size) {
+        sat_size = delta_size;
+    }
+    uint64_t count = mfu_flist_size(base) + mfu_flist_size(delta);
+    if (removed != MFU_FLIST_NULL) {
+        uint64_t removed_chars = mfu_flist_file_max_name(removed);
+        size_t removed_size = mfu_flist_file_pack_size(removed);
+        if (removed_chars > chars) {
+            chars = removed_chars;
+        }
+        if (removed_size > sat_size) {
+            sat_size = removed_size;
+        }
+        count += mfu_flist_size(removed);
+    }
+
+    /* bail out if there is nothing to merge, we can't create
+     * a valid comparison op for 0-length strings */
+    if (chars == 0) {
+        mfu_flist_summarize(flist);
+        return flist;
+    }
+
+    /* build key of (path, source), sorting paths in ascending order
+     * and sources in descending order, so that the item that wins
+     * comes first among those with the same path */
+    MPI_Datatype dt_filepath;
+    MPI_Type_contiguous((int)chars, MPI_CHAR, &dt_filepath);
+    MPI_Type_commit(&dt_filepath);
+
+    DTCMP_Op op_filepath;
+    if (DTCMP_Op_create(dt_filepath, merge_path_cmp, &op_filepath) != DTCMP_SUCCESS) {
+        MFU_ABORT(1, "Failed to create sorting operation for filepath");
+    }
+
+    MPI_Datatype key_types[2] = {dt_filepath, MPI_UINT32_T};
+    MPI_Datatype dt_key;
+    if (DTCMP_Type_create_series(2, key_types, &dt_key) != DTCMP_SUCCESS) {
+        MFU_ABORT(1, "Failed to create type for key");
+    }
+
+    DTCMP_Op key_ops[2] = {op_filepath, DTCMP_OP_UINT32T_DESCEND};
+    DTCMP_Op op_key;
+    if (DTCMP_Op_create_series(2, key_ops, &op_key) != DTCMP_SUCCESS) {
+        MFU_ABORT(1, "Failed to create sorting operation for key");
+    }
+
+    /* build keysat type */
+    MPI_Datatype dt_sat;
+    MPI_Type_contiguous((int)sat_size, MPI_BYTE, &dt_sat);
+
+    MPI_Datatype dt_keysat, keysat_types[2];
+    keysat_types[0] = dt_key;
+    keysat_types[1] = dt_sat;
+    if (DTCMP_Type_create_series(2, keysat_types, &dt_keysat) != DTCMP_SUCCESS) {
+        MFU_ABORT(1, "Failed to create type for keysat");
+    }
+
+    /* copy items of all lists into sort buffer */
+    size_t elem_size = chars + sizeof(uint32_t) + sat_size;
+    char* sortbuf = (char*) MFU_MALLOC(elem_size * count);
+    char* ptr = sortbuf;
+    ptr = merge_pack(ptr, base, chars, sat_size, MERGE_BASE);
+    ptr = merge_pack(ptr, delta, chars, sat_size, MERGE_DELTA);
+    if (removed != MFU_FLIST_NULL) {
+        ptr = merge_pack(ptr, removed, chars, sat_size, MERGE_REMOVED);
+    }
+
+    /* sort items from all lists together by path */
+    void* outsortbuf;
+    int outsortcount;
+    DTCMP_Handle handle;
+    int sort_rc = DTCMP_Sortz(
+                      sortbuf, (int)count, &outsortbuf, &outsortcount,
+                      dt_key, dt_keysat, op_key, DTCMP_FLAG_NONE,
+                      MPI_COMM_WORLD, &handle
+                  );
+    if (sort_rc != DTCMP_SUCCESS) {
+        MFU_ABORT(1, "Failed to sort data");
+    }
+    mfu_free(&sortbuf);
+
+    /* find the removed directory still open at the end of our items,
+     * a removed path drops every base item at or under it, and since
+     * those items directly follow it in sort order, only the outermost
+     * open removed directory needs to be tracked */
+    const char* root = NULL;
+    ptr = (char*) outsortbuf;
+    int i;
+    for (i = 0; i < outsortcount; i++) {
+        uint32_t source;
+        memcpy(&source, ptr + chars, sizeof(uint32_t));
+        if (root != NULL && !merge_path_under(root, ptr)) {
+            root = NULL;
+        }
+        if (root == NULL && source == MERGE_REMOVED) {
+            root = ptr;
+        }
+        ptr += elem_size;
+    }
+
+    /* items with the same path or under the same removed directory
+     * may span ranks, so get the last path held by a lower rank to
+     * know whether our first item is the first for its path, and the
+     * removed directory open at that point */
+    MPI_Datatype dt_last;
+    MPI_Type_contiguous(2 * ((int)chars + 1), MPI_CHAR, &dt_last);
+    MPI_Type_commit(&dt_last);
+
+    MPI_Op op_last;
+    MPI_Op_create(merge_last_path, 0, &op_last);
+
+    size_t last_size = 2 * (chars + 1);
+    char* last      = (char*) MFU_MALLOC(last_size);
+    char* prev_last = (char*) MFU_MALLOC(last_size);
+    memset(last, 0, last_size);
+    memset(prev_last, 0, last_size);
+    if (outsortcount > 0) {
+        const char* last_path = (const char*)outsortbuf + (size_t)(outsortcount - 1) * elem_size;
+        last[0] = 1;
+        memcpy(last + 1, last_path, chars);
+    }
+    if (root != NULL) {
+        last[chars + 1] = 1;
+        memcpy(last + chars + 2, root, chars);
+    }
+    MPI_Exscan(last, prev_last, 1, dt_last, op_last, MPI_COMM_WORLD);
+    if (rank == 0) {
+        /* exscan leaves result undefined on rank 0 */
+        memset(prev_last, 0, last_size);
+    }
+
+    /* keep the first item for each path if it comes from the delta,
+     * or if it comes from the base and no removed path covers it */
+    const char* prev = (prev_last[0] != 0) ? prev_last + 1 : NULL;
+    root = (prev_last[chars + 1] != 0) ? prev_last + chars + 2 : NULL;
+    ptr = (char*) outsortbuf;
+    for (i = 0; i < outsortcount; i++) {
+        const char* path = ptr;
+        uint32_t source;
+        memcpy(&source, ptr + chars, sizeof(uint32_t));
+        if (root != NULL && !merge_path_under(root, path)) {
+            root = NULL;
+        }
+        if (prev == NULL || strcmp(path, prev) != 0) {
+            if (source == MERGE_DELTA || (source == MERGE_BASE && root == NULL)) {
+                mfu_flist_file_unpack(ptr + chars + sizeof(uint32_t), flist);
+            }
+        }
+        if (root == NULL && source == MERGE_REMOVED) {
+            root = path;
+        }
+        prev = path;
+        ptr += elem_size;
+    }
+
+    /* build summary of new list */
+    mfu_flist_summarize(flist);
+
+    mfu_free(&prev_last);
+    mfu_free(&last);
+    MPI_Op_free(&op_last);
+    MPI_Type_free(&dt_last);
+
+    DTCMP_Free(&handle);
+
+    DTCMP_Op_free(&op_key);
+    DTCMP_Op_free(&op_filepath);
+
+    MPI_Type_free(&dt_keysat);
+    MPI_Type_free(&dt_sat);
+    MPI_Type_free(&dt_key);
+    MPI_Type_free(&dt_filepath);
+
+    /* end timer */
+    double end_merge = MPI_Wtime();
+
+    /* report merge count and time */
+    uint64_t all_base   = mfu_flist_global_size(base);
+    uint64_t all_delta  = mfu_flist_global_size(delta);
+    uint64_t all_remove = (removed != MFU_FLIST_NULL) ? mfu_flist_global_size(removed) : 0;
+    if (rank == 0) {
+        uint64_t all_count = mfu_flist_global_size(flist);
+        double time_diff = end_merge - start_merge;
+        MFU_LOG(MFU_LOG_INFO, "Merged %lu items with %lu changes and %lu removals into %lu items in %.3lf seconds",
+               all_base, all_delta, all_remove, all_count, time_diff
+              );
+    }
+
+    return flist;
+}
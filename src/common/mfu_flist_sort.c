@@ -15,6 +15,7 @@
 #include <pwd.h> /* for getpwent */
 #include <grp.h> /* for getgrent */
 #include <errno.h>
+#include <fcntl.h>
 
 #include "libcircle.h"
 #include "dtcmp.h"
@@ -627,3 +628,792 @@ mfu_flist mfu_flist_sort(const char* sortfields, mfu_flist flist)
 
     return flist2;
 }
+
+/****************************************
+ * External sort
+ ****************************************/
+
+/* max number of fields in a sort key */
+#define EXT_MAXFIELDS (7)
+
+/* number of samples to take per rank when picking splitters */
+#define EXT_OVERSAMPLE (32)
+
+/* describes the key built for each item in an external sort,
+ * each field is a NUL-terminated string or a native uint32_t or
+ * uint64_t value, and the key is followed by the packed item */
+typedef struct {
+    int nfields;
+    sort_field fields[EXT_MAXFIELDS];
+    size_t lengths[EXT_MAXFIELDS];
+    int reverse[EXT_MAXFIELDS];
+    size_t key_size;  /* number of bytes in key */
+    size_t elem_size; /* number of bytes in key and packed item */
+} ext_key_t;
+
+/* key used by comparison routine given to qsort */
+static const ext_key_t* ext_qsort_key = NULL;
+
+static int ext_is_string(sort_field field)
+{
+    return (field == FILENAME || field == USERNAME || field == GROUPNAME);
+}
+
+/* parse comma-delimited sort fields into key description */
+static void ext_key_init(ext_key_t* key, const char* sortfields, mfu_flist flist)
+{
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    int detail = mfu_flist_have_detail(flist);
+    uint64_t chars       = mfu_flist_file_max_name(flist);
+    uint64_t chars_user  = detail ? mfu_flist_user_max_name(flist) : 0;
+    uint64_t chars_group = detail ? mfu_flist_group_max_name(flist) : 0;
+
+    key->nfields  = 0;
+    key->key_size = 0;
+
+    char* sortfields_copy = MFU_STRDUP(sortfields);
+    char* token = strtok(sortfields_copy, ",");
+    while (token != NULL) {
+        /* a leading '-' reverses the sort order of a field */
+        int reverse = 0;
+        const char* name = token;
+        if (name[0] == '-') {
+            reverse = 1;
+            name++;
+        }
+
+        sort_field field = NULLFIELD;
+        size_t length = 0;
+        if (strcmp(name, "name") == 0) {
+            field  = FILENAME;
+            length = (size_t) chars;
+        }
+        else if (detail && strcmp(name, "user") == 0) {
+            field  = USERNAME;
+            length = (size_t) chars_user;
+        }
+        else if (detail && strcmp(name, "group") == 0) {
+            field  = GROUPNAME;
+            length = (size_t) chars_group;
+        }
+        else if (detail && strcmp(name, "uid") == 0) {
+            field  = USERID;
+            length = 4;
+        }
+        else if (detail && strcmp(name, "gid") == 0) {
+            field  = GROUPID;
+            length = 4;
+        }
+        else if (detail && strcmp(name, "atime") == 0) {
+            field  = ATIME;
+            length = 4;
+        }
+        else if (detail && strcmp(name, "mtime") == 0) {
+            field  = MTIME;
+            length = 4;
+        }
+        else if (detail && strcmp(name, "ctime") == 0) {
+            field  = CTIME;
+            length = 4;
+        }
+        else if (detail && strcmp(name, "size") == 0) {
+            field  = FILESIZE;
+            length = 8;
+        }
+
+        if (field == NULLFIELD) {
+            if (rank == 0) {
+                MFU_LOG(MFU_LOG_ERR, "Invalid sort field: %s\n", token);
+            }
+        }
+        else if (key->nfields < EXT_MAXFIELDS) {
+            /* leave room for the terminating NUL of empty strings */
+            if (length == 0) {
+                length = 1;
+            }
+            key->fields[key->nfields]  = field;
+            key->lengths[key->nfields] = length;
+            key->reverse[key->nfields] = reverse;
+            key->key_size += length;
+            key->nfields++;
+        }
+        else {
+            if (rank == 0) {
+                MFU_LOG(MFU_LOG_ERR, "Too many sort fields, at most %d allowed, ignoring: %s",
+                    EXT_MAXFIELDS, token);
+            }
+        }
+
+        token = strtok(NULL, ",");
+    }
+    mfu_free(&sortfields_copy);
+
+    key->elem_size = key->key_size + mfu_flist_file_pack_size(flist);
+}
+
+/* copy string into fixed-length key field */
+static void ext_copy_str(char* ptr, const char* str, size_t length)
+{
+    size_t len = 0;
+    if (str != NULL) {
+        len = strlen(str);
+        if (len > length - 1) {
+            len = length - 1;
+        }
+        memcpy(ptr, str, len);
+    }
+    memset(ptr + len, 0, length - len);
+}
+
+/* build key for item idx at ptr, returns number of bytes written */
+static size_t ext_key_pack(char* ptr, const ext_key_t* key, mfu_flist flist, uint64_t idx)
+{
+    char* start = ptr;
+    int i;
+    for (i = 0; i < key->nfields; i++) {
+        sort_field field = key->fields[i];
+        if (field == FILENAME) {
+            ext_copy_str(ptr, mfu_flist_file_get_name(flist, idx), key->lengths[i]);
+        }
+        else if (field == USERNAME) {
+            ext_copy_str(ptr, mfu_flist_file_get_username(flist, idx), key->lengths[i]);
+        }
+        else if (field == GROUPNAME) {
+            ext_copy_str(ptr, mfu_flist_file_get_groupname(flist, idx), key->lengths[i]);
+        }
+        else if (field == FILESIZE) {
+            uint64_t val64 = mfu_flist_file_get_size(flist, idx);
+            memcpy(ptr, &val64, 8);
+        }
+        else {
+            uint64_t val = 0;
+            if (field == USERID) {
+                val = mfu_flist_file_get_uid(flist, idx);
+            } else if (field == GROUPID) {
+                val = mfu_flist_file_get_gid(flist, idx);
+            } else if (field == ATIME) {
+                val = mfu_flist_file_get_atime(flist, idx);
+            } else if (field == MTIME) {
+                val = mfu_flist_file_get_mtime(flist, idx);
+            } else if (field == CTIME) {
+                val = mfu_flist_file_get_ctime(flist, idx);
+            }
+            uint32_t val32 = (uint32_t) val;
+            memcpy(ptr, &val32, 4);
+        }
+        ptr += key->lengths[i];
+    }
+    return (size_t)(ptr - start);
+}
+
+/* compare two keys, returns <0, 0, or >0 */
+static int ext_key_compare(const ext_key_t* key, const char* a, const char* b)
+{
+    int i;
+    for (i = 0; i < key->nfields; i++) {
+        size_t length = key->lengths[i];
+        int c;
+        if (ext_is_string(key->fields[i])) {
+            c = strcmp(a, b);
+        }
+        else if (length == 4) {
+            uint32_t x, y;
+            memcpy(&x, a, 4);
+            memcpy(&y, b, 4);
+            c = (x < y) ? -1 : (x > y);
+        }
+        else {
+            uint64_t x, y;
+            memcpy(&x, a, 8);
+            memcpy(&y, b, 8);
+            c = (x < y) ? -1 : (x > y);
+        }
+        if (key->reverse[i]) {
+            c = -c;
+        }
+        if (c != 0) {
+            return c;
+        }
+        a += length;
+        b += length;
+    }
+    return 0;
+}
+
+/* compare two pointers to keys for qsort */
+static int ext_qsort_compare(const void* a, const void* b)
+{
+    const char* x = *(const char* const*) a;
+    const char* y = *(const char* const*) b;
+    return ext_key_compare(ext_qsort_key, x, y);
+}
+
+/* open a spill file in dir, the file is unlinked right away so
+ * its space is released when it is closed or the job dies */
+static int ext_open(char* name, size_t name_size, const char* dir, const char* suffix)
+{
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    snprintf(name, name_size, "%s/mfu_sort.%d.%d.%s", dir, (int)getpid(), rank, suffix);
+
+    int fd = mfu_open(name, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+        MFU_ABORT(1, "Failed to open sort file: `%s' (errno=%d %s)",
+            name, errno, strerror(errno));
+    }
+    mfu_unlink(name);
+    return fd;
+}
+
+static void ext_write(const char* name, int fd, const char* buf, size_t size, uint64_t offset)
+{
+    while (size > 0) {
+        ssize_t n = mfu_pwrite(name, fd, buf, size, (off_t)offset);
+        if (n <= 0) {
+            MFU_ABORT(1, "Failed to write sort file: `%s' (errno=%d %s)",
+                name, errno, strerror(errno));
+        }
+        buf    += n;
+        size   -= (size_t)n;
+        offset += (uint64_t)n;
+    }
+}
+
+static void ext_read(const char* name, int fd, char* buf, size_t size, uint64_t offset)
+{
+    while (size > 0) {
+        ssize_t n = mfu_pread(name, fd, buf, size, (off_t)offset);
+        if (n <= 0) {
+            MFU_ABORT(1, "Failed to read sort file: `%s' (errno=%d %s)",
+                name, errno, strerror(errno));
+        }
+        buf    += n;
+        size   -= (size_t)n;
+        offset += (uint64_t)n;
+    }
+}
+
+/* reads records of a sorted run from a spill file through a buffer */
+typedef struct {
+    const char* name;
+    int fd;
+    size_t elem_size;
+    uint64_t offset;    /* offset of next record to read from file */
+    uint64_t remaining; /* number of records in file not yet read */
+    uint64_t capacity;  /* number of records buffer can hold */
+    uint64_t have;      /* number of records in buffer */
+    uint64_t pos;       /* index of current record in buffer */
+    char* buf;
+} ext_reader_t;
+
+static void ext_reader_fill(ext_reader_t* r)
+{
+    uint64_t n = r->remaining;
+    if (n > r->capacity) {
+        n = r->capacity;
+    }
+    ext_read(r->name, r->fd, r->buf, (size_t)(n * r->elem_size), r->offset);
+    r->offset    += n * r->elem_size;
+    r->remaining -= n;
+    r->have = n;
+    r->pos  = 0;
+}
+
+static void ext_reader_init(
+    ext_reader_t* r,
+    const char* name,
+    int fd,
+    size_t elem_size,
+    uint64_t offset,
+    uint64_t count,
+    uint64_t capacity)
+{
+    if (capacity > count) {
+        capacity = count;
+    }
+    if (capacity == 0) {
+        capacity = 1;
+    }
+    r->name      = name;
+    r->fd        = fd;
+    r->elem_size = elem_size;
+    r->offset    = offset;
+    r->remaining = count;
+    r->capacity  = capacity;
+    r->have      = 0;
+    r->pos       = 0;
+    r->buf       = (char*) MFU_MALLOC((size_t)(capacity * elem_size));
+    ext_reader_fill(r);
+}
+
+/* returns pointer to current record, or NULL at end of run */
+static const char* ext_reader_head(const ext_reader_t* r)
+{
+    if (r->pos < r->have) {
+        return r->buf + r->pos * r->elem_size;
+    }
+    return NULL;
+}
+
+static void ext_reader_advance(ext_reader_t* r)
+{
+    r->pos++;
+    if (r->pos == r->have && r->remaining > 0) {
+        ext_reader_fill(r);
+    }
+}
+
+static void ext_reader_free(ext_reader_t* r)
+{
+    mfu_free(&r->buf);
+}
+
+/* k-way merge of sorted runs using a binary heap of readers */
+typedef struct {
+    const ext_key_t* key;
+    ext_reader_t* readers;
+    int* heap;     /* indices of readers, ordered by their current record */
+    int size;      /* number of readers in heap */
+    int returned;  /* whether record at top of heap was returned */
+} ext_merge_t;
+
+static int ext_merge_less(const ext_merge_t* m, int i, int j)
+{
+    const char* a = ext_reader_head(&m->readers[m->heap[i]]);
+    const char* b = ext_reader_head(&m->readers[m->heap[j]]);
+    return (ext_key_compare(m->key, a, b) < 0);
+}
+
+static void ext_merge_sift(ext_merge_t* m, int i)
+{
+    while (1) {
+        int smallest = i;
+        int left  = 2 * i + 1;
+        int right = 2 * i + 2;
+        if (left < m->size && ext_merge_less(m, left, smallest)) {
+            smallest = left;
+        }
+        if (right < m->size && ext_merge_less(m, right, smallest)) {
+            smallest = right;
+        }
+        if (smallest == i) {
+            break;
+        }
+        int tmp = m->heap[i];
+        m->heap[i] = m->heap[smallest];
+        m->heap[smallest] = tmp;
+        i = smallest;
+    }
+}
+
+static void ext_merge_init(ext_merge_t* m, const ext_key_t* key, ext_reader_t* readers, int count)
+{
+    m->key      = key;
+    m->readers  = readers;
+    m->heap     = (int*) MFU_MALLOC((size_t)count * sizeof(int));
+    m->size     = 0;
+    m->returned = 0;
+
+    /* add each non-empty run and build heap */
+    int i;
+    for (i = 0; i < count; i++) {
+        if (ext_reader_head(&readers[i]) != NULL) {
+            m->heap[m->size] = i;
+            m->size++;
+        }
+    }
+    for (i = m->size / 2 - 1; i >= 0; i--) {
+        ext_merge_sift(m, i);
+    }
+}
+
+/* returns pointer to next record in sorted order, which is valid
+ * until the following call, or NULL when all runs are consumed */
+static const char* ext_merge_next(ext_merge_t* m)
+{
+    /* advance run whose record we returned last time */
+    if (m->returned && m->size > 0) {
+        ext_reader_t* r = &m->readers[m->heap[0]];
+        ext_reader_advance(r);
+        if (ext_reader_head(r) == NULL) {
+            m->size--;
+            m->heap[0] = m->heap[m->size];
+        }
+        ext_merge_sift(m, 0);
+    }
+
+    if (m->size == 0) {
+        return NULL;
+    }
+    m->returned = 1;
+    return ext_reader_head(&m->readers[m->heap[0]]);
+}
+
+static void ext_merge_free(ext_merge_t* m)
+{
+    mfu_free(&m->heap);
+}
+
+/* pick ranks-1 splitter keys from a sample of keys on all ranks */
+static char* ext_splitters(const ext_key_t* key, mfu_flist flist, uint64_t all_count)
+{
+    int rank, ranks;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+
+    size_t key_size = key->key_size;
+
+    /* take every stride-th item so that the number of samples
+     * on each rank is proportional to its number of items */
+    uint64_t stride = all_count / ((uint64_t)ranks * EXT_OVERSAMPLE);
+    if (stride == 0) {
+        stride = 1;
+    }
+    uint64_t count = mfu_flist_size(flist);
+    uint64_t nsamples = (count + stride - 1) / stride;
+
+    /* build key of each sampled item */
+    char* samples = (char*) MFU_MALLOC((size_t)(nsamples * key_size));
+    uint64_t i;
+    for (i = 0; i < nsamples; i++) {
+        ext_key_pack(samples + i * key_size, key, flist, i * stride);
+    }
+
+    /* gather samples to rank 0 */
+    int sendbytes = (int)(nsamples * key_size);
+    int* recvbytes = NULL;
+    int* displs = NULL;
+    char* all_samples = NULL;
+    uint64_t all_nsamples = 0;
+    if (rank == 0) {
+        recvbytes = (int*) MFU_MALLOC((size_t)ranks * sizeof(int));
+        displs    = (int*) MFU_MALLOC((size_t)ranks * sizeof(int));
+    }
+    MPI_Gather(&sendbytes, 1, MPI_INT, recvbytes, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (rank == 0) {
+        int r;
+        int total = 0;
+        for (r = 0; r < ranks; r++) {
+            displs[r] = total;
+            total += recvbytes[r];
+        }
+        all_nsamples = (uint64_t)total / key_size;
+        all_samples = (char*) MFU_MALLOC((size_t)total);
+    }
+    MPI_Gatherv(samples, sendbytes, MPI_BYTE, all_samples, recvbytes, displs, MPI_BYTE, 0, MPI_COMM_WORLD);
+
+    /* rank 0 sorts samples and picks evenly spaced splitters */
+    size_t splitters_size = (size_t)(ranks - 1) * key_size;
+    char* splitters = (char*) MFU_MALLOC(splitters_size + 1);
+    if (rank == 0) {
+        char** ptrs = (char**) MFU_MALLOC((size_t)all_nsamples * sizeof(char*));
+        for (i = 0; i < all_nsamples; i++) {
+            ptrs[i] = all_samples + i * key_size;
+        }
+        ext_qsort_key = key;
+        qsort(ptrs, (size_t)all_nsamples, sizeof(char*), ext_qsort_compare);
+
+        int r;
+        for (r = 1; r < ranks; r++) {
+            uint64_t idx = (uint64_t)r * all_nsamples / (uint64_t)ranks;
+            memcpy(splitters + (size_t)(r - 1) * key_size, ptrs[idx], key_size);
+        }
+        mfu_free(&ptrs);
+    }
+    MPI_Bcast(splitters, (int)splitters_size, MPI_BYTE, 0, MPI_COMM_WORLD);
+
+    mfu_free(&all_samples);
+    mfu_free(&displs);
+    mfu_free(&recvbytes);
+    mfu_free(&samples);
+
+    return splitters;
+}
+
+/* sort items into runs of at most run_items records, write each run
+ * to fd, and count records in each run that belong to each rank */
+static void ext_write_runs(
+    const ext_key_t* key,
+    mfu_flist flist,
+    const char* splitters,
+    const char* name,
+    int fd,
+    uint64_t run_items,
+    uint64_t nruns,
+    uint64_t* parts)
+{
+    int ranks;
+    MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+
+    size_t elem_size = key->elem_size;
+    uint64_t count = mfu_flist_size(flist);
+
+    char* runbuf = (char*) MFU_MALLOC((size_t)(run_items * elem_size));
+    char** ptrs  = (char**) MFU_MALLOC((size_t)run_items * sizeof(char*));
+
+    /* stage sorted records before writing them */
+    uint64_t stage_items = (1024 * 1024) / elem_size;
+    if (stage_items == 0) {
+        stage_items = 1;
+    }
+    char* stage = (char*) MFU_MALLOC((size_t)(stage_items * elem_size));
+
+    ext_qsort_key = key;
+
+    uint64_t offset = 0;
+    uint64_t run;
+    for (run = 0; run < nruns; run++) {
+        /* build records for items in this run */
+        uint64_t start = run * run_items;
+        uint64_t n = count - start;
+        if (n > run_items) {
+            n = run_items;
+        }
+        uint64_t i;
+        for (i = 0; i < n; i++) {
+            char* ptr = runbuf + i * elem_size;
+            ptrs[i] = ptr;
+            ptr += ext_key_pack(ptr, key, flist, start + i);
+            mfu_flist_file_pack(ptr, flist, start + i);
+        }
+
+        /* sort records by key */
+        qsort(ptrs, (size_t)n, sizeof(char*), ext_qsort_compare);
+
+        /* write records in order, counting those that fall
+         * between each pair of splitters */
+        uint64_t* run_parts = parts + run * (uint64_t)ranks;
+        int dest = 0;
+        uint64_t staged = 0;
+        for (i = 0; i < n; i++) {
+            while (dest < ranks - 1 &&
+                   ext_key_compare(key, ptrs[i], splitters + (size_t)dest * key->key_size) > 0)
+            {
+                dest++;
+            }
+            run_parts[dest]++;
+
+            memcpy(stage + staged * elem_size, ptrs[i], elem_size);
+            staged++;
+            if (staged == stage_items || i == n - 1) {
+                ext_write(name, fd, stage, (size_t)(staged * elem_size), offset);
+                offset += staged * elem_size;
+                staged = 0;
+            }
+        }
+    }
+
+    mfu_free(&stage);
+    mfu_free(&ptrs);
+    mfu_free(&runbuf);
+}
+
+/* sort flist like mfu_flist_sort, but spill sorted runs to files
+ * in dir and merge them, so that sort buffers on each rank stay
+ * within about bufsize bytes */
+mfu_flist mfu_flist_sort_external(
+    const char* sortfields,
+    mfu_flist flist,
+    const char* dir,
+    size_t bufsize)
+{
+    if (sortfields == NULL || dir == NULL) {
+        MFU_ABORT(1, "mfu_flist_sort_external called with invalid arguments");
+    }
+
+    /* start timer */
+    double start_sort = MPI_Wtime();
+
+    int rank, ranks;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+
+    /* create a new list as subset of original list */
+    mfu_flist flist2 = mfu_flist_subset(flist);
+
+    /* bail out if there is nothing to sort */
+    uint64_t all_count = mfu_flist_global_size(flist);
+    if (all_count == 0) {
+        mfu_flist_summarize(flist2);
+        return flist2;
+    }
+
+    ext_key_t key;
+    ext_key_init(&key, sortfields, flist);
+    size_t elem_size = key.elem_size;
+
+    /* each phase needs room for at least a few records */
+    if (bufsize < 4 * (elem_size + sizeof(char*))) {
+        bufsize = 4 * (elem_size + sizeof(char*));
+    }
+
+    /* pick splitters that divide keys evenly among ranks */
+    char* splitters = ext_splitters(&key, flist, all_count);
+
+    /* sort our items into runs that fit in bufsize,
+     * and write them to a local spill file */
+    char runs_name[PATH_MAX];
+    int runs_fd = ext_open(runs_name, sizeof(runs_name), dir, "runs");
+
+    uint64_t count = mfu_flist_size(flist);
+    uint64_t run_items = bufsize / (elem_size + sizeof(char*));
+    uint64_t nruns = (count + run_items - 1) / run_items;
+
+    uint64_t* parts = (uint64_t*) MFU_MALLOC((size_t)(nruns * ranks + 1) * sizeof(uint64_t));
+    uint64_t i;
+    for (i = 0; i < nruns * (uint64_t)ranks; i++) {
+        parts[i] = 0;
+    }
+    ext_write_runs(&key, flist, splitters, runs_name, runs_fd, run_items, nruns, parts);
+
+    /* count records we send to and receive from each rank */
+    uint64_t* sendcounts = (uint64_t*) MFU_MALLOC((size_t)ranks * sizeof(uint64_t));
+    uint64_t* recvcounts = (uint64_t*) MFU_MALLOC((size_t)ranks * sizeof(uint64_t));
+    int r;
+    for (r = 0; r < ranks; r++) {
+        sendcounts[r] = 0;
+    }
+    uint64_t run;
+    for (run = 0; run < nruns; run++) {
+        for (r = 0; r < ranks; r++) {
+            sendcounts[r] += parts[run * ranks + r];
+        }
+    }
+    MPI_Alltoall(sendcounts, 1, MPI_UINT64_T, recvcounts, 1, MPI_UINT64_T, MPI_COMM_WORLD);
+
+    /* exchange records with each rank in turn, merging the part of
+     * each of our runs that belongs to the destination as we send,
+     * and appending what we receive as one sorted run per source */
+    char recv_name[PATH_MAX];
+    int recv_fd = ext_open(recv_name, sizeof(recv_name), dir, "recv");
+
+    uint64_t chunk_items = (bufsize / 4) / elem_size;
+    if (chunk_items == 0) {
+        chunk_items = 1;
+    }
+    if (chunk_items * elem_size > (uint64_t)INT_MAX) {
+        chunk_items = (uint64_t)INT_MAX / elem_size;
+    }
+    char* sendbuf = (char*) MFU_MALLOC((size_t)(chunk_items * elem_size));
+    char* recvbuf = (char*) MFU_MALLOC((size_t)(chunk_items * elem_size));
+
+    uint64_t run_capacity = (bufsize / 2) / ((nruns + 1) * elem_size);
+    ext_reader_t* readers = (ext_reader_t*) MFU_MALLOC((size_t)(nruns + 1) * sizeof(ext_reader_t));
+
+    uint64_t* recv_offsets = (uint64_t*) MFU_MALLOC((size_t)ranks * sizeof(uint64_t));
+    uint64_t recv_pos = 0;
+
+    int k;
+    for (k = 0; k < ranks; k++) {
+        int dst = (rank + k) % ranks;
+        int src = (rank - k + ranks) % ranks;
+
+        /* set up a reader over the part of each run for dst */
+        for (run = 0; run < nruns; run++) {
+            uint64_t skip = 0;
+            for (r = 0; r < dst; r++) {
+                skip += parts[run * ranks + r];
+            }
+            uint64_t offset = (run * run_items + skip) * elem_size;
+            ext_reader_init(&readers[run], runs_name, runs_fd, elem_size,
+                offset, parts[run * ranks + dst], run_capacity);
+        }
+        ext_merge_t merge;
+        ext_merge_init(&merge, &key, readers, (int)nruns);
+
+        recv_offsets[src] = recv_pos;
+        uint64_t to_send = sendcounts[dst];
+        uint64_t to_recv = recvcounts[src];
+        while (to_send > 0 || to_recv > 0) {
+            uint64_t nsend = (to_send < chunk_items) ? to_send : chunk_items;
+            uint64_t nrecv = (to_recv < chunk_items) ? to_recv : chunk_items;
+
+            for (i = 0; i < nsend; i++) {
+                const char* elem = ext_merge_next(&merge);
+                memcpy(sendbuf + i * elem_size, elem, elem_size);
+            }
+
+            /* both sides step through the same sequence of chunk
+             * sizes, so each posts only messages that carry data
+             * and message counts still match, for k == 0 this rank
+             * sends to itself, which is safe with nonblocking calls */
+            MPI_Request req[2] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+            if (nrecv > 0) {
+                MPI_Irecv(recvbuf, (int)(nrecv * elem_size), MPI_BYTE, src, 0, MPI_COMM_WORLD, &req[0]);
+            }
+            if (nsend > 0) {
+                MPI_Isend(sendbuf, (int)(nsend * elem_size), MPI_BYTE, dst, 0, MPI_COMM_WORLD, &req[1]);
+            }
+            MPI_Waitall(2, req, MPI_STATUSES_IGNORE);
+
+            ext_write(recv_name, recv_fd, recvbuf, (size_t)(nrecv * elem_size), recv_pos);
+            recv_pos += nrecv * elem_size;
+
+            to_send -= nsend;
+            to_recv -= nrecv;
+        }
+
+        ext_merge_free(&merge);
+        for (run = 0; run < nruns; run++) {
+            ext_reader_free(&readers[run]);
+        }
+    }
+
+    mfu_free(&readers);
+    mfu_free(&recvbuf);
+    mfu_free(&sendbuf);
+    mfu_close(runs_name, runs_fd);
+
+    /* merge the sorted run from each source into the new list */
+    uint64_t recv_capacity = bufsize / ((uint64_t)ranks * elem_size);
+    ext_reader_t* recv_readers = (ext_reader_t*) MFU_MALLOC((size_t)ranks * sizeof(ext_reader_t));
+    for (r = 0; r < ranks; r++) {
+        ext_reader_init(&recv_readers[r], recv_name, recv_fd, elem_size,
+            recv_offsets[r], recvcounts[r], recv_capacity);
+    }
+    ext_merge_t merge;
+    ext_merge_init(&merge, &key, recv_readers, ranks);
+    const char* elem;
+    while ((elem = ext_merge_next(&merge)) != NULL) {
+        mfu_flist_file_unpack(elem + key.key_size, flist2);
+    }
+    ext_merge_free(&merge);
+    for (r = 0; r < ranks; r++) {
+        ext_reader_free(&recv_readers[r]);
+    }
+    mfu_free(&recv_readers);
+    mfu_close(recv_name, recv_fd);
+
+    /* build summary of new list */
+    mfu_flist_summarize(flist2);
+
+    mfu_free(&recv_offsets);
+    mfu_free(&recvcounts);
+    mfu_free(&sendcounts);
+    mfu_free(&parts);
+    mfu_free(&splitters);
+
+    /* end timer */
+    double end_sort = MPI_Wtime();
+
+    /* report sort count, time, and rate */
+    uint64_t all_runs;
+    MPI_Reduce(&nruns, &all_runs, 1, MPI_UINT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+    if (rank == 0) {
+        double secs = end_sort - start_sort;
+        double rate = 0.0;
+        if (secs > 0.0) {
+            rate = ((double)all_count) / secs;
+        }
+        MFU_LOG(MFU_LOG_INFO, "Sorted %lu items using %lu runs in %.3lf seconds (%.3lf items/sec)",
+            all_count, all_runs, secs, rate
+        );
+    }
+
+    /* wait for summary to be printed */
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    return flist2;
+}
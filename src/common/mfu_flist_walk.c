@@ -55,6 +55,14 @@ static int WALK_RESULT = 0;
 static int NO_ATIME;
 static mfu_file_t** CURRENT_PFILE;
 
+/* During an incremental walk, hashes of directories whose entries are
+ * unchanged since the previous list (sorted), and directories we must
+ * read because their parent is unchanged but they are not */
+static uint64_t INCR_NUM_DIRS = 0;
+static uint64_t* INCR_DIRS = NULL;
+static uint64_t INCR_NUM_SEEDS = 0;
+static char** INCR_SEEDS = NULL;
+
 /****************************************
  * Global counter and callbacks for LIBCIRCLE reductions
  ***************************************/
@@ -443,6 +451,208 @@ static void walk_process(CIRCLE_handle* handle)
     return;
 }
 
+/****************************************
+ * Incremental walk using a previous list
+ ***************************************/
+
+static int walk_incr_cmp(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*) a;
+    uint64_t y = *(const uint64_t*) b;
+    if (x != y) {
+        return (x < y) ? -1 : 1;
+    }
+    return 0;
+}
+
+/* returns 1 if the directory named by the first len chars of path
+ * has not changed since the previous list was created */
+static int walk_incr_dir_unchanged(const char* path, size_t len)
+{
+    if (INCR_NUM_DIRS == 0) {
+        return 0;
+    }
+    uint64_t hash = mfu_hash_fnv1a64(path, len);
+    void* found = bsearch(&hash, INCR_DIRS, (size_t)INCR_NUM_DIRS,
+        sizeof(uint64_t), walk_incr_cmp);
+    return (found != NULL);
+}
+
+/* returns 1 if name is one of the paths being walked */
+static int walk_incr_is_root(const char* name)
+{
+    uint64_t i;
+    for (i = 0; i < CURRENT_NUM_DIRS; i++) {
+        if (strcmp(name, CURRENT_DIRS[i]) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* returns 1 if name is one of the paths being walked or under one */
+static int walk_incr_under_root(const char* name)
+{
+    uint64_t i;
+    for (i = 0; i < CURRENT_NUM_DIRS; i++) {
+        const char* root = CURRENT_DIRS[i];
+        size_t len = strlen(root);
+        if (strncmp(name, root, len) == 0 &&
+            (name[len] == '\0' || name[len] == '/' || (len > 0 && root[len - 1] == '/')))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* stat an item following the dereference setting of the walk */
+static int walk_incr_stat(const char* path, struct stat* st)
+{
+    mfu_file_t* mfu_file = *CURRENT_PFILE;
+    int status;
+    if (DEREFERENCE) {
+        status = mfu_file_stat(path, st, mfu_file);
+    } else {
+        status = mfu_file_lstat(path, st, mfu_file);
+    }
+    if (status != 0) {
+        MFU_LOG(MFU_LOG_ERR, "Failed to stat: '%s' (errno=%d %s)",
+                path, errno, strerror(errno));
+        WALK_RESULT = -1;
+    }
+    return status;
+}
+
+/* Uses a list from a previous walk of the same paths to avoid reading
+ * directories whose entries have not changed.  A directory whose mtime
+ * and ctime match the previous list holds the same set of names, so
+ * its entries are taken from the previous list and only stat'ed again.
+ * Directories that did change, and new directories, are read by the
+ * walk as usual.  Adds reused entries to the current list, and sets up
+ * globals consulted by the walk callbacks. */
+static void walk_incr_setup(mfu_flist prev)
+{
+    uint64_t idx;
+    uint64_t size = mfu_flist_size(prev);
+
+    /* stat each directory in the previous list and record the
+     * ones that are unchanged */
+    uint64_t count = 0;
+    uint64_t* hashes = (uint64_t*) MFU_MALLOC((size + 1) * sizeof(uint64_t));
+    for (idx = 0; idx < size; idx++) {
+        if (mfu_flist_file_get_type(prev, idx) != MFU_TYPE_DIR) {
+            continue;
+        }
+
+        const char* name = mfu_flist_file_get_name(prev, idx);
+        if (! walk_incr_under_root(name)) {
+            continue;
+        }
+
+        /* directory may have been removed, which is not an error */
+        struct stat st;
+        mfu_file_t* mfu_file = *CURRENT_PFILE;
+        int status;
+        if (DEREFERENCE) {
+            status = mfu_file_stat(name, &st, mfu_file);
+        } else {
+            status = mfu_file_lstat(name, &st, mfu_file);
+        }
+        if (status != 0 || !S_ISDIR(st.st_mode)) {
+            continue;
+        }
+
+        /* adding, removing, or renaming entries changes both */
+        uint64_t mtime, mtime_nsec, ctime, ctime_nsec;
+        mfu_stat_get_mtimes(&st, &mtime, &mtime_nsec);
+        mfu_stat_get_ctimes(&st, &ctime, &ctime_nsec);
+        if (mtime      == mfu_flist_file_get_mtime(prev, idx) &&
+            mtime_nsec == mfu_flist_file_get_mtime_nsec(prev, idx) &&
+            ctime      == mfu_flist_file_get_ctime(prev, idx) &&
+            ctime_nsec == mfu_flist_file_get_ctime_nsec(prev, idx))
+        {
+            hashes[count] = mfu_hash_fnv1a64(name, strlen(name));
+            count++;
+        }
+    }
+
+    /* gather unchanged directories from all ranks */
+    int ranks;
+    MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+    int* counts = (int*) MFU_MALLOC(ranks * sizeof(int));
+    int* displs = (int*) MFU_MALLOC(ranks * sizeof(int));
+
+    int mycount = (int) count;
+    MPI_Allgather(&mycount, 1, MPI_INT, counts, 1, MPI_INT, MPI_COMM_WORLD);
+
+    int total = 0;
+    int i;
+    for (i = 0; i < ranks; i++) {
+        displs[i] = total;
+        total += counts[i];
+    }
+
+    INCR_DIRS = (uint64_t*) MFU_MALLOC(((size_t)total + 1) * sizeof(uint64_t));
+    MPI_Allgatherv(hashes, mycount, MPI_UINT64_T,
+        INCR_DIRS, counts, displs, MPI_UINT64_T, MPI_COMM_WORLD);
+    INCR_NUM_DIRS = (uint64_t) total;
+    qsort(INCR_DIRS, (size_t)INCR_NUM_DIRS, sizeof(uint64_t), walk_incr_cmp);
+
+    mfu_free(&displs);
+    mfu_free(&counts);
+    mfu_free(&hashes);
+
+    /* take entries of unchanged directories from the previous list,
+     * subdirectories that changed must still be read by the walk */
+    INCR_NUM_SEEDS = 0;
+    INCR_SEEDS = (char**) MFU_MALLOC((size + 1) * sizeof(char*));
+    for (idx = 0; idx < size; idx++) {
+        const char* name = mfu_flist_file_get_name(prev, idx);
+        if (walk_incr_is_root(name) || !walk_incr_under_root(name)) {
+            continue;
+        }
+
+        /* skip entries whose parent directory has changed */
+        const char* slash = strrchr(name, '/');
+        if (slash == NULL) {
+            continue;
+        }
+        size_t parent_len = (slash == name) ? 1 : (size_t)(slash - name);
+        if (! walk_incr_dir_unchanged(name, parent_len)) {
+            continue;
+        }
+
+        if (mfu_flist_file_get_type(prev, idx) == MFU_TYPE_DIR &&
+            !walk_incr_dir_unchanged(name, strlen(name)))
+        {
+            INCR_SEEDS[INCR_NUM_SEEDS] = MFU_STRDUP(name);
+            INCR_NUM_SEEDS++;
+            continue;
+        }
+
+        struct stat st;
+        if (walk_incr_stat(name, &st) == 0) {
+            mfu_flist_insert_stat(CURRENT_LIST, name, st.st_mode, &st);
+            reduce_items++;
+        }
+    }
+}
+
+/* free globals set up for an incremental walk */
+static void walk_incr_free(void)
+{
+    uint64_t i;
+    for (i = 0; i < INCR_NUM_SEEDS; i++) {
+        mfu_free(&INCR_SEEDS[i]);
+    }
+    mfu_free(&INCR_SEEDS);
+    INCR_NUM_SEEDS = 0;
+
+    mfu_free(&INCR_DIRS);
+    INCR_NUM_DIRS = 0;
+}
+
 /****************************************
  * Walk directory tree using stat on every object
  ***************************************/
@@ -486,11 +696,23 @@ static void walk_stat_process_dir(char* dir, CIRCLE_handle* handle)
 /** Call back given to initialize the dataset. */
 static void walk_stat_create(CIRCLE_handle* handle)
 {
+    /* an incremental walk calls this on all ranks, since each rank
+     * holds its own seeds, so only rank 0 adds the top level paths */
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
     uint64_t i;
-    for (i = 0; i < CURRENT_NUM_DIRS; i++) {
-        /* we'll call stat on every item */
-        const char* path = CURRENT_DIRS[i];
-        handle->enqueue((char*)path);
+    if (rank == 0) {
+        for (i = 0; i < CURRENT_NUM_DIRS; i++) {
+            /* we'll call stat on every item */
+            const char* path = CURRENT_DIRS[i];
+            handle->enqueue((char*)path);
+        }
+    }
+
+    /* add directories found by an incremental walk that need a readdir */
+    for (i = 0; i < INCR_NUM_SEEDS; i++) {
+        handle->enqueue(INCR_SEEDS[i]);
     }
 }
 
@@ -546,6 +768,12 @@ static void walk_stat_process(CIRCLE_handle* handle)
                 mfu_file_chmod(path, st.st_mode, mfu_file);
             }
         }
+        /* entries of an unchanged directory were added from the
+         * previous list, so skip reading it again */
+        if (walk_incr_dir_unchanged(path, strlen(path))) {
+            return;
+        }
+
         /* TODO: check that we can recurse into directory */
         walk_stat_process_dir(path, handle);
     }
@@ -561,10 +789,11 @@ int mfu_flist_walk_path(const char* dirpath,
     return mfu_flist_walk_paths(1, &dirpath, walk_opts, bflist, mfu_file);
 }
 
-/* Set up and execute directory walk */
-int mfu_flist_walk_paths(uint64_t num_paths, const char** paths,
-                          mfu_walk_opts_t* walk_opts, mfu_flist bflist,
-                          mfu_file_t* mfu_file)
+/* Set up and execute directory walk, reuse entries of unchanged
+ * directories from prev if it is not NULL */
+static int walk_paths(uint64_t num_paths, const char** paths,
+                      mfu_walk_opts_t* walk_opts, mfu_flist prev,
+                      mfu_flist bflist, mfu_file_t* mfu_file)
 {
     /* report walk count, time, and rate */
     double start_walk = MPI_Wtime();
@@ -609,8 +838,17 @@ int mfu_flist_walk_paths(uint64_t num_paths, const char** paths,
         }
     }
 
-    /* initialize libcircle */
-    CIRCLE_init(0, NULL, CIRCLE_SPLIT_EQUAL | CIRCLE_TERM_TREE);
+    /* we need stat info in both lists to tell whether
+     * a directory has changed */
+    int incremental = (prev != NULL && walk_opts->use_stat && mfu_flist_have_detail(prev));
+
+    /* initialize libcircle, seeds of an incremental walk are spread
+     * over all ranks, so every rank must call the create callback */
+    int circle_flags = CIRCLE_SPLIT_EQUAL | CIRCLE_TERM_TREE;
+    if (incremental) {
+        circle_flags |= CIRCLE_CREATE_GLOBAL;
+    }
+    CIRCLE_init(0, NULL, circle_flags);
 
     /* set libcircle verbosity level */
     enum CIRCLE_loglevel loglevel = CIRCLE_LOG_WARN;
@@ -663,10 +901,21 @@ int mfu_flist_walk_paths(uint64_t num_paths, const char** paths,
     }
     CIRCLE_set_reduce_period(reduce_secs);
 
+    if (prev != NULL) {
+        if (incremental) {
+            walk_incr_setup(prev);
+        } else if (rank == 0) {
+            MFU_LOG(MFU_LOG_WARN, "Incremental walk requires stat data, walking all directories");
+        }
+    }
+
     /* run the libcircle job */
     CIRCLE_begin();
     CIRCLE_finalize();
 
+    /* done with state from previous list */
+    walk_incr_free();
+
     /* compute global summary */
     mfu_flist_summarize(bflist);
 
@@ -694,12 +943,41 @@ int mfu_flist_walk_paths(uint64_t num_paths, const char** paths,
     return all_rc;
 }
 
+/* Set up and execute directory walk */
+int mfu_flist_walk_paths(uint64_t num_paths, const char** paths,
+                          mfu_walk_opts_t* walk_opts, mfu_flist bflist,
+                          mfu_file_t* mfu_file)
+{
+    return walk_paths(num_paths, paths, walk_opts, NULL, bflist, mfu_file);
+}
+
+/* Set up and execute directory walk, reusing entries of directories
+ * that have not changed since prev was walked */
+int mfu_flist_walk_paths_incremental(uint64_t num_paths, const char** paths,
+                                     mfu_walk_opts_t* walk_opts, mfu_flist prev,
+                                     mfu_flist bflist, mfu_file_t* mfu_file)
+{
+    return walk_paths(num_paths, paths, walk_opts, prev, bflist, mfu_file);
+}
+
 /* given a list of param_paths, walk each one and add to flist */
 int mfu_flist_walk_param_paths(uint64_t num,
                                 const mfu_param_path* params,
                                 mfu_walk_opts_t* walk_opts,
                                 mfu_flist flist,
                                 mfu_file_t* mfu_file)
+{
+    return mfu_flist_walk_param_paths_incremental(num, params, walk_opts, NULL, flist, mfu_file);
+}
+
+/* given a list of param_paths, walk each one and add to flist,
+ * reusing entries of directories that are unchanged in prev */
+int mfu_flist_walk_param_paths_incremental(uint64_t num,
+                                const mfu_param_path* params,
+                                mfu_walk_opts_t* walk_opts,
+                                mfu_flist prev,
+                                mfu_flist flist,
+                                mfu_file_t* mfu_file)
 {
     /* allocate memory to hold a list of paths */
     const char** path_list = (const char**) MFU_MALLOC(num * sizeof(char*));
@@ -723,7 +1001,7 @@ int mfu_flist_walk_param_paths(uint64_t num,
     }
 
     /* walk file tree and record stat data for each file */
-    walk_result = mfu_flist_walk_paths((uint64_t) num, path_list, walk_opts, flist, mfu_file);
+    walk_result = walk_paths((uint64_t) num, path_list, walk_opts, prev, flist, mfu_file);
 
     /* free the list */
     mfu_free(&path_list);
@@ -767,7 +1045,7 @@ void mfu_flist_stat(
         /* check whether we should skip this item */
         if (skip_fn != NULL && skip_fn(name, skip_args)) {
             /* skip this file, don't include it in new list */
-            MFU_LOG(MFU_LOG_INFO, "skip %s");
+            MFU_LOG(MFU_LOG_DBG, "skip %s", name);
             continue;
         }
 
@@ -144,6 +144,8 @@ typedef struct {
     char*        block_buf2;       /* another buffer to read / write data */
     int          grouplock_id;     /* Lustre grouplock ID */
     uint64_t     batch_files;      /* max batch size to copy files, 0 implies no limit */
+    bool         dynamic;          /* whether to hand out chunks on demand rather than statically */
+    bool         adaptive;         /* whether to pick chunk size per file rather than use chunk_size */
 } mfu_copy_opts_t;
 
 /*
@@ -0,0 +1,127 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "mfu.h"
+#include "mfu_pathmap.h"
+
+/* keep the table at most this full, as a fraction of 100 */
+#define MFU_PATHMAP_LOAD (70)
+
+struct mfu_pathmap_struct {
+    mfu_flist list;     /* list holding the items, used to read back keys */
+    size_t prefix_len;  /* number of leading characters to skip in each name */
+    uint64_t count;     /* number of items in map */
+    uint64_t capacity;  /* number of slots in table, always a power of two */
+    uint64_t* slots;    /* table of (index + 1) into list, 0 marks an empty slot */
+    uint32_t* tags;     /* upper bits of key hash for each item, to skip most string compares */
+    int nfields;        /* number of state values per item */
+    uint8_t* states;    /* state values, nfields per item, indexed by list position */
+};
+
+/* return key for item at given index */
+static const char* pathmap_key(const mfu_pathmap* map, uint64_t idx)
+{
+    const char* name = mfu_flist_file_get_name(map->list, idx);
+    return name + map->prefix_len;
+}
+
+/* look for key with given hash, returns slot holding the key,
+ * or the empty slot where the key would be inserted */
+static uint64_t pathmap_find(const mfu_pathmap* map, const char* key, uint64_t hash)
+{
+    uint64_t mask = map->capacity - 1;
+    uint32_t tag  = (uint32_t) (hash >> 32);
+    uint64_t slot = hash & mask;
+    while (map->slots[slot] != 0) {
+        uint64_t idx = map->slots[slot] - 1;
+        if (map->tags[idx] == tag && strcmp(pathmap_key(map, idx), key) == 0) {
+            break;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+mfu_pathmap* mfu_pathmap_new(mfu_flist list, const char* prefix, int nfields, uint8_t init_state)
+{
+    mfu_pathmap* map = (mfu_pathmap*) MFU_MALLOC(sizeof(mfu_pathmap));
+
+    uint64_t count = mfu_flist_size(list);
+    map->list       = list;
+    map->prefix_len = strlen(prefix);
+    map->count      = count;
+    map->nfields    = nfields;
+
+    /* size table to the next power of two that keeps load in bounds */
+    uint64_t capacity = 16;
+    while (capacity * MFU_PATHMAP_LOAD / 100 <= count) {
+        capacity *= 2;
+    }
+    map->capacity = capacity;
+    map->slots    = (uint64_t*) MFU_MALLOC(capacity * sizeof(uint64_t));
+    memset(map->slots, 0, capacity * sizeof(uint64_t));
+
+    map->tags   = (uint32_t*) MFU_MALLOC(count * sizeof(uint32_t));
+    map->states = (uint8_t*)  MFU_MALLOC(count * (uint64_t) nfields);
+    memset(map->states, init_state, count * (uint64_t) nfields);
+
+    /* insert each item */
+    uint64_t idx;
+    for (idx = 0; idx < count; idx++) {
+        const char* key = pathmap_key(map, idx);
+        uint64_t hash = mfu_hash_fnv1a64(key, strlen(key));
+        map->tags[idx] = (uint32_t) (hash >> 32);
+
+        /* if the same key shows up twice, the later item wins,
+         * which matches what a string map would do */
+        uint64_t slot = pathmap_find(map, key, hash);
+        map->slots[slot] = idx + 1;
+    }
+
+    return map;
+}
+
+void mfu_pathmap_delete(mfu_pathmap** pmap)
+{
+    if (pmap != NULL) {
+        mfu_pathmap* map = *pmap;
+        if (map != NULL) {
+            mfu_free(&map->slots);
+            mfu_free(&map->tags);
+            mfu_free(&map->states);
+        }
+        mfu_free(pmap);
+    }
+}
+
+uint64_t mfu_pathmap_size(const mfu_pathmap* map)
+{
+    return map->count;
+}
+
+const char* mfu_pathmap_key(const mfu_pathmap* map, uint64_t idx)
+{
+    return pathmap_key(map, idx);
+}
+
+int mfu_pathmap_index(const mfu_pathmap* map, const char* key, uint64_t* idx)
+{
+    uint64_t hash = mfu_hash_fnv1a64(key, strlen(key));
+    uint64_t slot = pathmap_find(map, key, hash);
+    if (map->slots[slot] == 0) {
+        return -1;
+    }
+    *idx = map->slots[slot] - 1;
+    return 0;
+}
+
+uint8_t mfu_pathmap_state_get(const mfu_pathmap* map, uint64_t idx, int field)
+{
+    return map->states[idx * (uint64_t) map->nfields + (uint64_t) field];
+}
+
+void mfu_pathmap_state_set(mfu_pathmap* map, uint64_t idx, int field, uint8_t state)
+{
+    map->states[idx * (uint64_t) map->nfields + (uint64_t) field] = state;
+}
@@ -0,0 +1,50 @@
+/* enable C++ codes to include this header directly */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef MFU_PATHMAP_H
+#define MFU_PATHMAP_H
+
+/* Maps the relative path of each item in a file list to its index
+ * in that list, and stores a small array of state bytes per item.
+ *
+ * Entries are kept in an open-addressing hash table keyed by a
+ * 64-bit hash of the relative path.  The table only stores list
+ * indices, keys are read back from the file list itself, so the
+ * list must not be modified or freed while the map exists. */
+
+#include <stdint.h>
+#include "mfu_flist.h"
+
+/* (opaque) path map structure */
+typedef struct mfu_pathmap_struct mfu_pathmap;
+
+/* create a map for each item in list, the key for each item is its
+ * full path with the first strlen(prefix) characters removed,
+ * each item gets nfields state values, all set to init_state */
+mfu_pathmap* mfu_pathmap_new(mfu_flist list, const char* prefix, int nfields, uint8_t init_state);
+
+/* free a map and set caller's pointer to NULL */
+void mfu_pathmap_delete(mfu_pathmap** pmap);
+
+/* return number of items in map, which matches size of its list */
+uint64_t mfu_pathmap_size(const mfu_pathmap* map);
+
+/* return key (relative path) of item at given index */
+const char* mfu_pathmap_key(const mfu_pathmap* map, uint64_t idx);
+
+/* lookup key, on success set idx to index of item in list and
+ * return 0, return -1 if key is not in map */
+int mfu_pathmap_index(const mfu_pathmap* map, const char* key, uint64_t* idx);
+
+/* get and set state value of a field for item at given index */
+uint8_t mfu_pathmap_state_get(const mfu_pathmap* map, uint64_t idx, int field);
+void mfu_pathmap_state_set(mfu_pathmap* map, uint64_t idx, int field, uint8_t state);
+
+#endif /* MFU_PATHMAP_H */
+
+/* enable C++ codes to include this header directly */
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
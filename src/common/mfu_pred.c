@@ -136,6 +136,179 @@ mfu_pred_times_rel* mfu_pred_relative(const char* str, const mfu_pred_times* t)
     return r;
 }
 
+/* narrow the range [*min, *max] to values that satisfy a
+ * find-like comparison against val */
+static void bounds_cmp(int cmp, uint64_t val, uint64_t* min, uint64_t* max)
+{
+    uint64_t lo = 0;
+    uint64_t hi = UINT64_MAX;
+    if (cmp > 0) {
+        lo = (val < UINT64_MAX) ? val + 1 : UINT64_MAX;
+    } else if (cmp < 0) {
+        if (val == 0) {
+            /* nothing is less than zero, leave an empty range */
+            lo = 1;
+            hi = 0;
+        } else {
+            hi = val - 1;
+        }
+    } else {
+        lo = val;
+        hi = val;
+    }
+    if (lo > *min) {
+        *min = lo;
+    }
+    if (hi < *max) {
+        *max = hi;
+    }
+}
+
+/* return secs - x, or 0 if that would be negative */
+static uint64_t bounds_sub(uint64_t secs, uint64_t x)
+{
+    return (secs > x) ? secs - x : 0;
+}
+
+/* narrow mtime range to items whose age in units matches r,
+ * widened by a second on each side to absorb nanoseconds */
+static void bounds_age(const mfu_pred_times_rel* r, uint64_t units, uint64_t* min, uint64_t* max)
+{
+    uint64_t unit_secs = units / 1000000000ULL;
+    uint64_t now = r->t.secs;
+    uint64_t lo = 0;
+    uint64_t hi = UINT64_MAX;
+    if (r->direction > 0) {
+        /* older than magnitude+1 units */
+        hi = bounds_sub(now, (r->magnitude + 1) * unit_secs) + 1;
+    } else if (r->direction < 0) {
+        /* newer than magnitude units */
+        lo = bounds_sub(now, r->magnitude * unit_secs + 1);
+    } else {
+        /* items from the future have age 0 */
+        lo = bounds_sub(now, (r->magnitude + 1) * unit_secs + 1);
+        if (r->magnitude > 0) {
+            hi = bounds_sub(now, r->magnitude * unit_secs) + 1;
+        }
+    }
+    if (lo > *min) {
+        *min = lo;
+    }
+    if (hi < *max) {
+        *max = hi;
+    }
+}
+
+void mfu_pred_bounds_init(mfu_pred_bounds* b, const mfu_pred* p)
+{
+    b->types     = UINT64_MAX;
+    b->min_size  = 0;
+    b->max_size  = UINT64_MAX;
+    b->min_mtime = 0;
+    b->max_mtime = UINT64_MAX;
+    b->min_uid   = 0;
+    b->max_uid   = UINT64_MAX;
+    b->min_gid   = 0;
+    b->max_gid   = UINT64_MAX;
+    b->prefix    = NULL;
+
+    for (; p != NULL; p = p->next) {
+        int cmp;
+        uint64_t val;
+        if (p->f == NULL) {
+            /* the head of the list has no test */
+            continue;
+        } else if (p->f == MFU_PRED_TYPE) {
+            mode_t type = *((mode_t*)p->arg);
+            b->types &= ((uint64_t)1 << mfu_flist_mode_to_filetype(type));
+        } else if (p->f == MFU_PRED_SIZE) {
+            const char* str = (const char*) p->arg;
+            unsigned long long bytes = 0;
+            cmp = 0;
+            if (str[0] == '+' || str[0] == '-') {
+                cmp = (str[0] == '+') ? 1 : -1;
+                str++;
+            }
+            mfu_abtoull(str, &bytes);
+            bounds_cmp(cmp, (uint64_t)bytes, &b->min_size, &b->max_size);
+        } else if (p->f == MFU_PRED_UID) {
+            parse_number((const char*)p->arg, &cmp, &val);
+            bounds_cmp(cmp, val, &b->min_uid, &b->max_uid);
+        } else if (p->f == MFU_PRED_GID) {
+            parse_number((const char*)p->arg, &cmp, &val);
+            bounds_cmp(cmp, val, &b->min_gid, &b->max_gid);
+        } else if (p->f == MFU_PRED_MMIN) {
+            bounds_age((const mfu_pred_times_rel*)p->arg, NSECS_IN_MIN, &b->min_mtime, &b->max_mtime);
+        } else if (p->f == MFU_PRED_MTIME) {
+            bounds_age((const mfu_pred_times_rel*)p->arg, NSECS_IN_DAY, &b->min_mtime, &b->max_mtime);
+        } else if (p->f == MFU_PRED_MNEWER) {
+            const mfu_pred_times* t = (const mfu_pred_times*) p->arg;
+            if (t->secs > b->min_mtime) {
+                b->min_mtime = t->secs;
+            }
+        } else if (p->f == MFU_PRED_PATH) {
+            /* every match starts with the characters before the
+             * first special character in the pattern */
+            const char* pattern = (const char*) p->arg;
+            size_t len = strcspn(pattern, "*?[\\");
+            if (b->prefix == NULL || strlen(b->prefix) < len) {
+                mfu_free(&b->prefix);
+                b->prefix = (char*) MFU_MALLOC(len + 1);
+                memcpy(b->prefix, pattern, len);
+                b->prefix[len] = '\0';
+            }
+        } else if (p->f == MFU_PRED_NAME  || p->f == MFU_PRED_REGEX ||
+                   p->f == MFU_PRED_USER  || p->f == MFU_PRED_GROUP ||
+                   p->f == MFU_PRED_AMIN  || p->f == MFU_PRED_CMIN  ||
+                   p->f == MFU_PRED_ATIME || p->f == MFU_PRED_CTIME ||
+                   p->f == MFU_PRED_ANEWER || p->f == MFU_PRED_CNEWER)
+        {
+            /* no bounds from these, but they have no side effects */
+            continue;
+        } else {
+            /* unknown predicate, it may be an action on items
+             * that passed the tests so far, so stop here */
+            break;
+        }
+    }
+}
+
+void mfu_pred_bounds_free(mfu_pred_bounds* b)
+{
+    mfu_free(&b->prefix);
+}
+
+int mfu_pred_bounds_check(
+    const mfu_pred_bounds* b,
+    const char* name,
+    uint64_t mode,
+    uint64_t uid,
+    uint64_t gid,
+    uint64_t mtime,
+    uint64_t size)
+{
+    mfu_filetype type = mfu_flist_mode_to_filetype((mode_t)mode);
+    if (! (b->types & ((uint64_t)1 << type))) {
+        return 0;
+    }
+    if (size < b->min_size || size > b->max_size) {
+        return 0;
+    }
+    if (mtime < b->min_mtime || mtime > b->max_mtime) {
+        return 0;
+    }
+    if (uid < b->min_uid || uid > b->max_uid) {
+        return 0;
+    }
+    if (gid < b->min_gid || gid > b->max_gid) {
+        return 0;
+    }
+    if (b->prefix != NULL && strncmp(name, b->prefix, strlen(b->prefix)) != 0) {
+        return 0;
+    }
+    return 1;
+}
+
 int MFU_PRED_TYPE (mfu_flist flist, uint64_t idx, void* arg)
 {
     mode_t type = *((mode_t*)arg);
@@ -48,6 +48,43 @@ mfu_pred_times* mfu_pred_now(void);
  * N (exactly N), +N (greater than N), -N (less than N) */
 mfu_pred_times_rel* mfu_pred_relative(const char* str, const mfu_pred_times* t);
 
+/* conservative bounds on item fields implied by a predicate chain,
+ * an item outside these bounds can not satisfy the chain, which lets
+ * readers drop items and whole blocks of a cache file before
+ * decoding them, items inside the bounds still need the full test */
+typedef struct mfu_pred_bounds_t {
+    uint64_t types;     /* bit mask of (1 << mfu_filetype) values that can match */
+    uint64_t min_size;  /* smallest size that can match */
+    uint64_t max_size;  /* largest size that can match */
+    uint64_t min_mtime; /* oldest mtime in seconds that can match */
+    uint64_t max_mtime; /* newest mtime in seconds that can match */
+    uint64_t min_uid;   /* smallest uid that can match */
+    uint64_t max_uid;   /* largest uid that can match */
+    uint64_t min_gid;   /* smallest gid that can match */
+    uint64_t max_gid;   /* largest gid that can match */
+    char* prefix;       /* leading string of every matching path, or NULL */
+} mfu_pred_bounds;
+
+/* compute bounds from the predefined tests at the head of the chain,
+ * stops at the first predicate that is not a predefined test,
+ * since it may have side effects like printing an item,
+ * free with mfu_pred_bounds_free */
+void mfu_pred_bounds_init(mfu_pred_bounds* b, const mfu_pred* p);
+
+/* free memory allocated in mfu_pred_bounds_init */
+void mfu_pred_bounds_free(mfu_pred_bounds* b);
+
+/* returns 1 if an item with the given fields is within bounds, 0 otherwise */
+int mfu_pred_bounds_check(
+    const mfu_pred_bounds* b,
+    const char* name,
+    uint64_t mode,
+    uint64_t uid,
+    uint64_t gid,
+    uint64_t mtime,
+    uint64_t size
+);
+
 /* --------------------------
  * Predefined predicates
  * -------------------------- */
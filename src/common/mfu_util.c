@@ -17,6 +17,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <pthread.h>
 
 #include <sys/vfs.h>
 
@@ -592,6 +593,17 @@ uint32_t mfu_hash_jenkins(const char* key, size_t len)
     return hash;
 }
 
+uint64_t mfu_hash_fnv1a64(const char* key, size_t len)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    size_t i;
+    for (i = 0; i < len; ++i) {
+        hash ^= (uint64_t) ((unsigned char) key[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
 void mfu_stat_get_atimes(const struct stat* sb, uint64_t* secs, uint64_t* nsecs)
 {
     *secs = (uint64_t) sb->st_atime;
@@ -706,6 +718,172 @@ void mfu_stat_set_ctimes (struct stat* sb, uint64_t secs, uint64_t nsecs)
 #endif
 }
 
+/* read count bytes at offset off into buf, with O_DIRECT a short
+ * read before end of file is retried with the same buffer and
+ * offset since those must be aligned at block boundaries */
+static ssize_t mfu_compare_read(
+    const char* name,
+    void* buf,
+    size_t count,
+    off_t off,
+    off_t file_size,
+    int direct,
+    mfu_file_t* mfu_file)
+{
+    ssize_t nread = mfu_file_pread(name, buf, count, off, mfu_file);
+    while (direct &&                      /* using O_DIRECT */
+           nread > 0 &&                   /* read was not an error or eof */
+           (size_t)nread < count &&       /* shorter than requested */
+           (off + nread) < file_size)     /* not at end of file */
+    {
+        /* TODO: probably should retry a limited number of times then abort */
+        nread = mfu_file_pread(name, buf, count, off, mfu_file);
+    }
+    return nread;
+}
+
+/* arguments and result of a read issued from a helper thread */
+typedef struct {
+    const char* name;
+    void* buf;
+    size_t count;
+    off_t off;
+    off_t file_size;
+    int direct;
+    mfu_file_t* mfu_file;
+    ssize_t nread; /* OUT - bytes read or -1 */
+    int err;       /* OUT - errno from read */
+} mfu_compare_read_t;
+
+static void mfu_compare_read_run(mfu_compare_read_t* r)
+{
+    r->nread = mfu_compare_read(r->name, r->buf, r->count, r->off,
+        r->file_size, r->direct, r->mfu_file);
+    r->err = errno;
+}
+
+/* reads the destination on a helper thread that lives for one call
+ * of mfu_compare_contents, at most one read is outstanding at a time,
+ * without a thread, reads run inline when they are posted */
+typedef struct {
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int threaded;           /* whether reads run on the helper thread */
+    int pending;            /* whether a posted read has not been collected */
+    int busy;               /* whether the helper has a read to do */
+    int quit;               /* tells the helper to exit */
+    mfu_compare_read_t req; /* current read */
+} mfu_compare_reader_t;
+
+static void* mfu_compare_reader_main(void* arg)
+{
+    mfu_compare_reader_t* r = (mfu_compare_reader_t*) arg;
+
+    pthread_mutex_lock(&r->mutex);
+    while (1) {
+        while (! r->busy && ! r->quit) {
+            pthread_cond_wait(&r->cond, &r->mutex);
+        }
+        if (! r->busy) {
+            break;
+        }
+
+        /* read without holding the lock */
+        pthread_mutex_unlock(&r->mutex);
+        mfu_compare_read_run(&r->req);
+        pthread_mutex_lock(&r->mutex);
+
+        r->busy = 0;
+        pthread_cond_broadcast(&r->cond);
+    }
+    pthread_mutex_unlock(&r->mutex);
+
+    return NULL;
+}
+
+static void mfu_compare_reader_start(mfu_compare_reader_t* r, int threaded)
+{
+    r->threaded = 0;
+    r->pending  = 0;
+    r->busy     = 0;
+    r->quit     = 0;
+    if (threaded) {
+        pthread_mutex_init(&r->mutex, NULL);
+        pthread_cond_init(&r->cond, NULL);
+        if (pthread_create(&r->thread, NULL, mfu_compare_reader_main, r) == 0) {
+            r->threaded = 1;
+        } else {
+            pthread_cond_destroy(&r->cond);
+            pthread_mutex_destroy(&r->mutex);
+        }
+    }
+}
+
+/* start reading count bytes at off into buf, the caller must
+ * collect any earlier read with mfu_compare_reader_wait first */
+static void mfu_compare_reader_post(
+    mfu_compare_reader_t* r,
+    const char* name,
+    void* buf,
+    size_t count,
+    off_t off,
+    off_t file_size,
+    int direct,
+    mfu_file_t* mfu_file)
+{
+    r->req.name      = name;
+    r->req.buf       = buf;
+    r->req.count     = count;
+    r->req.off       = off;
+    r->req.file_size = file_size;
+    r->req.direct    = direct;
+    r->req.mfu_file  = mfu_file;
+    r->req.nread     = -1;
+    r->req.err       = 0;
+    r->pending = 1;
+
+    if (r->threaded) {
+        pthread_mutex_lock(&r->mutex);
+        r->busy = 1;
+        pthread_cond_broadcast(&r->cond);
+        pthread_mutex_unlock(&r->mutex);
+    } else {
+        mfu_compare_read_run(&r->req);
+    }
+}
+
+/* wait for the posted read to complete and return its result */
+static const mfu_compare_read_t* mfu_compare_reader_wait(mfu_compare_reader_t* r)
+{
+    if (r->threaded) {
+        pthread_mutex_lock(&r->mutex);
+        while (r->busy) {
+            pthread_cond_wait(&r->cond, &r->mutex);
+        }
+        pthread_mutex_unlock(&r->mutex);
+    }
+    r->pending = 0;
+    return &r->req;
+}
+
+/* wait for any outstanding read, then stop the helper thread */
+static void mfu_compare_reader_stop(mfu_compare_reader_t* r)
+{
+    if (r->pending) {
+        mfu_compare_reader_wait(r);
+    }
+    if (r->threaded) {
+        pthread_mutex_lock(&r->mutex);
+        r->quit = 1;
+        pthread_cond_broadcast(&r->cond);
+        pthread_mutex_unlock(&r->mutex);
+        pthread_join(r->thread, NULL);
+        pthread_cond_destroy(&r->cond);
+        pthread_mutex_destroy(&r->mutex);
+    }
+}
+
 /* compares contents of two files and optionally overwrite dest with source,
  * returns -1 on error, 0 if equal, 1 if different */
 int mfu_compare_contents(
@@ -790,11 +968,22 @@ int mfu_compare_contents(
     /* allocate buffer to write files, aligned on 1MB boundaraies */
     size_t alignment = 1024*1024;
     void* src_buf = (char*) MFU_MEMALIGN(buf_size, alignment);
-    void* dst_buf = (char*) MFU_MEMALIGN(buf_size, alignment);
+    void* dst_bufs[2];
+    dst_bufs[0] = (char*) MFU_MEMALIGN(buf_size, alignment);
+    dst_bufs[1] = (char*) MFU_MEMALIGN(buf_size, alignment);
+    int cur = 0;
 
     /* initialize our starting offset within the file */
     off_t off = offset;
 
+    /* overlap source and destination reads when both are POSIX files,
+     * pread on separate descriptors is safe from two threads, a single
+     * helper reads the destination into one buffer while we read the
+     * source and compare or write the other */
+    int overlap = (mfu_src_file->type == POSIX && mfu_dst_file->type == POSIX);
+    mfu_compare_reader_t reader;
+    mfu_compare_reader_start(&reader, overlap);
+
     /* if we write with O_DIRECT, we may need to truncate file */
     int need_truncate = 0;
 
@@ -813,19 +1002,49 @@ int mfu_compare_contents(
             }
         }
 
-        /* read data from source file */
-        ssize_t src_read = mfu_file_pread(src_name, (ssize_t*)src_buf, left_to_read, off, mfu_src_file);
+        /* the destination read of this range may already be in flight
+         * from the last iteration, drop it if a short read moved us
+         * to a different offset, and start the read if needed */
+        if (reader.pending &&
+            (reader.req.off != off || reader.req.count != left_to_read))
+        {
+            mfu_compare_reader_wait(&reader);
+        }
+        if (! reader.pending) {
+            mfu_compare_reader_post(&reader, dst_name, dst_bufs[cur], left_to_read,
+                off, (off_t) file_size, direct, mfu_dst_file);
+        }
 
-        /* If we're using O_DIRECT, deal with short reads.
-         * Retry with same buffer and offset since those must
-         * be aligned at block boundaries. */
-        while (direct &&                     /* using O_DIRECT */
-               src_read > 0 &&               /* read was not an error or eof */
-               src_read < left_to_read &&    /* shorter than requested */
-               (off + src_read) < file_size) /* not at end of file */
+        /* read data from source file while the helper reads the destination */
+        ssize_t src_read = mfu_compare_read(src_name, src_buf, left_to_read, off,
+            (off_t) file_size, direct, mfu_src_file);
+        int src_errno = errno;
+
+        /* wait for the destination data */
+        const mfu_compare_read_t* dst_req = mfu_compare_reader_wait(&reader);
+        ssize_t dst_read = dst_req->nread;
+        int dst_errno = dst_req->err;
+        void* dst_buf = dst_bufs[cur];
+        errno = src_errno;
+
+        /* start reading the next range of the destination into the
+         * other buffer while we compare and possibly write this one,
+         * the ranges don't overlap, since we only get here on full reads */
+        off_t next_total = total_bytes + (off_t) left_to_read;
+        if (reader.threaded &&
+            src_read == (ssize_t) left_to_read &&
+            dst_read == (ssize_t) left_to_read &&
+            next_total < length)
         {
-            /* TODO: probably should retry a limited number of times then abort */
-            src_read = mfu_file_pread(src_name, src_buf, left_to_read, off, mfu_src_file);
+            size_t next_to_read = buf_size;
+            if (! direct) {
+                off_t remainder = length - next_total;
+                if (remainder < (off_t)buf_size) {
+                    next_to_read = (size_t) remainder;
+                }
+            }
+            mfu_compare_reader_post(&reader, dst_name, dst_bufs[cur ^ 1], next_to_read,
+                off + (off_t) left_to_read, (off_t) file_size, direct, mfu_dst_file);
         }
 
         /* check for read error */
@@ -849,22 +1068,8 @@ int mfu_compare_contents(
         /* tally up number of bytes read */
         *count_bytes_read += (uint64_t) src_read;
 
-        /* read data from destination file */
-        ssize_t dst_read = mfu_file_pread(dst_name, (ssize_t*)dst_buf, left_to_read, off, mfu_dst_file);
-
-        /* If we're using O_DIRECT, deal with short reads.
-         * Retry with same buffer and offset since those must
-         * be aligned at block boundaries. */
-        while (direct &&                     /* using O_DIRECT */
-               dst_read > 0 &&               /* read was not an error or eof */
-               dst_read < left_to_read &&    /* shorter than requested */
-               (off + dst_read) < file_size) /* not at end of file */
-        {
-            /* TODO: probably should retry a limited number of times then abort */
-            dst_read = mfu_file_pread(dst_name, dst_buf, left_to_read, off, mfu_dst_file);
-        }
-
         /* check for read error */
+        errno = dst_errno;
         if (dst_read < 0) {
             /* hit a read error */
             MFU_LOG(MFU_LOG_ERR, "Failed to read `%s' at offset %llx (errno=%d %s)",
@@ -967,8 +1172,14 @@ int mfu_compare_contents(
         count_bytes[0] = *count_bytes_read;
         count_bytes[1] = *count_bytes_written;
         mfu_progress_update(count_bytes, prg);
+
+        /* the next range goes into the other buffer */
+        cur ^= 1;
     }
 
+    /* wait for any read still in flight before we free its buffer */
+    mfu_compare_reader_stop(&reader);
+
     /* truncate destination file if we might have written past the end */
     if (need_truncate) {
         off_t last_written = offset + length;
@@ -987,7 +1198,8 @@ int mfu_compare_contents(
 
     /* free buffers */
     mfu_free(&src_buf);
-    mfu_free(&dst_buf);
+    mfu_free(&dst_bufs[0]);
+    mfu_free(&dst_bufs[1]);
 
     /* close files */
     mfu_file_close(dst_name, mfu_dst_file);
@@ -239,6 +239,9 @@ void mfu_unpack_uint64(const char** pptr, uint64_t* value);
 /* Bob Jenkins one-at-a-time hash: http://en.wikipedia.org/wiki/Jenkins_hash_function */
 uint32_t mfu_hash_jenkins(const char* key, size_t len);
 
+/* 64-bit FNV-1a hash: http://en.wikipedia.org/wiki/Fowler-Noll-Vo_hash_function */
+uint64_t mfu_hash_fnv1a64(const char* key, size_t len);
+
 /* get secs and nsecs values from stat structure */
 void mfu_stat_get_atimes(const struct stat* sb, uint64_t* secs, uint64_t* nsecs);
 void mfu_stat_get_mtimes(const struct stat* sb, uint64_t* secs, uint64_t* nsecs);
@@ -15,6 +15,7 @@
 #include <time.h>
 #include <string.h>
 #include <getopt.h>
+#include <pthread.h>
 
 #include <sys/vfs.h>
 
@@ -423,6 +424,662 @@ void compute_offset_size(
     return;
 }
 
+/* given the position of the current chunk, compute the position
+ * of the next chunk a reader will process, returns 0 if there is
+ * no next chunk */
+static int next_chunk(
+  uint64_t* bytes_read,  /* IN/OUT - number of bytes read from file */
+  uint64_t* stripe_read, /* IN/OUT - number of bytes read from current stripe */
+  uint64_t* chunk_id,    /* IN/OUT - chunk id within stripe */
+  uint64_t file_size,    /* file size in bytes */
+  uint64_t stripe_size,  /* stripe size in bytes */
+  size_t   chunk_size,   /* chunk size in bytes */
+  int      reader_size)  /* number of readers */
+{
+    *stripe_read += chunk_size;
+    *chunk_id += 1;
+    if (*stripe_read >= stripe_size) {
+        *stripe_read = 0;
+        *chunk_id = 0;
+        *bytes_read += stripe_size * (uint64_t)reader_size;
+    }
+    return (*bytes_read < file_size);
+}
+
+/* a file being broadcast, all files are laid end to end in a single
+ * stream of bytes which is divided into chunks and spread over the
+ * readers, so that many small files can share one chunk */
+typedef struct {
+    char* src;       /* path to source file */
+    char* dst;       /* path to destination file */
+    uint64_t offset; /* offset of first byte of file within stream */
+    uint64_t size;   /* size of file in bytes */
+    int mode;        /* file mode */
+    int exists;      /* whether destination existed before we started (writers only) */
+    uint64_t old_size; /* size of destination before we started, if it existed (writers only) */
+    int created;     /* whether we have created the destination (writers only) */
+    int modified;    /* whether we have written to or truncated an existing destination (writers only) */
+} bcast_file;
+
+/* a directory to create under the destination */
+typedef struct {
+    char* dst;       /* path to destination directory */
+    int mode;        /* directory mode */
+} bcast_dir;
+
+/* a file kept open between chunks, since consecutive chunks
+ * usually fall in the same file */
+typedef struct {
+    int index; /* index of open file, or -1 */
+    int fd;    /* open file descriptor */
+} bcast_fd;
+
+/* close file held open in cache */
+static int bcast_fd_close(const char* path, bcast_fd* cache)
+{
+    int rc = 0;
+    if (cache->index >= 0) {
+        rc = mfu_close(path, cache->fd);
+        cache->index = -1;
+        cache->fd    = -1;
+    }
+    return rc;
+}
+
+/* return index of file holding byte at offset pos in stream */
+static int bcast_file_find(const bcast_file* files, int nfiles, uint64_t pos)
+{
+    /* find last file starting at or before pos, empty files share
+     * their offset with the file after them so they are skipped */
+    int lo = 0;
+    int hi = nfiles - 1;
+    while (lo < hi) {
+        int mid = lo + (hi - lo + 1) / 2;
+        if (files[mid].offset <= pos) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return lo;
+}
+
+/* read size bytes at offset pos in stream into buf,
+ * aborts the job on error */
+static void read_chunk(const bcast_file* files, int nfiles, bcast_fd* cache, void* buf, off_t pos, size_t size)
+{
+    uint64_t off = (uint64_t) pos;
+    char* ptr = (char*) buf;
+    size_t left = size;
+    int idx = (size > 0) ? bcast_file_find(files, nfiles, off) : nfiles;
+    while (left > 0 && idx < nfiles) {
+        const bcast_file* f = &files[idx];
+
+        /* read as much as we need from this file */
+        uint64_t file_off = off - f->offset;
+        size_t n = left;
+        if ((uint64_t) n > f->size - file_off) {
+            n = (size_t) (f->size - file_off);
+        }
+
+        if (n > 0) {
+            /* open the file if we don't already have it */
+            if (cache->index != idx) {
+                if (cache->index >= 0) {
+                    bcast_fd_close(files[cache->index].src, cache);
+                }
+                errno = 0;
+                cache->fd = mfu_open(f->src, O_RDONLY);
+                if (cache->fd < 0) {
+                    MFU_LOG(MFU_LOG_ERR, "Failed to open file `%s` for reading (%s)", f->src, strerror(errno));
+                    file_bcast_exit();
+                }
+                cache->index = idx;
+            }
+
+            errno = 0;
+            ssize_t return_size = mfu_pread(f->src, cache->fd, ptr, n, (off_t) file_off);
+            if (return_size != (ssize_t)n) {
+                MFU_LOG(MFU_LOG_ERR, "Failed to read contents from `%s` (%s)", f->src, strerror(errno));
+                file_bcast_exit();
+            }
+        }
+
+        off  += (uint64_t) n;
+        ptr  += n;
+        left -= n;
+        idx++;
+    }
+}
+
+/* write size bytes at offset pos in stream from buf to destination files,
+ * if a destination file already existed, its contents are read first
+ * and we only write if they differ to save wear on the SSD,
+ * with direct, the destination is created with O_DIRECT and a partial
+ * last block is written as a full chunk, the file is truncated later,
+ * returns 0 on success, 1 on a write error, and WRITE_FATAL on an error
+ * that must abort the job, this may run on the writer thread, so
+ * aborting is left to the main thread */
+#define WRITE_FATAL (2)
+static int write_chunk(bcast_file* files, int nfiles, bcast_fd* cache, int direct,
+                       const char* buf, char* readbuf, off_t pos, size_t size, size_t chunk_size)
+{
+    int write_error = 0;
+
+    uint64_t off = (uint64_t) pos;
+    const char* ptr = buf;
+    size_t left = size;
+    int idx = (size > 0) ? bcast_file_find(files, nfiles, off) : nfiles;
+    while (left > 0 && idx < nfiles && !write_error) {
+        bcast_file* f = &files[idx];
+
+        /* write as much as we have for this file */
+        uint64_t file_off = off - f->offset;
+        size_t n = left;
+        if ((uint64_t) n > f->size - file_off) {
+            n = (size_t) (f->size - file_off);
+        }
+
+        if (n > 0) {
+            /* open the file if we don't already have it */
+            if (cache->index != idx) {
+                if (cache->index >= 0) {
+                    bcast_fd_close(files[cache->index].dst, cache);
+                }
+                if (f->exists || f->created) {
+                    /* file already exists, open for read/write,
+                     * to save wear on SSD, we'll only write if
+                     * there is a difference in what we read */
+                    cache->fd = mfu_open(f->dst, O_RDWR);
+                } else {
+                    /* file does not exist, so create it */
+                    int flags = O_CREAT | O_TRUNC | O_WRONLY;
+                    if (direct) {
+                        flags |= O_DIRECT;
+                    }
+                    cache->fd = mfu_open(f->dst, flags, S_IRWXU | S_IRWXG | S_IRWXO);
+
+                    /* if the open failed, try again without O_DIRECT */
+                    if (cache->fd < 0 && direct) {
+                        flags = O_CREAT | O_TRUNC | O_WRONLY;
+                        cache->fd = mfu_open(f->dst, flags, S_IRWXU | S_IRWXG | S_IRWXO);
+                    }
+                    if (cache->fd >= 0) {
+                        f->created = 1;
+                    }
+                }
+                if (cache->fd < 0) {
+                    MFU_LOG(MFU_LOG_ERR, "Failed to open `%s` (%s)", f->dst, strerror(errno));
+                    write_error = 1;
+                    break;
+                }
+                cache->index = idx;
+            }
+
+            /* assume that we'll be writing data */
+            int write_data = 1;
+
+            /* if the file already exists, read in this segment and compare
+             * it to what we should be writing */
+            if (f->exists) {
+                /* file exists, now assume it's the same content so that
+                 * we don't need to write this data */
+                write_data = 0;
+
+                /* read chunk from file */
+                errno = 0;
+                ssize_t return_size = mfu_pread(f->dst, cache->fd, readbuf, n, (off_t) file_off);
+                if (return_size == (ssize_t)n) {
+                    /* we read the correct number of bytes, now compare them */
+                    if (memcmp(readbuf, ptr, n) != 0) {
+                        /* found a difference so overwrite existing data */
+                        write_data = 1;
+                    }
+                } else {
+                    /* overwrite data if we got a short read or end of file,
+                     * otherwise, we got a read error  */
+                    if (return_size >= 0) {
+                        write_data = 1;
+                    } else {
+                        /* consider this a write error since we can't read
+                         * to determine whether we need to write */
+                        MFU_LOG(MFU_LOG_ERR, "Failed to read from existing file `%s` (%s)", f->dst, strerror(errno));
+                        write_error = 1;
+                    }
+                }
+            }
+
+            /* write data to output file */
+            if (write_data && !write_error) {
+                /* from here on, an existing file no longer holds
+                 * its original contents */
+                if (f->exists) {
+                    f->modified = 1;
+                }
+
+                /* to use O_DIRECT, we have to write in full blocks */
+                size_t write_size = n;
+                if (direct && write_size != chunk_size) {
+                    if (file_off + write_size < f->size) {
+                        /* this is bad, so consider it to be fatal */
+                        MFU_LOG(MFU_LOG_ERR, "Trying to write past end of chunk in middle block `%s`", f->dst);
+                        write_error = WRITE_FATAL;
+                        break;
+                    }
+                    write_size = chunk_size;
+                }
+
+                /* write chunk to output file */
+                errno = 0;
+                ssize_t return_size = mfu_pwrite(f->dst, cache->fd, ptr, write_size, (off_t) file_off);
+                if (return_size == -1) {
+                    /* remember that we had a write error,
+                     * we'll keep going and delete the
+                     * file at the end */
+                    MFU_LOG(MFU_LOG_ERR, "Failed to write contents to `%s` (%s)", f->dst, strerror(errno));
+                    write_error = 1;
+                }
+            }
+        }
+
+        off  += (uint64_t) n;
+        ptr  += n;
+        left -= n;
+        idx++;
+    }
+
+    return write_error;
+}
+
+/* on a node with a single process, that process reads and passes
+ * chunks around the ring while a thread takes the place of the
+ * writer process, buffers are handed to the thread one at a time */
+typedef struct {
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int posted;         /* whether a buffer is waiting to be written */
+    int done;           /* set when no more buffers will be posted */
+    const char* buf;    /* buffer to be written */
+    off_t pos;          /* offset of buffer in stream */
+    size_t size;        /* number of bytes in buffer */
+    bcast_file* files;  /* files we're writing */
+    int nfiles;         /* number of files */
+    bcast_fd* cache;    /* destination file held open */
+    int direct;         /* whether to write with O_DIRECT */
+    char* readbuf;      /* buffer to read existing data into */
+    size_t chunk_size;  /* size of a full chunk */
+    int write_error;    /* set if we fail to write */
+} bcast_writer;
+
+static void* bcast_writer_main(void* arg)
+{
+    bcast_writer* w = (bcast_writer*) arg;
+
+    pthread_mutex_lock(&w->mutex);
+    while (1) {
+        /* wait for a buffer or for the reader to tell us we're done */
+        while (! w->posted && ! w->done) {
+            pthread_cond_wait(&w->cond, &w->mutex);
+        }
+        if (! w->posted) {
+            break;
+        }
+
+        /* write the buffer without holding the lock */
+        pthread_mutex_unlock(&w->mutex);
+        if (w->size > 0 && !w->write_error) {
+            w->write_error = write_chunk(w->files, w->nfiles, w->cache, w->direct,
+                w->buf, w->readbuf, w->pos, w->size, w->chunk_size);
+        }
+        pthread_mutex_lock(&w->mutex);
+
+        /* let the reader know it can reuse the buffer */
+        w->posted = 0;
+        pthread_cond_broadcast(&w->cond);
+    }
+    pthread_mutex_unlock(&w->mutex);
+
+    return NULL;
+}
+
+static void bcast_writer_start(bcast_writer* w)
+{
+    w->posted = 0;
+    w->done   = 0;
+    pthread_mutex_init(&w->mutex, NULL);
+    pthread_cond_init(&w->cond, NULL);
+    if (pthread_create(&w->thread, NULL, bcast_writer_main, w) != 0) {
+        MFU_LOG(MFU_LOG_ERR, "Failed to start writer thread");
+        file_bcast_exit();
+    }
+}
+
+/* block until writer has finished with the last posted buffer,
+ * called from the main thread, which aborts if the writer hit
+ * a fatal error */
+static void bcast_writer_wait(bcast_writer* w)
+{
+    pthread_mutex_lock(&w->mutex);
+    while (w->posted) {
+        pthread_cond_wait(&w->cond, &w->mutex);
+    }
+    int write_error = w->write_error;
+    pthread_mutex_unlock(&w->mutex);
+
+    if (write_error == WRITE_FATAL) {
+        file_bcast_exit();
+    }
+}
+
+/* hand a buffer to the writer, the caller must not modify it
+ * until bcast_writer_wait returns */
+static void bcast_writer_post(bcast_writer* w, const char* buf, off_t pos, size_t size)
+{
+    bcast_writer_wait(w);
+    pthread_mutex_lock(&w->mutex);
+    w->buf    = buf;
+    w->pos    = pos;
+    w->size   = size;
+    w->posted = 1;
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->mutex);
+}
+
+/* wait for outstanding writes, then stop the writer thread */
+static void bcast_writer_stop(bcast_writer* w)
+{
+    bcast_writer_wait(w);
+    pthread_mutex_lock(&w->mutex);
+    w->done = 1;
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->mutex);
+    pthread_join(w->thread, NULL);
+    pthread_cond_destroy(&w->cond);
+    pthread_mutex_destroy(&w->mutex);
+}
+
+/* encode a file or directory from a walked list as
+ * type, size, mode, and path relative to the source */
+static size_t bcast_pack_item(char* buf, int type, uint64_t size, int mode, const char* rel)
+{
+    char* ptr = buf;
+    mfu_pack_uint64(&ptr, (uint64_t) type);
+    mfu_pack_uint64(&ptr, size);
+    mfu_pack_uint64(&ptr, (uint64_t) mode);
+    strcpy(ptr, rel);
+    ptr += strlen(rel) + 1;
+    return (size_t) (ptr - buf);
+}
+
+/* build list of files to broadcast, if src is a regular file this is
+ * just src, if src is a directory, walk it (or read the list of items
+ * under it from input), and give every process the full list of files
+ * and directories with paths under dst, files are laid end to end
+ * in the stream in the same order on all processes,
+ * returns 0 on success */
+static int bcast_build_files(
+    const char* src,
+    const char* dst,
+    const char* input,
+    bcast_file** outfiles,
+    int* outnfiles,
+    bcast_dir** outdirs,
+    int* outndirs,
+    int* outis_dir,
+    uint64_t* outtotal)
+{
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    /* rank 0 checks what kind of source we have */
+    uint64_t vals[4] = {0, 0, 0, 0}; /* ok, is_dir, size, mode */
+    if (rank == 0) {
+        errno = 0;
+        struct stat file_stat;
+        if (stat(src, &file_stat) < 0) {
+            MFU_LOG(MFU_LOG_ERR, "Failed to stat file `%s` (%s)", src, strerror(errno));
+        } else {
+            vals[0] = 1;
+            vals[1] = S_ISDIR(file_stat.st_mode) ? 1 : 0;
+            vals[2] = (uint64_t) file_stat.st_size;
+            vals[3] = (uint64_t) file_stat.st_mode;
+        }
+    }
+    MPI_Bcast(vals, 4, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+    if (! vals[0]) {
+        return -1;
+    }
+
+    *outis_dir = (int) vals[1];
+    *outdirs   = NULL;
+    *outndirs  = 0;
+
+    if (! vals[1]) {
+        /* a single file */
+        bcast_file* files = (bcast_file*) MFU_MALLOC(sizeof(bcast_file));
+        files[0].src     = MFU_STRDUP(src);
+        files[0].dst     = MFU_STRDUP(dst);
+        files[0].offset  = 0;
+        files[0].size    = vals[2];
+        files[0].mode    = (int) vals[3];
+        files[0].exists  = 0;
+        files[0].old_size = 0;
+        files[0].created = 0;
+        files[0].modified = 0;
+        *outfiles  = files;
+        *outnfiles = 1;
+        *outtotal  = vals[2];
+        return 0;
+    }
+
+    /* get list of items under source directory */
+    mfu_flist flist = mfu_flist_new();
+    if (input != NULL) {
+        mfu_flist_read_cache(input, flist);
+    } else {
+        mfu_walk_opts_t* walk_opts = mfu_walk_opts_new();
+        mfu_file_t* mfu_file = mfu_file_new();
+        mfu_flist_walk_path(src, walk_opts, flist, mfu_file);
+        mfu_file_delete(&mfu_file);
+        mfu_walk_opts_delete(&walk_opts);
+    }
+
+    /* pack up regular files and directories below the source,
+     * other types of items are skipped */
+    size_t src_len = strlen(src);
+    uint64_t size = mfu_flist_size(flist);
+    size_t bytes = 0;
+    uint64_t idx;
+    for (idx = 0; idx < size; idx++) {
+        const char* name = mfu_flist_file_get_name(flist, idx);
+        bytes += 3 * 8 + strlen(name) + 1;
+    }
+    char* sendbuf = (char*) MFU_MALLOC(bytes);
+    size_t sendbytes = 0;
+    uint64_t skipped = 0;
+    for (idx = 0; idx < size; idx++) {
+        const char* name = mfu_flist_file_get_name(flist, idx);
+        if (strncmp(name, src, src_len) != 0 || name[src_len] != '/') {
+            /* the source directory itself, or not under it */
+            continue;
+        }
+        const char* rel = name + src_len + 1;
+
+        mfu_filetype type = mfu_flist_file_get_type(flist, idx);
+        if (type != MFU_TYPE_FILE && type != MFU_TYPE_DIR) {
+            skipped++;
+            continue;
+        }
+
+        uint64_t file_size = (type == MFU_TYPE_FILE) ? mfu_flist_file_get_size(flist, idx) : 0;
+        int mode = (int) mfu_flist_file_get_mode(flist, idx);
+        sendbytes += bcast_pack_item(sendbuf + sendbytes, (int) type, file_size, mode, rel);
+    }
+    mfu_flist_free(&flist);
+
+    uint64_t all_skipped;
+    MPI_Allreduce(&skipped, &all_skipped, 1, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0 && all_skipped > 0) {
+        MFU_LOG(MFU_LOG_WARN, "Skipping %llu items that are not regular files or directories",
+            (unsigned long long) all_skipped);
+    }
+
+    /* gather the packed items on all processes, MPI counts and
+     * displacements are ints, so the whole list must fit in INT_MAX bytes */
+    int ranks;
+    MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+    uint64_t sendbytes64 = (uint64_t) sendbytes;
+    uint64_t recvbytes64;
+    MPI_Allreduce(&sendbytes64, &recvbytes64, 1, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+    if (recvbytes64 > (uint64_t) INT_MAX) {
+        MFU_ABORT(1, "List of items under `%s` takes %llu bytes, more than the limit of %d bytes",
+            src, (unsigned long long) recvbytes64, INT_MAX);
+    }
+    int sendcount = (int) sendbytes;
+    int* recvcounts = (int*) MFU_MALLOC((size_t)ranks * sizeof(int));
+    int* recvdisps  = (int*) MFU_MALLOC((size_t)ranks * sizeof(int));
+    MPI_Allgather(&sendcount, 1, MPI_INT, recvcounts, 1, MPI_INT, MPI_COMM_WORLD);
+    int recvtotal = 0;
+    int i;
+    for (i = 0; i < ranks; i++) {
+        recvdisps[i] = recvtotal;
+        recvtotal += recvcounts[i];
+    }
+    char* recvbuf = (char*) MFU_MALLOC((size_t)recvtotal);
+    MPI_Allgatherv(sendbuf, sendcount, MPI_BYTE, recvbuf, recvcounts, recvdisps, MPI_BYTE, MPI_COMM_WORLD);
+    mfu_free(&sendbuf);
+    mfu_free(&recvdisps);
+    mfu_free(&recvcounts);
+
+    /* count files and directories */
+    uint64_t nfiles64 = 0;
+    uint64_t ndirs64  = 0;
+    const char* ptr = recvbuf;
+    const char* end = recvbuf + recvtotal;
+    while (ptr < end) {
+        uint64_t type, file_size, mode;
+        mfu_unpack_uint64(&ptr, &type);
+        mfu_unpack_uint64(&ptr, &file_size);
+        mfu_unpack_uint64(&ptr, &mode);
+        ptr += strlen(ptr) + 1;
+        if (type == MFU_TYPE_DIR) {
+            ndirs64++;
+        } else {
+            nfiles64++;
+        }
+    }
+
+    /* every process computes the same counts, so all abort together,
+     * one slot is reserved for the top-level directory */
+    if (nfiles64 > (uint64_t) INT_MAX || ndirs64 >= (uint64_t) INT_MAX) {
+        MFU_ABORT(1, "Too many items under `%s`: %llu files and %llu directories, limit is %d of each",
+            src, (unsigned long long) nfiles64, (unsigned long long) ndirs64, INT_MAX - 1);
+    }
+    int nfiles = (int) nfiles64;
+    int ndirs  = (int) ndirs64 + 1;
+
+    /* lay files out end to end, every process sees them in the same order */
+    bcast_file* files = (bcast_file*) MFU_MALLOC((size_t)(nfiles > 0 ? nfiles : 1) * sizeof(bcast_file));
+    bcast_dir* dirs = (bcast_dir*) MFU_MALLOC((size_t)ndirs * sizeof(bcast_dir));
+
+    /* record the top-level directory so that its mode is set as well */
+    dirs[0].dst  = MFU_STRDUP(dst);
+    dirs[0].mode = (int) vals[3];
+    uint64_t total = 0;
+    int f = 0;
+    int d = 1;
+    ptr = recvbuf;
+    while (ptr < end) {
+        uint64_t type, file_size, mode;
+        mfu_unpack_uint64(&ptr, &type);
+        mfu_unpack_uint64(&ptr, &file_size);
+        mfu_unpack_uint64(&ptr, &mode);
+        const char* rel = ptr;
+        ptr += strlen(rel) + 1;
+
+        mfu_path* dst_path = mfu_path_from_str(dst);
+        mfu_path_append_str(dst_path, rel);
+        char* dst_str = mfu_path_strdup(dst_path);
+        mfu_path_delete(&dst_path);
+
+        if (type == MFU_TYPE_DIR) {
+            dirs[d].dst  = dst_str;
+            dirs[d].mode = (int) mode;
+            d++;
+            continue;
+        }
+
+        mfu_path* src_path = mfu_path_from_str(src);
+        mfu_path_append_str(src_path, rel);
+        files[f].src     = mfu_path_strdup(src_path);
+        files[f].dst     = dst_str;
+        files[f].offset  = total;
+        files[f].size    = file_size;
+        files[f].mode    = (int) mode;
+        files[f].exists  = 0;
+        files[f].old_size = 0;
+        files[f].created = 0;
+        files[f].modified = 0;
+        mfu_path_delete(&src_path);
+
+        total += file_size;
+        f++;
+    }
+    mfu_free(&recvbuf);
+
+    *outfiles  = files;
+    *outnfiles = nfiles;
+    *outdirs   = dirs;
+    *outndirs  = ndirs;
+    *outtotal  = total;
+    return 0;
+}
+
+/* sort directories so that the deepest come first */
+static int bcast_dir_depth_cmp(const void* a, const void* b)
+{
+    const bcast_dir* da = (const bcast_dir*) a;
+    const bcast_dir* db = (const bcast_dir*) b;
+    int depth_a = 0;
+    int depth_b = 0;
+    const char* p;
+    for (p = da->dst; *p != '\0'; p++) {
+        if (*p == '/') {
+            depth_a++;
+        }
+    }
+    for (p = db->dst; *p != '\0'; p++) {
+        if (*p == '/') {
+            depth_b++;
+        }
+    }
+    return depth_b - depth_a;
+}
+
+/* set the mode of each directory, this is done after all files have
+ * been written, since the source mode may not allow us to create or
+ * write files inside, and starting with the deepest directories
+ * so that a parent does not lock us out of its children,
+ * returns 0 on success */
+static int bcast_dirs_chmod(bcast_dir* dirs, int ndirs)
+{
+    int rc = 0;
+
+    qsort(dirs, (size_t)ndirs, sizeof(bcast_dir), bcast_dir_depth_cmp);
+
+    int i;
+    for (i = 0; i < ndirs; i++) {
+        errno = 0;
+        if (mfu_chmod(dirs[i].dst, (mode_t) dirs[i].mode) != 0) {
+            MFU_LOG(MFU_LOG_ERR, "Failed to chmod directory `%s` (%s)", dirs[i].dst, strerror(errno));
+            rc = -1;
+        }
+    }
+
+    return rc;
+}
+
 int mkdirp(const char* path)
 {
     /* assume we'll succeed */
@@ -466,6 +1123,7 @@ static void print_usage(void)
     printf("Usage: dbcast [options] <SRC> <DEST>\n");
     printf("\n");
     printf("Options:\n");
+    printf("  -i, --input <file> - read list of items under SRC directory from file\n");
     printf("  -s, --size <SIZE>  - block size to divide files (default 1MB)\n");
     printf("  -h, --help         - print usage\n");
     printf("For more information see https://mpifileutils.readthedocs.io.");
@@ -474,13 +1132,32 @@ static void print_usage(void)
     return;
 }
 
-int main (int argc, char *argv[])
+/* flush data on the file system holding path, returns 0 on success */
+static int sync_fs(const char* path)
 {
-    int in_file = -1;
-    int out_file = -1;
+#ifdef HAVE_SYNCFS
+    int fd = open(path, O_RDONLY);
+    if (fd >= 0) {
+        int rc = syncfs(fd);
+        close(fd);
+        return rc;
+    }
+#endif
 
-    /* set this to one to write blocks to file if they are different */
-    int file_exists = 0;
+    /* fall back to syncing everything */
+    sync();
+    return 0;
+}
+
+int main (int argc, char *argv[])
+{
+    /* files currently open for reading and writing */
+    bcast_fd in_cache;
+    in_cache.index = -1;
+    in_cache.fd    = -1;
+    bcast_fd out_cache;
+    out_cache.index = -1;
+    out_cache.fd    = -1;
 
     /* if a node fails to write the file, we'll set this to one,
      * it will no longer try to write, but it will delete the file
@@ -504,16 +1181,18 @@ int main (int argc, char *argv[])
     /* process any options */
     int option_index = 0;
     static struct option long_options[] = {
+        {"input",        1, 0, 'i'},
         {"size",         1, 0, 's'},
         {"help",         0, 0, 'h'},
         {0, 0, 0, 0}
     };
 
+    char* inputname = NULL;
     unsigned long long byte_val;
     int usage = 0;
     while (1) {
         int c = getopt_long(
-                    argc, argv, "s:h",
+                    argc, argv, "i:s:h",
                     long_options, &option_index
                 );
 
@@ -522,6 +1201,9 @@ int main (int argc, char *argv[])
         }
 
         switch (c) {
+            case 'i':
+                inputname = MFU_STRDUP(optarg);
+                break;
             case 's':
                 /* parse stripe_size from command line */
                 if (mfu_abtoull(optarg, &byte_val) != MFU_SUCCESS) {
@@ -556,6 +1238,7 @@ int main (int argc, char *argv[])
         if (rank == 0) {
             print_usage();
         }
+        mfu_free(&inputname);
         MPI_Finalize();
         return 0;
     }
@@ -578,56 +1261,47 @@ int main (int argc, char *argv[])
     MPI_Comm_rank(node_comm, &node_rank);
     MPI_Comm_size(node_comm, &node_size);
 
-    /* we'll split into levels, but we want each level to be ordered
-     * the same by node, so we use our node leader's rank as a key */
-    int key = rank;
-    MPI_Bcast(&key, 1, MPI_INT, 0, node_comm);
-
-    /* split across nodes into levels */
-    MPI_Comm level_comm;
-    MPI_Comm_split(MPI_COMM_WORLD, node_rank, key, &level_comm);
-
-    /* get our rank and number of ranks in the level communicator */
-    int level_rank, level_size;
-    MPI_Comm_rank(level_comm, &level_rank);
-    MPI_Comm_size(level_comm, &level_size);
-
-    /* ensure that all nodes have same number of procs,
-     * makes math easier when dividing up work */
+    /* number the nodes, ordered by the rank of their leader */
+    int node_index, num_nodes;
+    MPI_Comm leader_comm;
+    MPI_Comm_split(MPI_COMM_WORLD, (node_rank == 0) ? 0 : MPI_UNDEFINED, rank, &leader_comm);
+    if (node_rank == 0) {
+        MPI_Comm_rank(leader_comm, &node_index);
+        MPI_Comm_size(leader_comm, &num_nodes);
+        MPI_Comm_free(&leader_comm);
+    }
+    MPI_Bcast(&node_index, 1, MPI_INT, 0, node_comm);
+    MPI_Bcast(&num_nodes,  1, MPI_INT, 0, node_comm);
+
+    /* each node runs the same number of readers so that every reader
+     * has a partner on every other node, node_rank 0 writes and
+     * node_rank 1..lanes read, nodes with more procs leave the rest
+     * idle, and a node with a single proc both reads and writes
+     * using a thread for the writer */
+    int node_readers = (node_size > 1) ? node_size - 1 : 1;
+    int lanes;
+    MPI_Allreduce(&node_readers, &lanes, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
 
-    /* get number of procs on our node and max number of procs on any node */
     int max_node_size;
     MPI_Allreduce(&node_size, &max_node_size, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
-
-    /* determine whether all nodes have the same number of procs */
-    int same_count = 1;
-    if (node_size != max_node_size) {
-        same_count = 0;
+    if (rank == 0 && max_node_size - 1 > lanes) {
+        MFU_LOG(MFU_LOG_INFO, "Using %d reader(s) per node, some procs will be idle", lanes);
     }
-    int all_same_count;
-    MPI_Allreduce(&same_count, &all_same_count, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
 
-    /* bail out if we have different nodes have different numbers of procs */
-    if (! all_same_count) {
-        if (rank == 0) {
-            MFU_LOG(MFU_LOG_ERR, "Must run with same number of tasks on all nodes");
-        }
-        MPI_Finalize();
-        mfu_free(&out_file_path);
-        mfu_free(&in_file_path);
-        return 0;
+    /* whether we write, and which reader lane we serve (0 if none) */
+    int is_writer = (node_rank == 0);
+    int writer_thread = (node_size == 1);
+    int lane = 0;
+    if (writer_thread) {
+        lane = 1;
+    } else if (node_rank <= lanes) {
+        lane = node_rank;
     }
 
-    /* ensure that each node has at least two procs */
-    if (node_size < 2) {
-        if (rank == 0) {
-            MFU_LOG(MFU_LOG_ERR, "Must run with at least two tasks per node");
-        }
-        MPI_Finalize();
-        mfu_free(&out_file_path);
-        mfu_free(&in_file_path);
-        return 0;
-    }
+    /* split readers across nodes into levels, one for each lane,
+     * each ordered the same by node */
+    MPI_Comm level_comm;
+    MPI_Comm_split(MPI_COMM_WORLD, (lane > 0) ? lane : MPI_UNDEFINED, node_index, &level_comm);
 
     /* check that we can read the input from at least rank 0
      * to catch simple typos */
@@ -645,26 +1319,57 @@ int main (int argc, char *argv[])
         MPI_Finalize();
         mfu_free(&out_file_path);
         mfu_free(&in_file_path);
+        mfu_free(&inputname);
+        return 0;
+    }
+
+    /* build list of files to broadcast, this walks SRC if it is a directory */
+    bcast_file* files = NULL;
+    int nfiles = 0;
+    bcast_dir* dirs = NULL;
+    int ndirs = 0;
+    int is_dir = 0;
+    uint64_t file_size = 0;
+    if (bcast_build_files(in_file_path, out_file_path, inputname,
+        &files, &nfiles, &dirs, &ndirs, &is_dir, &file_size) != 0)
+    {
+        if (rank == 0) {
+            MFU_LOG(MFU_LOG_ERR, "Failed to list files in `%s`", in_file_path);
+        }
+        MPI_Finalize();
+        mfu_free(&out_file_path);
+        mfu_free(&in_file_path);
+        mfu_free(&inputname);
         return 0;
     }
 
     /* create destination directory (if needed) */
+    int i;
     int mkdir_rc = 0;
     if (rank == 0) {
         MFU_LOG(MFU_LOG_INFO, "Creating destination directories for `%s`", out_file_path);
     }
     if (node_rank == 0) {
-        /* define path to destination file */
-        mfu_path* parent_path = mfu_path_from_str(out_file_path);
-        mfu_path_dirname(parent_path);
-        const char* parent_path_str = mfu_path_strdup(parent_path);
+        if (is_dir) {
+            /* create destination directory and the tree below it,
+             * mkdirp creates any missing parents along the way */
+            mkdir_rc = mkdirp(out_file_path);
+            for (i = 0; i < ndirs && mkdir_rc == 0; i++) {
+                mkdir_rc = mkdirp(dirs[i].dst);
+            }
+        } else {
+            /* define path to destination file */
+            mfu_path* parent_path = mfu_path_from_str(out_file_path);
+            mfu_path_dirname(parent_path);
+            const char* parent_path_str = mfu_path_strdup(parent_path);
 
-        /* make directory for this path */
-        mkdir_rc = mkdirp(parent_path_str);
+            /* make directory for this path */
+            mkdir_rc = mkdirp(parent_path_str);
 
-        /* free path data structures */
-        mfu_free(&parent_path_str);
-        mfu_path_delete(&parent_path);
+            /* free path data structures */
+            mfu_free(&parent_path_str);
+            mfu_path_delete(&parent_path);
+        }
     }
     if (gcs_anytrue((mkdir_rc != 0), MPI_COMM_WORLD)) {
         /* someone failed to create the directory */
@@ -674,6 +1379,7 @@ int main (int argc, char *argv[])
         MPI_Finalize();
         mfu_free(&out_file_path);
         mfu_free(&in_file_path);
+        mfu_free(&inputname);
         return 0;
     }
     MPI_Barrier(MPI_COMM_WORLD);
@@ -685,13 +1391,13 @@ int main (int argc, char *argv[])
     size_t alignment = 1024*1024;
 
     /* we'll create multiple shared memory segments,
-     * two for each reader process */
-    int bufcounts = (node_size - 1) * 2;
+     * three for each reader on this node, one to send from,
+     * one to receive into, and one to read the next chunk into */
+    int bufcounts = lanes * 3;
     void** shmbuf_base = (void**) malloc(bufcounts * sizeof(void*));
     void** shmbuf      = (void**) malloc(bufcounts * sizeof(void*));
 
     /* initialize our shared memory pointers */
-    int i;
     for (i = 0; i < bufcounts; i++) {
         /* allocate memory (two buffers for each reader) */
         shmbuf_base[i] = GCS_Shmem_alloc(chunk_size + alignment, node_comm);
@@ -702,118 +1408,76 @@ int main (int argc, char *argv[])
         //shmbuf[i] = (char*)base + alignment - ((uint64_t)base & (alignment - 1)) ;
     }
 
-    /* rank 0 reads flie size and mode */
-    int mode;
-    uint64_t file_size;
     const char *time_format = "%b %d %T";
     if (rank == 0) {
-        /* post message to user about the file we're bcasting */
-        MFU_LOG(MFU_LOG_INFO, "Broadcasting contents of `%s` to `%s`", in_file_path, out_file_path);
-
-        /* get file size */
-        errno = 0;
-        struct stat file_stat;
-        if (stat(in_file_path, &file_stat) < 0) {
-            MFU_LOG(MFU_LOG_ERR, "Failed to stat file `%s` (%s)", in_file_path, strerror(errno));
-            file_bcast_exit();
+        /* post message to user about what we're bcasting */
+        if (is_dir) {
+            MFU_LOG(MFU_LOG_INFO, "Broadcasting %d files (%llu bytes) in `%s` to `%s`",
+                nfiles, (unsigned long long) file_size, in_file_path, out_file_path);
+        } else {
+            MFU_LOG(MFU_LOG_INFO, "Broadcasting contents of `%s` to `%s`", in_file_path, out_file_path);
         }
-
-        /* get file mode and size from stat info */
-        mode = (int) file_stat.st_mode;
-        file_size = (uint64_t) file_stat.st_size;
     }
 
-    /* broadcast file size to all procs */
-    MPI_Bcast(&file_size, 1, MPI_UINT64_T, 0, MPI_COMM_WORLD);
-
-    /* broadcast file mode to all procs */
-    MPI_Bcast(&mode, 1, MPI_INT, 0, MPI_COMM_WORLD);
-
     /* identify number of reader tasks and assign a rank to each one */
-
-    /* tasks with node_rank == 0 are excluded from this set */
-    int reader_size = ranks - level_size;
+    int reader_size = num_nodes * lanes;
 
     /* assign ranks so that readers on the same node are in
-     * consecutive order (remember to exclude node_rank == 0 from
-     * each node) */
-    int reader_rank = level_rank * (node_size - 1) + (node_rank - 1);
-
-    /* rank 0 on each node will write file, others will read from input */
-    if (node_rank == 0) {
-        /* open file for differently depending on whether it already exists */
+     * consecutive order */
+    int reader_rank = node_index * lanes + (lane - 1);
+
+    /* rank 0 on each node will write files, others will read from input,
+     * readers open input files as they get to them */
+    if (is_writer) {
+        /* we'll compare against files that already exist, and only
+         * write blocks that are different */
         uint64_t existing_file_size = 0;
-        if (mfu_access(out_file_path, F_OK) == 0) {
-            /* record that file already exists */
-            file_exists = 1;
-
-            /* get size of existing file */
+        for (i = 0; i < nfiles; i++) {
             errno = 0;
             struct stat file_stat;
-            if (mfu_lstat(out_file_path, &file_stat) < 0) {
-                /* can't measure free space so assume we have none */
-                MFU_LOG(MFU_LOG_ERR, "Failed to stat file `%s` (%s)", out_file_path, strerror(errno));
-            } else {
+            if (mfu_lstat(files[i].dst, &file_stat) == 0) {
+                /* record that file already exists */
+                files[i].exists   = 1;
+                files[i].old_size = (uint64_t) file_stat.st_size;
+
                 /* we'll overwrite the existing file, so include its
                  * size in our measure of free space */
-                existing_file_size = (uint64_t) file_stat.st_size;
+                existing_file_size += (uint64_t) file_stat.st_size;
+            } else if (errno != ENOENT) {
+                /* can't measure free space so assume we have none */
+                MFU_LOG(MFU_LOG_ERR, "Failed to stat file `%s` (%s)", files[i].dst, strerror(errno));
+                write_error = 1;
             }
+        }
 
-            /* file already exists, open for read/write,
-             * to save wear on SSD, we'll only write if
-             * there is a difference in what we read */
-            int flags = O_RDWR;
-            out_file = mfu_open(out_file_path, flags);
-        } else {
-            /* file does not exist, so create it */
-            int flags = O_CREAT | O_TRUNC | O_WRONLY | O_DIRECT;
-            out_file = mfu_open(out_file_path, flags, S_IRWXU | S_IRWXG | S_IRWXO);
-
-            /* if the open failed, try again without O_DIRECT */
-            if (out_file < 0) {
-                flags = O_CREAT | O_TRUNC | O_WRONLY;
-                out_file = mfu_open(out_file_path, flags, S_IRWXU | S_IRWXG | S_IRWXO);
-            }
+        /* compute free space left on device holding destination */
+        mfu_path* fs_path = mfu_path_from_str(out_file_path);
+        if (! is_dir) {
+            mfu_path_dirname(fs_path);
         }
+        char* fs_path_str = mfu_path_strdup(fs_path);
+        mfu_path_delete(&fs_path);
 
-        /* check whether our open worked */
-        if (out_file < 0) {
-            /* don't treat this as fatal incase just this node has
-             * the problem, but remember that we hit the error to
-             * report it at the end */
-            write_error = 1;
+        errno = 0;
+        uint64_t free_size = 0;
+        struct statfs fs_stat;
+        if (statfs(fs_path_str, &fs_stat) == 0) {
+            free_size = (uint64_t)fs_stat.f_bavail * (uint64_t)fs_stat.f_bsize;
         } else {
-            /* open worked, so now we have an output file that we can
-             * call statfs on to compute free space left on device */
-            errno = 0;
-            uint64_t free_size = 0;
-            struct statfs fs_stat;
-            if (statfs(out_file_path, &fs_stat) == 0) {
-                free_size = (uint64_t)fs_stat.f_bavail * (uint64_t)fs_stat.f_bsize;
-            } else {
-                MFU_LOG(MFU_LOG_ERR, "Failed to stat file system for `%s` (%s)", out_file_path, strerror(errno));
-            }
+            MFU_LOG(MFU_LOG_ERR, "Failed to stat file system for `%s` (%s)", fs_path_str, strerror(errno));
+        }
+        mfu_free(&fs_path_str);
 
-            /* we'll overwrite any existing file, so include its
-             * space in our measure of available space */
-            if (file_exists) {
-                free_size += existing_file_size;
-            }
+        /* we'll overwrite any existing files, so include their
+         * space in our measure of available space */
+        free_size += existing_file_size;
 
-            /* check whether we have space to write the file */
-            if (file_size > free_size) {
-                /* not enough space for file */
-                MFU_LOG(MFU_LOG_ERR, "Insufficient space for file `%s` filesize=%llu free=%llu", out_file_path, file_size, free_size);
-                write_error = 1;
-            }
-        }
-    } else {
-        /* open input file for reading if we're a reader */
-        errno = 0;
-        in_file = mfu_open(in_file_path, O_RDONLY);
-        if (in_file < 0) {
-            MFU_LOG(MFU_LOG_ERR, "Failed to open file `%s` for reading (%s)", in_file_path, strerror(errno));
-            file_bcast_exit();
+        /* check whether we have space to write the files */
+        if (file_size > free_size) {
+            /* not enough space for files */
+            MFU_LOG(MFU_LOG_ERR, "Insufficient space for `%s` size=%llu free=%llu",
+                out_file_path, (unsigned long long) file_size, (unsigned long long) free_size);
+            write_error = 1;
         }
     }
 
@@ -824,123 +1488,172 @@ int main (int argc, char *argv[])
 
     double time_start = MPI_Wtime();
 
-    /* compute rank on left side */
-    int left = level_rank - 1;
+    /* compute rank on left side, our rank in the level
+     * communicator is the index of our node */
+    int left = node_index - 1;
     if (left < 0) {
-      left = level_size - 1;
+      left = num_nodes - 1;
     }
 
     /* compute rank on right size */
-    int right = level_rank + 1;
-    if (right == level_size) {
+    int right = node_index + 1;
+    if (right == num_nodes) {
       right = 0;
     }
 
+    /* on a node with a single proc, start a thread to write */
+    char* readbuf = (char*) malloc(chunk_size);
+    bcast_writer writer;
+    if (writer_thread) {
+        writer.files       = files;
+        writer.nfiles      = nfiles;
+        writer.cache       = &out_cache;
+        writer.direct      = !is_dir;
+        writer.readbuf     = readbuf;
+        writer.chunk_size  = chunk_size;
+        writer.write_error = write_error;
+        bcast_writer_start(&writer);
+    }
+
 /* readers */
-if (node_rank != 0) {
+if (lane > 0) {
     /* read back parts of output file and broadcast */
     MPI_Request request[3];
     MPI_Status  status[3];
-    size_t bytes_read = 0;
-    while (bytes_read < file_size) {
-        /* process series of chunks in this stripe */
-        uint64_t chunk_id = 0;
-        uint64_t stripe_read = 0;
-        while (stripe_read < stripe_size) {
-            /* we'll send from buf1 and receive into buf2,
-             * read data from file into buf1 to begin */
-            int shmid = (node_rank - 1) * 2;
-            void* buf1 = shmbuf[shmid + 0];
-            void* buf2 = shmbuf[shmid + 1];
-
-            /* get offset and size of bytes to read */
-            off_t pos1;
-            size_t size1;
+
+    /* our three shared memory buffers, we read the next chunk
+     * into the prefetch buffer while the current chunk is
+     * being passed around the ring and written */
+    int shm_send = (lane - 1) * 3;
+    int shm_recv = shm_send + 1;
+    int shm_pre  = shm_send + 2;
+
+    /* read our first chunk */
+    uint64_t bytes_read  = 0;
+    uint64_t stripe_read = 0;
+    uint64_t chunk_id    = 0;
+    off_t pre_pos;
+    size_t pre_size = 0;
+    int have_chunk = (bytes_read < file_size);
+    if (have_chunk) {
+        compute_offset_size(
+            bytes_read, stripe_read, file_size, stripe_size, chunk_size, reader_rank, chunk_id,
+            &pre_pos, &pre_size
+        );
+        read_chunk(files, nfiles, &in_cache, shmbuf[shm_pre], pre_pos, pre_size);
+    }
+
+    while (have_chunk) {
+        /* the chunk we prefetched becomes the one we send,
+         * the buffer we sent from last time is free for the next read */
+        int shm_tmp = shm_send;
+        shm_send = shm_pre;
+        shm_pre  = shm_tmp;
+        off_t pos1   = pre_pos;
+        size_t size1 = pre_size;
+
+        /* remember position of this chunk and look up the next one */
+        uint64_t cur_bytes_read  = bytes_read;
+        uint64_t cur_stripe_read = stripe_read;
+        uint64_t cur_chunk_id    = chunk_id;
+        have_chunk = next_chunk(&bytes_read, &stripe_read, &chunk_id,
+            file_size, stripe_size, chunk_size, reader_size);
+        pre_size = 0;
+        if (have_chunk) {
             compute_offset_size(
                 bytes_read, stripe_read, file_size, stripe_size, chunk_size, reader_rank, chunk_id,
-                &pos1, &size1
+                &pre_pos, &pre_size
             );
+        }
 
-            /* seek to offset in input file */
-            if (size1 > 0) {
-                errno = 0;
-                off_t rc = mfu_lseek(in_file_path, in_file, pos1, SEEK_SET);
-                if (rc == (off_t)-1) {
-                    MFU_LOG(MFU_LOG_ERR, "Seek failed on file `%s` (%s)", out_file_path, strerror(errno));
-                    file_bcast_exit();
-                }
+        /* with a single node there is nothing to pass around,
+         * so read the next chunk right away */
+        if (num_nodes == 1) {
+            read_chunk(files, nfiles, &in_cache, shmbuf[shm_pre], pre_pos, pre_size);
+        }
 
-                /* read chunk from file */
-                errno = 0;
-                ssize_t return_size = mfu_read(in_file_path, in_file, buf1, size1);
-                if (return_size != (ssize_t)size1) {
-                    MFU_LOG(MFU_LOG_ERR, "Failed to read contents from `%s` (%s)", out_file_path, strerror(errno));
-                    file_bcast_exit();
-                }
+        /* we send data to the left and receive from the right until
+         * we've received and written all data for this chunk */
+        int lev;
+        for (lev = 1; lev < num_nodes; lev++) {
+            /* determine source of data we'll receive in this step */
+            int lev_incoming = node_index + lev;
+            if (lev_incoming >= num_nodes) {
+                lev_incoming -= num_nodes;
             }
+            int read_rank_incoming = lev_incoming * lanes + (lane - 1);
 
-            /* we send data to the left and receive from the right until
-             * we've received and written all data for this chunk */
-            int lev;
-            for (lev = 1; lev < level_size; lev++) {
-                /* determine source of data we'll receive in this step */
-                int lev_incoming = level_rank + lev;
-                if (lev_incoming >= level_size) {
-                    lev_incoming -= level_size;
-                }
-                int read_rank_incoming = lev_incoming * (node_size - 1) + (node_rank - 1);
-
-                /* get offset and size of incoming data */
-                off_t pos2;
-                size_t size2;
-                compute_offset_size(
-                    bytes_read, stripe_read, file_size, stripe_size, chunk_size, read_rank_incoming, chunk_id,
-                    &pos2, &size2
-                );
+            /* get offset and size of incoming data */
+            off_t pos2;
+            size_t size2;
+            compute_offset_size(
+                cur_bytes_read, cur_stripe_read, file_size, stripe_size, chunk_size, read_rank_incoming, cur_chunk_id,
+                &pos2, &size2
+            );
 
-                /* signal writer that our buffer is ready */
-                MPI_Send(&shmid, 1, MPI_INT, 0, 0, node_comm);
+            /* signal writer that our buffer is ready */
+            if (writer_thread) {
+                bcast_writer_post(&writer, (const char*) shmbuf[shm_send], pos1, size1);
+            } else {
+                MPI_Send(&shm_send, 1, MPI_INT, 0, 0, node_comm);
+            }
 
-                /* receieve data from right, send data to left,
-                 * and send data to writer on same node */
-                MPI_Irecv(buf2, (int) size2, MPI_BYTE, right, 0, level_comm, &request[0]);
-                MPI_Isend(buf1, (int) size1, MPI_BYTE, left,  0, level_comm, &request[1]);
-                MPI_Waitall(2, request, status);
+            /* receieve data from right, send data to left,
+             * and send data to writer on same node */
+            MPI_Irecv(shmbuf[shm_recv], (int) size2, MPI_BYTE, right, 0, level_comm, &request[0]);
+            MPI_Isend(shmbuf[shm_send], (int) size1, MPI_BYTE, left,  0, level_comm, &request[1]);
 
-                /* wait for signal from writer to know that it's
-                 * finished with our buffer */
-                MPI_Recv(&shmid, 1, MPI_INT, 0, 0, node_comm, &status[0]);
-
-                /* swap buffers to send data we just received */
-                size1 = size2;
-                char* buftmp = buf1;
-                buf1 = buf2;
-                buf2 = buftmp;
-                shmid = (shmid & 0x1) ? (shmid - 1) : (shmid + 1);
+            /* read our next chunk while the first exchange is in flight */
+            if (lev == 1) {
+                read_chunk(files, nfiles, &in_cache, shmbuf[shm_pre], pre_pos, pre_size);
             }
 
-            /* signal writer that our buffer is ready */
-            MPI_Send(&shmid, 1, MPI_INT, 0, 0, node_comm);
+            MPI_Waitall(2, request, status);
 
             /* wait for signal from writer to know that it's
              * finished with our buffer */
-            MPI_Recv(&shmid, 1, MPI_INT, 0, 0, node_comm, &status[0]);
+            if (writer_thread) {
+                bcast_writer_wait(&writer);
+            } else {
+                int shmid;
+                MPI_Recv(&shmid, 1, MPI_INT, 0, 0, node_comm, &status[0]);
+            }
 
-            /* go on to next chunk */
-            stripe_read += chunk_size;
-            chunk_id++;
+            /* swap buffers to send data we just received */
+            pos1  = pos2;
+            size1 = size2;
+            shm_tmp  = shm_send;
+            shm_send = shm_recv;
+            shm_recv = shm_tmp;
         }
 
-        /* record total number of bytes processed, the last set of stripes may
-         * not be full but that doesn't matter in this accounting */
-        bytes_read += stripe_size * (uint64_t)reader_size;
+        /* signal writer that our buffer is ready */
+        if (writer_thread) {
+            bcast_writer_post(&writer, (const char*) shmbuf[shm_send], pos1, size1);
+        } else {
+            MPI_Send(&shm_send, 1, MPI_INT, 0, 0, node_comm);
+        }
+
+        /* wait for signal from writer to know that it's
+         * finished with our buffer */
+        if (writer_thread) {
+            bcast_writer_wait(&writer);
+        } else {
+            int shmid;
+            MPI_Recv(&shmid, 1, MPI_INT, 0, 0, node_comm, &status[0]);
+        }
     }
 }
 
+/* on a single proc node, collect the result from the writer thread */
+if (writer_thread) {
+    bcast_writer_stop(&writer);
+    write_error = writer.write_error;
+}
+
 /* writers */
-if (node_rank == 0) {
+if (is_writer && !writer_thread) {
     double percent = 2.0;
-    char* readbuf = (char*) malloc(chunk_size);
 //    shmbuf[i] = (char*)base + alignment - ((uint64_t)base & (alignment - 1)) ;
 
     /* read back parts of output file and broadcast */
@@ -956,15 +1669,15 @@ if (node_rank == 0) {
             while (stripe_read < stripe_size) {
                 /* process this portion of the stripe for all procs at this level */
                 int lev;
-                for (lev = 0; lev < level_size; lev++) {
+                for (lev = 0; lev < num_nodes; lev++) {
                 int node;
-                for (node = 1; node < node_size; node++) {
+                for (node = 1; node <= lanes; node++) {
                     /* determine source of data we'll receive in this step */
-                    int lev_incoming = level_rank + lev;
-                    if (lev_incoming >= level_size) {
-                        lev_incoming -= level_size;
+                    int lev_incoming = node_index + lev;
+                    if (lev_incoming >= num_nodes) {
+                        lev_incoming -= num_nodes;
                     }
-                    int read_rank_incoming = lev_incoming * (node_size - 1) + (node - 1);
+                    int read_rank_incoming = lev_incoming * lanes + (node - 1);
 
                     /* get offset and size of bytes for this reader */
                     off_t pos;
@@ -981,81 +1694,12 @@ if (node_rank == 0) {
                     /* determine buffer to write data from */
                     void* copybuf = shmbuf[shmid];
 
-                    /* write data to file */
-                    if (size > 0) {
-                        /* assume that we'll be writing data */
-                        int write_data = 1;
-
-                        /* if the file already exists, read in this segment and compare
-                         * it to what we should be writing */
-                        if (file_exists) {
-                            /* file exists, now assume it's the same content so that
-                             * we don't need to write this data */
-                            write_data = 0;
-
-                            /* seek to offset in output file */
-                            errno = 0;
-                            int rc = mfu_lseek(out_file_path, out_file, pos, SEEK_SET);
-                            if (rc == (off_t)-1) {
-                                /* consider this a write error since we can't read
-                                 * to determine whether we need to write */
-                                MFU_LOG(MFU_LOG_ERR, "Seek failed on file `%s` (%s)", out_file_path, strerror(errno));
-                                write_error = 1;
-                            }
-
-                            /* read chunk from file */
-                            errno = 0;
-                            ssize_t return_size = mfu_read(out_file_path, out_file, readbuf, size);
-                            if (return_size == (ssize_t)size) {
-                                /* we read the correct number of bytes, now compare them */
-                                if (memcmp(readbuf, copybuf, size) != 0) {
-                                    /* found a difference so overwrite existing data */
-                                    write_data = 1;
-                                }
-                            } else {
-                                /* overwrite data if we got a short read or end of file,
-                                 * otherwise, we got a read error  */
-                                if (return_size >= 0) {
-                                    write_data = 1;
-                                } else {
-                                    /* consider this a write error since we can't read
-                                     * to determine whether we need to write */
-                                    MFU_LOG(MFU_LOG_ERR, "Failed to read from existing file `%s` (%s)", out_file_path, strerror(errno));
-                                    write_error = 1;
-                                }
-                            }
-                        }
-
-                        /* write data to output file */
-                        if (write_data && !write_error) {
-                            /* seek to offset in output file */
-                            errno = 0;
-                            int rc = mfu_lseek(out_file_path, out_file, pos, SEEK_SET);
-                            if (rc == (off_t)-1) {
-                                MFU_LOG(MFU_LOG_ERR, "Seek failed on file `%s` (%s)", out_file_path, strerror(errno));
-                                write_error = 1;
-                            }
-
-                            /* to use O_DIRECT, we have to write in full blocks */
-                            if (size != chunk_size) {
-                                if (pos + size < file_size) {
-                                    /* this is bad, so consider it to be fatal */
-                                    MFU_LOG(MFU_LOG_ERR, "Trying to write past end of chunk in middle block `%s`", out_file_path);
-                                    file_bcast_exit();
-                                }
-                                size = chunk_size;
-                            }
-
-                            /* write chunk to output file */
-                            errno = 0;
-                            ssize_t return_size = mfu_write(out_file_path, out_file, copybuf, size);
-                            if (return_size == -1) {
-                                /* remember that we had a write error,
-                                 * we'll keep going and delete the
-                                 * file at the end */
-                                MFU_LOG(MFU_LOG_ERR, "Failed to write contents to `%s` (%s)", out_file_path, strerror(errno));
-                                write_error = 1;
-                            }
+                    /* write data to files */
+                    if (size > 0 && !write_error) {
+                        write_error = write_chunk(files, nfiles, &out_cache, !is_dir,
+                            (const char*) copybuf, readbuf, pos, size, chunk_size);
+                        if (write_error == WRITE_FATAL) {
+                            file_bcast_exit();
                         }
                     }
 
@@ -1091,56 +1735,101 @@ if (node_rank == 0) {
             }
         }
     }
-
-    free(readbuf);
 }
+    free(readbuf);
 
     MPI_Barrier(MPI_COMM_WORLD);
 
-    /* every rank closes output file */
-    if (node_rank == 0) {
+    /* every rank closes its files */
+    if (is_writer) {
         /* if we have a file open, sync and close it */
-        if (out_file >= 0) {
+        if (out_cache.index >= 0) {
+            const char* path = files[out_cache.index].dst;
             errno = 0;
-            if (mfu_fsync(out_file_path, out_file) != 0) {
-                MFU_LOG(MFU_LOG_ERR, "Failed to fsync file `%s` (%s)", out_file_path, strerror(errno));
+            if (! is_dir && mfu_fsync(path, out_cache.fd) != 0) {
+                MFU_LOG(MFU_LOG_ERR, "Failed to fsync file `%s` (%s)", path, strerror(errno));
                 write_error = 1;
             }
 
             errno = 0;
-            if (mfu_close(out_file_path, out_file) != 0) {
-                MFU_LOG(MFU_LOG_ERR, "Failed to close file `%s` (%s)", out_file_path, strerror(errno));
+            if (bcast_fd_close(path, &out_cache) != 0) {
+                MFU_LOG(MFU_LOG_ERR, "Failed to close file `%s` (%s)", path, strerror(errno));
                 write_error = 1;
             }
         }
 
-        /* every writer truncates file, we do this in case the user is copying
-         * a file by the same name but of different size than a previous copy */
-        errno = 0;
-        if (mfu_truncate(out_file_path, (off_t) file_size) != 0) {
-            MFU_LOG(MFU_LOG_ERR, "Failed to truncate file `%s`", out_file_path, strerror(errno));
-            write_error = 1;
+        for (i = 0; i < nfiles && !write_error; i++) {
+            const char* path = files[i].dst;
+
+            /* create empty files, which are never written to */
+            if (! files[i].exists && ! files[i].created) {
+                errno = 0;
+                int fd = mfu_open(path, O_CREAT | O_TRUNC | O_WRONLY, S_IRWXU | S_IRWXG | S_IRWXO);
+                if (fd < 0) {
+                    MFU_LOG(MFU_LOG_ERR, "Failed to open `%s` (%s)", path, strerror(errno));
+                    write_error = 1;
+                    break;
+                }
+                mfu_close(path, fd);
+                files[i].created = 1;
+            }
+
+            /* every writer truncates file, we do this in case the user is copying
+             * a file by the same name but of different size than a previous copy */
+            if (files[i].exists && files[i].old_size != files[i].size) {
+                files[i].modified = 1;
+            }
+            errno = 0;
+            if (mfu_truncate(path, (off_t) files[i].size) != 0) {
+                MFU_LOG(MFU_LOG_ERR, "Failed to truncate file `%s` (%s)", path, strerror(errno));
+                write_error = 1;
+            }
+
+            /* have every writer update file mode */
+            errno = 0;
+            if (mfu_chmod(path, (mode_t) files[i].mode) != 0) {
+                MFU_LOG(MFU_LOG_ERR, "Failed to chmod file `%s` (%s)", path, strerror(errno));
+                write_error = 1;
+            }
         }
 
-        /* have every writer update file mode */
-        errno = 0;
-        if (mfu_chmod(out_file_path, (mode_t) mode) != 0) {
-            MFU_LOG(MFU_LOG_ERR, "Failed to chmod file `%s`", out_file_path, strerror(errno));
-            write_error = 1;
+        /* with many files, flush the file system once rather than
+         * syncing each file as we close it */
+        if (is_dir && !write_error) {
+            errno = 0;
+            if (sync_fs(out_file_path) != 0) {
+                MFU_LOG(MFU_LOG_ERR, "Failed to sync file system of `%s` (%s)", out_file_path, strerror(errno));
+                write_error = 1;
+            }
         }
 
-        /* delete file if we hit an error while writing */
+        /* delete files if we hit an error while writing, leave
+         * existing files alone unless we changed their contents */
         if (write_error) {
-            errno = 0;
-            if (mfu_unlink(out_file_path) != 0) {
-                MFU_LOG(MFU_LOG_ERR, "Failed to unlink file `%s`", out_file_path, strerror(errno));
+            for (i = 0; i < nfiles; i++) {
+                if (! files[i].created && ! files[i].modified) {
+                    continue;
+                }
+                errno = 0;
+                if (mfu_unlink(files[i].dst) != 0) {
+                    MFU_LOG(MFU_LOG_ERR, "Failed to unlink file `%s` (%s)", files[i].dst, strerror(errno));
+                }
             }
         }
-    } else {
+
+        /* now that the data is in place, set directory modes */
+        if (is_dir && bcast_dirs_chmod(dirs, ndirs) != 0) {
+            write_error = 1;
+        }
+    }
+    if (lane > 0) {
         /* readers close input file */
-        errno = 0;
-        if (mfu_close(in_file_path, in_file) != 0) {
-            MFU_LOG(MFU_LOG_ERR, "Failed to close file `%s`", in_file_path, strerror(errno));
+        if (in_cache.index >= 0) {
+            const char* path = files[in_cache.index].src;
+            errno = 0;
+            if (bcast_fd_close(path, &in_cache) != 0) {
+                MFU_LOG(MFU_LOG_ERR, "Failed to close file `%s` (%s)", path, strerror(errno));
+            }
         }
     }
 
@@ -1168,12 +1857,26 @@ if (node_rank == 0) {
         GCS_Shmem_free(shmbuf_base[i], node_comm);
     }
 
+    /* free list of files */
+    for (i = 0; i < nfiles; i++) {
+        mfu_free(&files[i].src);
+        mfu_free(&files[i].dst);
+    }
+    mfu_free(&files);
+    for (i = 0; i < ndirs; i++) {
+        mfu_free(&dirs[i].dst);
+    }
+    mfu_free(&dirs);
+
     /* free paths */
     mfu_free(&out_file_path);
     mfu_free(&in_file_path);
+    mfu_free(&inputname);
 
     /* free our node and level communicators */
-    MPI_Comm_free(&level_comm);
+    if (level_comm != MPI_COMM_NULL) {
+        MPI_Comm_free(&level_comm);
+    }
     MPI_Comm_free(&node_comm);
 
     mfu_finalize();
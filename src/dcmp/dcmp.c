@@ -17,7 +17,7 @@
 #include <assert.h>
 
 #include "mfu.h"
-#include "strmap.h"
+#include "mfu_pathmap.h"
 #include "list.h"
 
 /* for daos */
@@ -44,6 +44,9 @@ static void print_usage(void)
 #ifdef DAOS_SUPPORT
     printf("      --daos-api            - DAOS API in {DFS, DAOS} (default uses DFS for POSIX containers)\n");
 #endif
+    printf("      --digest              - compare contents by per-file digests, reusing digests stored in xattrs\n");
+    printf("      --store-digests       - use with --digest or --tree-digest; store computed digests in xattrs\n");
+    printf("      --tree-digest         - compare trees by hierarchical directory digests\n");
     printf("  -s, --direct              - open files with O_DIRECT\n");
     printf("      --open-noatime        - open files with O_NOATIME\n");
     printf("      --progress <N>        - print progress every N seconds\n");
@@ -180,6 +183,9 @@ struct dcmp_options {
     int format;                    /* output data format, 0 for text, 1 for raw */
     int base;                      /* whether to do base check */
     int debug;                     /* check result after get result */
+    int digest;                    /* compare contents using per-file digests */
+    int tree_digest;               /* compare using hierarchical tree digests */
+    int store_digests;             /* store computed digests in xattrs of both trees */
     int need_compare[DCMPF_MAX];   /* fields that need to be compared  */
 };
 
@@ -191,6 +197,9 @@ struct dcmp_options options = {
     .format       = 1,
     .base         = 0,
     .debug        = 0,
+    .digest       = 0,
+    .tree_digest  = 0,
+    .store_digests = 0,
     .need_compare = {0,}
 };
 
@@ -364,132 +373,57 @@ static int dcmp_state_from_string(const char* string, dcmp_state *state)
     return -ENOENT;
 }
 
-/* given a filename as the key, encode an index followed
- * by the init state */
-static void dcmp_strmap_item_init(
-    strmap* map,
-    const char *key,
-    uint64_t item_index)
-{
-    /* Should be long enough for 64 bit number and DCMPF_MAX */
-    char val[21 + DCMPF_MAX];
-    int i;
-
-    /* encode the index */
-    int len = snprintf(val, sizeof(val), "%llu",
-                       (unsigned long long) item_index);
-
-    /* encode the state (state characters and trailing NUL) */
-    assert((size_t)len + DCMPF_MAX + 1 <= (sizeof(val)));
-    size_t position = strlen(val);
-    for (i = 0; i < DCMPF_MAX; i++) {
-        val[position] = DCMPS_INIT;
-        position++;
-    }
-    val[position] = '\0';
-
-    /* add item to map */
-    strmap_set(map, key, val);
-}
-
+/* set state of a field for the item with the given key */
 static void dcmp_strmap_item_update(
-    strmap* map,
+    mfu_pathmap* map,
     const char *key,
     dcmp_field field,
     dcmp_state state)
 {
-    /* Should be long enough for 64 bit number and DCMPF_MAX */
-    char new_val[21 + DCMPF_MAX];
-
     /* lookup item from map */
-    const char* val = strmap_get(map, key);
-
-    /* copy existing index over */
+    uint64_t idx;
+    int rc = mfu_pathmap_index(map, key, &idx);
+    assert(rc == 0);
     assert(field < DCMPF_MAX);
-    assert(strlen(val) + 1 <= sizeof(new_val));
-    strcpy(new_val, val);
 
     /* set new state value */
-    size_t position = strlen(new_val) - DCMPF_MAX;
-    new_val[position + field] = state;
-
-    /* reinsert item in map */
-    strmap_set(map, key, new_val);
+    mfu_pathmap_state_set(map, idx, (int) field, (uint8_t) state);
 }
 
 static int dcmp_strmap_item_index(
-    strmap* map,
+    mfu_pathmap* map,
     const char *key,
     uint64_t *item_index)
 {
-    /* Should be long enough for 64 bit number and DCMPF_MAX */
-    char new_val[21 + DCMPF_MAX];
-
     /* lookup item from map */
-    const char* val = strmap_get(map, key);
-    if (val == NULL) {
-        return -1;
-    }
-
-    /* extract index */
-    assert(strlen(val) + 1 <= sizeof(new_val));
-    strcpy(new_val, val);
-    new_val[strlen(new_val) - DCMPF_MAX] = '\0';
-    *item_index = strtoull(new_val, NULL, 0);
-
-    return 0;
+    return mfu_pathmap_index(map, key, item_index);
 }
 
 static int dcmp_strmap_item_state(
-    strmap* map,
+    mfu_pathmap* map,
     const char *key,
     dcmp_field field,
     dcmp_state *state)
 {
     /* lookup item from map */
-    const char* val = strmap_get(map, key);
-    if (val == NULL) {
+    uint64_t idx;
+    if (mfu_pathmap_index(map, key, &idx) != 0) {
         return -1;
     }
 
     /* extract state */
-    assert(strlen(val) > DCMPF_MAX);
     assert(field < DCMPF_MAX);
-    size_t position = strlen(val) - DCMPF_MAX;
-    *state = val[position + field];
+    *state = (dcmp_state) mfu_pathmap_state_get(map, idx, (int) field);
 
     return 0;
 }
 
 /* map each file name to its index in the file list and initialize
  * its state for comparison operation */
-static strmap* dcmp_strmap_creat(mfu_flist list, const char* prefix)
+static mfu_pathmap* dcmp_strmap_creat(mfu_flist list, const char* prefix)
 {
-    /* create a new string map to map a file name to a string
-     * encoding its index and state */
-    strmap* map = strmap_new();
-
-    /* determine length of prefix string */
-    size_t prefix_len = strlen(prefix);
-
-    /* iterate over each item in the file list */
-    uint64_t i = 0;
-    uint64_t count = mfu_flist_size(list);
-    while (i < count) {
-        /* get full path of file name */
-        const char* name = mfu_flist_file_get_name(list, i);
-
-        /* ignore prefix portion of path */
-        name += prefix_len;
-
-        /* create entry for this file */
-        dcmp_strmap_item_init(map, name, i);
-
-        /* go to next item in list */
-        i++;
-    }
-
-    return map;
+    /* keys are file names with the prefix portion of the path removed */
+    return mfu_pathmap_new(list, prefix, DCMPF_MAX, DCMPS_INIT);
 }
 
 static void dcmp_compare_acl(
@@ -498,8 +432,8 @@ static void dcmp_compare_acl(
     uint64_t src_index,
     mfu_flist dst_list,
     uint64_t dst_index,
-    strmap* src_map,
-    strmap* dst_map,
+    mfu_pathmap* src_map,
+    mfu_pathmap* dst_map,
     int *diff)
 {
     void *src_val, *dst_val;
@@ -570,10 +504,10 @@ static int dcmp_option_need_compare(dcmp_field field)
 /* Return -1 when error, return 0 when equal, return > 0 when diff */
 static int dcmp_compare_metadata(
     mfu_flist src_list,
-    strmap* src_map,
+    mfu_pathmap* src_map,
     uint64_t src_index,
     mfu_flist dst_list,
-    strmap* dst_map,
+    mfu_pathmap* dst_map,
     uint64_t dst_index,
     const char* key)
 {
@@ -768,9 +702,9 @@ static void compare_progress_fn(const uint64_t* vals, int count, int complete, i
  * in comparison results in source and dest string maps */
 static int dcmp_strmap_compare_data(
     mfu_flist src_compare_list,
-    strmap* src_map,
+    mfu_pathmap* src_map,
     mfu_flist dst_compare_list,
-    strmap* dst_map,
+    mfu_pathmap* dst_map,
     size_t strlen_prefix,
     mfu_copy_opts_t* copy_opts,
     mfu_file_t* mfu_src_file,
@@ -872,7 +806,7 @@ static int dcmp_strmap_compare_data(
     /* execute logical OR over chunks for each file */
     mfu_file_chunk_list_lor(src_compare_list, src_head, vals, results);
 
-    /* unpack contents of recv buffer & store results in strmap */
+    /* unpack contents of recv buffer & store results in mfu_pathmap */
     for (i = 0; i < size; i++) {
         /* lookup name of file based on id to send to strmap updata call */
         const char* name = mfu_flist_file_get_name(src_compare_list, i);
@@ -911,6 +845,186 @@ static int dcmp_strmap_compare_data(
     return rc;
 }
 
+/* given a list of source/destination files to compare, compute a digest
+ * of each side independently and compare the digests, reusing digests
+ * stored on files by earlier runs, fill in comparison results in source
+ * and dest string maps */
+static int dcmp_strmap_compare_digest(
+    mfu_flist src_compare_list,
+    mfu_pathmap* src_map,
+    mfu_flist dst_compare_list,
+    mfu_pathmap* dst_map,
+    size_t strlen_prefix,
+    mfu_copy_opts_t* copy_opts,
+    uint64_t* bytes_read,
+    mfu_file_t* mfu_src_file,
+    mfu_file_t* mfu_dst_file)
+{
+    /* assume we'll succeed */
+    int rc = 0;
+
+    /* let user know what we're doing */
+    if (mfu_debug_level >= MFU_LOG_VERBOSE && mfu_rank == 0) {
+         MFU_LOG(MFU_LOG_INFO, "Comparing file digests");
+    }
+
+    /* items at the same index in the two lists refer to the same file */
+    uint64_t size = mfu_flist_size(src_compare_list);
+    uint64_t* src_digests = (uint64_t*) MFU_MALLOC(size * MFU_DIGEST_WORDS * sizeof(uint64_t));
+    uint64_t* dst_digests = (uint64_t*) MFU_MALLOC(size * MFU_DIGEST_WORDS * sizeof(uint64_t));
+    int* src_valid = (int*) MFU_MALLOC(size * sizeof(int));
+    int* dst_valid = (int*) MFU_MALLOC(size * sizeof(int));
+
+    /* each tree is read on its own, a digest only needs to be
+     * computed for files that changed since it was last stored */
+    int flags = MFU_DIGEST_LOAD;
+    if (options.store_digests) {
+        flags |= MFU_DIGEST_STORE;
+    }
+    uint64_t src_bytes = 0;
+    uint64_t dst_bytes = 0;
+    if (mfu_flist_digest(src_compare_list, flags, copy_opts,
+                         src_digests, src_valid, &src_bytes, mfu_src_file) != 0)
+    {
+        rc = -1;
+    }
+    if (mfu_flist_digest(dst_compare_list, flags, copy_opts,
+                         dst_digests, dst_valid, &dst_bytes, mfu_dst_file) != 0)
+    {
+        rc = -1;
+    }
+
+    /* get total number of bytes we actually read */
+    uint64_t bytes = src_bytes + dst_bytes;
+    MPI_Allreduce(&bytes, bytes_read, 1, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+
+    uint64_t i;
+    for (i = 0; i < size; i++) {
+        /* lookup name of file based on id to send to strmap updata call */
+        const char* name = mfu_flist_file_get_name(src_compare_list, i);
+
+        if (!src_valid[i] || !dst_valid[i]) {
+            MFU_LOG(MFU_LOG_ERR,
+                "Failed to compute digest of %s and/or %s. Assuming contents are different.",
+                name, mfu_flist_file_get_name(dst_compare_list, i));
+        }
+
+        /* ignore prefix portion of path to use as key */
+        name += strlen_prefix;
+
+        if (src_valid[i] && dst_valid[i] &&
+            memcmp(&src_digests[i * MFU_DIGEST_WORDS], &dst_digests[i * MFU_DIGEST_WORDS],
+                   MFU_DIGEST_WORDS * sizeof(uint64_t)) == 0)
+        {
+            /* update to say contents of the files were found to be the same */
+            dcmp_strmap_item_update(src_map, name, DCMPF_CONTENT, DCMPS_COMMON);
+            dcmp_strmap_item_update(dst_map, name, DCMPF_CONTENT, DCMPS_COMMON);
+        } else {
+            /* update to say contents of the files were found to be different */
+            dcmp_strmap_item_update(src_map, name, DCMPF_CONTENT, DCMPS_DIFFER);
+            dcmp_strmap_item_update(dst_map, name, DCMPF_CONTENT, DCMPS_DIFFER);
+        }
+    }
+
+    mfu_free(&dst_valid);
+    mfu_free(&src_valid);
+    mfu_free(&dst_digests);
+    mfu_free(&src_digests);
+
+    return rc;
+}
+
+/* look up the digest of the top-level item in a list walked from a single path */
+static void dcmp_tree_root_digest(mfu_flist list, const uint64_t* digests, const int* valid,
+                                  uint64_t* root, int* root_valid)
+{
+    /* only one rank holds the top-level item, others contribute zeros,
+     * the last value is the valid flag */
+    uint64_t vals[MFU_DIGEST_WORDS + 1];
+    memset(vals, 0, sizeof(vals));
+    int min_depth = mfu_flist_min_depth(list);
+    uint64_t idx;
+    uint64_t size = mfu_flist_size(list);
+    for (idx = 0; idx < size; idx++) {
+        if (mfu_flist_file_get_depth(list, idx) == min_depth) {
+            memcpy(vals, &digests[idx * MFU_DIGEST_WORDS], MFU_DIGEST_WORDS * sizeof(uint64_t));
+            vals[MFU_DIGEST_WORDS] = (uint64_t) valid[idx];
+            break;
+        }
+    }
+
+    uint64_t all_vals[MFU_DIGEST_WORDS + 1];
+    MPI_Allreduce(vals, all_vals, MFU_DIGEST_WORDS + 1, MPI_UINT64_T, MPI_BOR, MPI_COMM_WORLD);
+    memcpy(root, all_vals, MFU_DIGEST_WORDS * sizeof(uint64_t));
+    *root_valid = (int) all_vals[MFU_DIGEST_WORDS];
+}
+
+/* compute tree digests for the source and destination lists,
+ * sets trees_match to 1 if the two trees match as a whole */
+static int dcmp_tree_digest(
+    mfu_flist src_list,
+    mfu_flist dst_list,
+    mfu_copy_opts_t* copy_opts,
+    uint64_t* src_digests,
+    int* src_valid,
+    uint64_t* dst_digests,
+    int* dst_valid,
+    int* trees_match,
+    uint64_t* bytes_read,
+    mfu_file_t* mfu_src_file,
+    mfu_file_t* mfu_dst_file)
+{
+    /* assume we'll succeed */
+    int rc = 0;
+
+    /* let user know what we're doing */
+    if (mfu_debug_level >= MFU_LOG_VERBOSE && mfu_rank == 0) {
+         MFU_LOG(MFU_LOG_INFO, "Computing tree digests");
+    }
+
+    int flags = MFU_DIGEST_LOAD;
+    if (options.store_digests) {
+        flags |= MFU_DIGEST_STORE;
+    }
+    uint64_t src_bytes = 0;
+    uint64_t dst_bytes = 0;
+    if (mfu_flist_tree_digest(src_list, flags, copy_opts,
+                              src_digests, src_valid, &src_bytes, mfu_src_file) != 0)
+    {
+        rc = -1;
+    }
+    if (mfu_flist_tree_digest(dst_list, flags, copy_opts,
+                              dst_digests, dst_valid, &dst_bytes, mfu_dst_file) != 0)
+    {
+        rc = -1;
+    }
+
+    /* get total number of bytes we actually read */
+    uint64_t bytes = src_bytes + dst_bytes;
+    MPI_Allreduce(&bytes, bytes_read, 1, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+
+    /* the top-level digests tell whether the trees match as a whole */
+    uint64_t src_root[MFU_DIGEST_WORDS], dst_root[MFU_DIGEST_WORDS];
+    int src_root_valid, dst_root_valid;
+    dcmp_tree_root_digest(src_list, src_digests, src_valid, src_root, &src_root_valid);
+    dcmp_tree_root_digest(dst_list, dst_digests, dst_valid, dst_root, &dst_root_valid);
+    *trees_match = (src_root_valid && dst_root_valid &&
+                    memcmp(src_root, dst_root, sizeof(src_root)) == 0);
+    if (mfu_debug_level >= MFU_LOG_VERBOSE && mfu_rank == 0) {
+        MFU_LOG(MFU_LOG_INFO, "Source tree digest     : %016" PRIx64 "%016" PRIx64 "%016" PRIx64 "%016" PRIx64 "%s",
+            src_root[0], src_root[1], src_root[2], src_root[3], src_root_valid ? "" : " (incomplete)");
+        MFU_LOG(MFU_LOG_INFO, "Destination tree digest: %016" PRIx64 "%016" PRIx64 "%016" PRIx64 "%016" PRIx64 "%s",
+            dst_root[0], dst_root[1], dst_root[2], dst_root[3], dst_root_valid ? "" : " (incomplete)");
+        if (*trees_match) {
+            MFU_LOG(MFU_LOG_INFO, "Source and destination trees match");
+        } else {
+            MFU_LOG(MFU_LOG_INFO, "Source and destination trees differ");
+        }
+    }
+
+    return rc;
+}
+
 static void time_strmap_compare(mfu_flist src_list, double start_compare,
                                 double end_compare, time_t *time_started,
                                 time_t *time_ended, uint64_t total_bytes_read) {
@@ -967,12 +1081,50 @@ static void time_strmap_compare(mfu_flist src_list, double start_compare,
     }
 }
 
+/* returns 1 if every field that needs to be compared is implied
+ * by matching tree digests, the digest of a directory covers the
+ * names, types, sizes, and contents of all items below it, but
+ * not the mtime of the top-level item nor any other metadata */
+static int dcmp_tree_digest_covers_fields(void)
+{
+    int i;
+    for (i = 0; i < DCMPF_MAX; i++) {
+        if (!dcmp_option_need_compare((dcmp_field) i)) {
+            continue;
+        }
+        if (i != DCMPF_EXIST && i != DCMPF_TYPE &&
+            i != DCMPF_SIZE && i != DCMPF_CONTENT)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* mark every item in map as common in the fields
+ * covered by tree digests that need to be compared */
+static void dcmp_strmap_mark_common(mfu_pathmap* map)
+{
+    dcmp_field fields[] = {DCMPF_EXIST, DCMPF_TYPE, DCMPF_SIZE, DCMPF_CONTENT};
+    uint64_t idx;
+    uint64_t size = mfu_pathmap_size(map);
+    for (idx = 0; idx < size; idx++) {
+        const char* key = mfu_pathmap_key(map, idx);
+        int i;
+        for (i = 0; i < 4; i++) {
+            if (dcmp_option_need_compare(fields[i])) {
+                dcmp_strmap_item_update(map, key, fields[i], DCMPS_COMMON);
+            }
+        }
+    }
+}
+
 /* compare entries from src into dst */
 static int dcmp_strmap_compare(
     mfu_flist src_list,
-    strmap* src_map,
+    mfu_pathmap* src_map,
     mfu_flist dst_list,
-    strmap* dst_map,
+    mfu_pathmap* dst_map,
     size_t strlen_prefix,
     mfu_copy_opts_t* copy_opts,
     const mfu_param_path* src_path,
@@ -1002,18 +1154,54 @@ static int dcmp_strmap_compare(
     mfu_flist src_compare_list = mfu_flist_subset(src_list);
     mfu_flist dst_compare_list = mfu_flist_subset(dst_list);
 
+    /* with tree digests, compute digests of every item in both trees
+     * up front, items are then compared by digest without reading */
+    uint64_t* src_digests = NULL;
+    uint64_t* dst_digests = NULL;
+    int* src_valid = NULL;
+    int* dst_valid = NULL;
+    int trees_match = 0;
+    uint64_t digest_bytes_read = 0;
+    if (options.tree_digest) {
+        uint64_t src_size = mfu_flist_size(src_list);
+        uint64_t dst_size = mfu_flist_size(dst_list);
+        src_digests = (uint64_t*) MFU_MALLOC(src_size * MFU_DIGEST_WORDS * sizeof(uint64_t));
+        dst_digests = (uint64_t*) MFU_MALLOC(dst_size * MFU_DIGEST_WORDS * sizeof(uint64_t));
+        src_valid   = (int*) MFU_MALLOC(src_size * sizeof(int));
+        dst_valid   = (int*) MFU_MALLOC(dst_size * sizeof(int));
+        tmp_rc = dcmp_tree_digest(src_list, dst_list, copy_opts,
+            src_digests, src_valid, dst_digests, dst_valid,
+            &trees_match, &digest_bytes_read, mfu_src_file, mfu_dst_file);
+        if (tmp_rc < 0) {
+            rc = -1;
+        }
+    }
+
     /* get mtime seconds and nsecs to check modification times of src & dst */
     uint64_t src_mtime;
     uint64_t src_mtime_nsec;
     uint64_t dst_mtime;
     uint64_t dst_mtime_nsec;
 
+    /* when the trees match as a whole and the digests cover every
+     * field we need, all items are common, so skip the item by item
+     * comparison below */
+    uint64_t map_size = mfu_pathmap_size(src_map);
+    if (trees_match && dcmp_tree_digest_covers_fields()) {
+        if (mfu_debug_level >= MFU_LOG_VERBOSE && mfu_rank == 0) {
+            MFU_LOG(MFU_LOG_INFO, "Skipping item comparison of matching trees");
+        }
+        dcmp_strmap_mark_common(src_map);
+        dcmp_strmap_mark_common(dst_map);
+        map_size = 0;
+    }
+
     /* iterate over each item in source map */
-    const strmap_node* node;
-    strmap_foreach(src_map, node) {
+    uint64_t map_idx;
+    for (map_idx = 0; map_idx < map_size; map_idx++) {
 
         /* get file name */
-        const char* key = strmap_node_key(node);
+        const char* key = mfu_pathmap_key(src_map, map_idx);
 
         /* get index of source file */
         uint64_t src_index;
@@ -1141,6 +1329,21 @@ static int dcmp_strmap_compare(
             continue;
         }
 
+        if (options.tree_digest) {
+            /* both files were hashed along with their trees */
+            if (src_valid[src_index] && dst_valid[dst_index] &&
+                memcmp(&src_digests[src_index * MFU_DIGEST_WORDS], &dst_digests[dst_index * MFU_DIGEST_WORDS],
+                       MFU_DIGEST_WORDS * sizeof(uint64_t)) == 0)
+            {
+                dcmp_strmap_item_update(src_map, key, DCMPF_CONTENT, DCMPS_COMMON);
+                dcmp_strmap_item_update(dst_map, key, DCMPF_CONTENT, DCMPS_COMMON);
+            } else {
+                dcmp_strmap_item_update(src_map, key, DCMPF_CONTENT, DCMPS_DIFFER);
+                dcmp_strmap_item_update(dst_map, key, DCMPF_CONTENT, DCMPS_DIFFER);
+            }
+            continue;
+        }
+
         /* If we get to this point, we need to open files and compare
          * file contents.  We'll first identify all such files so that
          * we can do this comparison in parallel more effectively.  For
@@ -1158,8 +1361,13 @@ static int dcmp_strmap_compare(
         /* compare the contents of the files if we have anything in the compare list */
         cmp_global_size = mfu_flist_global_size(src_compare_list);
         if (cmp_global_size > 0) {
-            tmp_rc = dcmp_strmap_compare_data(src_compare_list, src_map, dst_compare_list,
-                    dst_map, strlen_prefix, copy_opts, mfu_src_file, mfu_dst_file);
+            if (options.digest) {
+                tmp_rc = dcmp_strmap_compare_digest(src_compare_list, src_map, dst_compare_list,
+                        dst_map, strlen_prefix, copy_opts, &digest_bytes_read, mfu_src_file, mfu_dst_file);
+            } else {
+                tmp_rc = dcmp_strmap_compare_data(src_compare_list, src_map, dst_compare_list,
+                        dst_map, strlen_prefix, copy_opts, mfu_src_file, mfu_dst_file);
+            }
             if (tmp_rc < 0) {
                 /* got a read error, signal that back to caller */
                 rc = -1;
@@ -1176,7 +1384,10 @@ static int dcmp_strmap_compare(
     uint64_t total_bytes_read = 0;
 
     /* get total bytes read (if any) */
-    if (cmp_global_size > 0) {
+    if (options.digest || options.tree_digest) {
+        /* files with a valid stored digest are not read at all */
+        total_bytes_read = digest_bytes_read;
+    } else if (cmp_global_size > 0) {
         total_bytes_read = get_total_bytes_read(src_compare_list);
     }
 
@@ -1187,19 +1398,25 @@ static int dcmp_strmap_compare(
     mfu_flist_free(&dst_compare_list);
     mfu_flist_free(&src_compare_list);
 
+    mfu_free(&dst_valid);
+    mfu_free(&src_valid);
+    mfu_free(&dst_digests);
+    mfu_free(&src_digests);
+
     return rc;
 }
 
 /* loop on the src map to check the results */
-static void dcmp_strmap_check_src(strmap* src_map,
-                                  strmap* dst_map)
+static void dcmp_strmap_check_src(mfu_pathmap* src_map,
+                                  mfu_pathmap* dst_map)
 {
     assert(dcmp_option_need_compare(DCMPF_EXIST));
     /* iterate over each item in source map */
-    const strmap_node* node;
-    strmap_foreach(src_map, node) {
+    uint64_t map_idx;
+    uint64_t map_size = mfu_pathmap_size(src_map);
+    for (map_idx = 0; map_idx < map_size; map_idx++) {
         /* get file name */
-        const char* key = strmap_node_key(node);
+        const char* key = mfu_pathmap_key(src_map, map_idx);
         int only_src = 0;
 
         /* get index of source file */
@@ -1279,16 +1496,17 @@ static void dcmp_strmap_check_src(strmap* src_map,
 }
 
 /* loop on the dest map to check the results */
-static void dcmp_strmap_check_dst(strmap* src_map,
-    strmap* dst_map)
+static void dcmp_strmap_check_dst(mfu_pathmap* src_map,
+    mfu_pathmap* dst_map)
 {
     assert(dcmp_option_need_compare(DCMPF_EXIST));
 
     /* iterate over each item in dest map */
-    const strmap_node* node;
-    strmap_foreach(dst_map, node) {
+    uint64_t map_idx;
+    uint64_t map_size = mfu_pathmap_size(dst_map);
+    for (map_idx = 0; map_idx < map_size; map_idx++) {
         /* get file name */
-        const char* key = strmap_node_key(node);
+        const char* key = mfu_pathmap_key(dst_map, map_idx);
         int only_dest = 0;
 
         /* get index of destination file */
@@ -1380,8 +1598,8 @@ static void dcmp_strmap_check_dst(strmap* src_map,
 
 /* check the result maps are valid */
 static void dcmp_strmap_check(
-    strmap* src_map,
-    strmap* dst_map)
+    mfu_pathmap* src_map,
+    mfu_pathmap* dst_map)
 {
     dcmp_strmap_check_src(src_map, dst_map);
     dcmp_strmap_check_dst(src_map, dst_map);
@@ -1475,7 +1693,7 @@ static void dcmp_expression_print(
 
 static int dcmp_expression_match(
     struct dcmp_expression *expression,
-    strmap* map,
+    mfu_pathmap* map,
     const char* key)
 {
     int ret;
@@ -1604,7 +1822,7 @@ static void dcmp_conjunction_print(
 /* if matched return 1, else return 0 */
 static int dcmp_conjunction_match(
     struct dcmp_conjunction *conjunction,
-    strmap* map,
+    mfu_pathmap* map,
     const char* key)
 {
     struct dcmp_expression* expression;
@@ -1703,7 +1921,7 @@ static void dcmp_disjunction_print(
 /* if matched return 1, else return 0 */
 static int dcmp_disjunction_match(
     struct dcmp_disjunction* disjunction,
-    strmap* map,
+    mfu_pathmap* map,
     const char* key,
     int is_src)
 {
@@ -1796,19 +2014,20 @@ static void dcmp_option_add_comparison(dcmp_field field)
 
 static int dcmp_output_flist_match(
     struct dcmp_output *output,
-    strmap* map,
+    mfu_pathmap* map,
     mfu_flist flist,
     mfu_flist new_flist,
     mfu_flist *matched_flist,
     int is_src)
 {
-    const strmap_node* node;
     struct dcmp_conjunction *conjunction;
 
     /* iterate over each item in map */
-    strmap_foreach(map, node) {
+    uint64_t map_idx;
+    uint64_t map_size = mfu_pathmap_size(map);
+    for (map_idx = 0; map_idx < map_size; map_idx++) {
         /* get file name */
-        const char* key = strmap_node_key(node);
+        const char* key = mfu_pathmap_key(map, map_idx);
 
         /* get index of file */
         uint64_t idx;
@@ -1839,9 +2058,9 @@ static int dcmp_output_flist_match(
 static int dcmp_output_write(
     struct dcmp_output *output,
     mfu_flist src_flist,
-    strmap* src_map,
+    mfu_pathmap* src_map,
     mfu_flist dst_flist,
-    strmap* dst_map)
+    mfu_pathmap* dst_map)
 {
     int ret = 0;
     mfu_flist new_flist = mfu_flist_subset(src_flist);
@@ -1896,9 +2115,9 @@ static int dcmp_output_write(
 
 static int dcmp_outputs_write(
     mfu_flist src_list,
-    strmap* src_map,
+    mfu_pathmap* src_map,
     mfu_flist dst_list,
-    strmap* dst_map)
+    mfu_pathmap* dst_map)
 {
     struct dcmp_output* output;
     int ret = 0;
@@ -2143,6 +2362,9 @@ int main(int argc, char **argv)
         {"bufsize",       1, 0, 'B'},
         {"chunksize",     1, 0, 'k'},
         {"daos-api",      1, 0, 'x'},
+        {"digest",        0, 0, 'D'},
+        {"tree-digest",   0, 0, 'T'},
+        {"store-digests", 0, 0, 'G'},
         {"direct",        0, 0, 's'},
         {"open-noatime",  0, 0, 'U'},
         {"progress",      1, 0, 'R'},
@@ -2237,6 +2459,15 @@ int main(int argc, char **argv)
         case 'd':
             options.debug++;
             break;
+        case 'D':
+            options.digest = 1;
+            break;
+        case 'T':
+            options.tree_digest = 1;
+            break;
+        case 'G':
+            options.store_digests = 1;
+            break;
 #ifdef DAOS_SUPPORT
         case 'x':
             if (daos_parse_api_str(optarg, &daos_args->api) != 0) {
@@ -2264,6 +2495,30 @@ int main(int argc, char **argv)
         usage = 1;
     }
 
+    /* digests are only used when reading file contents */
+    if ((options.digest || options.tree_digest) && options.lite) {
+        if (rank == 0) {
+            MFU_LOG(MFU_LOG_ERR, "Cannot combine --digest or --tree-digest with --lite");
+        }
+        usage = 1;
+    }
+
+    /* --tree-digest already compares file contents by digest */
+    if (options.digest && options.tree_digest) {
+        if (rank == 0) {
+            MFU_LOG(MFU_LOG_ERR, "Cannot combine --digest with --tree-digest");
+        }
+        usage = 1;
+    }
+
+    /* --store-digests only applies when digests are computed */
+    if (options.store_digests && !options.digest && !options.tree_digest) {
+        if (rank == 0) {
+            MFU_LOG(MFU_LOG_ERR, "--store-digests requires --digest or --tree-digest");
+        }
+        usage = 1;
+    }
+
     /* Generate default output */
     if (options.base || list_empty(&options.outputs)) {
         /*
@@ -2369,8 +2624,8 @@ int main(int argc, char **argv)
     mfu_flist flist4 = mfu_flist_remap(flist2, (mfu_flist_map_fn)dcmp_map_fn, (const void*)path2);
 
     /* map each file name to its index and its comparison state */
-    strmap* map1 = dcmp_strmap_creat(flist3, path1);
-    strmap* map2 = dcmp_strmap_creat(flist4, path2);
+    mfu_pathmap* map1 = dcmp_strmap_creat(flist3, path1);
+    mfu_pathmap* map2 = dcmp_strmap_creat(flist4, path2);
 
     /* compare files in map1 with those in map2 */
     int tmp_rc = dcmp_strmap_compare(flist3, map1, flist4, map2, strlen(path1), copy_opts, srcpath, destpath,
@@ -2389,8 +2644,8 @@ int main(int argc, char **argv)
     dcmp_outputs_write(flist3, map1, flist4, map2);
 
     /* free maps of file names to comparison state info */
-    strmap_delete(&map1);
-    strmap_delete(&map2);
+    mfu_pathmap_delete(&map1);
+    mfu_pathmap_delete(&map2);
 
     /* free file lists */
     mfu_flist_free(&flist1);
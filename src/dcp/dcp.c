@@ -97,6 +97,9 @@ void print_usage(void)
     printf("  -p, --preserve           - preserve permissions, ownership, timestamps (see also --xattrs)\n");
     printf("  -s, --direct             - open files with O_DIRECT\n");
     printf("      --open-noatime       - open files with O_NOATIME\n");
+    printf("      --dynamic            - hand out chunks to processes on demand\n");
+    printf("      --adaptive           - size chunks per file, starting from --chunksize and growing up to 1GB\n");
+    printf("                             or shrinking down to 1MB to balance load\n");
     printf("  -S, --sparse             - create sparse files when possible\n");
     printf("      --progress <N>       - print progress every N seconds\n");
     printf("  -G  --gid <GID>          - Set the group id to perform copy\n");
@@ -168,6 +171,8 @@ int main(int argc, char** argv)
         {"preserve"             , no_argument      , 0, 'p'},
         {"synchronous"          , no_argument      , 0, 's'},
         {"direct"               , no_argument      , 0, 's'},
+        {"dynamic"              , no_argument      , 0, 'Y'},
+        {"adaptive"             , no_argument      , 0, 'a'},
         {"open-noatime"         , no_argument      , 0, 'A'},
         {"sparse"               , no_argument      , 0, 'S'},
         {"progress"             , required_argument, 0, 'R'},
@@ -323,6 +328,18 @@ int main(int argc, char** argv)
                     MFU_LOG(MFU_LOG_INFO, "Using O_DIRECT");
                 }
                 break;
+            case 'a':
+                mfu_copy_opts->adaptive = true;
+                if(rank == 0) {
+                    MFU_LOG(MFU_LOG_INFO, "Using adaptive chunk size");
+                }
+                break;
+            case 'Y':
+                mfu_copy_opts->dynamic = true;
+                if(rank == 0) {
+                    MFU_LOG(MFU_LOG_INFO, "Using dynamic chunk scheduling");
+                }
+                break;
             case 'A':
                 mfu_copy_opts->open_noatime = true;
                 if(rank == 0) {
@@ -4,22 +4,32 @@
 #include <stdio.h>
 #include <string.h>
 #include <getopt.h>
-#include <openssl/sha.h>
+#include <openssl/evp.h>
 #include <assert.h>
 #include <inttypes.h>
+#include <fcntl.h>
+#include <sys/resource.h>
 
 #include "mpi.h"
 #include "dtcmp.h"
 #include "mfu.h"
 #include "list.h"
 
+/* size of file digest in bytes, all hash algorithms
+ * produce a digest of this length */
+#define DDUP_DIGEST_SIZE 32
+
 /* number of uint64_t values in our key
- * 1 for group ID + (SHA256_DIGEST_LENGTH / 8) */
+ * 1 for group ID + (DDUP_DIGEST_SIZE / 8) */
 #define DDUP_KEY_SIZE 5
 
 /* amount of data to read in order to compute hash */
 #define DDUP_CHUNK_SIZE 1048576
 
+/* amount of data read from the start and the end of each file
+ * to filter out files before hashing their full contents */
+#define DDUP_EDGE_SIZE 4096
+
 /* Print a usage message */
 static void print_usage(void)
 {
@@ -27,6 +37,7 @@ static void print_usage(void)
     printf("Usage: ddup <dir>\n");
     printf("\n");
     printf("Options:\n");
+    printf("      --hash <NAME>    - hash algorithm, one of: sha256,sha512-256,blake2s256 (default sha256)\n");
     printf("      --open-noatime   - open files with O_NOATIME\n");
     printf("  -d, --debug <DEBUG>  - set verbosity, one of: fatal,err,warn,info,dbg\n");
     printf("  -v, --verbose        - verbose output\n");
@@ -37,14 +48,186 @@ static void print_usage(void)
     fflush(stdout);
 }
 
+/* hash algorithms that can be used to compute file digests,
+ * each must produce a digest of DDUP_DIGEST_SIZE bytes */
+typedef struct {
+    const char* name;          /* name given on command line */
+    const EVP_MD* (*md)(void); /* OpenSSL digest implementation */
+} ddup_hash_alg;
+
+static const ddup_hash_alg ddup_hash_algs[] = {
+    {"sha256",     EVP_sha256},
+    {"sha512-256", EVP_sha512_256},
+    {"blake2s256", EVP_blake2s256},
+    {NULL,         NULL},
+};
+
+/* look up hash algorithm by name, returns NULL if not found */
+static const ddup_hash_alg* ddup_hash_lookup(const char* name)
+{
+    const ddup_hash_alg* alg;
+    for (alg = ddup_hash_algs; alg->name != NULL; alg++) {
+        if (strcmp(alg->name, name) == 0) {
+            return alg;
+        }
+    }
+    return NULL;
+}
+
+/* hash state for a single file */
+struct file_item {
+    EVP_MD_CTX* ctx;
+    int fd; /* file descriptor kept open between rounds, or -1 */
+};
+
+static void ddup_hash_init(struct file_item* item, const ddup_hash_alg* alg)
+{
+    item->ctx = EVP_MD_CTX_new();
+    if (item->ctx == NULL || EVP_DigestInit_ex(item->ctx, alg->md(), NULL) != 1) {
+        MFU_ABORT(-1, "Failed to initialize %s hash", alg->name);
+    }
+}
+
+static void ddup_hash_update(struct file_item* item, const void* buf, size_t len)
+{
+    EVP_DigestUpdate(item->ctx, buf, len);
+}
+
+/* compute the digest of the data hashed so far without
+ * disturbing the running state, so that more data can be added */
+static void ddup_hash_peek(struct file_item* item, unsigned char* digest)
+{
+    EVP_MD_CTX* tmp = EVP_MD_CTX_new();
+    EVP_MD_CTX_copy_ex(tmp, item->ctx);
+    EVP_DigestFinal_ex(tmp, digest, NULL);
+    EVP_MD_CTX_free(tmp);
+}
+
+static void ddup_hash_final(struct file_item* item, unsigned char* digest)
+{
+    EVP_DigestFinal_ex(item->ctx, digest, NULL);
+}
+
+static void ddup_hash_free(struct file_item* item)
+{
+    EVP_MD_CTX_free(item->ctx);
+    item->ctx = NULL;
+}
+
+/* release hash state and close the file if we still have it open */
+static void file_item_fini(struct file_item* item, const char* fname, uint64_t* open_files)
+{
+    ddup_hash_free(item);
+    if (item->fd >= 0) {
+        mfu_close(fname, item->fd);
+        item->fd = -1;
+        (*open_files)--;
+    }
+}
+
+/* hash the first and last DDUP_EDGE_SIZE bytes of a file,
+ * returns -1 on any read error */
+static int hash_edges(
+    const char* fname,
+    bool noatime,
+    char* buf,
+    uint64_t file_size,
+    const ddup_hash_alg* alg,
+    unsigned char* digest)
+{
+    /* open the file */
+    int flags = O_RDONLY;
+    if (noatime) {
+        flags |= O_NOATIME;
+    }
+    int fd = mfu_open(fname, flags);
+    if (fd < 0) {
+        return -1;
+    }
+
+    /* read the head of the file, and the tail if it does not
+     * overlap with the head */
+    uint64_t head = file_size;
+    if (head > DDUP_EDGE_SIZE) {
+        head = DDUP_EDGE_SIZE;
+    }
+    uint64_t tail_start = head;
+    if (file_size > tail_start + DDUP_EDGE_SIZE) {
+        tail_start = file_size - DDUP_EDGE_SIZE;
+    }
+    uint64_t tail = file_size - tail_start;
+
+    int status = 0;
+    ssize_t nread = mfu_pread(fname, fd, buf, (size_t)head, 0);
+    if (nread != (ssize_t)head) {
+        status = -1;
+    }
+    if (status == 0 && tail > 0) {
+        nread = mfu_pread(fname, fd, buf + head, (size_t)tail, (off_t)tail_start);
+        if (nread != (ssize_t)tail) {
+            status = -1;
+        }
+    }
+
+    mfu_close(fname, fd);
+
+    if (status == 0) {
+        struct file_item item;
+        item.fd = -1;
+        ddup_hash_init(&item, alg);
+        ddup_hash_update(&item, buf, (size_t)(head + tail));
+        ddup_hash_final(&item, digest);
+        ddup_hash_free(&item);
+    }
+
+    return status;
+}
+
+/* assign group ids to items in list based on their keys, and copy
+ * items from groups with more than one member to new_list, replacing
+ * the first key value with the group id, returns number of items kept */
+static uint64_t filter_unique(
+    uint64_t count,
+    const uint64_t* list,
+    uint64_t* new_list,
+    uint64_t* group_id,
+    uint64_t* group_ranks,
+    uint64_t* group_rank,
+    MPI_Datatype key,
+    MPI_Datatype keysat,
+    DTCMP_Op cmp)
+{
+    uint64_t groups;
+    DTCMP_Rankv(
+        (int)count, list,
+        &groups, group_id, group_ranks, group_rank,
+        key, keysat, cmp, DTCMP_FLAG_NONE, MPI_COMM_WORLD
+    );
+
+    uint64_t kept = 0;
+    const uint64_t* ptr = list;
+    uint64_t* new_ptr = new_list;
+    uint64_t i;
+    for (i = 0; i < count; i++) {
+        if (group_ranks[i] > 1) {
+            new_ptr[0] = group_id[i];
+            new_ptr[DDUP_KEY_SIZE] = ptr[DDUP_KEY_SIZE];
+            new_ptr += DDUP_KEY_SIZE + 1;
+            kept++;
+        }
+        ptr += DDUP_KEY_SIZE + 1;
+    }
+    return kept;
+}
+
 /* create MPI datatypes for key and key and satellite data */
 static void mpi_type_init(MPI_Datatype* key, MPI_Datatype* keysat)
 {
-    assert(SHA256_DIGEST_LENGTH == (DDUP_KEY_SIZE - 1) * 8);
+    assert(DDUP_DIGEST_SIZE == (DDUP_KEY_SIZE - 1) * 8);
 
     /*
      * Build MPI datatype for key.
-     * 1 for group ID + (SHA256_DIGEST_LENGTH / 8)
+     * 1 for group ID + (DDUP_DIGEST_SIZE / 8)
      */
     MPI_Type_contiguous(DDUP_KEY_SIZE, MPI_UINT64_T, key);
     MPI_Type_commit(key);
@@ -81,11 +264,16 @@ static void mtcmp_cmp_fini(DTCMP_Op* cmp)
     DTCMP_Op_free(cmp);
 }
 
-/* open the specified file, read specified chunk, and close file,
- * returns -1 on any read error */
+/* read specified chunk from the file, opening it if *fd is -1,
+ * the file is left open in *fd if keep_open is set and closed
+ * otherwise, after reading we ask the kernel to start reading
+ * the next chunk so it arrives while we sort, returns -1 on
+ * any read error */
 static int read_data(
     const char* fname,
     bool noatime,
+    int* fd_ptr,
+    bool keep_open,
     char* chunk_buf,
     uint64_t chunk_id,
     uint64_t chunk_size,
@@ -99,27 +287,24 @@ static int read_data(
     /* compute byte offset to read from in file */
     uint64_t offset = (chunk_id - 1) * chunk_size;
 
-    /* zero out our buffer */
-    memset(chunk_buf, 0, chunk_size);
+    /* no need to clear the buffer, only the bytes read are hashed */
+    *data_size = 0;
 
-    /* open the file */
-    int flags = O_RDONLY;
-    if (noatime) {
-        flags |= O_NOATIME;
-    }
-    int fd = mfu_open(fname, flags);
+    /* open the file if we don't already have it open */
+    int fd = *fd_ptr;
     if (fd < 0) {
-        return -1;
-    }
-
-    /* seek to the correct offset */
-    if (mfu_lseek(fname, fd, (off_t)offset, SEEK_SET) == (off_t) - 1) {
-        status = -1;
-        goto out;
+        int flags = O_RDONLY;
+        if (noatime) {
+            flags |= O_NOATIME;
+        }
+        fd = mfu_open(fname, flags);
+        if (fd < 0) {
+            return -1;
+        }
     }
 
     /* read data from file */
-    ssize_t read_size = mfu_read(fname, fd, chunk_buf, chunk_size);
+    ssize_t read_size = mfu_pread(fname, fd, chunk_buf, chunk_size, (off_t)offset);
     if (read_size < 0) {
         /* read failed */
         status = -1;
@@ -148,21 +333,27 @@ static int read_data(
     /* return number of bytes read */
     *data_size = (uint64_t)read_size;
 
+    /* start reading the next chunk in the background */
+    if (chunk_id * chunk_size < file_size) {
+        posix_fadvise(fd, (off_t)(chunk_id * chunk_size), (off_t)chunk_size, POSIX_FADV_WILLNEED);
+    }
+
 out:
-    /* close our file and return */
-    mfu_close(fname, fd);
+    /* keep the file open for the next round, or close it */
+    if (keep_open && status == 0) {
+        *fd_ptr = fd;
+    } else {
+        mfu_close(fname, fd);
+        *fd_ptr = -1;
+    }
     return status;
 }
 
-struct file_item {
-    SHA256_CTX ctx;
-};
-
-/* print SHA256 value to stdout */
-static void dump_sha256_digest(char* digest_string, unsigned char digest[])
+/* print digest value to stdout */
+static void dump_digest(char* digest_string, unsigned char digest[])
 {
     int i;
-    for (i = 0; i < SHA256_DIGEST_LENGTH; i++) {
+    for (i = 0; i < DDUP_DIGEST_SIZE; i++) {
         sprintf(&digest_string[i * 2], "%02x", (unsigned int)digest[i]);
     }
 }
@@ -175,7 +366,7 @@ int main(int argc, char** argv)
 
     uint64_t chunk_size = DDUP_CHUNK_SIZE;
 
-    SHA256_CTX* ctx_ptr;
+    const ddup_hash_alg* hash_alg = ddup_hash_lookup("sha256");
 
     MPI_Init(NULL, NULL);
     mfu_init();
@@ -192,6 +383,7 @@ int main(int argc, char** argv)
     bool open_noatime = false;
 
     static struct option long_options[] = {
+        {"hash",     1, 0, 'H'},
         {"open-noatime", 0, 0, 'U'},
         {"debug",    0, 0, 'd'},
         {"verbose",  0, 0, 'v'},
@@ -209,6 +401,15 @@ int main(int argc, char** argv)
                             long_options, &option_index)) != -1)
     {
         switch (c) {
+        case 'H':
+            hash_alg = ddup_hash_lookup(optarg);
+            if (hash_alg == NULL) {
+                if (rank == 0) {
+                    MFU_LOG(MFU_LOG_ERR, "Unknown hash algorithm: '%s'", optarg);
+                }
+                usage = 1;
+            }
+            break;
         case 'U':
             open_noatime = true;
             break;
@@ -334,7 +535,7 @@ int main(int argc, char** argv)
     /* get local number of items in flist */
     uint64_t checking_files = mfu_flist_size(flist);
 
-    /* allocate memory to hold SHA256 context values */
+    /* allocate memory to hold hash state for each file */
     struct file_item* file_items = (struct file_item*) MFU_MALLOC(checking_files * sizeof(*file_items));
 
     /* Allocate two lists of length size, where each
@@ -364,15 +565,11 @@ int main(int argc, char** argv)
 
         /* for first pass, group all files with same file size */
         ptr[0] = file_size;
-
-        /* we'll leave the middle part of the key unset */
+        memset(&ptr[1], 0, DDUP_DIGEST_SIZE);
 
         /* record our index in flist */
         ptr[DDUP_KEY_SIZE] = i;
 
-        /* initialize the SHA256 hash state for this file */
-        SHA256_Init(&file_items[i].ctx);
-
         /* increment our file count */
         new_checking_files++;
 
@@ -392,15 +589,92 @@ int main(int argc, char** argv)
 
     /* get total number of items across all tasks */
     uint64_t sum_checking_files;
+    MPI_Allreduce(&checking_files, &sum_checking_files, 1,
+                  MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+    uint64_t sum_regular_files = sum_checking_files;
+
+    /* a file whose size no other file has cannot have a duplicate,
+     * so drop those before reading any data */
+    checking_files = filter_unique(checking_files, list, new_list,
+        group_id, group_ranks, group_rank, key, keysat, cmp);
+    uint64_t* tmp_list = list;
+    list     = new_list;
+    new_list = tmp_list;
+
+    uint64_t sum_same_size;
+    MPI_Allreduce(&checking_files, &sum_same_size, 1,
+                  MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+
+    /* hash just the start and end of the remaining files,
+     * and drop files that differ there from all others of their size */
+    ptr = list;
+    for (i = 0; i < checking_files; i++) {
+        uint64_t idx = ptr[DDUP_KEY_SIZE];
+        const char* fname = mfu_flist_file_get_name(flist, idx);
+        file_size = mfu_flist_file_get_size(flist, idx);
+
+        /* open file with O_NOATIME if requested and if possible */
+        bool noatime = false;
+        if (open_noatime) {
+            uid_t owner = (uid_t) mfu_flist_file_get_uid(flist, idx);
+            if (proc.geteuid == owner || proc.cap_fowner) {
+                noatime = true;
+            }
+        }
+
+        if (hash_edges(fname, noatime, chunk_buf, file_size, hash_alg,
+                       (unsigned char*)(ptr + 1)) != 0)
+        {
+            /* leave the key zeroed, the full hash will catch
+             * any difference if this file is still kept */
+            MFU_LOG(MFU_LOG_WARN, "Failed to read %s, size may have changed", fname);
+            memset(&ptr[1], 0, DDUP_DIGEST_SIZE);
+        }
+
+        ptr += DDUP_KEY_SIZE + 1;
+    }
+
+    checking_files = filter_unique(checking_files, list, new_list,
+        group_id, group_ranks, group_rank, key, keysat, cmp);
+    tmp_list = list;
+    list     = new_list;
+    new_list = tmp_list;
+
     MPI_Allreduce(&checking_files, &sum_checking_files, 1,
                   MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
 
+    if (rank == 0) {
+        MFU_LOG(MFU_LOG_INFO, "Checked %" PRIu64 " files, %" PRIu64 " share a size, "
+            "%" PRIu64 " also share their first and last %d bytes",
+            sum_regular_files, sum_same_size, sum_checking_files, DDUP_EDGE_SIZE);
+    }
+
+    /* only the remaining files have their full contents hashed */
+    ptr = list;
+    for (i = 0; i < checking_files; i++) {
+        uint64_t idx = ptr[DDUP_KEY_SIZE];
+        ddup_hash_init(&file_items[idx], hash_alg);
+        file_items[idx].fd = -1;
+        ptr += DDUP_KEY_SIZE + 1;
+    }
+
+    /* keep files open between rounds rather than reopening them
+     * for every chunk, leaving room under the limit for other use */
+    uint64_t open_files = 0;
+    uint64_t max_open_files = 0;
+    struct rlimit nofile;
+    if (getrlimit(RLIMIT_NOFILE, &nofile) == 0 && nofile.rlim_cur != RLIM_INFINITY) {
+        max_open_files = (uint64_t) nofile.rlim_cur / 2;
+    } else {
+        max_open_files = 1024;
+    }
+
     uint64_t chunk_id = 0;
     while (sum_checking_files > 1) {
         /* update the chunk id we'll read from all files */
         chunk_id++;
 
-        /* iterate over our list and compute SHA256 value for each */
+        /* iterate over our list and compute hash value for each */
         ptr = list;
         for (i = 0; i < checking_files; i++) {
             /* get the flist index for this item */
@@ -421,27 +695,33 @@ int main(int argc, char** argv)
                 }
             }
 
+            /* keep the file open if there is more to read and we have room */
+            struct file_item* item = &file_items[idx];
+            int was_open = (item->fd >= 0);
+            bool keep_open = (file_size > chunk_id * chunk_size) &&
+                             (was_open || open_files < max_open_files);
+
             /* read a chunk of data from the file into chunk_buf */
             uint64_t data_size;
-            status = read_data(fname, noatime, chunk_buf, chunk_id,
-                               chunk_size, file_size, &data_size);
+            status = read_data(fname, noatime, &item->fd, keep_open, chunk_buf,
+                               chunk_id, chunk_size, file_size, &data_size);
             if (status) {
                 /* File size has been changed, TODO: handle */
                 MFU_LOG(MFU_LOG_WARN, "Failed to read %s, size may have changed", fname);
             }
 
-            /* update the SHA256 context for this file */
-            ctx_ptr = &file_items[idx].ctx;
-            SHA256_Update(ctx_ptr, chunk_buf, data_size);
+            /* track how many files we hold open */
+            if (!was_open && item->fd >= 0) {
+                open_files++;
+            } else if (was_open && item->fd < 0) {
+                open_files--;
+            }
+
+            /* update the hash state for this file */
+            ddup_hash_update(item, chunk_buf, data_size);
 
-            /*
-             * Use SHA256 value as key.
-             * This is actually an hack, but SHA256_Final can't
-             * be called multiple times with out changing ctx
-             */
-            SHA256_CTX ctx_tmp;
-            memcpy(&ctx_tmp, ctx_ptr, sizeof(ctx_tmp));
-            SHA256_Final((unsigned char*)(ptr + 1), &ctx_tmp);
+            /* use digest of data hashed so far as key */
+            ddup_hash_peek(item, (unsigned char*)(ptr + 1));
 
             /* move on to next file in the list */
             ptr += DDUP_KEY_SIZE + 1;
@@ -472,14 +752,15 @@ int main(int argc, char** argv)
             /* look up file size */
             file_size = mfu_flist_file_get_size(flist, idx);
 
-            /* get a pointer to the SHA256 context for this file */
-            ctx_ptr = &file_items[idx].ctx;
+            /* get a pointer to the hash state for this file */
+            struct file_item* item = &file_items[idx];
 
             if (group_ranks[i] == 1) {
                 /*
                  * Only one file in this group,
                  * mfu_flist_file_name(flist, idx) is unique
                  */
+                file_item_fini(item, fname, &open_files);
             } else if (file_size <= (chunk_id * chunk_size)) {
                 /*
                  * We've run out of bytes to checksum, and we
@@ -488,11 +769,12 @@ int main(int argc, char** argv)
                  * duplicate with other files that also have
                  * matching group_id[i]
                  */
-                unsigned char digest[SHA256_DIGEST_LENGTH];
-                SHA256_Final(digest, ctx_ptr);
+                unsigned char digest[DDUP_DIGEST_SIZE];
+                ddup_hash_final(item, digest);
+                file_item_fini(item, fname, &open_files);
 
-                char digest_string[SHA256_DIGEST_LENGTH * 2 + 1];
-                dump_sha256_digest(digest_string, digest);
+                char digest_string[DDUP_DIGEST_SIZE * 2 + 1];
+                dump_digest(digest_string, digest);
                 printf("%s %s\n", fname, digest_string);
             } else {
                 /* Have multiple files with the same checksum,
@@ -526,7 +808,6 @@ int main(int argc, char** argv)
         }
 
         /* Swap lists */
-        uint64_t* tmp_list;
         tmp_list = list;
         list     = new_list;
         new_list = tmp_list;
@@ -539,6 +820,15 @@ int main(int argc, char** argv)
                       MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
     }
 
+    /* free hash state of any files left in the list */
+    ptr = list;
+    for (i = 0; i < checking_files; i++) {
+        uint64_t idx = ptr[DDUP_KEY_SIZE];
+        const char* fname = mfu_flist_file_get_name(flist, idx);
+        file_item_fini(&file_items[idx], fname, &open_files);
+        ptr += DDUP_KEY_SIZE + 1;
+    }
+
     /* free the walk options */
     mfu_walk_opts_delete(&walk_opts);
 
@@ -672,8 +672,9 @@ daos_setup_done:
         (void) mfu_flist_walk_param_paths(numpaths, paths, walk_opts, flist, mfu_file);
     }
     else {
-        /* read data from cache file */
-        mfu_flist_read_cache(inputname, flist);
+        /* read data from cache file, dropping items that
+         * can't match while reading */
+        mfu_flist_read_cache_pred(inputname, flist, pred_head);
     }
 
     /* apply predicates to each item in list */
@@ -32,17 +32,22 @@
 #define _XOPEN_SOURCE 600
 #include <fcntl.h>
 #include <string.h>
+#include <ctype.h>
 
 /* for bool type, true/false macros */
 #include <stdbool.h>
 #include <assert.h>
 
 #include "mfu.h"
-#include "strmap.h"
+#include "mfu_pathmap.h"
 #include "list.h"
 
 #include "mfu_errors.h"
 
+#ifdef LUSTRE_SUPPORT
+#include <lustre/lustreapi.h>
+#endif
+
 /* for daos */
 #ifdef DAOS_SUPPORT
 #include "mfu_daos.h"
@@ -70,13 +75,21 @@ static void print_usage(void)
 #ifdef DAOS_SUPPORT
     printf("      --daos-api          - DAOS API in {DFS, DAOS} (default uses DFS for POSIX containers)\n");
 #endif
+    printf("      --changelog <SRC>   - only sync paths named in changelog file SRC or in mdt:<MDT>[:<USER>],\n");
+    printf("                            clearing records read for changelog user USER after a clean sync\n");
     printf("  -c, --contents          - read and compare file contents rather than compare size and mtime\n");
     printf("  -D, --delete            - delete extraneous files from target\n");
+    printf("      --delta             - rewrite only changed blocks of large modified files\n");
     printf("  -L, --dereference       - copy original files instead of links\n");
     printf("  -P, --no-dereference    - don't follow links in source\n"); 
     printf("  -s, --direct            - open files with O_DIRECT\n");
     printf("      --open-noatime      - open files with O_NOATIME\n");
+    printf("      --dynamic           - hand out chunks to processes on demand\n");
+    printf("      --adaptive          - size chunks per file, starting from --chunksize and growing up to 1GB\n");
+    printf("                            or shrinking down to 1MB to balance load\n");
+    printf("      --full-join         - exchange full records for all items, even if unchanged\n");
     printf("      --link-dest <DIR>   - hardlink to files in DIR when unchanged\n");
+    printf("      --manifest <FILE>   - read destination state from FILE rather than walk it, update FILE after sync\n");
     printf("  -S, --sparse            - create sparse files when possible\n");
     printf("      --progress <N>      - print progress every N seconds\n");
     printf("  -v, --verbose           - verbose output\n");
@@ -189,6 +202,10 @@ struct dsync_options {
     int debug;                     /* check result after get result */
     int delete;                    /* delete extraneous files from destination dirs */
     char* link_dest;               /* link dest dir */
+    int prefilter;                 /* drop unchanged items before exchanging full records */
+    char* manifest;                /* file recording destination state after sync */
+    char* changelog;               /* changelog naming changed source paths */
+    int delta;                     /* update modified files in place, writing only changed blocks */
     int need_compare[DCMPF_MAX];   /* fields that need to be compared  */
 };
 
@@ -201,6 +218,10 @@ struct dsync_options options = {
     .debug        = 0,
     .delete       = 0,
     .link_dest    = NULL,
+    .prefilter    = 1,
+    .manifest     = NULL,
+    .changelog    = NULL,
+    .delta        = 0,
     .need_compare = {0,}
 };
 
@@ -379,132 +400,57 @@ static int dsync_state_from_string(const char* string, dsync_state *state)
     return -ENOENT;
 }
 
-/* given a filename as the key, encode an index followed
- * by the init state */
-static void dsync_strmap_item_init(
-    strmap* map,
-    const char *key,
-    uint64_t item_index)
-{
-    /* Should be long enough for 64 bit number and DCMPF_MAX */
-    char val[21 + DCMPF_MAX];
-    int i;
-
-    /* encode the index */
-    int len = snprintf(val, sizeof(val), "%llu",
-                       (unsigned long long) item_index);
-
-    /* encode the state (state characters and trailing NUL) */
-    assert((size_t)len + DCMPF_MAX + 1 <= (sizeof(val)));
-    size_t position = strlen(val);
-    for (i = 0; i < DCMPF_MAX; i++) {
-        val[position] = DCMPS_INIT;
-        position++;
-    }
-    val[position] = '\0';
-
-    /* add item to map */
-    strmap_set(map, key, val);
-}
-
+/* set state of a field for the item with the given key */
 static void dsync_strmap_item_update(
-    strmap* map,
+    mfu_pathmap* map,
     const char *key,
     dsync_field field,
     dsync_state state)
 {
-    /* Should be long enough for 64 bit number and DCMPF_MAX */
-    char new_val[21 + DCMPF_MAX];
-
     /* lookup item from map */
-    const char* val = strmap_get(map, key);
-
-    /* copy existing index over */
+    uint64_t idx;
+    int rc = mfu_pathmap_index(map, key, &idx);
+    assert(rc == 0);
     assert(field < DCMPF_MAX);
-    assert(strlen(val) + 1 <= sizeof(new_val));
-    strcpy(new_val, val);
 
     /* set new state value */
-    size_t position = strlen(new_val) - DCMPF_MAX;
-    new_val[position + field] = state;
-
-    /* reinsert item in map */
-    strmap_set(map, key, new_val);
+    mfu_pathmap_state_set(map, idx, (int) field, (uint8_t) state);
 }
 
 static int dsync_strmap_item_index(
-    strmap* map,
+    mfu_pathmap* map,
     const char *key,
     uint64_t *item_index)
 {
-    /* Should be long enough for 64 bit number and DCMPF_MAX */
-    char new_val[21 + DCMPF_MAX];
-
     /* lookup item from map */
-    const char* val = strmap_get(map, key);
-    if (val == NULL) {
-        return -1;
-    }
-
-    /* extract index */
-    assert(strlen(val) + 1 <= sizeof(new_val));
-    strcpy(new_val, val);
-    new_val[strlen(new_val) - DCMPF_MAX] = '\0';
-    *item_index = strtoull(new_val, NULL, 0);
-
-    return 0;
+    return mfu_pathmap_index(map, key, item_index);
 }
 
 static int dsync_strmap_item_state(
-    strmap* map,
+    mfu_pathmap* map,
     const char *key,
     dsync_field field,
     dsync_state *state)
 {
     /* lookup item from map */
-    const char* val = strmap_get(map, key);
-    if (val == NULL) {
+    uint64_t idx;
+    if (mfu_pathmap_index(map, key, &idx) != 0) {
         return -1;
     }
 
     /* extract state */
-    assert(strlen(val) > DCMPF_MAX);
     assert(field < DCMPF_MAX);
-    size_t position = strlen(val) - DCMPF_MAX;
-    *state = val[position + field];
+    *state = (dsync_state) mfu_pathmap_state_get(map, idx, (int) field);
 
     return 0;
 }
 
 /* map each file name to its index in the file list and initialize
  * its state for comparison operation */
-static strmap* dsync_strmap_creat(mfu_flist list, const char* prefix)
+static mfu_pathmap* dsync_strmap_creat(mfu_flist list, const char* prefix)
 {
-    /* create a new string map to map a file name to a string
-     * encoding its index and state */
-    strmap* map = strmap_new();
-
-    /* determine length of prefix string */
-    size_t prefix_len = strlen(prefix);
-
-    /* iterate over each item in the file list */
-    uint64_t i = 0;
-    uint64_t count = mfu_flist_size(list);
-    while (i < count) {
-        /* get full path of file name */
-        const char* name = mfu_flist_file_get_name(list, i);
-
-        /* ignore prefix portion of path */
-        name += prefix_len;
-
-        /* create entry for this file */
-        dsync_strmap_item_init(map, name, i);
-
-        /* go to next item in list */
-        i++;
-    }
-
-    return map;
+    /* keys are file names with the prefix portion of the path removed */
+    return mfu_pathmap_new(list, prefix, DCMPF_MAX, DCMPS_INIT);
 }
 
 #define dsync_compare_field(field_name, field)                                \
@@ -528,8 +474,8 @@ static void dsync_compare_acl(
     uint64_t src_index,
     mfu_flist dst_list,
     uint64_t dst_index,
-    strmap* src_map,
-    strmap* dst_map,
+    mfu_pathmap* src_map,
+    mfu_pathmap* dst_map,
     int *diff)
 {
     void *src_val, *dst_val;
@@ -600,10 +546,10 @@ static int dsync_option_need_compare(dsync_field field)
 /* Return -1 when error, return 0 when equal, return > 0 when diff */
 static int dsync_compare_metadata(
     mfu_flist src_list,
-    strmap* src_map,
+    mfu_pathmap* src_map,
     uint64_t src_index,
     mfu_flist dst_list,
-    strmap* dst_map,
+    mfu_pathmap* dst_map,
     uint64_t dst_index,
     const char* key)
 {
@@ -818,7 +764,7 @@ static void dsync_strmap_compare_data_link_dest(
     /* execute logical OR over chunks for each file */
     mfu_file_chunk_list_lor(src_compare_list, src_head, vals, results);
 
-    /* unpack contents of recv buffer & store results in strmap */
+    /* unpack contents of recv buffer & store results in mfu_pathmap */
     for (i = 0; i < size; i++) {
         /* get comparison results for this item */
         int flag = results[i];
@@ -845,9 +791,9 @@ static void dsync_strmap_compare_data_link_dest(
 
 static int dsync_strmap_compare_data(
     mfu_flist src_compare_list,
-    strmap* src_map,
+    mfu_pathmap* src_map,
     mfu_flist dst_compare_list,
-    strmap* dst_map,
+    mfu_pathmap* dst_map,
     mfu_flist src_list,
     mfu_flist src_cp_list,
     mfu_flist dst_same_list,
@@ -857,6 +803,7 @@ static int dsync_strmap_compare_data(
     mfu_copy_opts_t* copy_opts,
     uint64_t* count_bytes_read,
     uint64_t* count_bytes_written,
+    int* errors,
     mfu_file_t* mfu_src_file,
     mfu_file_t* mfu_dst_file)
 {
@@ -897,6 +844,9 @@ static int dsync_strmap_compare_data(
      * to be used as input to logical OR to determine state of entire file */
     int* vals = (int*) MFU_MALLOC(list_count * sizeof(int));
 
+    /* likewise, a flag for each chunk set to 1 if we hit an error on it */
+    int* errs = (int*) MFU_MALLOC(list_count * sizeof(int));
+
     /* whether we should overwrite bytes in destination file during compare */
     int overwrite = 1;
     if (options.dry_run || use_hardlinks) {
@@ -937,6 +887,9 @@ static int dsync_strmap_compare_data(
             /* set flag to consider files to be different,
              * could actually be the same, but we'll draw attention to them this way */
             compare_rc = 1;
+            errs[i] = 1;
+        } else {
+            errs[i] = 0;
         }
 
         /* record results of comparison */
@@ -958,7 +911,12 @@ static int dsync_strmap_compare_data(
     /* execute logical OR over chunks for each file */
     mfu_file_chunk_list_lor(src_compare_list, src_head, vals, results);
 
-    /* unpack contents of recv buffer & store results in strmap */
+    /* report which files hit an error if the caller asks */
+    if (errors != NULL) {
+        mfu_file_chunk_list_lor(src_compare_list, src_head, errs, errors);
+    }
+
+    /* unpack contents of recv buffer & store results in mfu_pathmap */
     for (i = 0; i < size; i++) {
         /* lookup name of file based on id to send to strmap updata call */
         const char* name = mfu_flist_file_get_name(src_compare_list, i);
@@ -998,6 +956,7 @@ static int dsync_strmap_compare_data(
 
     /* free memory */
     mfu_free(&results);
+    mfu_free(&errs);
     mfu_free(&vals);
     mfu_file_chunk_list_free(&src_head);
     mfu_file_chunk_list_free(&dst_head);
@@ -1021,7 +980,7 @@ static void dsync_generate_real_lists(
     size_t src_strlen_prefix,   /* length of prefix string to source directory */
     const mfu_param_path *link_path, /* param path for link-dest directory */
     mfu_flist dst_list,         /* list of files in destination */
-    strmap *dst_map,            /* map each file in destination to its index in dst_list */
+    mfu_pathmap *dst_map,            /* map each file in destination to its index in dst_list */
     mfu_flist src_cp_list,      /* list of files to be copied to destination */
     mfu_flist dst_same_list,    /* list of files in destination that are same as in source */
     mfu_flist link_same_list,   /* list of files in link-dest that are same as in source */
@@ -1033,7 +992,7 @@ static void dsync_generate_real_lists(
     uint64_t idx;
 
     /* create map of item name to index in its respective list */
-    strmap* link_same_map = dsync_strmap_creat(link_same_list, link_path->path);
+    mfu_pathmap* link_same_map = dsync_strmap_creat(link_same_list, link_path->path);
 
     /* walk list of files we need to copy from source to destination,
      * and split into set that must actually be copied and set that
@@ -1126,7 +1085,7 @@ static void dsync_generate_real_lists(
     mfu_flist_summarize(dst_remove_list);
 
     /* free the map */
-    strmap_delete(&link_same_map);
+    mfu_pathmap_delete(&link_same_map);
 }
 
 /* given a list of source/destination files to compare, spread file
@@ -1169,10 +1128,10 @@ static int dsync_strmap_compare_lite(
     mfu_flist src_compare_list,
     mfu_flist src_cp_list,
     mfu_flist dst_same_list,
-    strmap* src_map,
+    mfu_pathmap* src_map,
     mfu_flist dst_compare_list,
     mfu_flist dst_remove_list,
-    strmap* dst_map,
+    mfu_pathmap* dst_map,
     size_t strlen_prefix,
     bool use_hardlinks)
 {
@@ -1313,14 +1272,15 @@ static void print_comparison_stats(
 
 /* loop on the dest map to check for files only in the dst list
  * and copy to a remove_list for the --sync option */
-static void dsync_only_dst(strmap* src_map,
-    strmap* dst_map, mfu_flist dst_list, mfu_flist dst_remove_list)
+static void dsync_only_dst(mfu_pathmap* src_map,
+    mfu_pathmap* dst_map, mfu_flist dst_list, mfu_flist dst_remove_list)
 {
     /* iterate over each item in dest map */
-    const strmap_node* node;
-    strmap_foreach(dst_map, node) {
+    uint64_t map_idx;
+    uint64_t map_size = mfu_pathmap_size(dst_map);
+    for (map_idx = 0; map_idx < map_size; map_idx++) {
         /* get file name */
-        const char* key = strmap_node_key(node);
+        const char* key = mfu_pathmap_key(dst_map, map_idx);
 
         /* get index of destination file */
         uint64_t dst_index;
@@ -1338,8 +1298,8 @@ static void dsync_only_dst(strmap* src_map,
 }
 
 static int dsync_sync_files(
-    strmap* src_map,
-    strmap* dst_map,
+    mfu_pathmap* src_map,
+    mfu_pathmap* dst_map,
     const mfu_param_path* src_path,
     const mfu_param_path* dest_path,
     const mfu_param_path* link_path,
@@ -1432,9 +1392,9 @@ static int dsync_sync_files(
 /* compare entries from src to items in link-dest */
 static int dsync_strmap_compare_link_dest(
     mfu_flist src_list,
-    strmap* src_map,
+    mfu_pathmap* src_map,
     mfu_flist link_list,
-    strmap* link_map,
+    mfu_pathmap* link_map,
     mfu_flist link_same_list,
     mfu_copy_opts_t* copy_opts,
     mfu_file_t* mfu_src_file,
@@ -1456,10 +1416,11 @@ static int dsync_strmap_compare_link_dest(
     mfu_flist link_compare_list = mfu_flist_subset(link_list);
 
     /* iterate over each item in source map */
-    const strmap_node* node;
-    strmap_foreach(src_map, node) {
+    uint64_t map_idx;
+    uint64_t map_size = mfu_pathmap_size(src_map);
+    for (map_idx = 0; map_idx < map_size; map_idx++) {
         /* get file name */
-        const char* key = strmap_node_key(node);
+        const char* key = mfu_pathmap_key(src_map, map_idx);
 
         /* get index of source file */
         uint64_t src_index;
@@ -1581,14 +1542,142 @@ static int dsync_strmap_compare_link_dest(
     return rc;
 }
 
+/* whether a modified regular file should be updated in place by
+ * rewriting the blocks that differ rather than copied in full,
+ * we only do this for files of at least one chunk */
+static bool dsync_delta_eligible(
+    mfu_flist src_list,
+    uint64_t src_index,
+    mode_t dst_mode,
+    const mfu_param_path* link_path,
+    mfu_copy_opts_t* copy_opts)
+{
+    if (!options.delta || options.dry_run || link_path != NULL) {
+        return false;
+    }
+    if (! S_ISREG(dst_mode)) {
+        return false;
+    }
+    uint64_t size = mfu_flist_file_get_size(src_list, src_index);
+    return (size >= copy_opts->chunk_size);
+}
+
+/* returns true if mtime of source and destination items differ */
+static bool dsync_mtime_differs(
+    mfu_flist src_list,
+    uint64_t src_index,
+    mfu_flist dst_list,
+    uint64_t dst_index)
+{
+    uint64_t src_mtime = mfu_flist_file_get_mtime(src_list, src_index);
+    uint64_t dst_mtime = mfu_flist_file_get_mtime(dst_list, dst_index);
+    if (src_mtime != dst_mtime) {
+        return true;
+    }
+    if (comp_mtime_nsec) {
+        uint64_t src_mtime_nsec = mfu_flist_file_get_mtime_nsec(src_list, src_index);
+        uint64_t dst_mtime_nsec = mfu_flist_file_get_mtime_nsec(dst_list, dst_index);
+        return (src_mtime_nsec != dst_mtime_nsec);
+    }
+    return false;
+}
+
+/* Updates destination files in place to match their source, the
+ * lists hold pairs of modified regular files.  Each destination file
+ * is first resized to the size of its source, then both are compared
+ * in chunks in parallel and only the blocks that differ are written.
+ * Files that can't be resized or that hit an error while being
+ * updated are copied in full instead.  Metadata is refreshed only on
+ * files that were updated, so a partly written file never gets the
+ * size and mtime of its source. */
+static int dsync_strmap_delta(
+    mfu_flist src_delta_list,
+    mfu_pathmap* src_map,
+    mfu_flist dst_delta_list,
+    mfu_pathmap* dst_map,
+    mfu_flist src_list,
+    mfu_flist src_cp_list,
+    mfu_flist dst_remove_list,
+    size_t strlen_prefix,
+    mfu_copy_opts_t* copy_opts,
+    uint64_t* metadata_refresh,
+    uint64_t* count_bytes_read,
+    uint64_t* count_bytes_written,
+    mfu_file_t* mfu_src_file,
+    mfu_file_t* mfu_dst_file)
+{
+    /* resize destination files, record sizes in a copy of the
+     * destination list so that chunks line up with the source */
+    mfu_flist src_resized = mfu_flist_subset(src_delta_list);
+    mfu_flist dst_resized = mfu_flist_subset(dst_delta_list);
+    uint64_t idx;
+    uint64_t size = mfu_flist_size(src_delta_list);
+    for (idx = 0; idx < size; idx++) {
+        const char* dst_name = mfu_flist_file_get_name(dst_delta_list, idx);
+        uint64_t src_size = mfu_flist_file_get_size(src_delta_list, idx);
+        if (mfu_file_truncate(dst_name, (off_t)src_size, mfu_dst_file) != 0) {
+            MFU_LOG(MFU_LOG_WARN, "Failed to truncate `%s', copying it in full (errno=%d %s)",
+                    dst_name, errno, strerror(errno));
+            mfu_flist_file_copy(dst_delta_list, idx, dst_remove_list);
+            mfu_flist_file_copy(src_delta_list, idx, src_cp_list);
+            continue;
+        }
+
+        mfu_flist_file_copy(src_delta_list, idx, src_resized);
+        mfu_flist_file_copy(dst_delta_list, idx, dst_resized);
+        uint64_t resized_idx = mfu_flist_size(dst_resized) - 1;
+        mfu_flist_file_set_size(dst_resized, resized_idx, src_size);
+    }
+    mfu_flist_summarize(src_resized);
+    mfu_flist_summarize(dst_resized);
+
+    /* chunks of a file may be written by any rank,
+     * so wait until all files have their final size */
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    /* compare chunks and write those that differ */
+    uint64_t resized_size = mfu_flist_size(src_resized);
+    int* errors = (int*) MFU_MALLOC(resized_size * sizeof(int));
+    int rc = dsync_strmap_compare_data(src_resized, src_map,
+        dst_resized, dst_map, src_list, src_cp_list, MFU_FLIST_NULL,
+        dst_remove_list, strlen_prefix, false, copy_opts,
+        count_bytes_read, count_bytes_written, errors,
+        mfu_src_file, mfu_dst_file
+    );
+
+    /* replace files we failed to update, and refresh metadata
+     * on the rest, since writing blocks changed their mtime */
+    for (idx = 0; idx < resized_size; idx++) {
+        if (errors[idx]) {
+            mfu_flist_file_copy(dst_resized, idx, dst_remove_list);
+            mfu_flist_file_copy(src_resized, idx, src_cp_list);
+            continue;
+        }
+
+        const char* key = mfu_flist_file_get_name(src_resized, idx) + strlen_prefix;
+        uint64_t src_index, dst_index;
+        int tmp_rc = dsync_strmap_item_index(src_map, key, &src_index);
+        assert(tmp_rc == 0);
+        tmp_rc = dsync_strmap_item_index(dst_map, key, &dst_index);
+        assert(tmp_rc == 0);
+        metadata_refresh[src_index] = dst_index + 1;
+    }
+    mfu_free(&errors);
+
+    mfu_flist_free(&dst_resized);
+    mfu_flist_free(&src_resized);
+
+    return rc;
+}
+
 /* compare entries from src into dst */
 static int dsync_strmap_compare(
     mfu_flist src_list,
-    strmap* src_map,
+    mfu_pathmap* src_map,
     mfu_flist dst_list,
-    strmap* dst_map,
+    mfu_pathmap* dst_map,
     mfu_flist link_list,
-    strmap* link_map,
+    mfu_pathmap* link_map,
     size_t strlen_prefix,
     mfu_copy_opts_t* copy_opts,
     const mfu_param_path* src_path,
@@ -1624,6 +1713,10 @@ static int dsync_strmap_compare(
     /* list to track files to be deleted from destination */
     mfu_flist dst_remove_list = mfu_flist_subset(dst_list);
 
+    /* lists to track modified files to be updated in place */
+    mfu_flist src_delta_list = mfu_flist_subset(src_list);
+    mfu_flist dst_delta_list = mfu_flist_subset(dst_list);
+
     /* list to track files that are the same in destination and source directories */
     mfu_flist dst_same_list = MFU_FLIST_NULL;
 
@@ -1644,15 +1737,18 @@ static int dsync_strmap_compare(
         src_real_cp_list = mfu_flist_subset(src_list);
     }
 
-    /* use a map as a list to record source and destination indices
-     * for entries that need a refresh on metadata */
-    strmap* metadata_refresh = strmap_new();
-
     /* iterate over each item in source map */
-    const strmap_node* node;
-    strmap_foreach(src_map, node) {
+    uint64_t map_idx;
+    uint64_t map_size = mfu_pathmap_size(src_map);
+
+    /* record index of destination file plus one for each source
+     * file that needs a refresh on metadata, 0 means no refresh */
+    uint64_t* metadata_refresh = (uint64_t*) MFU_MALLOC(map_size * sizeof(uint64_t));
+    memset(metadata_refresh, 0, map_size * sizeof(uint64_t));
+
+    for (map_idx = 0; map_idx < map_size; map_idx++) {
         /* get file name */
-        const char* key = strmap_node_key(node);
+        const char* key = mfu_pathmap_key(src_map, map_idx);
 
         /* get index of source file */
         uint64_t src_index;
@@ -1703,7 +1799,7 @@ static int dsync_strmap_compare(
         if ((uid_state == DCMPS_DIFFER) || (gid_state == DCMPS_DIFFER) ||
             (perm_state == DCMPS_DIFFER) || (atime_state == DCMPS_DIFFER) ||
             (mtime_state == DCMPS_DIFFER)) {
-            strmap_setf(metadata_refresh, "%llu=%llu", src_index, dst_index);
+            metadata_refresh[src_index] = dst_index + 1;
         }
 
         /* Skip if no need to compare type.
@@ -1800,6 +1896,15 @@ static int dsync_strmap_compare(
             dsync_strmap_item_update(src_map, key, DCMPF_CONTENT, DCMPS_DIFFER);
             dsync_strmap_item_update(dst_map, key, DCMPF_CONTENT, DCMPS_DIFFER);
 
+            /* update large files in place, rewriting changed blocks,
+             * metadata is refreshed only once the update succeeds */
+            if (dsync_delta_eligible(src_list, src_index, dst_mode, link_path, copy_opts)) {
+                mfu_flist_file_copy(src_list, src_index, src_delta_list);
+                mfu_flist_file_copy(dst_list, dst_index, dst_delta_list);
+                metadata_refresh[src_index] = 0;
+                continue;
+            }
+
             /* if the file sizes are different then we need to remove the file in
              * the dst directory, and replace it with the one in the src directory */
             if (!options.dry_run) {
@@ -1810,6 +1915,20 @@ static int dsync_strmap_compare(
             continue;
         }
 
+        /* a large file with a new mtime is assumed to be modified,
+         * update it in place rather than copying it in full */
+        if (!options.contents &&
+            dsync_delta_eligible(src_list, src_index, dst_mode, link_path, copy_opts) &&
+            dsync_mtime_differs(src_list, src_index, dst_list, dst_index))
+        {
+            dsync_strmap_item_update(src_map, key, DCMPF_CONTENT, DCMPS_DIFFER);
+            dsync_strmap_item_update(dst_map, key, DCMPF_CONTENT, DCMPS_DIFFER);
+            mfu_flist_file_copy(src_list, src_index, src_delta_list);
+            mfu_flist_file_copy(dst_list, dst_index, dst_delta_list);
+            metadata_refresh[src_index] = 0;
+            continue;
+        }
+
         /* If we get to this point, we need to open files and compare
          * file contents.  We'll first identify all such files so that
          * we can do this comparison in parallel more effectively.  For
@@ -1824,6 +1943,8 @@ static int dsync_strmap_compare(
     /* summarize lists of files for which we need to compare data contents */
     mfu_flist_summarize(src_compare_list);
     mfu_flist_summarize(dst_compare_list);
+    mfu_flist_summarize(src_delta_list);
+    mfu_flist_summarize(dst_delta_list);
 
     /* initalize total_bytes_read to zero */
     uint64_t total_files         = 0;
@@ -1850,7 +1971,7 @@ static int dsync_strmap_compare(
             tmp_rc = dsync_strmap_compare_data(src_compare_list, src_map,
                 dst_compare_list, dst_map, src_list, src_cp_list, dst_same_list,
                 dst_remove_list, strlen_prefix, use_hardlinks, copy_opts,
-                &total_bytes_read, &total_bytes_written,
+                &total_bytes_read, &total_bytes_written, NULL,
                 mfu_src_file, mfu_dst_file
             );
             if (tmp_rc < 0) {
@@ -1874,6 +1995,27 @@ static int dsync_strmap_compare(
         }
     }
 
+    /* update modified files in place if we have any */
+    uint64_t delta_global_size = mfu_flist_global_size(src_delta_list);
+    if (delta_global_size > 0) {
+        total_files += delta_global_size;
+
+        if (rank == 0) {
+            MFU_LOG(MFU_LOG_INFO, "Updating changed blocks of %llu items",
+                (unsigned long long) delta_global_size);
+        }
+
+        tmp_rc = dsync_strmap_delta(src_delta_list, src_map,
+            dst_delta_list, dst_map, src_list, src_cp_list,
+            dst_remove_list, strlen_prefix, copy_opts, metadata_refresh,
+            &total_bytes_read, &total_bytes_written,
+            mfu_src_file, mfu_dst_file
+        );
+        if (tmp_rc < 0) {
+            rc = -1;
+        }
+    }
+
     /* wait for all procs to finish before stopping timer */
     MPI_Barrier(MPI_COMM_WORLD);
 
@@ -1939,15 +2081,15 @@ static int dsync_strmap_compare(
         }
 
         /* update metadata on files */
-        strmap_foreach(metadata_refresh, node) {
-            /* extract source and destination indices */
-            unsigned long long src_i, dst_i;
-            const char* key = strmap_node_key(node);
-            const char* val = strmap_node_value(node);
-            sscanf(key, "%llu", &src_i);
-            sscanf(val, "%llu", &dst_i);
-            uint64_t src_index = (uint64_t) src_i;
-            uint64_t dst_index = (uint64_t) dst_i;
+        uint64_t src_index;
+        for (src_index = 0; src_index < map_size; src_index++) {
+            /* skip files that don't need a refresh */
+            if (metadata_refresh[src_index] == 0) {
+                continue;
+            }
+
+            /* extract destination index */
+            uint64_t dst_index = metadata_refresh[src_index] - 1;
 
             /* copy metadata values from source to destination, if needed */
             tmp_rc = mfu_flist_file_sync_meta(src_list, src_index, dst_list,
@@ -1963,7 +2105,7 @@ static int dsync_strmap_compare(
     }
 
     /* done with our list of files for refreshing metadata */
-    strmap_delete(&metadata_refresh);
+    mfu_free(&metadata_refresh);
 
     /* free lists used for removing and copying files */
     mfu_flist_free(&dst_remove_list);
@@ -1972,6 +2114,8 @@ static int dsync_strmap_compare(
     /* free the compare flists */
     mfu_flist_free(&dst_compare_list);
     mfu_flist_free(&src_compare_list);
+    mfu_flist_free(&dst_delta_list);
+    mfu_flist_free(&src_delta_list);
 
     /* free lists used for hardlinks */
     if (link_path) {
@@ -1991,15 +2135,16 @@ static int dsync_strmap_compare(
 }
 
 /* loop on the src map to check the results */
-static void dsync_strmap_check_src(strmap* src_map,
-                                  strmap* dst_map)
+static void dsync_strmap_check_src(mfu_pathmap* src_map,
+                                  mfu_pathmap* dst_map)
 {
     assert(dsync_option_need_compare(DCMPF_EXIST));
     /* iterate over each item in source map */
-    const strmap_node* node;
-    strmap_foreach(src_map, node) {
+    uint64_t map_idx;
+    uint64_t map_size = mfu_pathmap_size(src_map);
+    for (map_idx = 0; map_idx < map_size; map_idx++) {
         /* get file name */
-        const char* key = strmap_node_key(node);
+        const char* key = mfu_pathmap_key(src_map, map_idx);
         int only_src = 0;
 
         /* get index of source file */
@@ -2078,16 +2223,17 @@ static void dsync_strmap_check_src(strmap* src_map,
 }
 
 /* loop on the dest map to check the results */
-static void dsync_strmap_check_dst(strmap* src_map,
-    strmap* dst_map)
+static void dsync_strmap_check_dst(mfu_pathmap* src_map,
+    mfu_pathmap* dst_map)
 {
     assert(dsync_option_need_compare(DCMPF_EXIST));
 
     /* iterate over each item in dest map */
-    const strmap_node* node;
-    strmap_foreach(dst_map, node) {
+    uint64_t map_idx;
+    uint64_t map_size = mfu_pathmap_size(dst_map);
+    for (map_idx = 0; map_idx < map_size; map_idx++) {
         /* get file name */
-        const char* key = strmap_node_key(node);
+        const char* key = mfu_pathmap_key(dst_map, map_idx);
         int only_dest = 0;
 
         /* get index of destination file */
@@ -2179,8 +2325,8 @@ static void dsync_strmap_check_dst(strmap* src_map,
 
 /* check the result maps are valid */
 static void dsync_strmap_check(
-    strmap* src_map,
-    strmap* dst_map)
+    mfu_pathmap* src_map,
+    mfu_pathmap* dst_map)
 {
     dsync_strmap_check_src(src_map, dst_map);
     dsync_strmap_check_dst(src_map, dst_map);
@@ -2208,6 +2354,1032 @@ static int dsync_map_fn(
     return rank;
 }
 
+/* a source or destination item as seen by the rank that joins it,
+ * identified by hashes of its relative path rather than its name */
+typedef struct {
+    uint64_t hash;  /* 64-bit hash of path relative to prefix */
+    uint64_t check; /* 32-bit check hash of path, shifted, plus keep and side bits */
+    uint64_t meta;  /* digest of metadata fields that dsync compares */
+    uint64_t pos;   /* position of tuple in receive buffer */
+} dsync_join_item;
+
+/* number of 64-bit words we send for each item: hash, check, meta */
+#define DSYNC_JOIN_WORDS (3)
+
+/* order items by path, then put source ahead of destination */
+static int dsync_join_cmp(const void* a, const void* b)
+{
+    const dsync_join_item* x = (const dsync_join_item*) a;
+    const dsync_join_item* y = (const dsync_join_item*) b;
+    if (x->hash != y->hash) {
+        return (x->hash < y->hash) ? -1 : 1;
+    }
+    if (x->check != y->check) {
+        return (x->check < y->check) ? -1 : 1;
+    }
+    return 0;
+}
+
+/* compute a digest over the metadata of an item, covering at least
+ * every field dsync would compare, so that a source and destination
+ * item with equal digests need no further action */
+static uint64_t dsync_join_digest(mfu_flist flist, uint64_t idx)
+{
+    uint64_t vals[8];
+    size_t n = 0;
+
+    /* mode covers both type and permission bits, we ignore the
+     * size of directories like dsync_compare_metadata does */
+    mfu_filetype type = mfu_flist_file_get_type(flist, idx);
+    vals[n++] = mfu_flist_file_get_mode(flist, idx);
+    vals[n++] = (type != MFU_TYPE_DIR) ? mfu_flist_file_get_size(flist, idx) : 0;
+    vals[n++] = mfu_flist_file_get_uid(flist, idx);
+    vals[n++] = mfu_flist_file_get_gid(flist, idx);
+    vals[n++] = mfu_flist_file_get_mtime(flist, idx);
+    vals[n++] = comp_mtime_nsec ? mfu_flist_file_get_mtime_nsec(flist, idx) : 0;
+    if (dsync_option_need_compare(DCMPF_ATIME)) {
+        vals[n++] = mfu_flist_file_get_atime(flist, idx);
+    }
+    if (dsync_option_need_compare(DCMPF_CTIME)) {
+        vals[n++] = mfu_flist_file_get_ctime(flist, idx);
+    }
+
+    return mfu_hash_fnv1a64((const char*) vals, n * sizeof(uint64_t));
+}
+
+/* whether we can drop unchanged items before the full exchange,
+ * items that may still need their data or link target read, or
+ * that must be matched against link-dest, have to be kept */
+static bool dsync_join_prefilter_enabled(void)
+{
+    if (!options.prefilter) {
+        return false;
+    }
+    if (options.contents || options.link_dest != NULL) {
+        return false;
+    }
+    if (dsync_option_need_compare(DCMPF_ACL)) {
+        return false;
+    }
+    return true;
+}
+
+/* Joins source and destination lists on the path relative to their
+ * prefix by sending a small tuple for each item to the rank that owns
+ * the hash of its path.  Items present on both sides whose metadata
+ * digests match need no action, so they are dropped from both lists.
+ * This way only items that need work are exchanged as full file
+ * records by the remap that follows.  Replaces the input lists with
+ * filtered lists. */
+static void dsync_join_prefilter(
+    mfu_flist* psrc,
+    const char* path_src,
+    mfu_flist* pdst,
+    const char* path_dst)
+{
+    int rank, ranks;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+
+    mfu_flist lists[2] = { *psrc, *pdst };
+    size_t prefix_lens[2] = { strlen(path_src), strlen(path_dst) };
+    uint64_t sizes[2] = { mfu_flist_size(lists[0]), mfu_flist_size(lists[1]) };
+    uint64_t total = sizes[0] + sizes[1];
+
+    /* compute destination rank and tuple for each local item */
+    int* item_rank  = (int*)      MFU_MALLOC(total * sizeof(int));
+    uint64_t* items = (uint64_t*) MFU_MALLOC(total * DSYNC_JOIN_WORDS * sizeof(uint64_t));
+    int* sendcounts = (int*) MFU_MALLOC(ranks * sizeof(int));
+    int* senddispls = (int*) MFU_MALLOC(ranks * sizeof(int));
+    int* recvcounts = (int*) MFU_MALLOC(ranks * sizeof(int));
+    int* recvdispls = (int*) MFU_MALLOC(ranks * sizeof(int));
+    int i;
+    for (i = 0; i < ranks; i++) {
+        sendcounts[i] = 0;
+    }
+
+    int side;
+    uint64_t k = 0;
+    for (side = 0; side < 2; side++) {
+        uint64_t idx;
+        for (idx = 0; idx < sizes[side]; idx++) {
+            const char* name = mfu_flist_file_get_name(lists[side], idx);
+            const char* key  = name + prefix_lens[side];
+            size_t key_len = strlen(key);
+
+            uint64_t hash  = mfu_hash_fnv1a64(key, key_len);
+            uint32_t check = mfu_hash_jenkins(key, key_len);
+
+            /* symlinks may still differ in their targets */
+            uint64_t keep = 0;
+            mfu_filetype type = mfu_flist_file_get_type(lists[side], idx);
+            if (type == MFU_TYPE_LINK && dsync_option_need_compare(DCMPF_CONTENT)) {
+                keep = 1;
+            }
+
+            uint64_t* tuple = &items[k * DSYNC_JOIN_WORDS];
+            tuple[0] = hash;
+            tuple[1] = ((uint64_t)check << 2) | (keep << 1) | (uint64_t)side;
+            tuple[2] = dsync_join_digest(lists[side], idx);
+
+            item_rank[k] = (int)(hash % (uint64_t)ranks);
+            sendcounts[item_rank[k]] += DSYNC_JOIN_WORDS;
+            k++;
+        }
+    }
+
+    /* pack tuples by destination rank, remembering where each went
+     * since flags come back in the same order we sent them */
+    int senddisp = 0;
+    for (i = 0; i < ranks; i++) {
+        senddispls[i] = senddisp;
+        senddisp += sendcounts[i];
+    }
+
+    uint64_t* item_pos = (uint64_t*) MFU_MALLOC(total * sizeof(uint64_t));
+    uint64_t* sendbuf  = (uint64_t*) MFU_MALLOC(total * DSYNC_JOIN_WORDS * sizeof(uint64_t));
+    int* cursor = (int*) MFU_MALLOC(ranks * sizeof(int));
+    for (i = 0; i < ranks; i++) {
+        cursor[i] = senddispls[i];
+    }
+    for (k = 0; k < total; k++) {
+        int dest = item_rank[k];
+        memcpy(&sendbuf[cursor[dest]], &items[k * DSYNC_JOIN_WORDS],
+            DSYNC_JOIN_WORDS * sizeof(uint64_t));
+        item_pos[k] = (uint64_t)cursor[dest] / DSYNC_JOIN_WORDS;
+        cursor[dest] += DSYNC_JOIN_WORDS;
+    }
+    mfu_free(&items);
+    mfu_free(&item_rank);
+
+    /* exchange tuples */
+    MPI_Alltoall(sendcounts, 1, MPI_INT, recvcounts, 1, MPI_INT, MPI_COMM_WORLD);
+
+    int recvdisp = 0;
+    for (i = 0; i < ranks; i++) {
+        recvdispls[i] = recvdisp;
+        recvdisp += recvcounts[i];
+    }
+
+    uint64_t* recvbuf = (uint64_t*) MFU_MALLOC((size_t)recvdisp * sizeof(uint64_t));
+    MPI_Alltoallv(
+        sendbuf, sendcounts, senddispls, MPI_UINT64_T,
+        recvbuf, recvcounts, recvdispls, MPI_UINT64_T,
+        MPI_COMM_WORLD
+    );
+    mfu_free(&sendbuf);
+
+    /* sort what we received so matching paths are adjacent */
+    uint64_t recv_items = (uint64_t)recvdisp / DSYNC_JOIN_WORDS;
+    dsync_join_item* joined = (dsync_join_item*) MFU_MALLOC(recv_items * sizeof(dsync_join_item));
+    for (k = 0; k < recv_items; k++) {
+        joined[k].hash  = recvbuf[k * DSYNC_JOIN_WORDS + 0];
+        joined[k].check = recvbuf[k * DSYNC_JOIN_WORDS + 1];
+        joined[k].meta  = recvbuf[k * DSYNC_JOIN_WORDS + 2];
+        joined[k].pos   = k;
+    }
+    mfu_free(&recvbuf);
+    qsort(joined, (size_t)recv_items, sizeof(dsync_join_item), dsync_join_cmp);
+
+    /* flag a pair as unchanged only if the path has exactly one
+     * source and one destination item, neither must be kept, and
+     * their digests match, anything else is left for the full
+     * comparison */
+    char* recvflags = (char*) MFU_MALLOC((size_t)recv_items + 1);
+    memset(recvflags, 0, (size_t)recv_items + 1);
+    uint64_t start = 0;
+    while (start < recv_items) {
+        uint64_t end = start + 1;
+        while (end < recv_items &&
+               joined[end].hash == joined[start].hash &&
+               (joined[end].check >> 2) == (joined[start].check >> 2))
+        {
+            end++;
+        }
+
+        if (end - start == 2 &&
+            (joined[start].check & 3) == 0 &&
+            (joined[start + 1].check & 3) == 1 &&
+            joined[start].meta == joined[start + 1].meta)
+        {
+            recvflags[joined[start].pos]     = 1;
+            recvflags[joined[start + 1].pos] = 1;
+        }
+
+        start = end;
+    }
+    mfu_free(&joined);
+
+    /* send flags back to the ranks that own the items */
+    for (i = 0; i < ranks; i++) {
+        sendcounts[i] /= DSYNC_JOIN_WORDS;
+        senddispls[i] /= DSYNC_JOIN_WORDS;
+        recvcounts[i] /= DSYNC_JOIN_WORDS;
+        recvdispls[i] /= DSYNC_JOIN_WORDS;
+    }
+
+    char* sendflags = (char*) MFU_MALLOC((size_t)total + 1);
+    MPI_Alltoallv(
+        recvflags, recvcounts, recvdispls, MPI_CHAR,
+        sendflags, sendcounts, senddispls, MPI_CHAR,
+        MPI_COMM_WORLD
+    );
+    mfu_free(&recvflags);
+
+    /* keep only items that still need work */
+    uint64_t dropped = 0;
+    k = 0;
+    for (side = 0; side < 2; side++) {
+        mfu_flist filtered = mfu_flist_subset(lists[side]);
+        uint64_t idx;
+        for (idx = 0; idx < sizes[side]; idx++) {
+            if (sendflags[item_pos[k]]) {
+                dropped++;
+            } else {
+                mfu_flist_file_copy(lists[side], idx, filtered);
+            }
+            k++;
+        }
+        mfu_flist_summarize(filtered);
+        mfu_flist_free(&lists[side]);
+        lists[side] = filtered;
+    }
+
+    /* report number of pairs we skipped */
+    uint64_t all_dropped;
+    MPI_Allreduce(&dropped, &all_dropped, 1, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+        MFU_LOG(MFU_LOG_INFO, "Skipped %llu unchanged items", (unsigned long long)(all_dropped / 2));
+    }
+
+    mfu_free(&sendflags);
+    mfu_free(&item_pos);
+    mfu_free(&cursor);
+    mfu_free(&recvdispls);
+    mfu_free(&recvcounts);
+    mfu_free(&senddispls);
+    mfu_free(&sendcounts);
+
+    *psrc = lists[0];
+    *pdst = lists[1];
+}
+
+/* returns true if the sync manifest file exists, checked by rank 0 */
+static bool dsync_manifest_exists(const char* file)
+{
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    int exists = 0;
+    if (rank == 0) {
+        exists = (access(file, R_OK) == 0);
+    }
+    MPI_Bcast(&exists, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+    return (exists != 0);
+}
+
+/* returns true if every item of a manifest list falls under the
+ * destination path, so that it was recorded for this target */
+static bool dsync_manifest_check(mfu_flist flist, const char* path_dst)
+{
+    size_t len = strlen(path_dst);
+    int valid = 1;
+
+    uint64_t idx;
+    uint64_t size = mfu_flist_size(flist);
+    for (idx = 0; idx < size; idx++) {
+        const char* name = mfu_flist_file_get_name(flist, idx);
+        if (strncmp(name, path_dst, len) != 0 ||
+            (name[len] != '\0' && name[len] != '/' && path_dst[len - 1] != '/'))
+        {
+            valid = 0;
+            break;
+        }
+    }
+
+    int all_valid;
+    MPI_Allreduce(&valid, &all_valid, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+
+    return (all_valid != 0);
+}
+
+/* Create a copy of a list with the path_src prefix of each item
+ * replaced by path_dst.  Applied to the walked source list, this gives
+ * the list we expect to find in the destination after a successful
+ * sync, it is used the other way to get the source state from a
+ * manifest, and to map changed source paths to the destination */
+static mfu_flist dsync_flist_rebase(
+    mfu_flist src_list,
+    const char* path_src,
+    const char* path_dst)
+{
+    size_t prefix_len = strlen(path_src);
+
+    mfu_flist rebased = mfu_flist_subset(src_list);
+
+    uint64_t idx;
+    uint64_t size = mfu_flist_size(src_list);
+    for (idx = 0; idx < size; idx++) {
+        /* build destination name from portion following prefix */
+        const char* name = mfu_flist_file_get_name(src_list, idx);
+        mfu_path* dst_path = mfu_path_from_str(path_dst);
+        mfu_path_append_str(dst_path, name + prefix_len);
+        mfu_path_reduce(dst_path);
+        char* dst_name = mfu_path_strdup(dst_path);
+        mfu_path_delete(&dst_path);
+
+        /* copy item and rename it */
+        mfu_flist_file_copy(src_list, idx, rebased);
+        uint64_t rebased_idx = mfu_flist_size(rebased) - 1;
+        mfu_flist_file_set_name(rebased, rebased_idx, dst_name);
+
+        mfu_free(&dst_name);
+    }
+
+    mfu_flist_summarize(rebased);
+
+    return rebased;
+}
+
+/* qsort comparison for an array of strings */
+static int dsync_strcmp_ptr(const void* a, const void* b)
+{
+    return strcmp(*(const char* const*) a, *(const char* const*) b);
+}
+
+/* returns true if path is prefix or lies below it */
+static bool dsync_path_under(const char* path, const char* prefix)
+{
+    size_t len = strlen(prefix);
+    if (strncmp(path, prefix, len) != 0) {
+        return false;
+    }
+    return (path[len] == '\0' || path[len] == '/' || (len > 0 && prefix[len - 1] == '/'));
+}
+
+/* add a changed path to list if it lies within the source */
+static void dsync_changelog_add(mfu_flist list, const char* path, const char* prefix)
+{
+    char* name = mfu_path_strdup_reduce_str(path);
+    if (dsync_path_under(name, prefix)) {
+        uint64_t idx = mfu_flist_file_create(list);
+        mfu_flist_file_set_name(list, idx, name);
+    }
+    mfu_free(&name);
+}
+
+/* add an entry named in a directory, along with the directory
+ * itself, since adding or removing an entry changes its mtime */
+static void dsync_changelog_add_entry(
+    mfu_flist list,
+    const char* dir,
+    const char* entry,
+    const char* prefix)
+{
+    mfu_path* path = mfu_path_from_str(dir);
+    mfu_path_append_str(path, entry);
+    char* name = mfu_path_strdup(path);
+    mfu_path_delete(&path);
+
+    dsync_changelog_add(list, name, prefix);
+    dsync_changelog_add(list, dir, prefix);
+
+    mfu_free(&name);
+}
+
+#if defined(HAVE_LLAPI_FID2PATH)
+/* find root of the Lustre file system holding path, which is the
+ * topmost directory on the same device */
+static char* dsync_changelog_mount(const char* path)
+{
+    char* root = mfu_path_strdup_abs_reduce_str(path);
+
+    struct stat st;
+    if (lstat(root, &st) != 0) {
+        return root;
+    }
+    dev_t dev = st.st_dev;
+
+    while (strcmp(root, "/") != 0) {
+        char* parent = MFU_STRDUP(root);
+        char* slash = strrchr(parent, '/');
+        if (slash == parent) {
+            parent[1] = '\0';
+        } else {
+            *slash = '\0';
+        }
+
+        if (lstat(parent, &st) != 0 || st.st_dev != dev) {
+            mfu_free(&parent);
+            break;
+        }
+
+        mfu_free(&root);
+        root = parent;
+    }
+
+    return root;
+}
+
+/* get full path of a Lustre FID given as a string,
+ * returns NULL if FID no longer has a path */
+static char* dsync_changelog_fid2path(const char* mount, const char* fid)
+{
+    char relpath[PATH_MAX];
+    long long recno = -1;
+    int linkno = 0;
+    int rc = llapi_fid2path(mount, fid, relpath, sizeof(relpath), &recno, &linkno);
+    if (rc != 0) {
+        return NULL;
+    }
+
+    mfu_path* path = mfu_path_from_str(mount);
+    mfu_path_append_str(path, relpath);
+    char* name = mfu_path_strdup(path);
+    mfu_path_delete(&path);
+    return name;
+}
+#endif /* HAVE_LLAPI_FID2PATH */
+
+/* copy FID string of the form [seq:oid:ver] that follows key in
+ * line into fid, returns pointer to the character after the FID
+ * or NULL if key is not found */
+static const char* dsync_changelog_fid(const char* line, const char* key, char* fid, size_t len)
+{
+    const char* start = strstr(line, key);
+    if (start == NULL) {
+        return NULL;
+    }
+    start += strlen(key);
+
+    const char* end = strchr(start, ']');
+    if (*start != '[' || end == NULL || (size_t)(end - start + 2) > len) {
+        return NULL;
+    }
+
+    size_t chars = (size_t)(end - start + 1);
+    strncpy(fid, start, chars);
+    fid[chars] = '\0';
+    return end + 1;
+}
+
+/* returns true if line looks like a record printed by lfs changelog,
+ * which starts with a record number and a numbered record type */
+static bool dsync_changelog_is_record(const char* line)
+{
+    const char* ptr = line;
+    if (! isdigit((unsigned char)*ptr)) {
+        return false;
+    }
+    while (isdigit((unsigned char)*ptr)) {
+        ptr++;
+    }
+    return (ptr[0] == ' ' &&
+            isdigit((unsigned char)ptr[1]) &&
+            isdigit((unsigned char)ptr[2]) &&
+            isupper((unsigned char)ptr[3]));
+}
+
+/* Parse one line of changelog input and add the paths it changed
+ * to list.  A line is either a record in the format printed by
+ * lfs changelog, or a path that is absolute or relative to the
+ * source.  Returns 0 on success, -1 if the line can't be resolved. */
+static int dsync_changelog_parse(
+    char* line,
+    mfu_flist list,
+    const char* prefix,
+    const char* mount)
+{
+    /* chop trailing newline */
+    size_t len = strlen(line);
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+        line[len - 1] = '\0';
+        len--;
+    }
+
+    /* skip blank lines */
+    if (len == 0) {
+        return 0;
+    }
+
+    /* a plain path */
+    if (! dsync_changelog_is_record(line)) {
+        if (line[0] == '/') {
+            dsync_changelog_add(list, line, prefix);
+        } else {
+            dsync_changelog_add_entry(list, prefix, line, prefix);
+        }
+        return 0;
+    }
+
+#if defined(HAVE_LLAPI_FID2PATH)
+    int rc = 0;
+    char fid[64];
+
+    /* the source name of a rename follows the parent FID in sp= */
+    char* sname = NULL;
+    char* stail = strstr(line, " s=[");
+    if (stail != NULL) {
+        const char* ptr = dsync_changelog_fid(stail, " sp=", fid, sizeof(fid));
+        if (ptr != NULL && *ptr == ' ') {
+            sname = MFU_STRDUP(ptr + 1);
+            char* dir = dsync_changelog_fid2path(mount, fid);
+            if (dir != NULL) {
+                dsync_changelog_add_entry(list, dir, sname, prefix);
+                mfu_free(&dir);
+            } else {
+                rc = -1;
+            }
+            mfu_free(&sname);
+        }
+
+        /* terminate line before rename fields so they don't
+         * become part of the target name */
+        *stail = '\0';
+    }
+
+    /* namespace operations name the entry under its parent, this
+     * works even if the target itself has been removed */
+    const char* ptr = dsync_changelog_fid(line, " p=", fid, sizeof(fid));
+    if (ptr != NULL && *ptr == ' ') {
+        char* dir = dsync_changelog_fid2path(mount, fid);
+        if (dir != NULL) {
+            dsync_changelog_add_entry(list, dir, ptr + 1, prefix);
+            mfu_free(&dir);
+        } else {
+            rc = -1;
+        }
+        return rc;
+    }
+
+    /* other operations only carry the target */
+    if (dsync_changelog_fid(line, " t=", fid, sizeof(fid)) != NULL) {
+        char* name = dsync_changelog_fid2path(mount, fid);
+        if (name != NULL) {
+            dsync_changelog_add(list, name, prefix);
+            mfu_free(&name);
+        } else {
+            /* target was removed since, which a later
+             * record in the changelog will report */
+            MFU_LOG(MFU_LOG_DBG, "Skipping changelog record for missing %s", fid);
+        }
+        return rc;
+    }
+
+    return -1;
+#else
+    MFU_LOG(MFU_LOG_ERR, "Lustre support is required to resolve changelog records");
+    return -1;
+#endif
+}
+
+#if defined(HAVE_LLAPI_CHANGELOG) && defined(HAVE_LLAPI_FID2PATH)
+/* read records directly from a Lustre MDT changelog and add
+ * paths they changed to list, sets last_rec to the index of the
+ * last record read, returns 0 on success */
+static int dsync_changelog_read_mdt(
+    const char* mdt,
+    mfu_flist list,
+    const char* prefix,
+    const char* mount,
+    uint64_t* last_rec)
+{
+    int rc = 0;
+
+    void* ctx;
+    int tmp_rc = llapi_changelog_start(&ctx, CHANGELOG_FLAG_JOBID, mdt, 0);
+    if (tmp_rc < 0) {
+        MFU_LOG(MFU_LOG_ERR, "Failed to open changelog of `%s' (errno=%d %s)",
+                mdt, -tmp_rc, strerror(-tmp_rc));
+        return -1;
+    }
+
+    struct changelog_rec* rec;
+    while ((tmp_rc = llapi_changelog_recv(ctx, &rec)) == 0) {
+        char fid[64];
+
+        /* source name of a rename */
+        if (rec->cr_flags & CLF_RENAME) {
+            struct changelog_ext_rename* rnm = changelog_rec_rename(rec);
+            if (rnm->cr_spfid.f_seq != 0) {
+                snprintf(fid, sizeof(fid), DFID, PFID(&rnm->cr_spfid));
+                char* dir = dsync_changelog_fid2path(mount, fid);
+                if (dir != NULL) {
+                    char* sname = (char*) MFU_MALLOC(changelog_rec_snamelen(rec) + 1);
+                    strncpy(sname, changelog_rec_sname(rec), changelog_rec_snamelen(rec));
+                    sname[changelog_rec_snamelen(rec)] = '\0';
+                    dsync_changelog_add_entry(list, dir, sname, prefix);
+                    mfu_free(&sname);
+                    mfu_free(&dir);
+                } else {
+                    rc = -1;
+                }
+            }
+        }
+
+        if (rec->cr_namelen > 0) {
+            /* entry named under its parent */
+            snprintf(fid, sizeof(fid), DFID, PFID(&rec->cr_pfid));
+            char* dir = dsync_changelog_fid2path(mount, fid);
+            if (dir != NULL) {
+                char* name = (char*) MFU_MALLOC(rec->cr_namelen + 1);
+                strncpy(name, changelog_rec_name(rec), rec->cr_namelen);
+                name[rec->cr_namelen] = '\0';
+                dsync_changelog_add_entry(list, dir, name, prefix);
+                mfu_free(&name);
+                mfu_free(&dir);
+            } else {
+                rc = -1;
+            }
+        } else {
+            /* only the target */
+            snprintf(fid, sizeof(fid), DFID, PFID(&rec->cr_tfid));
+            char* name = dsync_changelog_fid2path(mount, fid);
+            if (name != NULL) {
+                dsync_changelog_add(list, name, prefix);
+                mfu_free(&name);
+            }
+        }
+
+        *last_rec = (uint64_t) rec->cr_index;
+        llapi_changelog_free(&rec);
+    }
+
+    if (tmp_rc < 0) {
+        MFU_LOG(MFU_LOG_ERR, "Failed to read changelog of `%s' (errno=%d %s)",
+                mdt, -tmp_rc, strerror(-tmp_rc));
+        rc = -1;
+    }
+
+    llapi_changelog_fini(&ctx);
+
+    return rc;
+}
+#endif
+
+/* split mdt:MDT[:USER] into newly allocated MDT and USER strings,
+ * user is set to NULL if not given */
+static void dsync_changelog_mdt_user(const char* changelog, char** mdt, char** user)
+{
+    *mdt  = MFU_STRDUP(changelog + 4);
+    *user = NULL;
+
+    char* sep = strchr(*mdt, ':');
+    if (sep != NULL) {
+        *sep = '\0';
+        if (*(sep + 1) != '\0') {
+            *user = MFU_STRDUP(sep + 1);
+        }
+    }
+}
+
+/* read changelog input and return list of changed source paths,
+ * each path appears once across all ranks, when reading from an MDT
+ * rank 0 sets last_rec to the index of the last record it read,
+ * returns 0 on success */
+static int dsync_changelog_read(
+    const char* changelog,
+    const char* prefix,
+    mfu_flist* out_list,
+    uint64_t* last_rec)
+{
+    int rc = 0;
+
+    int rank, ranks;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+
+    const char* mount = NULL;
+#if defined(HAVE_LLAPI_FID2PATH)
+    char* mount_str = dsync_changelog_mount(prefix);
+    mount = mount_str;
+#endif
+
+    mfu_flist list = mfu_flist_new();
+
+    if (strncmp(changelog, "mdt:", 4) == 0) {
+        /* read records from the MDT on rank 0,
+         * remap below spreads them out */
+#if defined(HAVE_LLAPI_CHANGELOG) && defined(HAVE_LLAPI_FID2PATH)
+        if (rank == 0) {
+            char* mdt;
+            char* user;
+            dsync_changelog_mdt_user(changelog, &mdt, &user);
+            rc = dsync_changelog_read_mdt(mdt, list, prefix, mount, last_rec);
+            mfu_free(&user);
+            mfu_free(&mdt);
+        }
+#else
+        if (rank == 0) {
+            MFU_LOG(MFU_LOG_ERR, "Lustre support is required to read changelog `%s'", changelog);
+        }
+        rc = -1;
+#endif
+    } else {
+        /* each rank reads the file and parses its share of lines */
+        FILE* fp = fopen(changelog, "r");
+        if (fp != NULL) {
+            char line[PATH_MAX * 2 + 256];
+            uint64_t count = 0;
+            while (fgets(line, sizeof(line), fp) != NULL) {
+                if (count % (uint64_t)ranks == (uint64_t)rank) {
+                    if (dsync_changelog_parse(line, list, prefix, mount) != 0) {
+                        MFU_LOG(MFU_LOG_ERR, "Failed to resolve changelog line %llu of `%s'",
+                                (unsigned long long)count + 1, changelog);
+                        rc = -1;
+                    }
+                }
+                count++;
+            }
+            fclose(fp);
+        } else {
+            MFU_LOG(MFU_LOG_ERR, "Failed to open changelog `%s' (errno=%d %s)",
+                    changelog, errno, strerror(errno));
+            rc = -1;
+        }
+    }
+
+#if defined(HAVE_LLAPI_FID2PATH)
+    mfu_free(&mount_str);
+#endif
+
+    mfu_flist_summarize(list);
+
+    /* send each path to the rank owning its hash, so duplicates
+     * land on the same rank, then drop them */
+    mfu_flist remapped = mfu_flist_remap(list, (mfu_flist_map_fn)dsync_map_fn, (const void*)"");
+    mfu_flist_free(&list);
+
+    uint64_t size = mfu_flist_size(remapped);
+    const char** names = (const char**) MFU_MALLOC((size + 1) * sizeof(char*));
+    uint64_t idx;
+    for (idx = 0; idx < size; idx++) {
+        names[idx] = mfu_flist_file_get_name(remapped, idx);
+    }
+    qsort(names, (size_t)size, sizeof(char*), dsync_strcmp_ptr);
+
+    list = mfu_flist_subset(remapped);
+    for (idx = 0; idx < size; idx++) {
+        if (idx > 0 && strcmp(names[idx], names[idx - 1]) == 0) {
+            continue;
+        }
+        uint64_t new_idx = mfu_flist_file_create(list);
+        mfu_flist_file_set_name(list, new_idx, names[idx]);
+    }
+    mfu_flist_summarize(list);
+
+    mfu_free(&names);
+    mfu_flist_free(&remapped);
+
+    int all_rc;
+    MPI_Allreduce(&rc, &all_rc, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+
+    *out_list = list;
+    return all_rc;
+}
+
+/* once a sync completes without errors, clear the records it read
+ * from an MDT changelog on behalf of the changelog user given in
+ * mdt:MDT:USER, so the next run starts after them, returns 0 on success */
+static int dsync_changelog_clear(const char* changelog, uint64_t last_rec)
+{
+    int rc = 0;
+
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    /* nothing to clear for changelog files or if we read no records */
+    if (strncmp(changelog, "mdt:", 4) != 0 || last_rec == 0) {
+        return rc;
+    }
+
+    if (rank == 0) {
+        char* mdt;
+        char* user;
+        dsync_changelog_mdt_user(changelog, &mdt, &user);
+        if (user != NULL) {
+#if defined(HAVE_LLAPI_CHANGELOG)
+            MFU_LOG(MFU_LOG_INFO, "Clearing changelog records of `%s' through %llu for user `%s'",
+                    mdt, (unsigned long long)last_rec, user);
+            int tmp_rc = llapi_changelog_clear(mdt, user, (long long)last_rec);
+            if (tmp_rc < 0) {
+                MFU_LOG(MFU_LOG_ERR, "Failed to clear changelog of `%s' for user `%s' (errno=%d %s)",
+                        mdt, user, -tmp_rc, strerror(-tmp_rc));
+                rc = -1;
+            }
+#endif
+        }
+        mfu_free(&user);
+        mfu_free(&mdt);
+    }
+
+    MPI_Bcast(&rc, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    return rc;
+}
+
+/* skip function for mfu_flist_stat to ignore paths that
+ * have since been removed */
+static int dsync_changelog_skip_missing(const char* path, void* args)
+{
+    mfu_file_t* mfu_file = (mfu_file_t*) args;
+    struct stat st;
+    return (mfu_file_lstat(path, &st, mfu_file) != 0);
+}
+
+/* Given a list of changed items stat'ed in one tree, find directories
+ * that are not directories in the other tree, because they were
+ * created, removed, or moved.  Walk those directories in this tree so
+ * their entire contents get copied or deleted, and replace the
+ * entries that lie within them with the walked items.  Returns 0
+ * on success. */
+static int dsync_changelog_expand(
+    mfu_flist* plist,
+    const char* path_self,
+    const char* path_other,
+    mfu_walk_opts_t* walk_opts,
+    mfu_file_t* mfu_self_file,
+    mfu_file_t* mfu_other_file)
+{
+    int rc = 0;
+
+    int ranks;
+    MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+
+    mfu_flist list = *plist;
+
+    /* find directories whose counterpart is not a directory */
+    mfu_flist dirs = mfu_flist_subset(list);
+    uint64_t idx;
+    uint64_t size = mfu_flist_size(list);
+    for (idx = 0; idx < size; idx++) {
+        if (mfu_flist_file_get_type(list, idx) == MFU_TYPE_DIR) {
+            mfu_flist_file_copy(list, idx, dirs);
+        }
+    }
+    mfu_flist_summarize(dirs);
+
+    mfu_flist dirs_other = dsync_flist_rebase(dirs, path_self, path_other);
+    uint64_t bytes = 0;
+    size = mfu_flist_size(dirs);
+    int* is_root = (int*) MFU_MALLOC((size + 1) * sizeof(int));
+    for (idx = 0; idx < size; idx++) {
+        struct stat st;
+        const char* name = mfu_flist_file_get_name(dirs_other, idx);
+        is_root[idx] = (mfu_file_lstat(name, &st, mfu_other_file) != 0 || !S_ISDIR(st.st_mode));
+        if (is_root[idx]) {
+            bytes += strlen(mfu_flist_file_get_name(dirs, idx)) + 1;
+        }
+    }
+    mfu_flist_free(&dirs_other);
+
+    /* gather names of those directories on all ranks */
+    char* sendbuf = (char*) MFU_MALLOC(bytes + 1);
+    char* ptr = sendbuf;
+    for (idx = 0; idx < size; idx++) {
+        if (is_root[idx]) {
+            const char* name = mfu_flist_file_get_name(dirs, idx);
+            strcpy(ptr, name);
+            ptr += strlen(name) + 1;
+        }
+    }
+    mfu_free(&is_root);
+    mfu_flist_free(&dirs);
+
+    int* counts = (int*) MFU_MALLOC(ranks * sizeof(int));
+    int* displs = (int*) MFU_MALLOC(ranks * sizeof(int));
+    int mybytes = (int) bytes;
+    MPI_Allgather(&mybytes, 1, MPI_INT, counts, 1, MPI_INT, MPI_COMM_WORLD);
+    int total = 0;
+    int i;
+    for (i = 0; i < ranks; i++) {
+        displs[i] = total;
+        total += counts[i];
+    }
+    char* recvbuf = (char*) MFU_MALLOC((size_t)total + 1);
+    MPI_Allgatherv(sendbuf, mybytes, MPI_CHAR, recvbuf, counts, displs, MPI_CHAR, MPI_COMM_WORLD);
+    mfu_free(&displs);
+    mfu_free(&counts);
+    mfu_free(&sendbuf);
+
+    /* keep only the topmost directories */
+    uint64_t num_roots = 0;
+    const char** roots = (const char**) MFU_MALLOC(((size_t)total + 1) * sizeof(char*));
+    for (ptr = recvbuf; ptr < recvbuf + total; ptr += strlen(ptr) + 1) {
+        roots[num_roots] = ptr;
+        num_roots++;
+    }
+    qsort(roots, (size_t)num_roots, sizeof(char*), dsync_strcmp_ptr);
+
+    uint64_t num_top = 0;
+    uint64_t j;
+    for (j = 0; j < num_roots; j++) {
+        if (num_top > 0 && dsync_path_under(roots[j], roots[num_top - 1])) {
+            continue;
+        }
+        roots[num_top] = roots[j];
+        num_top++;
+    }
+
+    if (num_top > 0) {
+        /* keep items that are not inside a directory we walk */
+        mfu_flist expanded = mfu_flist_subset(list);
+        size = mfu_flist_size(list);
+        for (idx = 0; idx < size; idx++) {
+            const char* name = mfu_flist_file_get_name(list, idx);
+            bool walked = false;
+            for (j = 0; j < num_top; j++) {
+                if (dsync_path_under(name, roots[j])) {
+                    walked = true;
+                    break;
+                }
+            }
+            if (! walked) {
+                mfu_flist_file_copy(list, idx, expanded);
+            }
+        }
+
+        /* walk directories, adding all of their contents */
+        mfu_flist walked = mfu_flist_new();
+        int walk_rc = mfu_flist_walk_paths(num_top, roots, walk_opts, walked, mfu_self_file);
+        if (walk_rc != 0) {
+            rc = -1;
+        }
+
+        size = mfu_flist_size(walked);
+        for (idx = 0; idx < size; idx++) {
+            mfu_flist_file_copy(walked, idx, expanded);
+        }
+        mfu_flist_free(&walked);
+
+        mfu_flist_summarize(expanded);
+        mfu_flist_free(plist);
+        *plist = expanded;
+    }
+
+    mfu_free(&roots);
+    mfu_free(&recvbuf);
+
+    return rc;
+}
+
+/* Builds source and destination lists from changelog input rather than
+ * by walking both trees.  Changed paths are stat'ed in the source and
+ * the destination, and directories that appear in only one of them
+ * are walked to pick up their contents.  Replaces the given empty
+ * lists with the source and destination lists.  Returns 0 on success. */
+static int dsync_changelog_lists(
+    const char* changelog,
+    const mfu_param_path* srcpath,
+    const mfu_param_path* destpath,
+    mfu_walk_opts_t* walk_opts,
+    mfu_flist* pflist_src,
+    mfu_flist* pflist_dst,
+    mfu_file_t* mfu_src_file,
+    mfu_file_t* mfu_dst_file,
+    uint64_t* last_rec)
+{
+    const char* path_src = srcpath->path;
+    const char* path_dst = destpath->path;
+
+    /* get list of changed paths in source */
+    mfu_flist changed;
+    int rc = dsync_changelog_read(changelog, path_src, &changed, last_rec);
+
+    /* stat items that still exist in the source */
+    mfu_flist_stat(changed, *pflist_src, dsync_changelog_skip_missing, (void*)mfu_src_file,
+                   walk_opts->dereference, mfu_src_file);
+
+    /* stat items that exist in the destination */
+    mfu_flist changed_dst = dsync_flist_rebase(changed, path_src, path_dst);
+    mfu_flist_stat(changed_dst, *pflist_dst, dsync_changelog_skip_missing, (void*)mfu_dst_file,
+                   0, mfu_dst_file);
+    mfu_flist_free(&changed_dst);
+    mfu_flist_free(&changed);
+
+    /* pick up contents of directories that are new in the source */
+    if (dsync_changelog_expand(pflist_src, path_src, path_dst, walk_opts,
+                               mfu_src_file, mfu_dst_file) != 0)
+    {
+        rc = -1;
+    }
+
+    /* pick up contents of directories that are gone from the source,
+     * we never dereference the destination */
+    int tmp_dereference = walk_opts->dereference;
+    walk_opts->dereference = 0;
+    if (dsync_changelog_expand(pflist_dst, path_dst, path_src, walk_opts,
+                               mfu_dst_file, mfu_src_file) != 0)
+    {
+        rc = -1;
+    }
+    walk_opts->dereference = tmp_dereference;
+
+    int all_rc;
+    MPI_Allreduce(&rc, &all_rc, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+    return all_rc;
+}
+
 static struct dsync_expression* dsync_expression_alloc(void)
 {
     struct dsync_expression *expression;
@@ -2274,7 +3446,7 @@ static void dsync_expression_print(
 
 static int dsync_expression_match(
     struct dsync_expression *expression,
-    strmap* map,
+    mfu_pathmap* map,
     const char* key)
 {
     int ret;
@@ -2402,7 +3574,7 @@ static void dsync_conjunction_print(
 /* if matched return 1, else return 0 */
 static int dsync_conjunction_match(
     struct dsync_conjunction *conjunction,
-    strmap* map,
+    mfu_pathmap* map,
     const char* key)
 {
     struct dsync_expression* expression;
@@ -2493,7 +3665,7 @@ static void dsync_disjunction_print(
 /* if matched return 1, else return 0 */
 static int dsync_disjunction_match(
     struct dsync_disjunction* disjunction,
-    strmap* map,
+    mfu_pathmap* map,
     const char* key,
     int is_src)
 {
@@ -2561,6 +3733,8 @@ static void dsync_option_fini(void)
     assert(list_empty(&options.outputs));
 
     mfu_free(&options.link_dest);
+    mfu_free(&options.manifest);
+    mfu_free(&options.changelog);
 }
 
 static void dsync_option_add_output(struct dsync_output *output, int add_at_head)
@@ -2586,19 +3760,20 @@ static void dsync_option_add_comparison(dsync_field field)
 
 static int dsync_output_flist_match(
     struct dsync_output *output,
-    strmap* map,
+    mfu_pathmap* map,
     mfu_flist flist,
     mfu_flist new_flist,
     mfu_flist *matched_flist,
     int is_src)
 {
-    const strmap_node* node;
     struct dsync_conjunction *conjunction;
 
     /* iterate over each item in map */
-    strmap_foreach(map, node) {
+    uint64_t map_idx;
+    uint64_t map_size = mfu_pathmap_size(map);
+    for (map_idx = 0; map_idx < map_size; map_idx++) {
         /* get file name */
-        const char* key = strmap_node_key(node);
+        const char* key = mfu_pathmap_key(map, map_idx);
 
         /* get index of file */
         uint64_t idx;
@@ -2629,9 +3804,9 @@ static int dsync_output_flist_match(
 static int dsync_output_write(
     struct dsync_output *output,
     mfu_flist src_flist,
-    strmap* src_map,
+    mfu_pathmap* src_map,
     mfu_flist dst_flist,
-    strmap* dst_map)
+    mfu_pathmap* dst_map)
 {
     int ret = 0;
     mfu_flist new_flist = mfu_flist_subset(src_flist);
@@ -2682,9 +3857,9 @@ static int dsync_output_write(
 
 static int dsync_outputs_write(
     mfu_flist src_list,
-    strmap* src_map,
+    mfu_pathmap* src_map,
     mfu_flist dst_list,
-    strmap* dst_map)
+    mfu_pathmap* dst_map)
 {
     struct dsync_output* output;
     int ret = 0;
@@ -3082,9 +4257,15 @@ int main(int argc, char **argv)
         {"no-dereference", 0, 0, 'P'},
         {"direct",         0, 0, 's'},
         {"open-noatime",   0, 0, 'U'},
+        {"dynamic",        0, 0, 'Y'},
+        {"full-join",      0, 0, 'F'},
+        {"adaptive",       0, 0, 'a'},
         {"output",         1, 0, 'o'}, // undocumented
         {"debug",          0, 0, 'd'}, // undocumented
         {"link-dest",      1, 0, 'l'},
+        {"manifest",       1, 0, 'M'},
+        {"changelog",      1, 0, 'C'},
+        {"delta",          0, 0, 'T'},
         {"sparse",         0, 0, 'S'},
         {"progress",       1, 0, 'R'},
         {"verbose",        0, 0, 'v'},
@@ -3165,6 +4346,9 @@ int main(int argc, char **argv)
         case 'D':
             options.delete = 1;
             break;
+        case 'F':
+            options.prefilter = 0;
+            break;
         case 'L':
             /* turn on dereference.
              * turn off no_dereference */
@@ -3191,9 +4375,30 @@ int main(int argc, char **argv)
                 MFU_LOG(MFU_LOG_INFO, "Using O_NOATIME");
             }
             break;
+        case 'a':
+            copy_opts->adaptive = true;
+            if(rank == 0) {
+                MFU_LOG(MFU_LOG_INFO, "Using adaptive chunk size");
+            }
+            break;
+        case 'Y':
+            copy_opts->dynamic = true;
+            if(rank == 0) {
+                MFU_LOG(MFU_LOG_INFO, "Using dynamic chunk scheduling");
+            }
+            break;
         case 'l':
             options.link_dest = MFU_STRDUP(optarg);
             break;
+        case 'M':
+            options.manifest = MFU_STRDUP(optarg);
+            break;
+        case 'C':
+            options.changelog = MFU_STRDUP(optarg);
+            break;
+        case 'T':
+            options.delta = 1;
+            break;
         case 'o':
             if (dsync_option_output_parse(optarg, 0)) {
                 usage = 1;
@@ -3238,6 +4443,15 @@ int main(int argc, char **argv)
         usage = 1;
     }
     
+    /* a manifest must describe the whole tree, which we
+     * don't see when syncing changes from a changelog */
+    if (options.changelog != NULL && options.manifest != NULL) {
+        if (rank == 0) {
+            MFU_LOG(MFU_LOG_ERR, "Cannot use --changelog with --manifest");
+        }
+        usage = 1;
+    }
+
     /* we should have two arguments left, source and dest paths */
     int numargs = argc - optind;
 
@@ -3365,11 +4579,59 @@ int main(int argc, char **argv)
         }
     }
 
-    /* walk source path */
-    if (rank == 0) {
-        MFU_LOG(MFU_LOG_INFO, "Walking source path");
+    bool dst_from_manifest = false;
+    if (options.manifest != NULL && dsync_manifest_exists(options.manifest)) {
+        /* read destination state recorded by a previous sync */
+        if (rank == 0) {
+            MFU_LOG(MFU_LOG_INFO, "Reading destination state from manifest `%s'", options.manifest);
+        }
+        mfu_flist_read_cache(options.manifest, flist_tmp_dst);
+
+        /* ignore the manifest if it was written for another target */
+        if (dsync_manifest_check(flist_tmp_dst, destpath->path)) {
+            dst_from_manifest = true;
+        } else {
+            if (rank == 0) {
+                MFU_LOG(MFU_LOG_WARN, "Manifest `%s' does not match destination, walking destination path",
+                        options.manifest);
+            }
+            mfu_flist_free(&flist_tmp_dst);
+            flist_tmp_dst = mfu_flist_new();
+        }
+    }
+
+    /* index of the last MDT changelog record read, set on rank 0 */
+    uint64_t changelog_last = 0;
+
+    /* get source list from a changelog, or walk the source path, if
+     * we have a manifest it also records the state of the source from
+     * the last sync, so we can skip reading source directories that
+     * have not changed since then */
+    if (options.changelog != NULL) {
+        /* only consider paths named in the changelog */
+        if (rank == 0) {
+            MFU_LOG(MFU_LOG_INFO, "Reading changes from `%s'", options.changelog);
+        }
+        walk_rc = dsync_changelog_lists(options.changelog, srcpath, destpath, walk_opts,
+                                        &flist_tmp_src, &flist_tmp_dst, mfu_src_file, mfu_dst_file,
+                                        &changelog_last);
+        if (walk_rc != 0) {
+            rc = 1;
+        }
+    } else if (dst_from_manifest) {
+        if (rank == 0) {
+            MFU_LOG(MFU_LOG_INFO, "Walking source path");
+        }
+        mfu_flist prev_src = dsync_flist_rebase(flist_tmp_dst, destpath->path, srcpath->path);
+        walk_rc = mfu_flist_walk_param_paths_incremental(1, srcpath, walk_opts, prev_src,
+                                                         flist_tmp_src, mfu_src_file);
+        mfu_flist_free(&prev_src);
+    } else {
+        if (rank == 0) {
+            MFU_LOG(MFU_LOG_INFO, "Walking source path");
+        }
+        walk_rc = mfu_flist_walk_param_paths(1, srcpath, walk_opts, flist_tmp_src, mfu_src_file);
     }
-    walk_rc = mfu_flist_walk_param_paths(1, srcpath, walk_opts, flist_tmp_src, mfu_src_file);
 
     /* If we encountered an error during the srcpath walk, the src flist is likely incomplete,
      * and a delete might delete files already on the destination.  Disable the delete and
@@ -3386,8 +4648,9 @@ int main(int argc, char **argv)
     }
 
     /* check that we actually got something so that we don't delete
-     * an entire target directory because of a typo on the source dir */
-    if (mfu_flist_global_size(flist_tmp_src) == 0) {
+     * an entire target directory because of a typo on the source dir,
+     * a changelog may well report no changes */
+    if (options.changelog == NULL && mfu_flist_global_size(flist_tmp_src) == 0) {
         if (rank == 0) {
             MFU_LOG(MFU_LOG_ERR, "ERROR: No items found at source: `%s'", srcpath->orig);
         }
@@ -3406,10 +4669,12 @@ int main(int argc, char **argv)
      * We never dereference the destination */
     int tmp_dereference = walk_opts->dereference;
     walk_opts->dereference = 0;
-    if (rank == 0) {
-        MFU_LOG(MFU_LOG_INFO, "Walking destination path");
+    if (!dst_from_manifest && options.changelog == NULL) {
+        if (rank == 0) {
+            MFU_LOG(MFU_LOG_INFO, "Walking destination path");
+        }
+        (void) mfu_flist_walk_param_paths(1, destpath, walk_opts, flist_tmp_dst, mfu_dst_file);
     }
-    (void) mfu_flist_walk_param_paths(1, destpath, walk_opts, flist_tmp_dst, mfu_dst_file);
 
     /* walk link-dest path if we have one */
     if (options.link_dest != NULL) {
@@ -3431,6 +4696,19 @@ int main(int argc, char **argv)
         path_link = linkpath->path;
     }
 
+    /* build the destination state we expect after this sync from
+     * the full source list, before any items are filtered out */
+    mfu_flist flist_manifest = MFU_FLIST_NULL;
+    if (options.manifest != NULL && !options.dry_run) {
+        flist_manifest = dsync_flist_rebase(flist_tmp_src, path_src, path_dst);
+    }
+
+    /* drop items that match in source and destination, so only
+     * items that need work are exchanged as full records */
+    if (dsync_join_prefilter_enabled()) {
+        dsync_join_prefilter(&flist_tmp_src, path_src, &flist_tmp_dst, path_dst);
+    }
+
     /* map files to ranks based on portion following prefix directory */
     mfu_flist flist_src = mfu_flist_remap(flist_tmp_src, (mfu_flist_map_fn)dsync_map_fn, (const void*)path_src);
     mfu_flist flist_dst = mfu_flist_remap(flist_tmp_dst, (mfu_flist_map_fn)dsync_map_fn, (const void*)path_dst);
@@ -3448,9 +4726,9 @@ int main(int argc, char **argv)
     }
 
     /* map each file name to its index and its comparison state */
-    strmap* map_src = dsync_strmap_creat(flist_src, path_src);
-    strmap* map_dst = dsync_strmap_creat(flist_dst, path_dst);
-    strmap* map_link = NULL;
+    mfu_pathmap* map_src = dsync_strmap_creat(flist_src, path_src);
+    mfu_pathmap* map_dst = dsync_strmap_creat(flist_dst, path_dst);
+    mfu_pathmap* map_link = NULL;
     if (options.link_dest != NULL) {
         map_link = dsync_strmap_creat(flist_link, path_link);
     }
@@ -3462,11 +4740,34 @@ int main(int argc, char **argv)
         rc = 1;
     }
 
+    /* record destination state for the next run, or drop the
+     * manifest if this run did not complete cleanly */
+    if (options.manifest != NULL && !options.dry_run) {
+        if (rc == 0 && all_rc == 0) {
+            if (rank == 0) {
+                MFU_LOG(MFU_LOG_INFO, "Writing manifest `%s'", options.manifest);
+            }
+            mfu_flist_write_cache(options.manifest, flist_manifest);
+        } else if (rank == 0) {
+            MFU_LOG(MFU_LOG_WARN, "Removing manifest `%s' after errors", options.manifest);
+            unlink(options.manifest);
+        }
+        mfu_flist_free(&flist_manifest);
+    }
+
+    /* drop changelog records this run consumed, we keep them
+     * if anything failed so the next run picks them up again */
+    if (options.changelog != NULL && !options.dry_run && rc == 0 && all_rc == 0) {
+        if (dsync_changelog_clear(options.changelog, changelog_last) != 0) {
+            rc = 1;
+        }
+    }
+
     /* free maps of file names to comparison state info */
-    strmap_delete(&map_src);
-    strmap_delete(&map_dst);
+    mfu_pathmap_delete(&map_src);
+    mfu_pathmap_delete(&map_dst);
     if (options.link_dest != NULL) {
-        strmap_delete(&map_link);
+        mfu_pathmap_delete(&map_link);
     }
 
     /* free file lists */
@@ -314,8 +314,16 @@ static void print_usage(void)
     printf("  -i, --input <file>      - read list from file\n");
     printf("  -o, --output <file>     - write processed list to file in binary format\n");
     printf("  -t, --text              - use with -o; write processed list to file in ascii format\n");
+    printf("      --compress          - use with -o; compress blocks of binary output file\n");
+    printf("      --shards <N>        - use with -o; write binary output as N shard files and an index\n");
+    printf("      --stripe            - use with --shards; stripe each shard over all Lustre OSTs\n");
+    printf("      --merge <file>      - use with -i; merge changed items from file into input list\n");
+    printf("      --removed <file>    - use with -i; drop paths listed one per line in text file from input list\n");
     printf("  -l, --lite              - walk file system without stat\n");
+    printf("      --incremental <file> - skip reading directories unchanged since walk in file\n");
     printf("  -s, --sort <fields>     - sort output by comma-delimited fields\n");
+    printf("      --sort-dir <dir>    - use with -s; sort in bounded memory, spilling to node-local dir\n");
+    printf("      --sort-mem <size>   - use with --sort-dir; memory per process for sort buffers (default 256MB)\n");
     printf("  -d, --distribution <field>:<separators> \n                          - print distribution by field\n");
     printf("  -f, --file_histogram    - print default size distribution of items\n");
     printf("  -p, --print             - print files to screen\n");
@@ -350,6 +358,9 @@ int main(int argc, char** argv)
     /* pointer to mfu_walk_opts */
     mfu_walk_opts_t* walk_opts = mfu_walk_opts_new();
 
+    /* options for writing output cache */
+    mfu_cache_opts_t* cache_opts = mfu_cache_opts_new();
+
 #ifdef DAOS_SUPPORT
     /* DAOS vars */
     daos_args_t* daos_args = daos_args_new();
@@ -367,8 +378,13 @@ int main(int argc, char** argv)
      *   - allow user to group output (sum all bytes, group by user) */
 
     char* inputname      = NULL;
+    char* prevname       = NULL;
+    char* mergename      = NULL;
+    char* removedname    = NULL;
     char* outputname     = NULL;
     char* sortfields     = NULL;
+    char* sortdir        = NULL;
+    size_t sortmem       = 256 * 1024 * 1024;
     char* distribution   = NULL;
 
     int file_histogram       = 0;
@@ -386,8 +402,16 @@ int main(int argc, char** argv)
         {"input",          1, 0, 'i'},
         {"output",         1, 0, 'o'},
         {"text",           0, 0, 't'},
+        {"compress",       0, 0, 'z'},
+        {"shards",         1, 0, 'S'},
+        {"stripe",         0, 0, 'T'},
+        {"merge",          1, 0, 'M'},
+        {"removed",        1, 0, 'D'},
         {"lite",           0, 0, 'l'},
+        {"incremental",    1, 0, 'I'},
         {"sort",           1, 0, 's'},
+        {"sort-dir",       1, 0, 'E'},
+        {"sort-mem",       1, 0, 'm'},
         {"distribution",   1, 0, 'd'},
         {"file_histogram", 0, 0, 'f'},
         {"print",          0, 0, 'p'},
@@ -422,9 +446,33 @@ int main(int argc, char** argv)
                 /* don't stat each file on the walk */
                 walk_opts->use_stat = 0;
                 break;
+            case 'I':
+                prevname = MFU_STRDUP(optarg);
+                break;
+            case 'M':
+                mergename = MFU_STRDUP(optarg);
+                break;
+            case 'D':
+                removedname = MFU_STRDUP(optarg);
+                break;
             case 's':
                 sortfields = MFU_STRDUP(optarg);
                 break;
+            case 'E':
+                sortdir = MFU_STRDUP(optarg);
+                break;
+            case 'm': {
+                unsigned long long bytes = 0;
+                if (mfu_abtoull(optarg, &bytes) != MFU_SUCCESS || bytes == 0) {
+                    if (rank == 0) {
+                        MFU_LOG(MFU_LOG_ERR, "Failed to parse sort memory size: '%s'", optarg);
+                    }
+                    usage = 1;
+                } else {
+                    sortmem = (size_t)bytes;
+                }
+                break;
+            }
             case 'd':
                 distribution = MFU_STRDUP(optarg);
                 break;
@@ -452,6 +500,25 @@ int main(int argc, char** argv)
             case 't':
                 text = 1;
                 break;
+            case 'z':
+                cache_opts->compress = true;
+                break;
+            case 'S': {
+                char* end = NULL;
+                long shards = strtol(optarg, &end, 10);
+                if (end == optarg || *end != '\0' || shards < 1 || shards > INT_MAX) {
+                    if (rank == 0) {
+                        MFU_LOG(MFU_LOG_ERR, "Number of shards must be a positive integer: '%s'", optarg);
+                    }
+                    usage = 1;
+                } else {
+                    cache_opts->shards = (int)shards;
+                }
+                break;
+            }
+            case 'T':
+                cache_opts->stripe = true;
+                break;
             case 'h':
                 usage = 1;
                 break;
@@ -546,6 +613,22 @@ daos_setup_done:
         if (inputname != NULL) {
             usage = 1;
         }
+
+        /* need stat data to tell whether directories changed */
+        if (prevname != NULL && !walk_opts->use_stat) {
+            if (rank == 0) {
+                MFU_LOG(MFU_LOG_ERR, "Cannot use --incremental with --lite");
+            }
+            usage = 1;
+        }
+
+        /* changes are merged into a list read from a file */
+        if (mergename != NULL || removedname != NULL) {
+            if (rank == 0) {
+                MFU_LOG(MFU_LOG_ERR, "--merge and --removed require --input");
+            }
+            usage = 1;
+        }
     }
     else {
         /* if we're not walking, we must be reading,
@@ -657,13 +740,49 @@ daos_setup_done:
     /* create an empty file list with default values */
     mfu_flist flist = mfu_flist_new();
 
-    if (walk) {
+    if (walk && prevname != NULL) {
+        /* walk list of input paths, reusing entries of unchanged
+         * directories from a previous walk */
+        mfu_flist prev = mfu_flist_new();
+        mfu_flist_read_cache(prevname, prev);
+        (void) mfu_flist_walk_param_paths_incremental(numpaths, paths, walk_opts, prev, flist, mfu_file);
+        mfu_flist_free(&prev);
+    }
+    else if (walk) {
         /* walk list of input paths */
         (void) mfu_flist_walk_param_paths(numpaths, paths, walk_opts, flist, mfu_file);
     }
     else {
         /* read data from cache file */
         mfu_flist_read_cache(inputname, flist);
+
+        /* apply changes to list read from cache file */
+        if (mergename != NULL || removedname != NULL) {
+            mfu_flist delta = mfu_flist_new();
+            if (mergename != NULL) {
+                /* reading a cache quietly leaves the list empty if the
+                 * file can't be opened, which would drop the changes */
+                if (rank == 0 && mfu_access(mergename, R_OK) != 0) {
+                    MFU_ABORT(1, "Failed to read merge file: `%s' (errno=%d %s)",
+                        mergename, errno, strerror(errno));
+                }
+                mfu_flist_read_cache(mergename, delta);
+            }
+
+            mfu_flist removed = MFU_FLIST_NULL;
+            if (removedname != NULL) {
+                removed = mfu_flist_new();
+                mfu_flist_read_paths(removedname, removed);
+            }
+
+            mfu_flist merged = mfu_flist_merge(flist, delta, removed);
+            if (removed != MFU_FLIST_NULL) {
+                mfu_flist_free(&removed);
+            }
+            mfu_flist_free(&delta);
+            mfu_flist_free(&flist);
+            flist = merged;
+        }
     }
 
     /* TODO: filter files */
@@ -672,7 +791,12 @@ daos_setup_done:
     /* sort files */
     if (sortfields != NULL) {
         /* TODO: don't sort unless all_count > 0 */
-        mfu_flist flist2 = mfu_flist_sort(sortfields, flist);
+        mfu_flist flist2;
+        if (sortdir != NULL) {
+            flist2 = mfu_flist_sort_external(sortfields, flist, sortdir, sortmem);
+        } else {
+            flist2 = mfu_flist_sort(sortfields, flist);
+        }
         mfu_free(&flist);
         flist = flist2;
     }
@@ -693,7 +817,7 @@ daos_setup_done:
     /* write data to cache file */
     if (outputname != NULL) {
         if (!text) {
-            mfu_flist_write_cache(outputname, flist);
+            mfu_flist_write_cache_opts(outputname, flist, cache_opts);
         } else {
             mfu_flist_write_text(outputname, flist);
         }
@@ -710,6 +834,10 @@ daos_setup_done:
     mfu_free(&distribution);
     mfu_free(&sortfields);
     mfu_free(&outputname);
+    mfu_free(&prevname);
+    mfu_free(&mergename);
+    mfu_free(&sortdir);
+    mfu_free(&removedname);
     mfu_free(&inputname);
 
     /* free the path parameters */
@@ -721,6 +849,9 @@ daos_setup_done:
     /* free the walk options */
     mfu_walk_opts_delete(&walk_opts);
 
+    /* free the cache options */
+    mfu_cache_opts_delete(&cache_opts);
+
     /* delete file object */
     mfu_file_delete(&mfu_file);
 
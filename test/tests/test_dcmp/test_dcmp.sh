@@ -420,3 +420,25 @@ test_10()
 }
 
 run_test 10 "Same, extras and diff comparison"
+
+test_11()
+{
+	dd if=/dev/urandom of=$TEST_SRC/$tfile bs=4096 count=16 2>/dev/null
+	cp -a $TEST_SRC/$tfile $TEST_DST/$tfile
+
+	# record digests on both files
+	$DCMP --digest --store-digests $TEST_SRC $TEST_DST \
+		|| error "failed to store digests"
+
+	# corrupt a byte of the copy, keeping its size and mtime,
+	# then carry the digest xattr of the source over to it
+	printf 'X' | dd of=$TEST_DST/$tfile bs=1 seek=100 conv=notrunc 2>/dev/null
+	cp -a --attributes-only $TEST_SRC/$tfile $TEST_DST/$tfile
+	touch -r $TEST_SRC/$tfile $TEST_DST/$tfile
+
+	$DCMP --digest $TEST_SRC $TEST_DST -o CONTENT=DIFFER:$OUTPUT_FILE
+	in_flist $OUTPUT_FILE $TEST_SRC/$tfile \
+		|| error "$TEST_SRC/$tfile not reported as different"
+	return 0
+}
+run_test 11 "digest of a corrupted copy with a copied xattr"
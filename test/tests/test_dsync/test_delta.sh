@@ -0,0 +1,180 @@
+#!/bin/bash
+
+##############################################################################
+# Description:
+#
+#   Verify dsync --delta updates modified files in place
+#     - blocks rewritten in the middle of a source file reach the destination
+#     - data appended to a source file reaches the destination
+#     - a source file that shrank is truncated in the destination
+#     - each destination file keeps its inode, so it was not copied in full
+#     - a file whose update fails partway is not given the size and mtime
+#       of its source, so a later run without --contents repairs it
+#
+##############################################################################
+
+# Turn on verbose output
+#set -x
+
+MFU_TEST_BIN=${MFU_TEST_BIN:-${1}}
+DSYNC_SRC_BASE=${DSYNC_SRC_BASE:-${2}}
+DSYNC_DEST_BASE=${DSYNC_DEST_BASE:-${3}}
+DSYNC_TREE_NAME=${DSYNC_TREE_NAME:-${4}}
+
+mpirun=$(which mpirun 2>/dev/null)
+mpirun_opts=""
+if [[ -n $mpirun ]]; then
+	procs=$(( $(nproc ) / 8 ))
+	if [[ $procs -lt 1 ]]; then
+		procs=1
+	fi
+	if [[ $procs -gt 16 ]]; then
+		procs=16
+	fi
+	mpirun_opts="-c $procs"
+
+	echo "Using mpirun: $mpirun $mpirun_opts"
+fi
+
+echo "Using MFU binaries at: $MFU_TEST_BIN"
+echo "Using src parent directory at: $DSYNC_SRC_BASE"
+echo "Using dest parent directory at: $DSYNC_DEST_BASE"
+
+DSYNC_SRC_DIR=$(mktemp --directory ${DSYNC_SRC_BASE}/${DSYNC_TREE_NAME}.XXXXX)
+DSYNC_DEST_DIR=$(mktemp --directory ${DSYNC_DEST_BASE}/${DSYNC_TREE_NAME}.XXXXX)
+
+#
+# In resulting file, field 1 is sum, field 2 is filename
+#
+function sum_all_files()
+{
+	pushd $1 >/dev/null
+	find . -type f -print0 | xargs --no-run-if-empty -0 md5sum | sort -k2
+	popd >/dev/null
+}
+
+#
+# In resulting file, field 1 is inode, field 2 is filename
+#
+function inode_all_files()
+{
+	pushd $1 >/dev/null
+	find . -type f -print0 | xargs --no-run-if-empty -0 stat -c "%i %n" | sort -k2
+	popd >/dev/null
+}
+
+function run_dsync()
+{
+	if [[ -n $mpirun ]]; then
+		$mpirun $mpirun_opts ${MFU_TEST_BIN}/dsync --quiet "$@"
+	else
+		${MFU_TEST_BIN}/dsync --quiet "$@"
+	fi
+}
+
+result=0
+
+# build source tree, with files of several 1MB chunks each,
+# and make an initial full copy
+srcdir=$DSYNC_SRC_DIR/stuff
+destdir=$DSYNC_DEST_DIR/stuff
+mkdir $srcdir
+mkdir $destdir
+for name in middle append shrink same; do
+	dd if=/dev/urandom of=$srcdir/$name bs=1M count=8 2>/dev/null
+done
+
+run_dsync --chunksize 1MB $srcdir $destdir
+rc=$?
+if [[ $rc -ne 0 ]]; then
+	echo "FAILED initial dsync with rc $rc"
+	result=1
+fi
+
+inodes_before=$(mktemp /tmp/test_delta.before.XXXXX)
+inode_all_files $destdir > $inodes_before
+
+# modify source files, keeping at least one chunk in each
+sleep 1
+dd if=/dev/urandom of=$srcdir/middle bs=1K count=16 seek=3000 conv=notrunc 2>/dev/null
+dd if=/dev/urandom bs=1M count=2 2>/dev/null >> $srcdir/append
+truncate --size 5M $srcdir/shrink
+
+# update destination in place
+run_dsync --delta --chunksize 1MB $srcdir $destdir
+rc=$?
+if [[ $rc -ne 0 ]]; then
+	echo "FAILED dsync --delta with rc $rc"
+	result=1
+fi
+
+# destination data must match source
+src_sum=$(mktemp /tmp/test_delta.src.XXXXX)
+dest_sum=$(mktemp /tmp/test_delta.dest.XXXXX)
+sum_all_files $srcdir > $src_sum
+sum_all_files $destdir > $dest_sum
+if ! diff $src_sum $dest_sum; then
+	echo "FAILED verify of --delta data - sets differ"
+	result=1
+fi
+
+# updated files must be the same files as before
+inodes_after=$(mktemp /tmp/test_delta.after.XXXXX)
+inode_all_files $destdir > $inodes_after
+if ! diff $inodes_before $inodes_after; then
+	echo "FAILED verify of --delta inodes - files were replaced"
+	result=1
+fi
+
+# build a file whose update will fail partway through
+srcfail=$DSYNC_SRC_DIR/fail
+destfail=$DSYNC_DEST_DIR/fail
+mkdir $srcfail
+mkdir $destfail
+dd if=/dev/urandom of=$srcfail/file bs=1M count=8 2>/dev/null
+
+run_dsync --chunksize 1MB $srcfail $destfail
+rc=$?
+if [[ $rc -ne 0 ]]; then
+	echo "FAILED initial dsync of failure case with rc $rc"
+	result=1
+fi
+
+# shrink the source and change a block past 4MB, the destination
+# can be shrunk, but writes past a 4MB file size limit fail,
+# run a single process so the limit and ignored SIGXFSZ apply to it
+sleep 1
+truncate --size 6M $srcfail/file
+dd if=/dev/urandom of=$srcfail/file bs=512K count=1 seek=10 conv=notrunc 2>/dev/null
+(ulimit -f 4096; trap '' XFSZ; ${MFU_TEST_BIN}/dsync --quiet --delta --chunksize 1MB $srcfail $destfail)
+rc=$?
+if [[ $rc -eq 0 ]]; then
+	echo "FAILED dsync --delta succeeded past the file size limit"
+	result=1
+fi
+
+# a later run that only checks size and mtime must repair the file
+run_dsync --chunksize 1MB $srcfail $destfail
+rc=$?
+if [[ $rc -ne 0 ]]; then
+	echo "FAILED dsync after failed --delta with rc $rc"
+	result=1
+fi
+
+sum_all_files $srcfail > $src_sum
+sum_all_files $destfail > $dest_sum
+if ! diff $src_sum $dest_sum; then
+	echo "FAILED verify of failed --delta data - file was not repaired"
+	result=1
+fi
+
+if [[ $result -eq 0 ]]; then
+	echo "PASSED verify of --delta for $destdir"
+fi
+
+# clean up
+rm -f $src_sum $dest_sum $inodes_before $inodes_after
+rm -fr $DSYNC_SRC_DIR
+rm -fr $DSYNC_DEST_DIR
+
+exit $result
@@ -0,0 +1,92 @@
+#!/bin/bash
+
+##############################################################################
+# Description:
+#
+#   Verify dwalk --incremental finds the same items as a full walk
+#     - with several ranks, so that reused directories are spread over ranks
+#     - after adding and removing items in some directories
+#
+##############################################################################
+
+# Turn on verbose output
+#set -x
+
+MFU_TEST_BIN=${MFU_TEST_BIN:-${1}}
+DWALK_BASE=${DWALK_BASE:-${2}}
+DWALK_TREE_NAME=${DWALK_TREE_NAME:-${3:-dwalk_incr}}
+
+mpirun=$(which mpirun 2>/dev/null)
+if [[ -z $mpirun ]]; then
+	echo "mpirun not found, need several ranks for this test"
+	exit 1
+fi
+mpirun_opts="-np 4 --oversubscribe"
+echo "Using mpirun: $mpirun $mpirun_opts"
+
+echo "Using MFU binaries at: $MFU_TEST_BIN"
+echo "Using parent directory at: $DWALK_BASE"
+
+DWALK_DIR=$(mktemp --directory ${DWALK_BASE}/${DWALK_TREE_NAME}.XXXXX)
+DWALK_TMP=$(mktemp --directory /tmp/${DWALK_TREE_NAME}.XXXXX)
+
+function walk_paths()
+{
+	local out=$1
+	shift
+	$mpirun $mpirun_opts ${MFU_TEST_BIN}/dwalk --quiet "$@" --text --output $out.txt $DWALK_DIR/stuff
+	if [[ $? -ne 0 ]]; then
+		echo "dwalk $@ failed"
+		exit 1
+	fi
+	awk -F 'File=| ' '{print $NF}' $out.txt | sort > $out.sorted
+}
+
+mkdir $DWALK_DIR/stuff
+$MFU_TEST_BIN/dfilemaker --nitems 1000-2000 --depth 5-6 --size 1KB-10KB $DWALK_DIR/stuff
+
+# walk once to get the list used by the incremental walk
+$mpirun $mpirun_opts ${MFU_TEST_BIN}/dwalk --quiet --output $DWALK_TMP/prev.mfu $DWALK_DIR/stuff
+if [[ $? -ne 0 ]]; then
+	echo "dwalk failed to write $DWALK_TMP/prev.mfu"
+	exit 1
+fi
+
+# change a few directories, leaving most of the tree as it was
+count=0
+find $DWALK_DIR/stuff -mindepth 1 -type d -print | while read dname; do
+	count=$((count + 1))
+	if [[ $((count % 7)) -eq 0 ]]; then
+		touch $dname/incr_added.$count
+	fi
+	if [[ $((count % 11)) -eq 0 ]]; then
+		find $dname -maxdepth 1 -type f -print | head -n 1 | xargs --no-run-if-empty rm -f
+	fi
+done
+
+walk_paths $DWALK_TMP/full
+walk_paths $DWALK_TMP/incr --incremental $DWALK_TMP/prev.mfu
+
+full_count=$(wc -l < $DWALK_TMP/full.sorted)
+incr_count=$(wc -l < $DWALK_TMP/incr.sorted)
+
+result=0
+if [[ $full_count -ne $incr_count ]]; then
+	echo "FAILED incremental walk found $incr_count items, full walk found $full_count"
+	result=1
+fi
+
+diff $DWALK_TMP/full.sorted $DWALK_TMP/incr.sorted
+if [[ $? -ne 0 ]]; then
+	echo "FAILED incremental walk items differ from full walk"
+	result=1
+fi
+
+if [[ $result -eq 0 ]]; then
+	echo "PASSED incremental walk found the same $full_count items as full walk"
+fi
+
+# clean up
+rm -fr $DWALK_DIR $DWALK_TMP
+
+exit $result
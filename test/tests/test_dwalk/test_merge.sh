@@ -0,0 +1,96 @@
+#!/bin/bash
+
+##############################################################################
+# Description:
+#
+#   Verify dwalk --merge and --removed bring a saved list up to date
+#     - a removed non-empty directory drops all items under it
+#     - a renamed non-empty directory drops items under its old name,
+#       and items under its new name come from the merge list
+#     - siblings whose names start with a removed name are kept
+#
+##############################################################################
+
+# Turn on verbose output
+#set -x
+
+MFU_TEST_BIN=${MFU_TEST_BIN:-${1}}
+DWALK_BASE=${DWALK_BASE:-${2}}
+DWALK_TREE_NAME=${DWALK_TREE_NAME:-${3:-dwalk_merge}}
+
+mpirun=$(which mpirun 2>/dev/null)
+if [[ -z $mpirun ]]; then
+	echo "mpirun not found, need several ranks for this test"
+	exit 1
+fi
+mpirun_opts="-np 4 --oversubscribe"
+echo "Using mpirun: $mpirun $mpirun_opts"
+
+echo "Using MFU binaries at: $MFU_TEST_BIN"
+echo "Using parent directory at: $DWALK_BASE"
+
+DWALK_DIR=$(mktemp --directory ${DWALK_BASE}/${DWALK_TREE_NAME}.XXXXX)
+DWALK_TMP=$(mktemp --directory /tmp/${DWALK_TREE_NAME}.XXXXX)
+
+function run_dwalk()
+{
+	$mpirun $mpirun_opts ${MFU_TEST_BIN}/dwalk --quiet "$@"
+	if [[ $? -ne 0 ]]; then
+		echo "dwalk $@ failed"
+		exit 1
+	fi
+}
+
+function sorted_paths()
+{
+	awk -F 'File=| ' '{print $NF}' $1.txt | sort > $1.sorted
+}
+
+# build a tree where some names extend the names of the directories
+# that are removed or renamed below
+stuff=$DWALK_DIR/stuff
+mkdir $stuff
+for dname in gone gone.keep gone-keep moved moved.keep; do
+	mkdir -p $stuff/$dname/sub/deeper
+	for fname in a b c; do
+		echo $dname > $stuff/$dname/$fname
+		echo $dname > $stuff/$dname/sub/$fname
+		echo $dname > $stuff/$dname/sub/deeper/$fname
+	done
+done
+
+# save the list that is brought up to date below
+run_dwalk --output $DWALK_TMP/base.mfu $stuff
+
+# remove one directory and rename another
+rm -fr $stuff/gone
+mv $stuff/moved $stuff/renamed
+
+# list the items that changed, and the paths that went away
+run_dwalk --output $DWALK_TMP/delta.mfu $stuff/renamed
+echo $stuff/gone   >  $DWALK_TMP/removed.txt
+echo $stuff/moved  >> $DWALK_TMP/removed.txt
+
+run_dwalk --input $DWALK_TMP/base.mfu --merge $DWALK_TMP/delta.mfu \
+	--removed $DWALK_TMP/removed.txt --text --output $DWALK_TMP/merged.txt
+sorted_paths $DWALK_TMP/merged
+
+run_dwalk --text --output $DWALK_TMP/full.txt $stuff
+sorted_paths $DWALK_TMP/full
+
+result=0
+diff $DWALK_TMP/full.sorted $DWALK_TMP/merged.sorted
+if [[ $? -ne 0 ]]; then
+	echo "FAILED merged list differs from full walk"
+	result=1
+fi
+
+if [[ $result -eq 0 ]]; then
+	count=$(wc -l < $DWALK_TMP/full.sorted)
+	echo "PASSED merged list has the same $count items as full walk"
+fi
+
+# clean up
+rm -fr $DWALK_DIR $DWALK_TMP
+
+exit $result